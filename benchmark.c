@@ -0,0 +1,1185 @@
+/* ============================================
+   BENCHMARKS DO SISTEMA DE ARQUIVOS
+   ============================================ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "filesystem.h"
+#include "fs_daemon.h"
+#include "fs_client.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define BENCH_SEED 20250101ULL
+#define BENCH_DISK "bench_disk.img"
+
+/* Seções do disco com a geometria padrão (a de fs_format) */
+static FsLayout layout;
+
+/* ============================================
+   UTILITÁRIOS
+   ============================================ */
+
+/* Gerador xorshift64: sequência reprodutível a partir de BENCH_SEED */
+static uint64_t rng_state = BENCH_SEED;
+
+static uint64_t rng_next(void) {
+    uint64_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    rng_state = x;
+    return x;
+}
+
+static uint64_t rng_range(uint64_t lo, uint64_t hi) {
+    return lo + rng_next() % (hi - lo + 1);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* ============================================
+   BITMAP: BUSCA BIT A BIT x PALAVRA A PALAVRA
+   ============================================ */
+
+typedef enum {
+    FRAG_ALEATORIO,     // Cada bloco ocupado com probabilidade de 75%
+    FRAG_QUASE_CHEIO,   // 99% ocupado, buracos de 1 a 8 blocos
+    FRAG_CHURN          // Arquivos de 1-64 blocos, 30% removidos
+} FragPattern;
+
+static const char *frag_names[] = { "aleatorio 75%", "quase cheio", "churn" };
+
+static void build_fragmented_bitmap(uint8_t *bitmap, FragPattern pattern) {
+    memset(bitmap, 0, layout.bitmap_blocks * layout.block_size);
+    for (uint64_t i = 0; i < layout.data_start; i++) {
+        bitmap_set_bit(bitmap, i);
+    }
+
+    switch (pattern) {
+        case FRAG_ALEATORIO:
+            for (uint64_t i = layout.data_start; i < layout.total_blocks; i++) {
+                if (rng_next() % 4 != 0) {
+                    bitmap_set_bit(bitmap, i);
+                }
+            }
+            break;
+        case FRAG_QUASE_CHEIO:
+            for (uint64_t i = layout.data_start; i < layout.total_blocks; i++) {
+                bitmap_set_bit(bitmap, i);
+            }
+            for (uint64_t i = layout.data_start + 50; i < layout.total_blocks; i += 100) {
+                uint64_t hole = rng_range(1, 8);
+                for (uint64_t j = 0; j < hole && i + j < layout.total_blocks; j++) {
+                    bitmap_clear_bit(bitmap, i + j);
+                }
+            }
+            break;
+        case FRAG_CHURN: {
+            uint64_t pos = layout.data_start;
+            while (pos < layout.total_blocks) {
+                uint64_t len = rng_range(1, 64);
+                int removed = rng_range(0, 99) < 30;
+                for (uint64_t j = 0; j < len && pos < layout.total_blocks; j++, pos++) {
+                    if (!removed) {
+                        bitmap_set_bit(bitmap, pos);
+                    }
+                }
+            }
+            break;
+        }
+    }
+}
+
+static void bench_bitmap(void) {
+    static const uint64_t sizes[] = { 1, 4, 16, 64, 256 };
+    const int reps = 200;
+    uint8_t *bitmap = malloc(layout.bitmap_blocks * layout.block_size);
+
+    printf("\n=== Busca de espaço contíguo (first-fit, %d buscas) ===\n", reps);
+    printf("%-14s %6s %8s %14s %14s %8s\n",
+           "CENARIO", "BLOCOS", "INICIO", "BIT (us)", "PALAVRA (us)", "GANHO");
+
+    for (int p = FRAG_ALEATORIO; p <= FRAG_CHURN; p++) {
+        build_fragmented_bitmap(bitmap, (FragPattern)p);
+
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            int64_t expected = bitmap_find_contiguous_bitwise(bitmap, layout.total_blocks, sizes[s]);
+            int64_t got = bitmap_find_contiguous(bitmap, layout.total_blocks, sizes[s]);
+            if (expected != got) {
+                printf("ERRO: resultados divergentes (%ld x %ld)\n",
+                       (long)expected, (long)got);
+                free(bitmap);
+                exit(1);
+            }
+
+            volatile int64_t sink = 0;
+            double t0 = now_seconds();
+            for (int r = 0; r < reps; r++) {
+                sink += bitmap_find_contiguous_bitwise(bitmap, layout.total_blocks, sizes[s]);
+            }
+            double t1 = now_seconds();
+            for (int r = 0; r < reps; r++) {
+                sink += bitmap_find_contiguous(bitmap, layout.total_blocks, sizes[s]);
+            }
+            double t2 = now_seconds();
+            (void)sink;
+
+            double bit_us = (t1 - t0) * 1e6 / reps;
+            double word_us = (t2 - t1) * 1e6 / reps;
+            printf("%-14s %6lu %8ld %14.2f %14.2f %7.1fx\n",
+                   frag_names[p], sizes[s], (long)got, bit_us, word_us,
+                   word_us > 0 ? bit_us / word_us : 0.0);
+        }
+    }
+
+    free(bitmap);
+}
+
+/* ============================================
+   VAZÃO: BLOCO A BLOCO x EXTENSÃO INTEIRA
+   ============================================ */
+
+static double mb_per_s(uint64_t bytes, double seconds) {
+    return seconds > 0 ? (bytes / (1024.0 * 1024.0)) / seconds : 0.0;
+}
+
+static void bench_io(void) {
+    static const uint64_t sizes_mb[] = { 1, 8, 24 };
+    const int reps = 3;
+    const uint64_t start_block = layout.data_start;
+
+    // Disco de rascunho com o tamanho de uma imagem real
+    int fd = open(BENCH_DISK, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    FILE *disk = fd >= 0 ? fdopen(fd, "r+b") : NULL;
+    if (!disk || ftruncate(fd, (off_t)(layout.total_blocks * layout.block_size)) != 0) {
+        printf("Erro: não foi possível criar %s\n", BENCH_DISK);
+        return;
+    }
+
+    printf("\n=== Vazão sequencial (MB/s, média de %d execuções) ===\n", reps);
+    printf("%-8s %14s %14s %14s %14s\n",
+           "TAMANHO", "ESCR. BLOCO", "ESCR. EXTENSAO", "LEIT. BLOCO", "LEIT. EXTENSAO");
+
+    for (size_t s = 0; s < sizeof(sizes_mb) / sizeof(sizes_mb[0]); s++) {
+        uint64_t size = sizes_mb[s] * 1024 * 1024;
+        uint64_t blocks = size / layout.block_size;
+        uint8_t *data = malloc(size);
+        uint8_t *check = malloc(size);
+        for (uint64_t i = 0; i < size; i++) {
+            data[i] = (uint8_t)rng_next();
+        }
+
+        double t_wb = 0, t_wr = 0, t_rb = 0, t_rr = 0;
+        for (int r = 0; r < reps; r++) {
+            double t0 = now_seconds();
+            for (uint64_t b = 0; b < blocks; b++) {
+                block_write(disk, layout.block_size, start_block + b, data + b * layout.block_size);
+            }
+            double t1 = now_seconds();
+            block_write_range(fd, layout.block_size, start_block, data, size);
+            double t2 = now_seconds();
+            for (uint64_t b = 0; b < blocks; b++) {
+                block_read(disk, layout.block_size, start_block + b, check + b * layout.block_size);
+            }
+            double t3 = now_seconds();
+            block_read_range(fd, layout.block_size, start_block, check, size);
+            double t4 = now_seconds();
+
+            t_wb += t1 - t0;
+            t_wr += t2 - t1;
+            t_rb += t3 - t2;
+            t_rr += t4 - t3;
+        }
+
+        if (memcmp(data, check, size) != 0) {
+            printf("ERRO: dados lidos diferem dos escritos\n");
+        }
+        printf("%5luMB %14.1f %14.1f %14.1f %14.1f\n", sizes_mb[s],
+               mb_per_s(size * reps, t_wb), mb_per_s(size * reps, t_wr),
+               mb_per_s(size * reps, t_rb), mb_per_s(size * reps, t_rr));
+        free(data);
+        free(check);
+    }
+
+    fclose(disk);
+    unlink(BENCH_DISK);
+}
+
+/* ============================================
+   FORMATAÇÃO
+   ============================================ */
+
+#define FMT_REPS 20
+
+/* Espaço ocupado pela imagem no hospedeiro */
+static uint64_t disk_usage_kb(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (uint64_t)st.st_blocks * 512 / 1024 : 0;
+}
+
+/* Imagem inteira gravada com zeros bloco a bloco (como a formatação
+   fazia antes) x imagem esparsa x formatação rápida de uma imagem
+   existente */
+static void bench_format(void) {
+    static const char *modes[] = { "zeros na imagem toda", "fs_format", "fs_format_quick" };
+    static const uint8_t zero_block[FS_DEFAULT_BLOCK_SIZE];
+    double seconds[3] = {0};
+    uint64_t usage[3];
+
+    for (int mode = 0; mode < 3; mode++) {
+        for (int r = 0; r < FMT_REPS; r++) {
+            if (mode == 2) {
+                fs_format(BENCH_DISK);
+            } else {
+                unlink(BENCH_DISK);
+            }
+            double t0 = now_seconds();
+            if (mode == 0) {
+                FILE *disk = fopen(BENCH_DISK, "wb");
+                for (uint64_t b = 0; disk && b < layout.total_blocks; b++) {
+                    fwrite(zero_block, sizeof(zero_block), 1, disk);
+                }
+                if (disk) fclose(disk);
+                fs_format_quick(BENCH_DISK);
+            } else if (mode == 1) {
+                fs_format(BENCH_DISK);
+            } else {
+                fs_format_quick(BENCH_DISK);
+            }
+            seconds[mode] += now_seconds() - t0;
+        }
+        usage[mode] = disk_usage_kb(BENCH_DISK);
+    }
+    unlink(BENCH_DISK);
+
+    printf("\n=== Formatação (%llu MB, média de %d execuções) ===\n",
+           (unsigned long long)(layout.total_blocks * layout.block_size / (1024 * 1024)), FMT_REPS);
+    printf("%-22s %12s %14s\n", "MODO", "MS", "KB NO DISCO");
+    for (int mode = 0; mode < 3; mode++) {
+        printf("%-22s %12.3f %14lu\n", modes[mode], seconds[mode] * 1000 / FMT_REPS, usage[mode]);
+    }
+}
+
+/* ============================================
+   CACHE DE BLOCOS: LEITURAS REPETIDAS
+   ============================================ */
+
+#define CACHE_FILES 300
+#define CACHE_FILE_SIZE 2048
+#define CACHE_HOT_FILES 60
+
+/* Leituras aleatórias com 90% dos acessos concentrados em 20% dos
+   arquivos, com o cache desligado e em algumas capacidades */
+static void bench_cache(void) {
+    static const size_t capacities[] = { 0, 256, 1024, 4096 };
+    const int reads = 50000;
+    uint8_t buffer[CACHE_FILE_SIZE];
+    char name[16];
+
+    fs_format(BENCH_DISK);
+    FileSystem *fs = fs_mount(BENCH_DISK);
+    if (fs) {
+        for (int i = 0; i < CACHE_FILES; i++) {
+            snprintf(name, sizeof(name), "c%d", i);
+            for (int j = 0; j < CACHE_FILE_SIZE; j++) {
+                buffer[j] = (uint8_t)rng_next();
+            }
+            fs_create(fs, name, TYPE_BINARIO, PERM_ALL);
+            fs_write(fs, name, buffer, CACHE_FILE_SIZE);
+        }
+        fs_sync(fs);
+    }
+    if (!fs) {
+        printf("Erro: não foi possível montar %s\n", BENCH_DISK);
+        return;
+    }
+
+    // Handles abertos uma vez: a medição isola o caminho de E/S
+    FileHandle *handles[CACHE_FILES];
+    for (int i = 0; i < CACHE_FILES; i++) {
+        snprintf(name, sizeof(name), "c%d", i);
+        handles[i] = fs_open(fs, name, FS_OPEN_READ);
+    }
+
+    printf("\n=== Cache de blocos (%d leituras de %d bytes, 90%% em %d arquivos) ===\n",
+           reads, CACHE_FILE_SIZE, CACHE_HOT_FILES);
+    printf("%-10s %14s %10s %12s\n", "CAPACIDADE", "LEITURAS/s", "ACERTOS", "FALTAS");
+
+    for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); c++) {
+        fs_set_cache_size(fs, capacities[c]);
+        uint64_t saved_rng = rng_state;
+
+        double t0 = now_seconds();
+        for (int r = 0; r < reads; r++) {
+            int f = rng_range(0, 9) < 9 ? (int)rng_range(0, CACHE_HOT_FILES - 1)
+                                        : (int)rng_range(CACHE_HOT_FILES, CACHE_FILES - 1);
+            fs_pread(handles[f], buffer, CACHE_FILE_SIZE, 0);
+        }
+        double elapsed = now_seconds() - t0;
+        rng_state = saved_rng; // Mesma sequência de acessos para cada capacidade
+
+        CacheStats stats;
+        fs_cache_stats(fs, &stats, NULL);
+        printf("%-10zu %14.0f %10lu %12lu\n", capacities[c],
+               elapsed > 0 ? reads / elapsed : 0.0, stats.hits, stats.misses);
+    }
+
+    for (int i = 0; i < CACHE_FILES; i++) {
+        fs_close(handles[i]);
+    }
+    fs_unmount(fs);
+    unlink(BENCH_DISK);
+}
+
+/* ============================================
+   CARGAS DE TRABALHO PELA API PÚBLICA
+   ============================================ */
+
+/* Latência de cada operação de um tipo; vazão e percentis saem daqui */
+typedef struct {
+    uint64_t *latency_ns;
+    size_t count;
+    size_t capacity;
+    uint64_t bytes;             // Bytes transferidos (0 = operação sem dados)
+    uint64_t errors;
+} Samples;
+
+static void samples_init(Samples *samples, size_t capacity) {
+    samples->latency_ns = malloc(capacity * sizeof(uint64_t));
+    samples->count = 0;
+    samples->capacity = samples->latency_ns ? capacity : 0;
+    samples->bytes = 0;
+    samples->errors = 0;
+}
+
+static void samples_add(Samples *samples, uint64_t start_ns, uint64_t bytes, int failed) {
+    uint64_t elapsed = now_ns() - start_ns;
+    if (samples->count < samples->capacity) {
+        samples->latency_ns[samples->count++] = elapsed;
+    }
+    samples->bytes += bytes;
+    samples->errors += failed != 0;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Imprime uma linha da tabela e libera as amostras. A vazão considera só
+   o tempo dentro das operações medidas. */
+static void samples_report(const char *workload, const char *op, Samples *samples) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < samples->count; i++) {
+        total += samples->latency_ns[i];
+    }
+    qsort(samples->latency_ns, samples->count, sizeof(uint64_t), compare_u64);
+    
+    double seconds = total / 1e9;
+    double p50 = 0, p99 = 0;
+    if (samples->count > 0) {
+        p50 = samples->latency_ns[(samples->count - 1) * 50 / 100] / 1e3;
+        p99 = samples->latency_ns[(samples->count - 1) * 99 / 100] / 1e3;
+    }
+    printf("%-12s %-8s %8zu %12.0f ", workload, op, samples->count,
+           seconds > 0 ? samples->count / seconds : 0.0);
+    if (samples->bytes > 0) {
+        printf("%10.1f", mb_per_s(samples->bytes, seconds));
+    } else {
+        printf("%10s", "-");
+    }
+    printf(" %10.1f %10.1f", p50, p99);
+    if (samples->errors > 0) {
+        printf("  (%lu erros)", samples->errors);
+    }
+    printf("\n");
+    free(samples->latency_ns);
+}
+
+/* Disco novo para cada carga */
+static FileSystem* workload_begin(void) {
+    fs_format(BENCH_DISK);
+    FileSystem *fs = fs_mount(BENCH_DISK);
+    if (!fs) {
+        printf("Erro: não foi possível montar %s\n", BENCH_DISK);
+    }
+    return fs;
+}
+
+static void workload_end(FileSystem *fs) {
+    fs_unmount(fs);
+    unlink(BENCH_DISK);
+}
+
+static void fill_random(uint8_t *buffer, uint64_t size) {
+    for (uint64_t i = 0; i < size; i++) {
+        buffer[i] = (uint8_t)rng_next();
+    }
+}
+
+#define WL_CREATE_FILES 2000
+#define WL_SMALL_FILES 1500
+#define WL_SMALL_MAX 8192
+#define WL_LARGE_FILES 3
+#define WL_LARGE_SIZE (6 * 1024 * 1024)
+#define WL_LARGE_CHUNK (64 * 1024)
+#define WL_CHURN_FILES 1200
+#define WL_CHURN_OPS 6000
+#define WL_CHURN_MAX_BLOCKS 64
+#define WL_LOOKUPS 200000
+
+/* Criação de muitos arquivos vazios seguida da remoção de todos */
+static void workload_create(void) {
+    FileSystem *fs = workload_begin();
+    if (!fs) return;
+    
+    char name[16];
+    Samples create, remove;
+    samples_init(&create, WL_CREATE_FILES);
+    samples_init(&remove, WL_CREATE_FILES);
+    for (int i = 0; i < WL_CREATE_FILES; i++) {
+        snprintf(name, sizeof(name), "k%d", i);
+        uint64_t t0 = now_ns();
+        int result = fs_create(fs, name, TYPE_BINARIO, PERM_ALL);
+        samples_add(&create, t0, 0, result);
+    }
+    for (int i = 0; i < WL_CREATE_FILES; i++) {
+        snprintf(name, sizeof(name), "k%d", i);
+        uint64_t t0 = now_ns();
+        int result = fs_remove(fs, name);
+        samples_add(&remove, t0, 0, result);
+    }
+    workload_end(fs);
+    
+    samples_report("criacao", "create", &create);
+    samples_report("criacao", "remove", &remove);
+}
+
+/* Arquivos pequenos (até 8KB) escritos e lidos inteiros */
+static void workload_small(void) {
+    FileSystem *fs = workload_begin();
+    if (!fs) return;
+    
+    char name[16];
+    uint8_t *buffer = malloc(WL_SMALL_MAX);
+    uint64_t sizes[WL_SMALL_FILES];
+    Samples write, read;
+    samples_init(&write, WL_SMALL_FILES);
+    samples_init(&read, WL_SMALL_FILES);
+    for (int i = 0; i < WL_SMALL_FILES; i++) {
+        snprintf(name, sizeof(name), "s%d", i);
+        sizes[i] = rng_range(1, WL_SMALL_MAX);
+        fill_random(buffer, sizes[i]);
+        fs_create(fs, name, TYPE_BINARIO, PERM_ALL);
+        uint64_t t0 = now_ns();
+        int result = fs_write(fs, name, buffer, sizes[i]);
+        samples_add(&write, t0, sizes[i], result);
+    }
+    for (int i = 0; i < WL_SMALL_FILES; i++) {
+        int f = (int)rng_range(0, WL_SMALL_FILES - 1);
+        uint64_t size;
+        snprintf(name, sizeof(name), "s%d", f);
+        uint64_t t0 = now_ns();
+        int result = fs_read(fs, name, buffer, &size);
+        samples_add(&read, t0, sizes[f], result != 0 || size != sizes[f]);
+    }
+    workload_end(fs);
+    free(buffer);
+    
+    samples_report("pequenos", "write", &write);
+    samples_report("pequenos", "read", &read);
+}
+
+/* Arquivos grandes escritos e lidos em sequência, em pedaços de 64KB */
+static void workload_large(void) {
+    FileSystem *fs = workload_begin();
+    if (!fs) return;
+    
+    const size_t chunks = WL_LARGE_SIZE / WL_LARGE_CHUNK;
+    char name[16];
+    uint8_t *buffer = malloc(WL_LARGE_CHUNK);
+    fill_random(buffer, WL_LARGE_CHUNK);
+    Samples write, read;
+    samples_init(&write, WL_LARGE_FILES * chunks);
+    samples_init(&read, WL_LARGE_FILES * chunks);
+    for (int i = 0; i < WL_LARGE_FILES; i++) {
+        snprintf(name, sizeof(name), "g%d", i);
+        fs_create(fs, name, TYPE_BINARIO, PERM_ALL);
+        FileHandle *handle = fs_open(fs, name, FS_OPEN_WRITE);
+        for (size_t c = 0; c < chunks; c++) {
+            uint64_t t0 = now_ns();
+            int64_t n = fs_append(handle, buffer, WL_LARGE_CHUNK);
+            samples_add(&write, t0, WL_LARGE_CHUNK, n != WL_LARGE_CHUNK);
+        }
+        fs_close(handle);
+    }
+    fs_sync(fs); // Leitura começa com o cache em estado estável
+    for (int i = 0; i < WL_LARGE_FILES; i++) {
+        snprintf(name, sizeof(name), "g%d", i);
+        FileHandle *handle = fs_open(fs, name, FS_OPEN_READ);
+        for (size_t c = 0; c < chunks; c++) {
+            uint64_t t0 = now_ns();
+            int64_t n = fs_pread(handle, buffer, WL_LARGE_CHUNK, c * WL_LARGE_CHUNK);
+            samples_add(&read, t0, WL_LARGE_CHUNK, n != WL_LARGE_CHUNK);
+        }
+        fs_close(handle);
+    }
+    workload_end(fs);
+    free(buffer);
+    
+    samples_report("sequencial", "pwrite", &write);
+    samples_report("sequencial", "pread", &read);
+}
+
+/* Remoções e regravações aleatórias com tamanhos variados, que
+   fragmentam o espaço livre */
+static void workload_churn(void) {
+    FileSystem *fs = workload_begin();
+    if (!fs) return;
+    
+    char name[16];
+    uint8_t *buffer = malloc(WL_CHURN_MAX_BLOCKS * layout.block_size);
+    fill_random(buffer, WL_CHURN_MAX_BLOCKS * layout.block_size);
+    for (int i = 0; i < WL_CHURN_FILES; i++) {
+        snprintf(name, sizeof(name), "h%d", i);
+        fs_create(fs, name, TYPE_BINARIO, PERM_ALL);
+        fs_write(fs, name, buffer, rng_range(1, WL_CHURN_MAX_BLOCKS) * layout.block_size);
+    }
+    
+    Samples remove, write;
+    samples_init(&remove, WL_CHURN_OPS);
+    samples_init(&write, WL_CHURN_OPS);
+    for (int op = 0; op < WL_CHURN_OPS; op++) {
+        snprintf(name, sizeof(name), "h%d", (int)rng_range(0, WL_CHURN_FILES - 1));
+        uint64_t size = rng_range(1, WL_CHURN_MAX_BLOCKS) * layout.block_size;
+        uint64_t t0 = now_ns();
+        int result = fs_remove(fs, name);
+        samples_add(&remove, t0, 0, result);
+        fs_create(fs, name, TYPE_BINARIO, PERM_ALL);
+        t0 = now_ns();
+        result = fs_write(fs, name, buffer, size);
+        samples_add(&write, t0, size, result);
+    }
+    FragmentationInfo frag;
+    fs_fragmentation(fs, &frag);
+    workload_end(fs);
+    free(buffer);
+    
+    samples_report("churn", "remove", &remove);
+    samples_report("churn", "write", &write);
+    printf("%-12s %lu extensões livres, fragmentação %.1f%%\n", "",
+           frag.free_extents, frag.fragmentation * 100.0);
+}
+
+/* Tabela de arquivos cheia e aberturas por nome aleatório */
+static void workload_lookup(void) {
+    FileSystem *fs = workload_begin();
+    if (!fs) return;
+    
+    char name[16];
+    for (uint32_t i = 0; i < layout.max_files; i++) {
+        snprintf(name, sizeof(name), "l%u", i);
+        fs_create(fs, name, TYPE_BINARIO, PERM_ALL);
+    }
+    
+    Samples lookup;
+    samples_init(&lookup, WL_LOOKUPS);
+    for (int i = 0; i < WL_LOOKUPS; i++) {
+        snprintf(name, sizeof(name), "l%d", (int)rng_range(0, layout.max_files - 1));
+        uint64_t t0 = now_ns();
+        FileHandle *handle = fs_open(fs, name, FS_OPEN_READ);
+        fs_close(handle);
+        samples_add(&lookup, t0, 0, handle == NULL);
+    }
+    workload_end(fs);
+    
+    samples_report("busca", "open", &lookup);
+}
+
+static void bench_workloads(void) {
+    printf("\n=== Cargas de trabalho (latência por operação) ===\n");
+    printf("%-12s %-8s %8s %12s %10s %10s %10s\n",
+           "CARGA", "OPERACAO", "OPS", "OPS/s", "MB/s", "p50 (us)", "p99 (us)");
+    workload_create();
+    workload_small();
+    workload_large();
+    workload_churn();
+    workload_lookup();
+}
+
+/* ============================================
+   COMPRESSÃO: VAZÃO x ESPAÇO
+   ============================================ */
+
+#define COMP_FILES 4
+#define COMP_FILE_SIZE (4 * 1024 * 1024)
+#define COMP_RANDOM_READS 4000
+#define COMP_READ_SIZE 4096
+
+/* Texto com palavras de um vocabulário pequeno, como logs e código */
+static void fill_text(uint8_t *buffer, uint64_t size) {
+    static const char *words[] = {
+        "arquivo", "bloco", "disco", "erro", "leitura", "escrita", "sistema", "de", "o", "a",
+        "extensão", "cache", "journal", "usuário", "permissão", "tamanho", "que", "em", "para", "com"
+    };
+    const size_t count = sizeof(words) / sizeof(words[0]);
+    uint64_t pos = 0;
+    while (pos < size) {
+        const char *word = words[rng_next() % count];
+        for (size_t i = 0; word[i] != '\0' && pos < size; i++) {
+            buffer[pos++] = (uint8_t)word[i];
+        }
+        if (pos < size) {
+            buffer[pos++] = rng_next() % 12 == 0 ? '\n' : ' ';
+        }
+    }
+}
+
+/* Mesmos arquivos gravados sem e com compressão: blocos ocupados, vazão
+   de fs_write/fs_read do arquivo inteiro e de leituras aleatórias de
+   4KB por handle (que descomprimem um quadro inteiro a cada acesso) */
+static void bench_compression(void) {
+    static const char *data_names[] = { "texto", "aleatorio" };
+    char name[16];
+    uint8_t *data = malloc(COMP_FILE_SIZE);
+    uint8_t *check = malloc(COMP_FILE_SIZE);
+    if (!data || !check) {
+        free(data);
+        free(check);
+        return;
+    }
+    
+    printf("\n=== Compressão (%d arquivos de %dMB por linha) ===\n",
+           COMP_FILES, COMP_FILE_SIZE / (1024 * 1024));
+    printf("%-10s %-11s %8s %12s %12s %12s\n",
+           "DADOS", "MODO", "BLOCOS", "ESCR. MB/s", "LEIT. MB/s", "PREAD 4KB");
+    
+    for (int kind = 0; kind < 2; kind++) {
+        for (int compressed = 0; compressed <= 1; compressed++) {
+            FileSystem *fs = workload_begin();
+            if (!fs) break;
+            uint32_t free_before = fs->superblock.free_blocks;
+            
+            double t_write = 0, t_read = 0, t_pread = 0;
+            int failed = 0;
+            for (int i = 0; i < COMP_FILES; i++) {
+                // A mesma semente nas duas linhas: os dois modos gravam o mesmo conteúdo
+                rng_state = BENCH_SEED + (uint64_t)kind * COMP_FILES + (uint64_t)i;
+                if (kind == 0) {
+                    fill_text(data, COMP_FILE_SIZE);
+                } else {
+                    fill_random(data, COMP_FILE_SIZE);
+                }
+                snprintf(name, sizeof(name), "z%d", i);
+                fs_create(fs, name, kind == 0 ? TYPE_TEXTO : TYPE_BINARIO, PERM_ALL);
+                if (compressed) {
+                    fs_set_compression(fs, name, 1);
+                }
+                double t0 = now_seconds();
+                failed |= fs_write(fs, name, data, COMP_FILE_SIZE) != 0;
+                t_write += now_seconds() - t0;
+            }
+            uint32_t used = free_before - fs->superblock.free_blocks;
+            fs_sync(fs);
+            
+            for (int i = 0; i < COMP_FILES; i++) {
+                uint64_t size = 0;
+                snprintf(name, sizeof(name), "z%d", i);
+                double t0 = now_seconds();
+                failed |= fs_read(fs, name, check, &size) != 0 || size != COMP_FILE_SIZE;
+                t_read += now_seconds() - t0;
+            }
+            
+            for (int r = 0; r < COMP_RANDOM_READS; r++) {
+                snprintf(name, sizeof(name), "z%d", (int)rng_range(0, COMP_FILES - 1));
+                uint64_t offset = rng_range(0, COMP_FILE_SIZE / COMP_READ_SIZE - 1) * COMP_READ_SIZE;
+                FileHandle *handle = fs_open(fs, name, FS_OPEN_READ);
+                double t0 = now_seconds();
+                failed |= fs_pread(handle, check, COMP_READ_SIZE, offset) != COMP_READ_SIZE;
+                t_pread += now_seconds() - t0;
+                fs_close(handle);
+            }
+            workload_end(fs);
+            
+            if (failed) {
+                printf("ERRO: falha nas operações (%s, %s)\n", data_names[kind],
+                       compressed ? "comprimido" : "normal");
+            }
+            printf("%-10s %-11s %8u %12.1f %12.1f %12.1f\n", data_names[kind],
+                   compressed ? "comprimido" : "normal", used,
+                   mb_per_s((uint64_t)COMP_FILES * COMP_FILE_SIZE, t_write),
+                   mb_per_s((uint64_t)COMP_FILES * COMP_FILE_SIZE, t_read),
+                   mb_per_s((uint64_t)COMP_RANDOM_READS * COMP_READ_SIZE, t_pread));
+        }
+    }
+    free(data);
+    free(check);
+}
+
+/* ============================================
+   ESCRITA GRANDE EM DISCO FRAGMENTADO
+   ============================================ */
+
+#define FRAG_FILL_SIZE 15500        // 31 blocos: o disco cheio com buracos iguais
+#define FRAG_FILL_FILES (FS_DEFAULT_MAX_FILES - 16)
+#define FRAG_LARGE_FILES 4
+#define FRAG_LARGE_SIZE (3 * 1024 * 1024)
+
+/* Enche o disco de arquivos pequenos e remove um sim, um não: sobra quase
+   metade do espaço livre, mas nenhum buraco maior que um arquivo pequeno */
+static void fragment_disk(FileSystem *fs, uint8_t *data) {
+    char name[16];
+    fill_random(data, FRAG_FILL_SIZE);
+    for (int i = 0; i < FRAG_FILL_FILES; i++) {
+        snprintf(name, sizeof(name), "p%d", i);
+        if (fs_create(fs, name, TYPE_BINARIO, PERM_ALL) != 0 ||
+            fs_write(fs, name, data, FRAG_FILL_SIZE) != 0) {
+            break;
+        }
+    }
+    for (int i = 0; i < FRAG_FILL_FILES; i += 2) {
+        snprintf(name, sizeof(name), "p%d", i);
+        fs_remove(fs, name);
+    }
+}
+
+/* Arquivos de 3MB gravados num disco novo e num disco fragmentado (antes
+   eles falhavam por falta de espaço contíguo): extensões por arquivo e
+   vazão de fs_write/fs_read; no fragmentado, também depois do defrag */
+static void bench_fragmented(void) {
+    static const char *modes[] = { "disco novo", "fragmentado", "pos-defrag" };
+    char name[16];
+    uint8_t *data = malloc(FRAG_LARGE_SIZE);
+    uint8_t *check = malloc(FRAG_LARGE_SIZE);
+    if (!data || !check) {
+        free(data);
+        free(check);
+        return;
+    }
+    
+    printf("\n=== Escrita grande sem espaço contíguo (%d arquivos de %dMB) ===\n",
+           FRAG_LARGE_FILES, FRAG_LARGE_SIZE / (1024 * 1024));
+    printf("%-12s %8s %10s %12s %12s\n", "DISCO", "GRAVADOS", "EXTENSOES", "ESCR. MB/s", "LEIT. MB/s");
+    
+    for (int fragmented = 0; fragmented <= 1; fragmented++) {
+        FileSystem *fs = workload_begin();
+        if (!fs) break;
+        if (fragmented) {
+            fragment_disk(fs, data);
+        }
+        
+        int written = 0;
+        double t_write = 0;
+        for (int i = 0; i < FRAG_LARGE_FILES; i++) {
+            rng_state = BENCH_SEED + (uint64_t)i;
+            fill_random(data, FRAG_LARGE_SIZE);
+            snprintf(name, sizeof(name), "g%d", i);
+            fs_create(fs, name, TYPE_BINARIO, PERM_ALL);
+            double t0 = now_seconds();
+            written += fs_write(fs, name, data, FRAG_LARGE_SIZE) == 0;
+            t_write += now_seconds() - t0;
+        }
+        fs_sync(fs);
+        
+        // Linha do disco como ficou e, no fragmentado, depois do defrag
+        int extents[2] = {0, 0}, failed[2] = {0, 0};
+        double t_read[2] = {0, 0};
+        for (int pass = 0; pass <= fragmented; pass++) {
+            if (pass == 1) {
+                DefragReport report;
+                fs_defrag(fs, NULL, &report);
+            }
+            for (int i = 0; i < written; i++) {
+                uint64_t size = 0;
+                snprintf(name, sizeof(name), "g%d", i);
+                extents[pass] += fs_get_extents(fs, name);
+                double t0 = now_seconds();
+                failed[pass] |= fs_read(fs, name, check, &size) != 0 || size != FRAG_LARGE_SIZE;
+                t_read[pass] += now_seconds() - t0;
+                rng_state = BENCH_SEED + (uint64_t)i;
+                fill_random(data, FRAG_LARGE_SIZE);
+                failed[pass] |= memcmp(data, check, FRAG_LARGE_SIZE) != 0;
+            }
+        }
+        workload_end(fs);
+        
+        uint64_t bytes = (uint64_t)written * FRAG_LARGE_SIZE;
+        for (int pass = 0; pass <= fragmented; pass++) {
+            const char *mode = modes[fragmented + pass];
+            if (failed[pass]) {
+                printf("ERRO: conteúdo diferente do gravado (%s)\n", mode);
+            }
+            printf("%-12s %5d/%-2d %10.1f %12.1f %12.1f\n", mode, written, FRAG_LARGE_FILES,
+                   written ? (double)extents[pass] / written : 0.0,
+                   pass == 0 ? mb_per_s(bytes, t_write) : 0.0, mb_per_s(bytes, t_read[pass]));
+        }
+    }
+    free(data);
+    free(check);
+}
+
+/* ============================================
+   LEITURAS CONCORRENTES
+   ============================================ */
+
+#define THR_FILES 128
+#define THR_FILE_SIZE 2048
+#define THR_MAX 16
+#define THR_SECONDS 0.3
+
+typedef enum {
+    THR_READ,               // fs_read pelo nome
+    THR_PREAD,              // fs_pread por handle
+    THR_MIXED               // fs_pread com 5% de fs_pwrite
+} ThreadLoad;
+
+static const char *thread_load_names[] = { "fs_read", "fs_pread", "misto 95/5" };
+
+typedef struct {
+    FileSystem *fs;
+    ThreadLoad load;
+    int id;
+    double deadline;
+    uint64_t ops;
+    uint64_t errors;
+} ThreadBench;
+
+/* Cada thread tem o próprio gerador, handles e arquivo de escrita */
+static void* thread_bench_run(void *arg) {
+    ThreadBench *t = arg;
+    uint64_t rng = BENCH_SEED + (uint64_t)t->id * 7919;
+    uint8_t buffer[THR_FILE_SIZE];
+    char name[16];
+    FileHandle *handles[THR_FILES] = {0};
+    FileHandle *own = NULL;
+
+    if (t->load != THR_READ) {
+        for (int i = 0; i < THR_FILES; i++) {
+            snprintf(name, sizeof(name), "t%d", i);
+            handles[i] = fs_open(t->fs, name, FS_OPEN_READ);
+        }
+    }
+    if (t->load == THR_MIXED) {
+        snprintf(name, sizeof(name), "w%d", t->id);
+        own = fs_open(t->fs, name, FS_OPEN_WRITE);
+    }
+
+    while (now_seconds() < t->deadline) {
+        // Lotes de 64 operações entre as consultas ao relógio
+        for (int k = 0; k < 64; k++) {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            int f = (int)(rng % THR_FILES);
+            int failed;
+            if (t->load == THR_READ) {
+                uint64_t size;
+                snprintf(name, sizeof(name), "t%d", f);
+                failed = fs_read(t->fs, name, buffer, &size) != 0;
+            } else if (own && (rng >> 32) % 20 == 0) {
+                failed = fs_pwrite(own, buffer, THR_FILE_SIZE, 0) != THR_FILE_SIZE;
+            } else {
+                failed = fs_pread(handles[f], buffer, THR_FILE_SIZE, 0) != THR_FILE_SIZE;
+            }
+            t->ops++;
+            t->errors += failed;
+        }
+    }
+
+    for (int i = 0; i < THR_FILES; i++) {
+        fs_close(handles[i]);
+    }
+    fs_close(own);
+    return NULL;
+}
+
+/* Vazão agregada de leituras de arquivos pequenos (todos no cache) com
+   1, 2, 4... threads no mesmo FileSystem em modo concorrente; a escala é
+   relativa a uma thread e fica limitada pelos núcleos disponíveis */
+static void bench_threads(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = cores > 2 ? (int)cores * 2 : 4;
+    if (max_threads > THR_MAX) max_threads = THR_MAX;
+
+    FileSystem *fs = workload_begin();
+    if (!fs) return;
+    uint8_t data[THR_FILE_SIZE];
+    char name[16];
+    fill_random(data, THR_FILE_SIZE);
+    for (int i = 0; i < THR_FILES; i++) {
+        snprintf(name, sizeof(name), "t%d", i);
+        fs_create(fs, name, TYPE_BINARIO, PERM_ALL);
+        fs_write(fs, name, data, THR_FILE_SIZE);
+    }
+    for (int i = 0; i < THR_MAX; i++) {
+        snprintf(name, sizeof(name), "w%d", i);
+        fs_create(fs, name, TYPE_BINARIO, PERM_ALL);
+        fs_write(fs, name, data, THR_FILE_SIZE);
+    }
+    fs_sync(fs);
+    fs_set_concurrent(fs, 1);
+
+    printf("\n=== Leituras concorrentes (%d arquivos de %d bytes, %ld núcleo(s)) ===\n",
+           THR_FILES, THR_FILE_SIZE, cores);
+    printf("%-12s %8s %14s %8s %8s\n", "CARGA", "THREADS", "OPS/s", "ESCALA", "ERROS");
+
+    for (int load = THR_READ; load <= THR_MIXED; load++) {
+        double single = 0;
+        for (int n = 1; n <= max_threads; n *= 2) {
+            ThreadBench bench[THR_MAX];
+            pthread_t threads[THR_MAX];
+            double t0 = now_seconds();
+            int started = 0;
+            for (int i = 0; i < n; i++) {
+                bench[i] = (ThreadBench){ fs, (ThreadLoad)load, i, t0 + THR_SECONDS, 0, 0 };
+                if (pthread_create(&threads[i], NULL, thread_bench_run, &bench[i]) != 0) break;
+                started++;
+            }
+            uint64_t ops = 0, errors = 0;
+            for (int i = 0; i < started; i++) {
+                pthread_join(threads[i], NULL);
+                ops += bench[i].ops;
+                errors += bench[i].errors;
+            }
+            double rate = ops / (now_seconds() - t0);
+            if (n == 1) single = rate;
+            printf("%-12s %8d %14.0f %7.2fx %8lu\n", thread_load_names[load], started, rate,
+                   single > 0 ? rate / single : 0.0, errors);
+        }
+    }
+
+    workload_end(fs);
+}
+
+/* ============================================
+   DAEMON: MONTAGEM COMPARTILHADA
+   ============================================ */
+
+#define DMN_SOCKET "bench_daemon.sock"
+#define DMN_FILES 128
+#define DMN_FILE_SIZE 2048
+#define DMN_OPS 20000
+#define DMN_MOUNT_OPS 200
+#define DMN_DEPTH 64
+
+/* Espera o daemon do processo filho aceitar conexões */
+static FsClient* daemon_connect(void) {
+    struct timespec pause = { 0, 10 * 1000000L };
+    for (int i = 0; i < 300; i++) {
+        FsClient *client = fsc_connect(DMN_SOCKET);
+        if (client) return client;
+        nanosleep(&pause, NULL);
+    }
+    return NULL;
+}
+
+/* Leituras de 2 KB: no próprio processo, montando o disco a cada
+   operação (o que cada ferramenta fazia sem o daemon) e pelo socket,
+   esperando cada resposta ou com DMN_DEPTH pedidos em sequência */
+static void bench_daemon(void) {
+    FileSystem *fs = workload_begin();
+    if (!fs) return;
+    uint8_t data[DMN_FILE_SIZE], buffer[DMN_FILE_SIZE];
+    char name[16];
+    fill_random(data, DMN_FILE_SIZE);
+    for (int i = 0; i < DMN_FILES; i++) {
+        snprintf(name, sizeof(name), "d%d", i);
+        fs_create(fs, name, TYPE_BINARIO, PERM_ALL);
+        fs_write(fs, name, data, DMN_FILE_SIZE);
+    }
+    fs_sync(fs);
+
+    double rate[5] = {0};
+    uint64_t errors[5] = {0};
+    uint64_t size;
+
+    double t0 = now_seconds();
+    for (int i = 0; i < DMN_OPS; i++) {
+        snprintf(name, sizeof(name), "d%d", (int)rng_range(0, DMN_FILES - 1));
+        errors[0] += fs_read(fs, name, buffer, &size) != 0;
+    }
+    rate[0] = DMN_OPS / (now_seconds() - t0);
+    fs_unmount(fs);
+
+    t0 = now_seconds();
+    for (int i = 0; i < DMN_MOUNT_OPS; i++) {
+        snprintf(name, sizeof(name), "d%d", (int)rng_range(0, DMN_FILES - 1));
+        FileSystem *once = fs_mount(BENCH_DISK);
+        errors[1] += !once || fs_read(once, name, buffer, &size) != 0;
+        fs_unmount(once);
+    }
+    rate[1] = DMN_MOUNT_OPS / (now_seconds() - t0);
+
+    unlink(DMN_SOCKET);
+    pid_t child = fork();
+    if (child == 0) {
+        FileSystem *served = fs_mount(BENCH_DISK);
+        int result = served ? fs_daemon_run(served, DMN_SOCKET) : -1;
+        fs_unmount(served);
+        _exit(result == 0 ? 0 : 1);
+    }
+    FsClient *client = child > 0 ? daemon_connect() : NULL;
+    int connected = client != NULL;
+    if (client) {
+        t0 = now_seconds();
+        for (int i = 0; i < DMN_OPS; i++) {
+            errors[2] += fsc_ping(client) != 0;
+        }
+        rate[2] = DMN_OPS / (now_seconds() - t0);
+
+        t0 = now_seconds();
+        for (int i = 0; i < DMN_OPS; i++) {
+            snprintf(name, sizeof(name), "d%d", (int)rng_range(0, DMN_FILES - 1));
+            errors[3] += fsc_read(client, name, buffer, sizeof(buffer)) != DMN_FILE_SIZE;
+        }
+        rate[3] = DMN_OPS / (now_seconds() - t0);
+
+        t0 = now_seconds();
+        for (int i = 0; i < DMN_OPS; i += DMN_DEPTH) {
+            for (int k = 0; k < DMN_DEPTH; k++) {
+                snprintf(name, sizeof(name), "d%d", (int)rng_range(0, DMN_FILES - 1));
+                errors[4] += fsc_send(client, FSP_OP_READ, name, NULL, 0, 0, NULL, 0) == 0;
+            }
+            FsClientReply reply;
+            for (int k = 0; k < DMN_DEPTH; k++) {
+                errors[4] += fsc_receive(client, &reply) != 0 || reply.length != DMN_FILE_SIZE;
+            }
+        }
+        rate[4] = DMN_OPS / (now_seconds() - t0);
+
+        fsc_shutdown(client);
+        fsc_disconnect(client);
+    }
+    if (child > 0) {
+        waitpid(child, NULL, 0);
+    }
+    unlink(BENCH_DISK);
+
+    static const char *modes[] = {
+        "no processo (fs_read)", "montagem a cada leitura", "daemon: ping",
+        "daemon: fsc_read", "daemon: lotes de 64"
+    };
+    printf("\n=== Daemon (%d arquivos de %d bytes, leituras pelo nome) ===\n",
+           DMN_FILES, DMN_FILE_SIZE);
+    if (!connected) {
+        printf("Erro: daemon não respondeu em %s\n", DMN_SOCKET);
+        return;
+    }
+    printf("%-24s %14s %8s\n", "MODO", "OPS/s", "ERROS");
+    for (int i = 0; i < 5; i++) {
+        printf("%-24s %14.0f %8lu\n", modes[i], rate[i], errors[i]);
+    }
+}
+
+/* ============================================
+   GEOMETRIA: TAMANHO DO BLOCO E DA IMAGEM
+   ============================================ */
+
+#define GEO_FILE_SIZE (64 * 1024 * 1024)
+#define GEO_CHUNK (1024 * 1024)
+
+typedef struct {
+    uint32_t block_size;
+    uint64_t image_mb;
+} GeometryCase;
+
+/* Formatação, montagem e um arquivo grande lido e escrito em pedaços de
+   1MB, com a imagem esparsa em cada geometria */
+static void bench_geometry(void) {
+    static const GeometryCase cases[] = {
+        { 512, 1024 }, { 4096, 1024 }, { 65536, 1024 }, { 512, 16384 }, { 65536, 16384 }
+    };
+    uint8_t *buffer = malloc(GEO_CHUNK);
+    fill_random(buffer, GEO_CHUNK);
+
+    printf("\n=== Geometria (arquivo de %d MB em pedaços de %d KB) ===\n",
+           GEO_FILE_SIZE / (1024 * 1024), GEO_CHUNK / 1024);
+    printf("%-8s %8s %12s %12s %12s %12s\n",
+           "BLOCO", "IMAGEM", "FORMAT (ms)", "MOUNT (ms)", "ESCR. MB/s", "LEIT. MB/s");
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        FsGeometry geometry = { cases[c].block_size,
+                                cases[c].image_mb * 1024 * 1024 / cases[c].block_size,
+                                FS_DEFAULT_MAX_FILES };
+        double t0 = now_seconds();
+        int formatted = fs_format_geometry(BENCH_DISK, &geometry, 0);
+        double t1 = now_seconds();
+        FileSystem *fs = formatted == 0 ? fs_mount(BENCH_DISK) : NULL;
+        double t2 = now_seconds();
+        if (!fs) {
+            unlink(BENCH_DISK);
+            printf("Erro: não foi possível formatar %s com blocos de %u bytes\n",
+                   BENCH_DISK, cases[c].block_size);
+            continue;
+        }
+
+        int failed = fs_create(fs, "geo", TYPE_BINARIO, PERM_ALL) != 0;
+        FileHandle *handle = fs_open(fs, "geo", FS_OPEN_WRITE);
+        double t3 = now_seconds();
+        for (uint64_t off = 0; handle && off < GEO_FILE_SIZE; off += GEO_CHUNK) {
+            failed |= fs_append(handle, buffer, GEO_CHUNK) != GEO_CHUNK;
+        }
+        fs_close(handle);
+        failed |= fs_sync(fs) != 0;
+        double t4 = now_seconds();
+        handle = fs_open(fs, "geo", FS_OPEN_READ);
+        for (uint64_t off = 0; handle && off < GEO_FILE_SIZE; off += GEO_CHUNK) {
+            failed |= fs_pread(handle, buffer, GEO_CHUNK, off) != GEO_CHUNK;
+        }
+        fs_close(handle);
+        double t5 = now_seconds();
+        fs_unmount(fs);
+        unlink(BENCH_DISK);
+
+        if (failed || !handle) {
+            printf("ERRO: falha de E/S com blocos de %u bytes\n", cases[c].block_size);
+        }
+        printf("%-8u %6luMB %12.2f %12.2f %12.1f %12.1f\n", cases[c].block_size, cases[c].image_mb,
+               (t1 - t0) * 1000, (t2 - t1) * 1000,
+               mb_per_s(GEO_FILE_SIZE, t4 - t3), mb_per_s(GEO_FILE_SIZE, t5 - t4));
+    }
+    free(buffer);
+}
+
+/* ============================================
+   PROGRAMA PRINCIPAL
+   ============================================ */
+
+int main(void) {
+    FsGeometry geometry = { FS_DEFAULT_BLOCK_SIZE, FS_DEFAULT_TOTAL_BLOCKS, FS_DEFAULT_MAX_FILES };
+    fs_layout_compute(&geometry, &layout);
+    // As funções do sistema de arquivos informam cada operação; nas
+    // medições só os erros aparecem
+    fs_set_verbosity(FS_VERBOSITY_ERRORS);
+    printf("Benchmarks do sistema de arquivos (semente %llu)\n",
+           (unsigned long long)BENCH_SEED);
+    bench_bitmap();
+    bench_io();
+    bench_format();
+    bench_cache();
+    bench_workloads();
+    bench_compression();
+    bench_fragmented();
+    bench_threads();
+    bench_daemon();
+    bench_geometry();
+    return 0;
+}
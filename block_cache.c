@@ -0,0 +1,572 @@
+#define _GNU_SOURCE
+
+#include "block_cache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+/* ============================================
+   FUNÇÕES AUXILIARES - E/S
+   ============================================ */
+
+static int cache_pread(int fd, void *buffer, uint64_t size, uint64_t offset) {
+    uint8_t *ptr = buffer;
+    while (size > 0) {
+        ssize_t n = pread(fd, ptr, size, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        ptr += n;
+        size -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+static int cache_pwrite(int fd, const void *buffer, uint64_t size, uint64_t offset) {
+    const uint8_t *ptr = buffer;
+    while (size > 0) {
+        ssize_t n = pwrite(fd, ptr, size, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        ptr += n;
+        size -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+/* ============================================
+   FUNÇÕES AUXILIARES - PARTES, HASH E LRU
+   ============================================ */
+
+/* Grupos de CACHE_SHARD_SPAN blocos vizinhos ficam na mesma parte, para
+   que uma leitura curta trave uma parte só */
+static CacheShard* shard_of(const BlockCache *cache, uint64_t block) {
+    return &cache->shards[(block / CACHE_SHARD_SPAN) % cache->shard_count];
+}
+
+static size_t bucket_of(const CacheShard *shard, uint64_t block) {
+    return (size_t)((block * 0x9E3779B97F4A7C15ULL) >> 32) & shard->bucket_mask;
+}
+
+static CacheBlock* cache_lookup(CacheShard *shard, uint64_t block) {
+    CacheBlock *slot = shard->buckets[bucket_of(shard, block)];
+    while (slot && slot->block != block) {
+        slot = slot->hash_next;
+    }
+    return slot;
+}
+
+static void hash_insert(CacheShard *shard, CacheBlock *slot) {
+    size_t b = bucket_of(shard, slot->block);
+    slot->hash_next = shard->buckets[b];
+    shard->buckets[b] = slot;
+}
+
+static void hash_remove(CacheShard *shard, CacheBlock *slot) {
+    CacheBlock **link = &shard->buckets[bucket_of(shard, slot->block)];
+    while (*link != slot) {
+        link = &(*link)->hash_next;
+    }
+    *link = slot->hash_next;
+}
+
+static void lru_unlink(CacheShard *shard, CacheBlock *slot) {
+    if (slot->lru_prev) slot->lru_prev->lru_next = slot->lru_next;
+    else shard->lru_head = slot->lru_next;
+    if (slot->lru_next) slot->lru_next->lru_prev = slot->lru_prev;
+    else shard->lru_tail = slot->lru_prev;
+    slot->lru_prev = slot->lru_next = NULL;
+}
+
+static void lru_push_front(CacheShard *shard, CacheBlock *slot) {
+    slot->lru_prev = NULL;
+    slot->lru_next = shard->lru_head;
+    if (shard->lru_head) shard->lru_head->lru_prev = slot;
+    else shard->lru_tail = slot;
+    shard->lru_head = slot;
+}
+
+static int write_back(BlockCache *cache, CacheShard *shard, CacheBlock *slot) {
+    if (!slot->dirty) return 0;
+    if (cache_pwrite(cache->fd, slot->data, cache->block_size,
+                     slot->block * cache->block_size) != 0) {
+        return -1;
+    }
+    slot->dirty = 0;
+    shard->stats.writebacks++;
+    return 0;
+}
+
+/* Entrada livre para block: usa um slot ainda vazio ou expulsa o menos
+   recentemente usado, gravando-o antes se estiver sujo */
+static CacheBlock* cache_take_slot(BlockCache *cache, CacheShard *shard, uint64_t block) {
+    CacheBlock *slot;
+    if (shard->used < shard->capacity) {
+        slot = &shard->slots[shard->used++];
+    } else {
+        slot = shard->lru_tail;
+        if (write_back(cache, shard, slot) != 0) {
+            return NULL;
+        }
+        hash_remove(shard, slot);
+        lru_unlink(shard, slot);
+        shard->stats.evictions++;
+    }
+    slot->block = block;
+    slot->dirty = 0;
+    hash_insert(shard, slot);
+    lru_push_front(shard, slot);
+    return slot;
+}
+
+/* Retira uma entrada do cache; o slot é reaproveitado trocando de lugar
+   com o último em uso, para manter os slots ocupados contíguos */
+static void cache_drop(CacheShard *shard, CacheBlock *slot) {
+    hash_remove(shard, slot);
+    lru_unlink(shard, slot);
+
+    CacheBlock *last = &shard->slots[--shard->used];
+    if (last != slot) {
+        // Troca as áreas de dados: o slot vago fica com a do último
+        uint8_t *data = slot->data;
+        hash_remove(shard, last);
+        slot->data = last->data;
+        last->data = data;
+        slot->block = last->block;
+        slot->dirty = last->dirty;
+        slot->lru_prev = last->lru_prev;
+        slot->lru_next = last->lru_next;
+        if (slot->lru_prev) slot->lru_prev->lru_next = slot;
+        else shard->lru_head = slot;
+        if (slot->lru_next) slot->lru_next->lru_prev = slot;
+        else shard->lru_tail = slot;
+        hash_insert(shard, slot);
+    }
+}
+
+/* Transferências grandes passam direto pelo disco */
+static int cache_bypass(const BlockCache *cache, uint64_t first, uint64_t last) {
+    return last - first + 1 > cache->capacity / 4;
+}
+
+/* Travas só no modo concorrente; com uma thread só não custam nada */
+static void shard_lock(const BlockCache *cache, CacheShard *shard) {
+    if (cache->concurrent) pthread_mutex_lock(&shard->lock);
+}
+
+static void shard_unlock(const BlockCache *cache, CacheShard *shard) {
+    if (cache->concurrent) pthread_mutex_unlock(&shard->lock);
+}
+
+/* Trava a parte de block, soltando a anterior se for outra; os laços
+   que percorrem vários blocos mantêm no máximo uma parte travada */
+static CacheShard* shard_switch(BlockCache *cache, CacheShard *held, uint64_t block) {
+    CacheShard *shard = shard_of(cache, block);
+    if (shard != held) {
+        if (held) shard_unlock(cache, held);
+        shard_lock(cache, shard);
+    }
+    return shard;
+}
+
+static void lock_all(BlockCache *cache) {
+    for (size_t i = 0; i < cache->shard_count; i++) {
+        shard_lock(cache, &cache->shards[i]);
+    }
+}
+
+static void unlock_all(BlockCache *cache) {
+    for (size_t i = cache->shard_count; i-- > 0; ) {
+        shard_unlock(cache, &cache->shards[i]);
+    }
+}
+
+/* ============================================
+   CRIAÇÃO E DESTRUIÇÃO
+   ============================================ */
+
+BlockCache* cache_create(int fd, uint32_t block_size, size_t capacity) {
+    if (capacity == 0 || block_size == 0) {
+        return NULL;
+    }
+
+    BlockCache *cache = calloc(1, sizeof(BlockCache));
+    if (!cache) {
+        return NULL;
+    }
+    cache->fd = fd;
+    cache->block_size = block_size;
+    cache->capacity = capacity;
+
+    // Cada parte fica com pelo menos CACHE_SHARD_MIN_BLOCKS blocos
+    size_t count = capacity / CACHE_SHARD_MIN_BLOCKS;
+    if (count < 1) count = 1;
+    if (count > CACHE_MAX_SHARDS) count = CACHE_MAX_SHARDS;
+
+    cache->shards = calloc(count, sizeof(CacheShard));
+    cache->memory = malloc(capacity * block_size);
+    if (!cache->shards || !cache->memory) {
+        cache_destroy(cache);
+        return NULL;
+    }
+
+    uint8_t *memory = cache->memory;
+    for (size_t s = 0; s < count; s++) {
+        CacheShard *shard = &cache->shards[s];
+        shard->capacity = capacity / count + (s < capacity % count ? 1 : 0);
+
+        size_t buckets = 1;
+        while (buckets < shard->capacity * 2) {
+            buckets <<= 1;
+        }
+        shard->bucket_mask = buckets - 1;
+        shard->slots = calloc(shard->capacity, sizeof(CacheBlock));
+        shard->buckets = calloc(buckets, sizeof(CacheBlock *));
+        pthread_mutex_init(&shard->lock, NULL);
+        cache->shard_count = s + 1;
+        if (!shard->slots || !shard->buckets) {
+            cache_destroy(cache);
+            return NULL;
+        }
+        for (size_t i = 0; i < shard->capacity; i++) {
+            shard->slots[i].data = memory;
+            memory += block_size;
+        }
+    }
+    return cache;
+}
+
+/* Não grava nada: quem destrói deve chamar cache_flush antes */
+void cache_destroy(BlockCache *cache) {
+    if (!cache) return;
+    for (size_t s = 0; s < cache->shard_count; s++) {
+        free(cache->shards[s].slots);
+        free(cache->shards[s].buckets);
+        pthread_mutex_destroy(&cache->shards[s].lock);
+    }
+    free(cache->shards);
+    free(cache->memory);
+    free(cache);
+}
+
+void cache_set_concurrent(BlockCache *cache, int enabled) {
+    cache->concurrent = enabled != 0;
+}
+
+/* ============================================
+   LEITURA E ESCRITA
+   ============================================ */
+
+/* Leitura direta: os blocos sujos do trecho são gravados antes, e o
+   disco passa a ter a versão atual. Leitores nunca sujam blocos, então
+   nada muda entre a descarga e a leitura enquanto os escritores estiverem
+   excluídos */
+static int read_direct(BlockCache *cache, uint64_t offset, void *buffer, uint64_t size) {
+    uint32_t bs = cache->block_size;
+    uint64_t first = offset / bs;
+    uint64_t last = (offset + size - 1) / bs;
+    if (cache_flush_range(cache, first, last - first + 1) != 0) {
+        return -1;
+    }
+    return cache_pread(cache->fd, buffer, size, offset);
+}
+
+/* Escrita direta: blocos em cache recebem os novos bytes e os
+   inteiramente cobertos deixam de estar sujos */
+static int write_direct(BlockCache *cache, uint64_t offset, const void *data, uint64_t size) {
+    uint32_t bs = cache->block_size;
+    uint64_t first = offset / bs;
+    uint64_t last = (offset + size - 1) / bs;
+    const uint8_t *in = data;
+
+    if (cache_pwrite(cache->fd, data, size, offset) != 0) {
+        return -1;
+    }
+    CacheShard *shard = NULL;
+    for (uint64_t b = first; b <= last; b++) {
+        shard = shard_switch(cache, shard, b);
+        CacheBlock *slot = cache_lookup(shard, b);
+        if (slot) {
+            uint64_t lo = b * bs > offset ? b * bs : offset;
+            uint64_t hi = (b + 1) * bs < offset + size ? (b + 1) * bs : offset + size;
+            memcpy(slot->data + (lo - b * bs), in + (lo - offset), hi - lo);
+            if (hi - lo == bs) {
+                slot->dirty = 0;
+            }
+        }
+    }
+    shard_unlock(cache, shard);
+    return 0;
+}
+
+int cache_read(BlockCache *cache, uint64_t offset, void *buffer, uint64_t size) {
+    if (size == 0) return 0;
+
+    uint32_t bs = cache->block_size;
+    uint64_t first = offset / bs;
+    uint64_t last = (offset + size - 1) / bs;
+    uint8_t *out = buffer;
+
+    if (cache_bypass(cache, first, last)) {
+        return read_direct(cache, offset, buffer, size);
+    }
+
+    CacheShard *shard = NULL;
+    int result = 0;
+    for (uint64_t b = first; b <= last && result == 0; b++) {
+        shard = shard_switch(cache, shard, b);
+        CacheBlock *slot = cache_lookup(shard, b);
+        if (slot) {
+            shard->stats.hits++;
+            lru_unlink(shard, slot);
+            lru_push_front(shard, slot);
+        } else {
+            shard->stats.misses++;
+            slot = cache_take_slot(cache, shard, b);
+            if (!slot) {
+                result = -1;
+                break;
+            }
+            if (cache_pread(cache->fd, slot->data, bs, b * bs) != 0) {
+                cache_drop(shard, slot);
+                result = -1;
+                break;
+            }
+        }
+        uint64_t lo = b * bs > offset ? b * bs : offset;
+        uint64_t hi = (b + 1) * bs < offset + size ? (b + 1) * bs : offset + size;
+        memcpy(out + (lo - offset), slot->data + (lo - b * bs), hi - lo);
+    }
+    shard_unlock(cache, shard);
+    return result;
+}
+
+int cache_write(BlockCache *cache, uint64_t offset, const void *data, uint64_t size) {
+    if (size == 0) return 0;
+
+    uint32_t bs = cache->block_size;
+    uint64_t first = offset / bs;
+    uint64_t last = (offset + size - 1) / bs;
+    const uint8_t *in = data;
+
+    if (cache_bypass(cache, first, last)) {
+        return write_direct(cache, offset, data, size);
+    }
+
+    CacheShard *shard = NULL;
+    int result = 0;
+    for (uint64_t b = first; b <= last; b++) {
+        uint64_t lo = b * bs > offset ? b * bs : offset;
+        uint64_t hi = (b + 1) * bs < offset + size ? (b + 1) * bs : offset + size;
+
+        shard = shard_switch(cache, shard, b);
+        CacheBlock *slot = cache_lookup(shard, b);
+        if (slot) {
+            shard->stats.hits++;
+            lru_unlink(shard, slot);
+            lru_push_front(shard, slot);
+        } else {
+            shard->stats.misses++;
+            slot = cache_take_slot(cache, shard, b);
+            if (!slot) {
+                result = -1;
+                break;
+            }
+            // Escrita parcial precisa do restante do bloco
+            if (hi - lo < bs && cache_pread(cache->fd, slot->data, bs, b * bs) != 0) {
+                cache_drop(shard, slot);
+                result = -1;
+                break;
+            }
+        }
+        memcpy(slot->data + (lo - b * bs), in + (lo - offset), hi - lo);
+        slot->dirty = 1;
+    }
+    shard_unlock(cache, shard);
+    return result;
+}
+
+int cache_read_direct(BlockCache *cache, uint64_t offset, void *buffer, uint64_t size) {
+    if (size == 0) return 0;
+    return read_direct(cache, offset, buffer, size);
+}
+
+int cache_write_direct(BlockCache *cache, uint64_t offset, const void *data, uint64_t size) {
+    if (size == 0) return 0;
+    return write_direct(cache, offset, data, size);
+}
+
+/* ============================================
+   DESCARGA E DESCARTE
+   ============================================ */
+
+static int compare_by_block(const void *a, const void *b) {
+    const CacheBlock *x = *(CacheBlock * const *)a;
+    const CacheBlock *y = *(CacheBlock * const *)b;
+    return x->block < y->block ? -1 : x->block > y->block;
+}
+
+/* Grava os blocos de dirty (todos sujos) em ordem de número; as partes
+   de todos eles devem estar travadas */
+static int write_sorted(BlockCache *cache, CacheBlock **dirty, size_t count) {
+    qsort(dirty, count, sizeof(CacheBlock *), compare_by_block);
+
+    // Blocos vizinhos saem numa única chamada pwritev
+    struct iovec iov[64];
+    int result = 0;
+    size_t i = 0;
+    while (i < count && result == 0) {
+        size_t run = 1;
+        while (i + run < count && run < sizeof(iov) / sizeof(iov[0]) && run < IOV_MAX &&
+               dirty[i + run]->block == dirty[i]->block + run) {
+            run++;
+        }
+        for (size_t k = 0; k < run; k++) {
+            iov[k].iov_base = dirty[i + k]->data;
+            iov[k].iov_len = cache->block_size;
+        }
+
+        uint64_t offset = dirty[i]->block * cache->block_size;
+        ssize_t n;
+        do {
+            n = pwritev(cache->fd, iov, (int)run, offset);
+        } while (n < 0 && errno == EINTR);
+
+        if (n == (ssize_t)(run * cache->block_size)) {
+            for (size_t k = 0; k < run; k++) {
+                dirty[i + k]->dirty = 0;
+                shard_of(cache, dirty[i + k]->block)->stats.writebacks++;
+            }
+        } else {
+            // Escrita curta ou erro: refaz bloco a bloco
+            for (size_t k = 0; k < run && result == 0; k++) {
+                result = write_back(cache, shard_of(cache, dirty[i + k]->block), dirty[i + k]);
+            }
+        }
+        i += run;
+    }
+    return result;
+}
+
+/* Junta em dirty os blocos sujos de [start_block, start_block + count)
+   de uma parte travada, percorrendo os slots em uso; sem vetor, grava
+   um a um */
+static int collect_dirty(BlockCache *cache, CacheShard *shard, uint64_t start_block,
+                         uint64_t count, CacheBlock **dirty, size_t *found) {
+    for (size_t i = 0; i < shard->used; i++) {
+        CacheBlock *slot = &shard->slots[i];
+        if (slot->dirty && slot->block >= start_block && slot->block - start_block < count) {
+            if (!dirty) {
+                if (write_back(cache, shard, slot) != 0) return -1;
+            } else {
+                dirty[(*found)++] = slot;
+            }
+        }
+    }
+    return 0;
+}
+
+int cache_flush(BlockCache *cache) {
+    return cache ? cache_flush_range(cache, 0, UINT64_MAX) : 0;
+}
+
+int cache_flush_range(BlockCache *cache, uint64_t start_block, uint64_t count) {
+    if (!cache) return 0;
+
+    // Todas as partes ficam travadas (sempre na mesma ordem) para que os
+    // blocos sujos saiam ordenados numa única passada
+    lock_all(cache);
+    size_t used = 0;
+    for (size_t s = 0; s < cache->shard_count; s++) {
+        used += cache->shards[s].used;
+    }
+    if (used == 0) {
+        unlock_all(cache);
+        return 0;
+    }
+    if (count > UINT64_MAX - start_block) {
+        count = UINT64_MAX - start_block;
+    }
+
+    CacheBlock **dirty = malloc(used * sizeof(CacheBlock *));
+    size_t found = 0;
+    int result = 0;
+    if (count > used) {
+        for (size_t s = 0; s < cache->shard_count && result == 0; s++) {
+            result = collect_dirty(cache, &cache->shards[s], start_block, count, dirty, &found);
+        }
+    } else {
+        // Trecho curto: procura bloco a bloco na parte de cada um
+        for (uint64_t b = start_block; b < start_block + count && result == 0; b++) {
+            CacheShard *shard = shard_of(cache, b);
+            CacheBlock *slot = cache_lookup(shard, b);
+            if (slot && slot->dirty) {
+                if (!dirty) {
+                    result = write_back(cache, shard, slot);
+                } else {
+                    dirty[found++] = slot;
+                }
+            }
+        }
+    }
+    if (dirty) {
+        if (result == 0) {
+            result = write_sorted(cache, dirty, found);
+        }
+        free(dirty);
+    }
+    unlock_all(cache);
+    return result;
+}
+
+/* Blocos liberados pelo sistema de arquivos: o conteúdo deixou de
+   importar, então saem do cache sem ser gravados */
+void cache_discard(BlockCache *cache, uint64_t start_block, uint64_t count) {
+    if (!cache || count == 0) return;
+
+    if (count > cache->capacity) {
+        // Trecho maior que o cache: percorre os slots em uso de cada parte
+        for (size_t s = 0; s < cache->shard_count; s++) {
+            CacheShard *shard = &cache->shards[s];
+            shard_lock(cache, shard);
+            size_t i = 0;
+            while (i < shard->used) {
+                CacheBlock *slot = &shard->slots[i];
+                if (slot->block >= start_block && slot->block - start_block < count) {
+                    cache_drop(shard, slot); // O último slot veio para i
+                } else {
+                    i++;
+                }
+            }
+            shard_unlock(cache, shard);
+        }
+        return;
+    }
+
+    CacheShard *shard = NULL;
+    for (uint64_t b = start_block; b < start_block + count; b++) {
+        shard = shard_switch(cache, shard, b);
+        CacheBlock *slot = cache_lookup(shard, b);
+        if (slot) {
+            cache_drop(shard, slot);
+        }
+    }
+    shard_unlock(cache, shard);
+}
+
+void cache_get_stats(BlockCache *cache, CacheStats *stats) {
+    memset(stats, 0, sizeof(CacheStats));
+    for (size_t s = 0; s < cache->shard_count; s++) {
+        CacheShard *shard = &cache->shards[s];
+        shard_lock(cache, shard);
+        stats->hits += shard->stats.hits;
+        stats->misses += shard->stats.misses;
+        stats->writebacks += shard->stats.writebacks;
+        stats->evictions += shard->stats.evictions;
+        shard_unlock(cache, shard);
+    }
+}
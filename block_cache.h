@@ -0,0 +1,97 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/* ============================================
+   CACHE DE BLOCOS (WRITE-BACK, LRU)
+   ============================================ */
+
+/* Camada entre o sistema de arquivos e o descritor do disco. Guarda até
+   capacity blocos em memória; escritas só marcam o bloco como sujo, e a
+   gravação no disco acontece na expulsão (LRU) ou em cache_flush.
+   Transferências maiores que um quarto da capacidade passam direto pelo
+   disco para não expulsar o conjunto quente, mantendo os blocos já em
+   cache coerentes.
+
+   O cache é dividido em partes independentes, cada uma com lista LRU,
+   tabela hash e trava próprias; grupos de CACHE_SHARD_SPAN blocos
+   vizinhos caem na mesma parte. Leituras de várias threads ao mesmo
+   tempo só disputam a trava quando tocam a mesma parte. Escritas,
+   descargas e descartes também são seguros entre threads, mas quem
+   escreve deve excluir os leitores do mesmo trecho (o sistema de arquivos
+   faz isso com o lock do modo concorrente). As travas só são tomadas
+   depois de cache_set_concurrent. */
+
+#define CACHE_SHARD_SPAN 16         // Blocos vizinhos na mesma parte
+#define CACHE_MAX_SHARDS 16         // Partes no máximo
+#define CACHE_SHARD_MIN_BLOCKS 64   // Capacidade mínima de cada parte
+
+typedef struct CacheBlock {
+    uint64_t block;                 // Número do bloco no disco
+    uint8_t *data;                  // Conteúdo (block_size bytes)
+    int dirty;                      // Alterado e ainda não gravado
+    struct CacheBlock *lru_prev;    // Lista LRU (cabeça = mais recente)
+    struct CacheBlock *lru_next;
+    struct CacheBlock *hash_next;   // Encadeamento na tabela hash
+} CacheBlock;
+
+typedef struct {
+    uint64_t hits;                  // Blocos encontrados no cache
+    uint64_t misses;                // Blocos lidos do disco
+    uint64_t writebacks;            // Blocos sujos gravados no disco
+    uint64_t evictions;             // Blocos expulsos por falta de espaço
+} CacheStats;
+
+typedef struct {
+    pthread_mutex_t lock;           // Protege tudo abaixo
+    size_t capacity;                // Máximo de blocos desta parte
+    size_t used;                    // Blocos em uso
+    CacheBlock *slots;              // Vetor com capacity entradas
+    CacheBlock **buckets;           // Tabela hash bloco -> entrada
+    size_t bucket_mask;             // Número de buckets - 1
+    CacheBlock *lru_head;           // Mais recentemente usado
+    CacheBlock *lru_tail;           // Candidato à expulsão
+    CacheStats stats;               // Contadores
+} CacheShard;
+
+typedef struct {
+    int fd;                         // Descritor do disco
+    uint32_t block_size;            // Tamanho do bloco
+    size_t capacity;                // Máximo de blocos em memória (soma das partes)
+    size_t shard_count;             // Partes
+    CacheShard *shards;             // Vetor com shard_count partes
+    uint8_t *memory;                // Área de dados de todos os blocos
+    int concurrent;                 // Usado por várias threads: trava as partes
+} BlockCache;
+
+BlockCache* cache_create(int fd, uint32_t block_size, size_t capacity);
+void cache_destroy(BlockCache *cache);
+
+/* Liga as travas das partes; só sem transferências em andamento */
+void cache_set_concurrent(BlockCache *cache, int enabled);
+
+/* Leitura/escrita de bytes a partir de um deslocamento absoluto no disco */
+int cache_read(BlockCache *cache, uint64_t offset, void *buffer, uint64_t size);
+int cache_write(BlockCache *cache, uint64_t offset, const void *data, uint64_t size);
+
+/* Como cache_read/cache_write, mas sempre direto pelo disco, como as
+   transferências grandes: para uma transferência grande feita em pedaços
+   (um arquivo em várias extensões), que de outro modo expulsaria o cache */
+int cache_read_direct(BlockCache *cache, uint64_t offset, void *buffer, uint64_t size);
+int cache_write_direct(BlockCache *cache, uint64_t offset, const void *data, uint64_t size);
+
+/* Grava todos os blocos sujos (em ordem, agrupando blocos vizinhos);
+   a versão com trecho grava só os de [start_block, start_block + count) */
+int cache_flush(BlockCache *cache);
+int cache_flush_range(BlockCache *cache, uint64_t start_block, uint64_t count);
+
+/* Retira do cache, sem gravar, blocos que deixaram de estar em uso */
+void cache_discard(BlockCache *cache, uint64_t start_block, uint64_t count);
+
+/* Soma dos contadores de todas as partes */
+void cache_get_stats(BlockCache *cache, CacheStats *stats);
+
+#endif // BLOCK_CACHE_H
@@ -0,0 +1,123 @@
+/* ============================================
+   IDA E VOLTA PELO DAEMON (make test)
+   ============================================ */
+
+/* Uso: client_test <socket> <arquivo>
+   Grava o arquivo local no daemon, lê de volta inteiro, em pedidos
+   síncronos e em sequência, testa a cópia por reflink e encerra o
+   daemon. Retorna 0 se tudo voltou igual. */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "fs_client.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CHUNK 4096
+
+static int fail(const char *message) {
+    printf("Erro: %s\n", message);
+    return 1;
+}
+
+/* O daemon pode ainda não ter criado o socket */
+static FsClient* connect_retry(const char *socket_path) {
+    struct timespec pause = { 0, 10 * 1000000L };
+    for (int i = 0; i < 300; i++) {
+        FsClient *client = fsc_connect(socket_path);
+        if (client) return client;
+        nanosleep(&pause, NULL);
+    }
+    return NULL;
+}
+
+static uint8_t* load_file(const char *path, uint64_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = length > 0 ? malloc(length) : NULL;
+    if (data && fread(data, 1, length, file) != (size_t)length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    *size = (uint64_t)length;
+    return data;
+}
+
+static int round_trip(FsClient *client, const uint8_t *data, uint64_t size) {
+    uint8_t *buffer = malloc(size);
+    if (!buffer) return fail("memória insuficiente.");
+    int result = 1;
+    FspStat stat;
+
+    if (fsc_ping(client) != 0 ||
+        fsc_create(client, "dados", FSP_TYPE_BINARIO, FSP_PERM_ALL) != 0 ||
+        fsc_write(client, "dados", data, size) != 0) {
+        fail("falha ao gravar pelo daemon.");
+    } else if (fsc_read(client, "dados", buffer, size) != (int64_t)size ||
+               memcmp(buffer, data, size) != 0) {
+        fail("leitura síncrona diferente do original.");
+    } else if (fsc_stat(client, "dados", &stat) != 0 || stat.size_bytes != size) {
+        fail("tamanho errado no stat.");
+    } else {
+        result = 0;
+    }
+
+    // Um pedido de pread por pedaço, todos enviados antes da primeira resposta
+    uint64_t chunks = (size + CHUNK - 1) / CHUNK;
+    uint32_t *tags = malloc(chunks * sizeof(uint32_t));
+    for (uint64_t c = 0; result == 0 && tags && c < chunks; c++) {
+        tags[c] = fsc_send(client, FSP_OP_PREAD, "dados", NULL, CHUNK, c * CHUNK, NULL, 0);
+        if (tags[c] == 0) result = fail("falha ao enfileirar pedido.");
+    }
+    for (uint64_t c = 0; result == 0 && tags && c < chunks; c++) {
+        FsClientReply reply;
+        uint64_t expected = size - c * CHUNK < CHUNK ? size - c * CHUNK : CHUNK;
+        if (fsc_receive(client, &reply) != 0 || reply.tag != tags[c] || reply.status != 0 ||
+            reply.length != expected || memcmp(reply.data, data + c * CHUNK, expected) != 0) {
+            result = fail("resposta em sequência fora de ordem ou diferente do original.");
+        }
+    }
+    if (!tags) result = fail("memória insuficiente.");
+    free(tags);
+
+    // A cópia por reflink muda sem alterar a origem
+    uint8_t piece[5];
+    if (result == 0 &&
+        (fsc_reflink(client, "dados", "copia") != 0 ||
+         fsc_pwrite(client, "copia", "curto", 5, 0) != 5 ||
+         fsc_pread(client, "copia", piece, 5, 0) != 5 || memcmp(piece, "curto", 5) != 0 ||
+         fsc_pread(client, "dados", piece, 5, 0) != 5 || memcmp(piece, data, 5) != 0)) {
+        result = fail("cópia por reflink alterou a origem ou não foi gravada.");
+    }
+    free(buffer);
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        printf("Uso: %s <socket> <arquivo>\n", argv[0]);
+        return 1;
+    }
+    uint64_t size;
+    uint8_t *data = load_file(argv[2], &size);
+    if (!data) return fail("não foi possível ler o arquivo local.");
+    FsClient *client = connect_retry(argv[1]);
+    if (!client) {
+        free(data);
+        return fail("daemon não respondeu.");
+    }
+
+    int result = round_trip(client, data, size);
+    if (fsc_shutdown(client) != 0 && result == 0) {
+        result = fail("daemon não confirmou o encerramento.");
+    }
+    fsc_disconnect(client);
+    free(data);
+    return result;
+}
@@ -0,0 +1,346 @@
+#include "extent_tree.h"
+#include <stdlib.h>
+
+/* ============================================
+   FUNÇÕES AUXILIARES - TREAPS
+   ============================================ */
+
+static uint64_t node_max(const ExtentNode *node) {
+    return node ? node->max_length : 0;
+}
+
+static void node_update(ExtentNode *node) {
+    uint64_t max = node->length;
+    if (node_max(node->off_left) > max) max = node_max(node->off_left);
+    if (node_max(node->off_right) > max) max = node_max(node->off_right);
+    node->max_length = max;
+}
+
+static uint32_t next_priority(ExtentIndex *index) {
+    // xorshift32: prioridades reprodutíveis entre montagens
+    uint32_t x = index->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    index->seed = x;
+    return x;
+}
+
+/* Árvore por bloco inicial: left recebe start < key, right o restante */
+static void off_split(ExtentNode *root, uint64_t key, ExtentNode **left, ExtentNode **right) {
+    if (!root) {
+        *left = *right = NULL;
+        return;
+    }
+    if (root->start < key) {
+        off_split(root->off_right, key, &root->off_right, right);
+        *left = root;
+    } else {
+        off_split(root->off_left, key, left, &root->off_left);
+        *right = root;
+    }
+    node_update(root);
+}
+
+static ExtentNode* off_merge(ExtentNode *left, ExtentNode *right) {
+    if (!left) return right;
+    if (!right) return left;
+    if (left->priority > right->priority) {
+        left->off_right = off_merge(left->off_right, right);
+        node_update(left);
+        return left;
+    }
+    right->off_left = off_merge(left, right->off_left);
+    node_update(right);
+    return right;
+}
+
+/* Ordem da árvore por tamanho: (length, start) */
+static int size_less(uint64_t len_a, uint64_t start_a, uint64_t len_b, uint64_t start_b) {
+    return len_a < len_b || (len_a == len_b && start_a < start_b);
+}
+
+static void size_split(ExtentNode *root, uint64_t len, uint64_t start,
+                       ExtentNode **left, ExtentNode **right) {
+    if (!root) {
+        *left = *right = NULL;
+        return;
+    }
+    if (size_less(root->length, root->start, len, start)) {
+        size_split(root->size_right, len, start, &root->size_right, right);
+        *left = root;
+    } else {
+        size_split(root->size_left, len, start, left, &root->size_left);
+        *right = root;
+    }
+}
+
+static ExtentNode* size_merge(ExtentNode *left, ExtentNode *right) {
+    if (!left) return right;
+    if (!right) return left;
+    if (left->priority > right->priority) {
+        left->size_right = size_merge(left->size_right, right);
+        return left;
+    }
+    right->size_left = size_merge(left, right->size_left);
+    return right;
+}
+
+/* ============================================
+   INSERÇÃO E REMOÇÃO DE NÓS
+   ============================================ */
+
+static int insert_extent(ExtentIndex *index, uint64_t start, uint64_t length) {
+    ExtentNode *node = calloc(1, sizeof(ExtentNode));
+    if (!node) {
+        return -1;
+    }
+    node->start = start;
+    node->length = length;
+    node->max_length = length;
+    node->priority = next_priority(index);
+
+    ExtentNode *left, *right;
+    off_split(index->by_offset, start, &left, &right);
+    index->by_offset = off_merge(off_merge(left, node), right);
+
+    size_split(index->by_size, length, start, &left, &right);
+    index->by_size = size_merge(size_merge(left, node), right);
+
+    index->extent_count++;
+    index->free_blocks += length;
+    return 0;
+}
+
+static void remove_extent(ExtentIndex *index, ExtentNode *node) {
+    ExtentNode *left, *middle, *right;
+
+    off_split(index->by_offset, node->start, &left, &right);
+    off_split(right, node->start + 1, &middle, &right);
+    index->by_offset = off_merge(left, right);
+
+    size_split(index->by_size, node->length, node->start, &left, &right);
+    size_split(right, node->length, node->start + 1, &middle, &right);
+    index->by_size = size_merge(left, right);
+
+    index->extent_count--;
+    index->free_blocks -= node->length;
+    free(node);
+}
+
+/* Maior extensão com start <= block */
+static ExtentNode* find_predecessor(const ExtentIndex *index, uint64_t block) {
+    ExtentNode *node = index->by_offset;
+    ExtentNode *best = NULL;
+    while (node) {
+        if (node->start <= block) {
+            best = node;
+            node = node->off_right;
+        } else {
+            node = node->off_left;
+        }
+    }
+    return best;
+}
+
+/* Menor extensão com start >= block */
+static ExtentNode* find_successor(const ExtentIndex *index, uint64_t block) {
+    ExtentNode *node = index->by_offset;
+    ExtentNode *best = NULL;
+    while (node) {
+        if (node->start >= block) {
+            best = node;
+            node = node->off_left;
+        } else {
+            node = node->off_right;
+        }
+    }
+    return best;
+}
+
+/* ============================================
+   CONSTRUÇÃO E DESTRUIÇÃO
+   ============================================ */
+
+ExtentIndex* extent_index_build(const uint8_t *bitmap, uint64_t first_bit, uint64_t total_bits) {
+    ExtentIndex *index = calloc(1, sizeof(ExtentIndex));
+    if (!index) {
+        return NULL;
+    }
+    index->seed = 0x9E3779B9u;
+
+    uint64_t run_start = 0;
+    uint64_t run_length = 0;
+    uint64_t i = first_bit;
+
+    while (i < total_bits) {
+        // Pula bytes totalmente ocupados de uma vez
+        if (run_length == 0 && i % 8 == 0 && i + 8 <= total_bits && bitmap[i / 8] == 0xFF) {
+            i += 8;
+            continue;
+        }
+        int used = (bitmap[i / 8] >> (i % 8)) & 1;
+        if (!used) {
+            if (run_length == 0) {
+                run_start = i;
+            }
+            run_length++;
+        } else if (run_length > 0) {
+            if (insert_extent(index, run_start, run_length) != 0) {
+                extent_index_destroy(index);
+                return NULL;
+            }
+            run_length = 0;
+        }
+        i++;
+    }
+    if (run_length > 0 && insert_extent(index, run_start, run_length) != 0) {
+        extent_index_destroy(index);
+        return NULL;
+    }
+
+    return index;
+}
+
+static void destroy_nodes(ExtentNode *node) {
+    if (!node) return;
+    destroy_nodes(node->off_left);
+    destroy_nodes(node->off_right);
+    free(node);
+}
+
+void extent_index_destroy(ExtentIndex *index) {
+    if (!index) return;
+    destroy_nodes(index->by_offset);
+    free(index);
+}
+
+/* ============================================
+   CONSULTAS
+   ============================================ */
+
+int64_t extent_index_first_fit(ExtentIndex *index, uint64_t num_blocks) {
+    index->last_scan = 0;
+    if (num_blocks == 0) return -1;
+
+    // Desce sempre pelo ramo mais à esquerda que ainda comporta o pedido
+    ExtentNode *node = index->by_offset;
+    while (node && node->max_length >= num_blocks) {
+        index->last_scan++;
+        if (node_max(node->off_left) >= num_blocks) {
+            node = node->off_left;
+        } else if (node->length >= num_blocks) {
+            return (int64_t)node->start;
+        } else {
+            node = node->off_right;
+        }
+    }
+    return -1;
+}
+
+int64_t extent_index_best_fit(ExtentIndex *index, uint64_t num_blocks) {
+    index->last_scan = 0;
+    if (num_blocks == 0) return -1;
+
+    // Menor (tamanho, início) com tamanho >= num_blocks
+    ExtentNode *node = index->by_size;
+    ExtentNode *best = NULL;
+    while (node) {
+        index->last_scan++;
+        if (node->length >= num_blocks) {
+            best = node;
+            node = node->size_left;
+        } else {
+            node = node->size_right;
+        }
+    }
+    return best ? (int64_t)best->start : -1;
+}
+
+int extent_index_is_free(const ExtentIndex *index, uint64_t start, uint64_t num_blocks) {
+    ExtentNode *node = find_predecessor(index, start);
+    return node && start + num_blocks <= node->start + node->length;
+}
+
+/* Extensão livre que contém block; retorna -1 se o bloco está ocupado */
+int extent_index_containing(const ExtentIndex *index, uint64_t block,
+                            uint64_t *start, uint64_t *length) {
+    ExtentNode *node = find_predecessor(index, block);
+    if (!node || block >= node->start + node->length) {
+        return -1;
+    }
+    *start = node->start;
+    *length = node->length;
+    return 0;
+}
+
+uint64_t extent_index_largest(const ExtentIndex *index) {
+    return node_max(index->by_offset);
+}
+
+/* ============================================
+   ATUALIZAÇÃO
+   ============================================ */
+
+int extent_index_allocate(ExtentIndex *index, uint64_t start, uint64_t num_blocks) {
+    if (num_blocks == 0) return 0;
+
+    ExtentNode *node = find_predecessor(index, start);
+    if (!node || start + num_blocks > node->start + node->length) {
+        return -1; // Trecho não está inteiramente livre
+    }
+
+    uint64_t ext_start = node->start;
+    uint64_t ext_end = node->start + node->length;
+    remove_extent(index, node);
+
+    // Devolve as sobras à esquerda e à direita do trecho alocado
+    if (ext_start < start && insert_extent(index, ext_start, start - ext_start) != 0) {
+        return -1;
+    }
+    if (start + num_blocks < ext_end &&
+        insert_extent(index, start + num_blocks, ext_end - (start + num_blocks)) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int extent_index_release(ExtentIndex *index, uint64_t start, uint64_t num_blocks) {
+    if (num_blocks == 0) return 0;
+
+    uint64_t new_start = start;
+    uint64_t new_end = start + num_blocks;
+
+    ExtentNode *prev = find_predecessor(index, start);
+    ExtentNode *next = find_successor(index, start);
+    if ((prev && prev->start + prev->length > start) || (next && next->start < new_end)) {
+        return -1; // Trecho já estava (parcialmente) livre
+    }
+
+    // Coalesce com as extensões livres imediatamente vizinhas
+    if (prev && prev->start + prev->length == start) {
+        new_start = prev->start;
+        remove_extent(index, prev);
+    }
+    if (next && next->start == new_end) {
+        new_end = next->start + next->length;
+        remove_extent(index, next);
+    }
+
+    return insert_extent(index, new_start, new_end - new_start);
+}
+
+/* ============================================
+   PERCURSO
+   ============================================ */
+
+static void visit_nodes(const ExtentNode *node, ExtentVisitor visit, void *ctx) {
+    if (!node) return;
+    visit_nodes(node->off_left, visit, ctx);
+    visit(node->start, node->length, ctx);
+    visit_nodes(node->off_right, visit, ctx);
+}
+
+void extent_index_foreach(const ExtentIndex *index, ExtentVisitor visit, void *ctx) {
+    visit_nodes(index->by_offset, visit, ctx);
+}
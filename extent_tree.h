@@ -0,0 +1,58 @@
+#ifndef EXTENT_TREE_H
+#define EXTENT_TREE_H
+
+#include <stdint.h>
+
+/* ============================================
+   ÍNDICE DE EXTENSÕES LIVRES
+   ============================================ */
+
+/* Cada trecho contíguo de blocos livres é um nó presente em duas treaps:
+   uma ordenada por bloco inicial (com o maior tamanho da subárvore, para
+   first-fit e coalescência com os vizinhos) e outra ordenada por
+   (tamanho, bloco inicial), para best-fit. Todas as operações são
+   O(log n) no número de extensões livres. */
+
+typedef struct ExtentNode {
+    uint64_t start;                 // Primeiro bloco livre
+    uint64_t length;                // Quantidade de blocos livres
+    uint64_t max_length;            // Maior extensão na subárvore (offset)
+    uint32_t priority;              // Prioridade da treap
+    struct ExtentNode *off_left;    // Árvore ordenada por bloco inicial
+    struct ExtentNode *off_right;
+    struct ExtentNode *size_left;   // Árvore ordenada por tamanho
+    struct ExtentNode *size_right;
+} ExtentNode;
+
+typedef struct {
+    ExtentNode *by_offset;          // Raiz da árvore por bloco inicial
+    ExtentNode *by_size;            // Raiz da árvore por tamanho
+    uint64_t extent_count;          // Número de extensões livres
+    uint64_t free_blocks;           // Soma dos tamanhos
+    uint32_t seed;                  // Estado do gerador de prioridades
+    uint64_t last_scan;             // Nós visitados pela última consulta de fit
+} ExtentIndex;
+
+/* Construção e destruição */
+ExtentIndex* extent_index_build(const uint8_t *bitmap, uint64_t first_bit, uint64_t total_bits);
+void extent_index_destroy(ExtentIndex *index);
+
+/* Consultas: retornam o bloco inicial ou -1 (first/best fit registram em
+   last_scan quantos nós visitaram) */
+int64_t extent_index_first_fit(ExtentIndex *index, uint64_t num_blocks);
+int64_t extent_index_best_fit(ExtentIndex *index, uint64_t num_blocks);
+int extent_index_is_free(const ExtentIndex *index, uint64_t start, uint64_t num_blocks);
+int extent_index_containing(const ExtentIndex *index, uint64_t block,
+                            uint64_t *start, uint64_t *length);
+uint64_t extent_index_largest(const ExtentIndex *index);
+
+/* Atualização: allocate retira um trecho livre, release devolve e
+   coalesce com os vizinhos */
+int extent_index_allocate(ExtentIndex *index, uint64_t start, uint64_t num_blocks);
+int extent_index_release(ExtentIndex *index, uint64_t start, uint64_t num_blocks);
+
+/* Percorre as extensões em ordem de bloco inicial */
+typedef void (*ExtentVisitor)(uint64_t start, uint64_t length, void *ctx);
+void extent_index_foreach(const ExtentIndex *index, ExtentVisitor visit, void *ctx);
+
+#endif // EXTENT_TREE_H
@@ -1,7 +1,50 @@
+#define _GNU_SOURCE
+
 #include "filesystem.h"
+#include "lz.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdarg.h>
+
+/* ============================================
+   MENSAGENS
+   ============================================ */
+
+/* Nível das mensagens das funções fs_* (global: fs_format e fs_mount
+   ainda não têm um FileSystem). A formatação só acontece quando o nível
+   permite. */
+static FsVerbosity verbosity = FS_VERBOSITY_NORMAL;
+
+/* Informação de andamento: "arquivo criado", "montado"... */
+static void log_info(const char *format, ...) __attribute__((format(printf, 1, 2)));
+static void log_info(const char *format, ...) {
+    if (verbosity < FS_VERBOSITY_NORMAL) return;
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+/* Erros e avisos */
+static void log_error(const char *format, ...) __attribute__((format(printf, 1, 2)));
+static void log_error(const char *format, ...) {
+    if (verbosity < FS_VERBOSITY_ERRORS) return;
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+void fs_set_verbosity(FsVerbosity level) {
+    verbosity = level;
+}
 
 /* ============================================
    FUNÇÕES AUXILIARES - BITMAP
@@ -25,11 +68,179 @@ void bitmap_clear_bit(uint8_t *bitmap, uint64_t bit_index) {
     bitmap[byte_index] &= ~(1 << bit_offset);
 }
 
+/* Marca/desmarca um trecho inteiro: bits soltos nas pontas e memset nos
+   bytes completos do meio. */
+void bitmap_set_range(uint8_t *bitmap, uint64_t start, uint64_t count) {
+    uint64_t end = start + count;
+    uint64_t i = start;
+    while (i < end && i % 8 != 0) {
+        bitmap_set_bit(bitmap, i++);
+    }
+    if (end - i >= 8) {
+        memset(bitmap + i / 8, 0xFF, (end - i) / 8);
+        i += ((end - i) / 8) * 8;
+    }
+    while (i < end) {
+        bitmap_set_bit(bitmap, i++);
+    }
+}
+
+void bitmap_clear_range(uint8_t *bitmap, uint64_t start, uint64_t count) {
+    uint64_t end = start + count;
+    uint64_t i = start;
+    while (i < end && i % 8 != 0) {
+        bitmap_clear_bit(bitmap, i++);
+    }
+    if (end - i >= 8) {
+        memset(bitmap + i / 8, 0x00, (end - i) / 8);
+        i += ((end - i) / 8) * 8;
+    }
+    while (i < end) {
+        bitmap_clear_bit(bitmap, i++);
+    }
+}
+
+/* Contagem de bits: usa os builtins do GCC/Clang quando disponíveis e
+   cai para versões portáveis nos demais compiladores. */
+#if defined(__GNUC__) || defined(__clang__)
+#define bit_ctz64(x) ((unsigned)__builtin_ctzll(x))
+#define bit_clz64(x) ((unsigned)__builtin_clzll(x))
+#define bit_popcount64(x) ((unsigned)__builtin_popcountll(x))
+#else
+static unsigned bit_ctz64(uint64_t x) {
+    unsigned n = 0;
+    while (!(x & 1)) { x >>= 1; n++; }
+    return n;
+}
+
+static unsigned bit_clz64(uint64_t x) {
+    unsigned n = 0;
+    while (!(x & (1ULL << 63))) { x <<= 1; n++; }
+    return n;
+}
+
+static unsigned bit_popcount64(uint64_t x) {
+    unsigned n = 0;
+    while (x) { x &= x - 1; n++; }
+    return n;
+}
+#endif
+
+/* Carrega a palavra de 64 bits de índice word_index do bitmap. O bit i do
+   bitmap fica no bit (i % 64) da palavra, independente da ordem de bytes
+   da máquina. Bytes além de total_bits são lidos como zero. */
+static uint64_t bitmap_load_word(const uint8_t *bitmap, uint64_t total_bits, uint64_t word_index) {
+    uint64_t first_byte = word_index * 8;
+    uint64_t total_bytes = (total_bits + 7) / 8;
+    uint64_t count = total_bytes - first_byte < 8 ? total_bytes - first_byte : 8;
+    uint64_t word = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        word |= ((uint64_t)bitmap[first_byte + i]) << (i * 8);
+    }
+    return word;
+}
+
+/* Busca first-fit percorrendo o bitmap 64 bits por vez. Palavras cheias
+   são puladas inteiras; dentro de uma palavra, ctz salta direto para o
+   próximo trecho livre e mede seu tamanho. Quando a palavra tem menos bits
+   livres que o pedido (popcount), só o trecho livre no topo (clz) pode
+   fazer parte da resposta. */
+int64_t bitmap_find_contiguous_from(const uint8_t *bitmap, uint64_t total_bits,
+                                    uint64_t num_blocks, uint64_t first_bit) {
+    if (num_blocks == 0 || first_bit >= total_bits) {
+        return -1;
+    }
+    
+    uint64_t run = 0;
+    uint64_t start = 0;
+    uint64_t num_words = (total_bits + 63) / 64;
+    
+    for (uint64_t w = first_bit / 64; w < num_words; w++) {
+        uint64_t base = w * 64;
+        uint64_t free_bits = ~bitmap_load_word(bitmap, total_bits, w);
+        
+        // Ignora bits antes de first_bit e depois do fim do bitmap
+        if (base < first_bit) {
+            free_bits &= ~0ULL << (first_bit - base);
+        }
+        if (total_bits - base < 64) {
+            free_bits &= (1ULL << (total_bits - base)) - 1;
+        }
+        
+        if (free_bits == ~0ULL) {
+            // Palavra totalmente livre
+            if (run == 0) {
+                start = base;
+            }
+            run += 64;
+            if (run >= num_blocks) {
+                return start;
+            }
+            continue;
+        }
+        
+        if (free_bits == 0) {
+            // Palavra totalmente ocupada
+            run = 0;
+            continue;
+        }
+        
+        unsigned pos = 0;
+        if (run > 0) {
+            // Continua o trecho que veio da palavra anterior
+            pos = bit_ctz64(~free_bits);
+            run += pos;
+            if (run >= num_blocks) {
+                return start;
+            }
+            run = 0;
+        }
+        
+        uint64_t rest = free_bits >> pos;
+        if (bit_popcount64(rest) < num_blocks) {
+            // Nenhum trecho interno basta: só o topo pode continuar
+            unsigned top = bit_clz64(~free_bits);
+            if (top > 0) {
+                start = base + 64 - top;
+                run = top;
+            }
+            continue;
+        }
+        
+        while (rest != 0) {
+            pos += bit_ctz64(rest);
+            rest = free_bits >> pos;
+            unsigned len = bit_ctz64(~rest);
+            if (len >= num_blocks) {
+                return base + pos;
+            }
+            if (pos + len == 64) {
+                // Trecho chega ao topo: pode continuar na próxima palavra
+                start = base + pos;
+                run = len;
+                break;
+            }
+            pos += len;
+            rest = free_bits >> pos;
+        }
+    }
+    
+    return -1; // Não encontrou espaço contíguo suficiente
+}
+
+/* Busca no bitmap inteiro: os blocos de metadados estão marcados como
+   ocupados */
 int64_t bitmap_find_contiguous(uint8_t *bitmap, uint64_t total_bits, uint64_t num_blocks) {
+    return bitmap_find_contiguous_from(bitmap, total_bits, num_blocks, 0);
+}
+
+/* Versão original, bit a bit. Mantida como referência de corretude e de
+   desempenho para o benchmark. */
+int64_t bitmap_find_contiguous_bitwise(uint8_t *bitmap, uint64_t total_bits, uint64_t num_blocks) {
     uint64_t count = 0;
     uint64_t start = 0;
     
-    for (uint64_t i = DATA_START; i < total_bits; i++) {
+    for (uint64_t i = 0; i < total_bits; i++) {
         if (bitmap_get_bit(bitmap, i) == 0) {
             if (count == 0) {
                 start = i;
@@ -46,31 +257,120 @@ int64_t bitmap_find_contiguous(uint8_t *bitmap, uint64_t total_bits, uint64_t nu
     return -1; // Não encontrou espaço contíguo suficiente
 }
 
+/* Conta os blocos livres em [first_bit, total_bits) usando popcount. */
+uint64_t bitmap_count_free(const uint8_t *bitmap, uint64_t total_bits, uint64_t first_bit) {
+    uint64_t count = 0;
+    uint64_t num_words = (total_bits + 63) / 64;
+    
+    for (uint64_t w = first_bit / 64; w < num_words; w++) {
+        uint64_t base = w * 64;
+        uint64_t free_bits = ~bitmap_load_word(bitmap, total_bits, w);
+        if (base < first_bit) {
+            free_bits &= ~0ULL << (first_bit - base);
+        }
+        if (total_bits - base < 64) {
+            free_bits &= (1ULL << (total_bits - base)) - 1;
+        }
+        count += bit_popcount64(free_bits);
+    }
+    return count;
+}
+
 /* ============================================
    FUNÇÕES AUXILIARES - BLOCOS
    ============================================ */
 
-int block_read(FILE *disk, uint64_t block_num, void *buffer) {
-    if (fseek(disk, block_num * BLOCK_SIZE, SEEK_SET) != 0) {
+/* Acesso bloco a bloco via stdio: caminho original, mantido como
+   referência para o benchmark de vazão. */
+int block_read(FILE *disk, uint32_t block_size, uint64_t block_num, void *buffer) {
+    if (fseeko(disk, (off_t)(block_num * block_size), SEEK_SET) != 0) {
         return -1;
     }
-    if (fread(buffer, BLOCK_SIZE, 1, disk) != 1) {
+    if (fread(buffer, block_size, 1, disk) != 1) {
         return -1;
     }
     return 0;
 }
 
-int block_write(FILE *disk, uint64_t block_num, const void *buffer) {
-    if (fseek(disk, block_num * BLOCK_SIZE, SEEK_SET) != 0) {
+int block_write(FILE *disk, uint32_t block_size, uint64_t block_num, const void *buffer) {
+    if (fseeko(disk, (off_t)(block_num * block_size), SEEK_SET) != 0) {
         return -1;
     }
-    if (fwrite(buffer, BLOCK_SIZE, 1, disk) != 1) {
+    if (fwrite(buffer, block_size, 1, disk) != 1) {
         return -1;
     }
     fflush(disk);
     return 0;
 }
 
+/* pread/pwrite que repetem em transferências parciais e interrupções */
+static int pread_full(int fd, void *buffer, uint64_t size, uint64_t offset) {
+    uint8_t *ptr = buffer;
+    while (size > 0) {
+        ssize_t n = pread(fd, ptr, size, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        ptr += n;
+        size -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+static int pwrite_full(int fd, const void *buffer, uint64_t size, uint64_t offset) {
+    const uint8_t *ptr = buffer;
+    while (size > 0) {
+        ssize_t n = pwrite(fd, ptr, size, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        ptr += n;
+        size -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+/* Transferência de uma extensão inteira a partir de start_block numa
+   única chamada ao sistema. A leitura devolve exatamente size bytes; a
+   escrita completa o último bloco com zeros usando pwritev, sem copiar os
+   dados para um buffer intermediário. Nenhuma das duas força a descarga:
+   isso fica para os pontos de sincronização (fs_sync, fs_unmount). */
+int block_read_range(int fd, uint32_t block_size, uint64_t start_block, void *buffer, uint64_t size) {
+    return pread_full(fd, buffer, size, start_block * block_size);
+}
+
+int block_write_range(int fd, uint32_t block_size, uint64_t start_block, const void *data, uint64_t size) {
+    static const uint8_t zero_pad[FS_MAX_BLOCK_SIZE];
+    uint64_t offset = start_block * block_size;
+    uint64_t padding = (block_size - size % block_size) % block_size;
+    
+    if (padding == 0) {
+        return pwrite_full(fd, data, size, offset);
+    }
+    
+    struct iovec iov[2] = {
+        { (void *)data, size },
+        { (void *)zero_pad, padding }
+    };
+    ssize_t n;
+    do {
+        n = pwritev(fd, iov, 2, offset);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        return -1;
+    }
+    
+    // Escrita parcial: completa o que faltou com pwrite
+    uint64_t written = (uint64_t)n;
+    if (written < size) {
+        if (pwrite_full(fd, (const uint8_t *)data + written, size - written, offset + written) != 0) {
+            return -1;
+        }
+        written = size;
+    }
+    return pwrite_full(fd, zero_pad + (written - size), size + padding - written, offset + written);
+}
+
 /* ============================================
    FUNÇÕES AUXILIARES - CONVERSÃO
    ============================================ */
@@ -89,14 +389,29 @@ void array_to_bytes(uint64_t value, uint8_t *array, int size) {
     }
 }
 
-void metadata_to_entry(const FileMetadata *meta, FileEntry *entry) {
+void metadata_to_entry(const FileMetadata *meta, FileEntry *entry, uint32_t block_size) {
     memcpy(entry->name, meta->name, MAX_FILENAME_LENGTH);
     entry->name[MAX_FILENAME_LENGTH] = '\0';
     
-    entry->type = (FileType)bytes_to_array(meta->type, 3);
+    entry->type = (FileType)(meta->type & ~(META_TYPE_COMPRESSED | META_TYPE_EXTENTS));
+    entry->compressed = (meta->type & META_TYPE_COMPRESSED) != 0;
     entry->size_blocks = bytes_to_array(meta->size, 6);
-    entry->size_bytes = entry->size_blocks * BLOCK_SIZE;
-    entry->start_block = bytes_to_array(meta->location, 8);
+    
+    // O último bloco guarda só tail_bytes bytes úteis (0 = bloco cheio,
+    // que é também o significado nos discos da versão antiga)
+    uint64_t tail = bytes_to_array(meta->tail_bytes, 2);
+    entry->size_bytes = entry->size_blocks * block_size;
+    if (entry->size_blocks > 0 && tail > 0) {
+        entry->size_bytes -= block_size - tail;
+    }
+    // Arquivo em várias extensões: location é o mapa, lido na montagem
+    if (meta->type & META_TYPE_EXTENTS) {
+        entry->map_block = bytes_to_array(meta->location, 8);
+        entry->start_block = 0;
+    } else {
+        entry->map_block = 0;
+        entry->start_block = bytes_to_array(meta->location, 8);
+    }
     entry->owner = (uint8_t)bytes_to_array(meta->owner, 3);
     entry->permission = (FilePermission)bytes_to_array(meta->permission, 3);
     entry->last_modified = meta->last_modified;
@@ -105,13 +420,15 @@ void metadata_to_entry(const FileMetadata *meta, FileEntry *entry) {
     entry->is_used = (meta->name[0] != '\0');
 }
 
-void entry_to_metadata(const FileEntry *entry, FileMetadata *meta) {
+void entry_to_metadata(const FileEntry *entry, FileMetadata *meta, uint32_t block_size) {
     memset(meta, 0, sizeof(FileMetadata));
     memcpy(meta->name, entry->name, MAX_FILENAME_LENGTH);
     
-    array_to_bytes(entry->type, meta->type, 3);
+    meta->type = (uint8_t)entry->type | (entry->compressed ? META_TYPE_COMPRESSED : 0) |
+                 (entry->map_block ? META_TYPE_EXTENTS : 0);
+    array_to_bytes(entry->size_bytes % block_size, meta->tail_bytes, 2);
     array_to_bytes(entry->size_blocks, meta->size, 6);
-    array_to_bytes(entry->start_block, meta->location, 8);
+    array_to_bytes(entry->map_block ? entry->map_block : entry->start_block, meta->location, 8);
     array_to_bytes(entry->owner, meta->owner, 3);
     array_to_bytes(entry->permission, meta->permission, 3);
     meta->last_modified = entry->last_modified;
@@ -144,438 +461,5203 @@ const char* permission_to_string(FilePermission perm) {
 }
 
 /* ============================================
-   FORMATAÇÃO DO SISTEMA DE ARQUIVOS
+   MEDIÇÃO DE TEMPO
    ============================================ */
 
-int fs_format(const char *disk_path) {
-    FILE *disk = fopen(disk_path, "wb");
-    if (!disk) {
-        printf("Erro: Não foi possível criar o disco virtual.\n");
-        return -1;
-    }
-    
-    // Cria um disco vazio
-    uint8_t *zero_block = calloc(1, BLOCK_SIZE);
-    for (int i = 0; i < TOTAL_BLOCKS; i++) {
-        fwrite(zero_block, BLOCK_SIZE, 1, disk);
-    }
-    free(zero_block);
-    
-    // Cria o superbloco
-    Superblock sb;
-    memset(&sb, 0, sizeof(Superblock));
-    strcpy(sb.signature, "UNIOESTE");
-    sb.block_size = BLOCK_SIZE;
-    sb.total_blocks = TOTAL_BLOCKS;
-    sb.free_blocks = TOTAL_BLOCKS - DATA_START;
-    sb.bitmap_start = BITMAP_START;
-    sb.root_dir_start = ROOT_DIR_START;
-    sb.data_start = DATA_START;
-    sb.max_files = MAX_FILES;
-    sb.current_files = 0;
-    
-    fseek(disk, 0, SEEK_SET);
-    fwrite(&sb, sizeof(Superblock), 1, disk);
-    
-    // Inicializa o bitmap (marca blocos do sistema como ocupados)
-    uint8_t *bitmap = calloc(BITMAP_BLOCKS * BLOCK_SIZE, 1);
-    for (int i = 0; i < DATA_START; i++) {
-        bitmap_set_bit(bitmap, i);
-    }
-    
-    fseek(disk, BITMAP_START * BLOCK_SIZE, SEEK_SET);
-    fwrite(bitmap, BITMAP_BLOCKS * BLOCK_SIZE, 1, disk);
-    free(bitmap);
-    
-    // Inicializa o diretório raiz (vazio)
-    uint8_t *root_dir = calloc(ROOT_DIR_BLOCKS * BLOCK_SIZE, 1);
-    fseek(disk, ROOT_DIR_START * BLOCK_SIZE, SEEK_SET);
-    fwrite(root_dir, ROOT_DIR_BLOCKS * BLOCK_SIZE, 1, disk);
-    free(root_dir);
-    
-    fclose(disk);
-    printf("Sistema de arquivos formatado com sucesso!\n");
-    printf("Tamanho total: %d blocos (%d MB)\n", TOTAL_BLOCKS, 
-           (TOTAL_BLOCKS * BLOCK_SIZE) / (1024 * 1024));
-    printf("Área de dados: %d blocos\n", TOTAL_BLOCKS - DATA_START);
-    return 0;
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Soma a counter o tempo decorrido desde start */
+static void time_since(uint64_t *counter, uint64_t start) {
+    *counter += clock_ns() - start;
 }
 
+/* Etapas da operação pública em andamento e quantas estão aninhadas. São
+   por thread: no modo concorrente várias operações medem ao mesmo tempo. */
+static _Thread_local OpTiming op_timing;
+static _Thread_local int op_depth;
+
 /* ============================================
-   MONTAGEM E DESMONTAGEM
+   CONCORRÊNCIA
    ============================================ */
 
-FileSystem* fs_mount(const char *disk_path) {
-    FileSystem *fs = malloc(sizeof(FileSystem));
-    if (!fs) {
-        printf("Erro: Falha ao alocar memória para o sistema de arquivos.\n");
-        return NULL;
-    }
-    
-    // Abre o disco
-    fs->disk_file = fopen(disk_path, "r+b");
-    if (!fs->disk_file) {
-        printf("Erro: Não foi possível abrir o disco virtual.\n");
-        free(fs);
-        return NULL;
-    }
-    
-    // Lê o superbloco
-    fseek(fs->disk_file, 0, SEEK_SET);
-    if (fread(&fs->superblock, sizeof(Superblock), 1, fs->disk_file) != 1) {
-        printf("Erro: Falha ao ler o superbloco.\n");
-        fclose(fs->disk_file);
-        free(fs);
-        return NULL;
-    }
-    
-    // Verifica a assinatura
-    if (strncmp(fs->superblock.signature, "UNIOESTE", 8) != 0) {
-        printf("Erro: Assinatura inválida. Disco não formatado?\n");
-        fclose(fs->disk_file);
-        free(fs);
-        return NULL;
-    }
-    
-    // Carrega o bitmap
-    fs->bitmap = malloc(BITMAP_BLOCKS * BLOCK_SIZE);
-    fseek(fs->disk_file, BITMAP_START * BLOCK_SIZE, SEEK_SET);
-    if (fread(fs->bitmap, BITMAP_BLOCKS * BLOCK_SIZE, 1, fs->disk_file) != 1) {
-        printf("Erro: Falha ao ler o bitmap.\n");
-        fclose(fs->disk_file);
-        free(fs);
-        return NULL;
-    }
-    
-    // Carrega a tabela de arquivos
-    fs->file_table = calloc(MAX_FILES, sizeof(FileEntry));
-    uint8_t *root_dir_data = malloc(ROOT_DIR_BLOCKS * BLOCK_SIZE);
-    fseek(fs->disk_file, ROOT_DIR_START * BLOCK_SIZE, SEEK_SET);
-    fread(root_dir_data, ROOT_DIR_BLOCKS * BLOCK_SIZE, 1, fs->disk_file);
-    
-    for (int i = 0; i < MAX_FILES; i++) {
-        FileMetadata *meta = (FileMetadata *)(root_dir_data + i * METADATA_SIZE);
-        metadata_to_entry(meta, &fs->file_table[i]);
+/* Locks do modo concorrente (fs_set_concurrent). Operações que só leem
+   (leituras, listagens, estatísticas) entram juntas com o lock
+   compartilhado; as que alteram o disco ou a memória do sistema de
+   arquivos (escritas, alocação, journal, sincronização) entram sozinhas
+   com o exclusivo. Uma operação pública chamada por outra na mesma
+   thread já está coberta pelo lock da externa. */
+static _Thread_local int lock_depth;
+
+static void fs_lock(FileSystem *fs, int exclusive) {
+    if (!fs->concurrent || lock_depth++ > 0) return;
+    if (exclusive) {
+        pthread_rwlock_wrlock(&fs->lock);
+    } else {
+        pthread_rwlock_rdlock(&fs->lock);
     }
-    free(root_dir_data);
-    
-    fs->current_user = 0; // Root por padrão
-    
-    printf("Sistema de arquivos montado com sucesso!\n");
-    printf("Arquivos presentes: %d/%d\n", fs->superblock.current_files, MAX_FILES);
-    printf("Blocos livres: %d/%d\n", fs->superblock.free_blocks, 
-           TOTAL_BLOCKS - DATA_START);
-    
-    return fs;
 }
 
-int fs_unmount(FileSystem *fs) {
+static void fs_unlock(FileSystem *fs) {
+    if (!fs->concurrent || --lock_depth > 0) return;
+    pthread_rwlock_unlock(&fs->lock);
+}
+
+/* Os contadores de op_stats são atualizados também por leitores, que
+   entram juntos: têm trava própria */
+static void op_stats_lock(FileSystem *fs) {
+    if (fs->concurrent) pthread_mutex_lock(&fs->stats_lock);
+}
+
+static void op_stats_unlock(FileSystem *fs) {
+    if (fs->concurrent) pthread_mutex_unlock(&fs->stats_lock);
+}
+
+/* Liga o modo concorrente. Deve ser chamada sem nenhuma operação em
+   andamento; desligado (padrão), nenhum lock é tomado. */
+int fs_set_concurrent(FileSystem *fs, int enabled) {
     if (!fs) return -1;
-    
-    // Salva o superbloco
-    fseek(fs->disk_file, 0, SEEK_SET);
-    fwrite(&fs->superblock, sizeof(Superblock), 1, fs->disk_file);
-    
-    // Salva o bitmap
-    fseek(fs->disk_file, BITMAP_START * BLOCK_SIZE, SEEK_SET);
-    fwrite(fs->bitmap, BITMAP_BLOCKS * BLOCK_SIZE, 1, fs->disk_file);
-    
-    // Salva o diretório raiz
-    uint8_t *root_dir_data = calloc(ROOT_DIR_BLOCKS * BLOCK_SIZE, 1);
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (fs->file_table[i].is_used) {
-            FileMetadata meta;
-            entry_to_metadata(&fs->file_table[i], &meta);
-            memcpy(root_dir_data + i * METADATA_SIZE, &meta, METADATA_SIZE);
-        }
+    fs->concurrent = enabled != 0;
+    if (fs->cache) {
+        cache_set_concurrent(fs->cache, fs->concurrent);
     }
-    fseek(fs->disk_file, ROOT_DIR_START * BLOCK_SIZE, SEEK_SET);
-    fwrite(root_dir_data, ROOT_DIR_BLOCKS * BLOCK_SIZE, 1, fs->disk_file);
-    free(root_dir_data);
-    
-    // Libera recursos
-    fclose(fs->disk_file);
-    free(fs->bitmap);
-    free(fs->file_table);
-    free(fs);
-    
-    printf("Sistema de arquivos desmontado com sucesso!\n");
     return 0;
 }
 
 /* ============================================
-   OPERAÇÕES COM ARQUIVOS
+   ACESSO AO DISCO MONTADO
    ============================================ */
 
-int fs_create(FileSystem *fs, const char *name, FileType type, FilePermission perm) {
-    if (!fs || !name) return -1;
-    
-    // Verifica tamanho do nome
-    if (strlen(name) > MAX_FILENAME_LENGTH) {
-        printf("Erro: Nome muito longo (máximo %d caracteres).\n", MAX_FILENAME_LENGTH);
-        return -1;
+/* Leitura/escrita de bytes do disco montado a partir de um deslocamento
+   absoluto. No modo mapeado em memória a transferência é um memcpy
+   direto sobre o mapeamento; no modo normal passa pelo cache de blocos
+   (quando ligado) ou usa pread/pwrite; com direct, a transferência
+   passa ao largo do cache mesmo sendo pequena. O tempo gasto entra em
+   op_timing.io_ns. */
+static int disk_read_at(FileSystem *fs, uint64_t offset, void *buffer, uint64_t size, int direct) {
+    uint64_t start = clock_ns();
+    int result = 0;
+    if (fs->disk_map) {
+        memcpy(buffer, fs->disk_map + offset, size);
+    } else if (fs->cache) {
+        result = direct ? cache_read_direct(fs->cache, offset, buffer, size)
+                        : cache_read(fs->cache, offset, buffer, size);
+    } else {
+        result = pread_full(fs->disk_fd, buffer, size, offset);
     }
-    
-    // Verifica se já existe
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (fs->file_table[i].is_used && 
-            strcmp(fs->file_table[i].name, name) == 0) {
-            printf("Erro: Arquivo '%s' já existe.\n", name);
-            return -1;
-        }
+    time_since(&op_timing.io_ns, start);
+    return result;
+}
+
+static int disk_write_at(FileSystem *fs, uint64_t offset, const void *data, uint64_t size,
+                         int direct) {
+    uint64_t start = clock_ns();
+    int result = 0;
+    if (fs->disk_map) {
+        memcpy(fs->disk_map + offset, data, size);
+    } else if (fs->cache) {
+        result = direct ? cache_write_direct(fs->cache, offset, data, size)
+                        : cache_write(fs->cache, offset, data, size);
+    } else {
+        result = pwrite_full(fs->disk_fd, data, size, offset);
     }
-    
-    // Procura entrada livre
-    int free_entry = -1;
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (!fs->file_table[i].is_used) {
-            free_entry = i;
-            break;
+    time_since(&op_timing.io_ns, start);
+    return result;
+}
+
+/* Extensões a partir de um bloco; a escrita completa o último bloco com
+   zeros */
+static int disk_read(FileSystem *fs, uint64_t start_block, void *buffer, uint64_t size) {
+    return disk_read_at(fs, start_block * fs->layout.block_size, buffer, size, 0);
+}
+
+static int disk_write(FileSystem *fs, uint64_t start_block, const void *data, uint64_t size) {
+    uint64_t start = clock_ns();
+    uint64_t padding = (fs->layout.block_size - size % fs->layout.block_size) % fs->layout.block_size;
+    int result = 0;
+    if (fs->disk_map) {
+        uint8_t *dest = fs->disk_map + start_block * fs->layout.block_size;
+        memcpy(dest, data, size);
+        memset(dest + size, 0, padding);
+    } else if (fs->cache) {
+        static const uint8_t zero_pad[FS_MAX_BLOCK_SIZE];
+        uint64_t offset = start_block * fs->layout.block_size;
+        result = cache_write(fs->cache, offset, data, size);
+        if (result == 0) {
+            result = cache_write(fs->cache, offset + size, zero_pad, padding);
         }
+    } else {
+        result = block_write_range(fs->disk_fd, fs->layout.block_size, start_block, data, size);
     }
-    
-    if (free_entry == -1) {
-        printf("Erro: Número máximo de arquivos atingido.\n");
-        return -1;
+    time_since(&op_timing.io_ns, start);
+    return result;
+}
+
+/* Preenche com zeros size bytes a partir de offset */
+static int disk_zero_at(FileSystem *fs, uint64_t offset, uint64_t size, int direct) {
+    static const uint8_t zeros[64 * 1024];
+    while (size > 0) {
+        uint64_t chunk = size < sizeof(zeros) ? size : sizeof(zeros);
+        if (disk_write_at(fs, offset, zeros, chunk, direct) != 0) {
+            return -1;
+        }
+        offset += chunk;
+        size -= chunk;
     }
-    
-    // Cria o arquivo
-    FileEntry *entry = &fs->file_table[free_entry];
-    strcpy(entry->name, name);
-    entry->type = type;
-    entry->size_bytes = 0;
-    entry->size_blocks = 0;
-    entry->start_block = 0;
-    entry->owner = fs->current_user;
-    entry->permission = perm;
-    entry->last_modified = 0;
-    entry->is_used = 1;
-    
-    fs->superblock.current_files++;
-    
-    printf("Arquivo '%s' criado com sucesso.\n", name);
     return 0;
 }
 
-int fs_write(FileSystem *fs, const char *name, const void *data, uint64_t size) {
-    if (!fs || !name || !data || size == 0) return -1;
+/* Cópia feita pelo kernel dentro da imagem (copy_file_range): os dados
+   não passam pelo espaço do usuário e, se o sistema hospedeiro suportar
+   reflink, nem chegam a ser duplicados. Como a cópia ignora o cache, os
+   blocos sujos da origem são gravados antes e os do destino descartados.
+   Retorna 1, sem ter copiado nada, quando o kernel não oferece a
+   operação para este arquivo. */
+static int disk_copy_kernel(FileSystem *fs, uint64_t src_block, uint64_t dest_block, uint64_t size) {
+    uint64_t blocks = (size + fs->layout.block_size - 1) / fs->layout.block_size;
+    if (cache_flush_range(fs->cache, src_block, blocks) != 0) {
+        return -1;
+    }
+    cache_discard(fs->cache, dest_block, blocks);
     
-    // Procura o arquivo
-    int file_index = -1;
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (fs->file_table[i].is_used && 
-            strcmp(fs->file_table[i].name, name) == 0) {
-            file_index = i;
+    uint64_t start = clock_ns();
+    off_t off_in = (off_t)(src_block * fs->layout.block_size);
+    off_t off_out = (off_t)(dest_block * fs->layout.block_size);
+    uint64_t done = 0;
+    int result = 0;
+    while (done < size) {
+        ssize_t n = copy_file_range(fs->disk_fd, &off_in, fs->disk_fd, &off_out, size - done, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (done == 0 && n < 0 &&
+                (errno == ENOSYS || errno == EXDEV || errno == EOPNOTSUPP || errno == EINVAL)) {
+                fs->no_kernel_copy = 1; // Não adianta tentar de novo
+                result = 1;
+            } else {
+                result = -1;
+            }
             break;
         }
+        done += (uint64_t)n;
     }
-    
-    if (file_index == -1) {
-        printf("Erro: Arquivo '%s' não encontrado.\n", name);
-        return -1;
+    time_since(&op_timing.io_ns, start);
+    return result;
+}
+
+/* Copia size bytes entre dois pontos do disco. Trechos disjuntos vão pelo
+   kernel; os sobrepostos (e os sistemas sem copy_file_range) usam pedaços
+   de tamanho fixo, do início para o fim (seguro quando o destino vem
+   antes da origem). A memória usada não depende do tamanho copiado. */
+static int disk_copy(FileSystem *fs, uint64_t src_block, uint64_t dest_block, uint64_t size) {
+    if (size == 0) return 0;
+    if (fs->disk_map) {
+        uint64_t start = clock_ns();
+        memmove(fs->disk_map + dest_block * fs->layout.block_size, fs->disk_map + src_block * fs->layout.block_size, size);
+        time_since(&op_timing.io_ns, start);
+        return 0;
     }
     
-    FileEntry *entry = &fs->file_table[file_index];
-    
-    // Verifica permissão
-    if (entry->owner != fs->current_user && fs->current_user != 0) {
-        if (!(entry->permission & PERM_WRITE)) {
-            printf("Erro: Sem permissão de escrita.\n");
-            return -1;
-        }
+    uint64_t blocks = (size + fs->layout.block_size - 1) / fs->layout.block_size;
+    int disjoint = src_block + blocks <= dest_block || dest_block + blocks <= src_block;
+    if (disjoint && !fs->no_kernel_copy) {
+        int result = disk_copy_kernel(fs, src_block, dest_block, size);
+        if (result != 1) return result;
     }
     
-    // Calcula blocos necessários
-    uint64_t blocks_needed = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint64_t chunk_size = 256 * 1024;
+    uint8_t *buffer = malloc(chunk_size);
+    if (!buffer) return -1;
     
-    // Libera blocos antigos se o arquivo já tinha dados
-    if (entry->size_blocks > 0) {
-        for (uint64_t i = 0; i < entry->size_blocks; i++) {
-            bitmap_clear_bit(fs->bitmap, entry->start_block + i);
+    int result = 0;
+    for (uint64_t done = 0; done < size && result == 0; done += chunk_size) {
+        uint64_t chunk = size - done < chunk_size ? size - done : chunk_size;
+        if (disk_read_at(fs, src_block * fs->layout.block_size + done, buffer, chunk, 0) != 0 ||
+            disk_write_at(fs, dest_block * fs->layout.block_size + done, buffer, chunk, 0) != 0) {
+            result = -1;
         }
-        fs->superblock.free_blocks += entry->size_blocks;
     }
+    free(buffer);
+    return result;
+}
+
+static void journal_append(FileSystem *fs, JournalRecordType type, const void *payload, uint32_t size);
+
+/* Chamado sempre que uma entrada da tabela de arquivos muda: o bloco do
+   diretório que a contém fica marcado para o próximo fs_sync e a imagem
+   nova da entrada vai para o journal */
+static void fs_entry_changed(FileSystem *fs, int index) {
+    uint8_t record[4 + METADATA_SIZE] = {0};
     
-    // Procura espaço contíguo
-    int64_t start_block = bitmap_find_contiguous(fs->bitmap, TOTAL_BLOCKS, blocks_needed);
-    if (start_block == -1) {
-        printf("Erro: Espaço insuficiente no disco.\n");
-        return -1;
+    fs->dir_dirty[(uint64_t)index * METADATA_SIZE / fs->layout.block_size] = 1;
+    fs->entry_generation++;
+    if (fs->fingerprints) {
+        // Conteúdo pode ter mudado: as posições do índice deixam de valer
+        free(fs->fingerprints[index].prints);
+        fs->fingerprints[index].prints = NULL;
+        fs->fingerprints[index].count = 0;
     }
-    
-    // Marca blocos como ocupados
-    for (uint64_t i = 0; i < blocks_needed; i++) {
-        bitmap_set_bit(fs->bitmap, start_block + i);
+    array_to_bytes((uint64_t)index, record, 4);
+    if (fs->file_table[index].is_used) {
+        entry_to_metadata(&fs->file_table[index], (FileMetadata *)(record + 4), fs->layout.block_size);
     }
-    
-    // Escreve os dados
-    uint8_t *buffer = calloc(1, BLOCK_SIZE);
-    const uint8_t *data_ptr = (const uint8_t *)data;
-    
-    for (uint64_t i = 0; i < blocks_needed; i++) {
-        uint64_t bytes_to_write = BLOCK_SIZE;
-        if (i == blocks_needed - 1) {
-            bytes_to_write = size - (i * BLOCK_SIZE);
+    journal_append(fs, JREC_ENTRY, record, sizeof(record));
+}
+
+/* ============================================
+   ALOCAÇÃO DE BLOCOS
+   ============================================ */
+
+/* Blocos liberados só voltam ao índice de extensões livres quando a
+   liberação fica durável (commit do journal ou fs_sync). Até lá, o último
+   estado confirmado ainda aponta para eles: reaproveitados antes, o
+   conteúdo novo poderia chegar ao disco e, depois de uma queda, aparecer
+   no arquivo antigo. No bitmap e em free_blocks a liberação é imediata. */
+static int journal_enabled(const FileSystem *fs);
+static int journal_commit(FileSystem *fs);
+static int sync_filesystem(FileSystem *fs);
+
+static void pending_free_push(FileSystem *fs, uint64_t start, uint64_t num_blocks) {
+    if (fs->pending_count == fs->pending_cap) {
+        uint32_t cap = fs->pending_cap ? fs->pending_cap * 2 : 64;
+        FreeRange *list = realloc(fs->pending_free, cap * sizeof(FreeRange));
+        if (!list) {
+            // Sem memória: o trecho fica fora do índice até a próxima
+            // montagem, que reconstrói o índice a partir do bitmap
+            return;
         }
-        memcpy(buffer, data_ptr + (i * BLOCK_SIZE), bytes_to_write);
-        block_write(fs->disk_file, start_block + i, buffer);
-        memset(buffer, 0, BLOCK_SIZE);
+        fs->pending_free = list;
+        fs->pending_cap = cap;
     }
-    free(buffer);
-    
-    // Atualiza metadados
-    entry->size_bytes = size;
-    entry->size_blocks = blocks_needed;
-    entry->start_block = start_block;
-    entry->last_modified = 1;
-    fs->superblock.free_blocks -= blocks_needed;
-    
-    printf("Dados escritos no arquivo '%s' (%lu bytes, %lu blocos).\n", 
-           name, size, blocks_needed);
-    return 0;
+    fs->pending_free[fs->pending_count].start = start;
+    fs->pending_free[fs->pending_count].count = num_blocks;
+    fs->pending_count++;
 }
 
-int fs_read(FileSystem *fs, const char *name, void *buffer, uint64_t *size) {
+/* Chamado depois de um commit ou fs_sync bem-sucedido */
+static void pending_free_apply(FileSystem *fs) {
+    for (uint32_t i = 0; i < fs->pending_count; i++) {
+        const FreeRange *range = &fs->pending_free[i];
+        if (extent_index_release(fs->free_extents, range->start, range->count) != 0) {
+            log_error("Erro: Trecho liberado já estava no índice de extensões livres (%llu+%llu).\n",
+                      (unsigned long long)range->start, (unsigned long long)range->count);
+        }
+    }
+    fs->pending_count = 0;
+}
+
+/* Sem espaço livre no índice: antecipa o commit para reaproveitar os
+   blocos liberados, desde que a operação em andamento ainda não tenha
+   alterado metadados (o commit só pode acontecer entre operações).
+   Retorna 1 se algum trecho voltou ao índice. */
+static int pending_free_reclaim(FileSystem *fs) {
+    if (fs->pending_count == 0 || fs->op_dirty) {
+        return 0;
+    }
+    int result = journal_enabled(fs) ? journal_commit(fs) : sync_filesystem(fs);
+    return result == 0 && fs->pending_count == 0;
+}
+
+static int64_t find_free_extent(FileSystem *fs, uint64_t num_blocks) {
+    int64_t block;
+    if (fs->alloc_policy == ALLOC_BEST_FIT) {
+        block = extent_index_best_fit(fs->free_extents, num_blocks);
+    } else {
+        block = extent_index_first_fit(fs->free_extents, num_blocks);
+    }
+    op_timing.alloc_scans++;
+    op_timing.alloc_scan_nodes += fs->free_extents->last_scan;
+    return block;
+}
+
+int64_t fs_find_free(FileSystem *fs, uint64_t num_blocks) {
+    uint64_t start = clock_ns();
+    int64_t block = find_free_extent(fs, num_blocks);
+    if (block == -1 && pending_free_reclaim(fs)) {
+        block = find_free_extent(fs, num_blocks);
+    }
+    time_since(&op_timing.alloc_ns, start);
+    return block;
+}
+
+/* Marca os blocos do bitmap que guardam os bits de [start, start + n) e o
+   superbloco (contador de blocos livres) para o próximo fs_sync */
+static void bitmap_mark_dirty(FileSystem *fs, uint64_t start, uint64_t num_blocks) {
+    if (num_blocks == 0) return;
+    uint64_t first = start / 8 / fs->layout.block_size;
+    uint64_t last = (start + num_blocks - 1) / 8 / fs->layout.block_size;
+    memset(fs->bitmap_dirty + first, 1, last - first + 1);
+    fs->superblock_dirty = 1;
+}
+
+static void journal_range(FileSystem *fs, JournalRecordType type, uint64_t start, uint64_t num_blocks) {
+    uint8_t record[16];
+    array_to_bytes(start, record, 8);
+    array_to_bytes(num_blocks, record + 8, 8);
+    journal_append(fs, type, record, sizeof(record));
+}
+
+/* Trecho liberado ainda não confirmado que contém block, ou -1 */
+static int64_t pending_free_find(const FileSystem *fs, uint64_t block) {
+    for (uint32_t i = 0; i < fs->pending_count; i++) {
+        const FreeRange *pending = &fs->pending_free[i];
+        if (block >= pending->start && block < pending->start + pending->count) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Retira [start, start + num_blocks) dos livres: do índice e, para o
+   arquivo que volta a ocupar a própria extensão (sobrescrita no lugar),
+   dos trechos que ele liberou e ainda não foram confirmados. Sem nada
+   alterado se algum bloco estiver ocupado. */
+static int free_space_take(FileSystem *fs, uint64_t start, uint64_t num_blocks) {
+    uint64_t end = start + num_blocks;
+    if (fs->pending_count == 0) {
+        return extent_index_allocate(fs->free_extents, start, num_blocks);
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        uint64_t pos = start;
+        while (pos < end) {
+            int64_t i = pending_free_find(fs, pos);
+            uint64_t piece_end;
+            if (i >= 0) {
+                FreeRange *pending = &fs->pending_free[i];
+                piece_end = pending->start + pending->count < end ? pending->start + pending->count : end;
+                if (pass == 1) {
+                    // Sobra antes do pedaço fica na lista; a depois, num item novo
+                    uint64_t tail_start = piece_end;
+                    uint64_t tail = pending->start + pending->count - piece_end;
+                    pending->count = pos - pending->start;
+                    if (pending->count == 0) {
+                        fs->pending_free[i] = fs->pending_free[--fs->pending_count];
+                    }
+                    if (tail > 0) {
+                        pending_free_push(fs, tail_start, tail);
+                    }
+                }
+            } else {
+                uint64_t free_start, free_length;
+                if (extent_index_containing(fs->free_extents, pos, &free_start, &free_length) != 0) {
+                    return -1;
+                }
+                piece_end = free_start + free_length < end ? free_start + free_length : end;
+                if (pass == 1) {
+                    extent_index_allocate(fs->free_extents, pos, piece_end - pos);
+                }
+            }
+            pos = piece_end;
+        }
+    }
+    return 0;
+}
+
+int fs_alloc_range(FileSystem *fs, uint64_t start, uint64_t num_blocks) {
+    uint64_t begin = clock_ns();
+    if (free_space_take(fs, start, num_blocks) != 0) {
+        return -1;
+    }
+    bitmap_set_range(fs->bitmap, start, num_blocks);
+    bitmap_mark_dirty(fs, start, num_blocks);
+    journal_range(fs, JREC_ALLOC, start, num_blocks);
+    fs->superblock.free_blocks -= num_blocks;
+    time_since(&op_timing.alloc_ns, begin);
+    return 0;
+}
+
+/* Todo o trecho marcado como ocupado no bitmap? Bytes inteiros de uma vez
+   no meio, bit a bit nas pontas. */
+static int bitmap_range_used(const uint8_t *bitmap, uint64_t start, uint64_t count) {
+    uint64_t end = start + count;
+    uint64_t i = start;
+    while (i < end && i % 8 != 0) {
+        if (!((bitmap[i / 8] >> (i % 8)) & 1)) return 0;
+        i++;
+    }
+    for (; end - i >= 8; i += 8) {
+        if (bitmap[i / 8] != 0xFF) return 0;
+    }
+    for (; i < end; i++) {
+        if (!((bitmap[i / 8] >> (i % 8)) & 1)) return 0;
+    }
+    return 1;
+}
+
+/* Liberar blocos que já estão livres (liberação dupla ou sobreposta)
+   corromperia free_blocks, o bitmap e o índice: o pedido é recusado sem
+   alterar nada. */
+int fs_release_range(FileSystem *fs, uint64_t start, uint64_t num_blocks) {
+    if (start < fs->layout.data_start || start + num_blocks < start ||
+        start + num_blocks > fs->superblock.total_blocks ||
+        !bitmap_range_used(fs->bitmap, start, num_blocks)) {
+        log_error("Erro: Liberação de blocos já livres ou fora da área de dados (%llu+%llu).\n",
+                  (unsigned long long)start, (unsigned long long)num_blocks);
+        return -1;
+    }
+    uint64_t begin = clock_ns();
+    cache_discard(fs->cache, start, num_blocks); // Conteúdo não precisa mais ir ao disco
+    bitmap_clear_range(fs->bitmap, start, num_blocks);
+    bitmap_mark_dirty(fs, start, num_blocks);
+    journal_range(fs, JREC_FREE, start, num_blocks);
+    pending_free_push(fs, start, num_blocks);
+    fs->superblock.free_blocks += num_blocks;
+    time_since(&op_timing.alloc_ns, begin);
+    return 0;
+}
+
+/* ============================================
+   ARQUIVOS EM VÁRIAS EXTENSÕES
+   ============================================ */
+
+/* Um arquivo ocupa uma única extensão sempre que há espaço contíguo para
+   ele. Quando não há, o conteúdo é distribuído por várias extensões, em
+   ordem, e a lista vai para um mapa no disco (ver ExtentMapHeader). As
+   transferências percorrem a lista com uma chamada por extensão; com uma
+   extensão só, o caminho é o mesmo de antes. O mapa nunca é alterado no
+   lugar: cada mudança da lista grava um mapa novo antes de devolver o
+   antigo, como os dados. */
+
+static int64_t share_lookup(const FileSystem *fs, uint64_t start, uint64_t count);
+static void share_unref(FileSystem *fs, uint32_t slot);
+
+static uint64_t extent_map_blocks(const FileSystem *fs, uint32_t count) {
+    return (count + fs->layout.extent_map_entries - 1) / fs->layout.extent_map_entries;
+}
+
+/* Extensões do arquivo: a lista ou, com extensão única, *single */
+static const FileExtent* file_extents(const FileEntry *entry, FileExtent *single, uint32_t *count) {
+    if (entry->map_block) {
+        *count = entry->extent_count;
+        return entry->extents;
+    }
+    single->start = entry->start_block;
+    single->count = entry->size_blocks;
+    single->logical = 0;
+    *count = entry->size_blocks > 0 ? 1 : 0;
+    return single;
+}
+
+/* Bloco seguinte ao fim da última extensão */
+static uint64_t file_end_block(const FileEntry *entry) {
+    if (entry->map_block) {
+        const FileExtent *last = &entry->extents[entry->extent_count - 1];
+        return last->start + last->count;
+    }
+    return entry->start_block + entry->size_blocks;
+}
+
+/* Posição no disco do byte offset do conteúdo e quantos bytes seguem
+   contíguos a partir dela (busca binária pelo bloco lógico) */
+static uint64_t extents_locate(uint32_t block_size, const FileExtent *list, uint32_t count, uint64_t offset, uint64_t *run) {
+    uint64_t block = offset / block_size;
+    uint32_t lo = 1, hi = count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (list[mid].logical <= block) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    const FileExtent *extent = &list[lo - 1];
+    uint64_t within = offset - extent->logical * block_size;
+    *run = (uint64_t)extent->count * block_size - within;
+    return extent->start * block_size + within;
+}
+
+typedef enum {
+    XFER_READ,
+    XFER_WRITE,
+    XFER_ZERO
+} TransferKind;
+
+/* Transfere size bytes a partir de offset do conteúdo: um trecho
+   contíguo por vez, do tamanho da extensão. O chamador garante que
+   [offset, offset + size) está dentro dos blocos alocados. */
+static int extents_transfer(FileSystem *fs, const FileExtent *list, uint32_t count, uint64_t offset,
+                            void *buffer, uint64_t size, TransferKind kind) {
+    uint8_t *ptr = buffer;
+    // Grande o bastante para passar direto pelo disco se fosse contígua:
+    // os pedaços também passam, em vez de expulsar o cache bloco a bloco
+    int direct = fs->cache && !fs->disk_map && count > 1 &&
+                 size / fs->layout.block_size > fs->cache->capacity / 4;
+    int result = 0;
+    while (size > 0 && result == 0) {
+        uint64_t run;
+        uint64_t at = extents_locate(fs->layout.block_size, list, count, offset, &run);
+        uint64_t chunk = size < run ? size : run;
+        if (kind == XFER_READ) {
+            result = disk_read_at(fs, at, ptr, chunk, direct);
+        } else if (kind == XFER_WRITE) {
+            result = disk_write_at(fs, at, ptr, chunk, direct);
+        } else {
+            result = disk_zero_at(fs, at, chunk, direct);
+        }
+        if (ptr) {
+            ptr += chunk;
+        }
+        offset += chunk;
+        size -= chunk;
+    }
+    return result == 0 ? 0 : -1;
+}
+
+/* Leitura/escrita de bytes do arquivo a partir de um deslocamento dentro
+   dele */
+static int file_read_at(FileSystem *fs, const FileEntry *entry, uint64_t offset,
+                        void *buffer, uint64_t size) {
+    FileExtent single;
+    uint32_t count;
+    const FileExtent *list = file_extents(entry, &single, &count);
+    return extents_transfer(fs, list, count, offset, buffer, size, XFER_READ);
+}
+
+static int file_write_at(FileSystem *fs, const FileEntry *entry, uint64_t offset,
+                         const void *data, uint64_t size) {
+    FileExtent single;
+    uint32_t count;
+    const FileExtent *list = file_extents(entry, &single, &count);
+    return extents_transfer(fs, list, count, offset, (void *)data, size, XFER_WRITE);
+}
+
+static int file_zero_at(FileSystem *fs, const FileEntry *entry, uint64_t offset, uint64_t size) {
+    FileExtent single;
+    uint32_t count;
+    const FileExtent *list = file_extents(entry, &single, &count);
+    return extents_transfer(fs, list, count, offset, NULL, size, XFER_ZERO);
+}
+
+/* Copia os primeiros size bytes de um conteúdo para outro, trecho a
+   trecho pelo disco (disk_copy); os dois não podem se sobrepor */
+static int extents_copy(FileSystem *fs, const FileExtent *src, uint32_t src_count,
+                        const FileExtent *dest, uint32_t dest_count, uint64_t size) {
+    uint64_t done = 0;
+    while (done < size) {
+        uint64_t src_run, dest_run;
+        uint64_t from = extents_locate(fs->layout.block_size, src, src_count, done, &src_run);
+        uint64_t to = extents_locate(fs->layout.block_size, dest, dest_count, done, &dest_run);
+        uint64_t chunk = size - done;
+        if (chunk > src_run) chunk = src_run;
+        if (chunk > dest_run) chunk = dest_run;
+        if (disk_copy(fs, from / fs->layout.block_size, to / fs->layout.block_size, chunk) != 0) {
+            return -1;
+        }
+        done += chunk;
+    }
+    return 0;
+}
+
+/* Garante espaço para needed extensões na lista */
+static int extents_reserve(FileExtent **list, uint32_t *cap, uint32_t needed) {
+    if (needed <= *cap) {
+        return 0;
+    }
+    uint32_t new_cap = *cap ? *cap * 2 : 4;
+    while (new_cap < needed) {
+        new_cap *= 2;
+    }
+    FileExtent *grown = realloc(*list, new_cap * sizeof(FileExtent));
+    if (!grown) {
+        return -1;
+    }
+    *list = grown;
+    *cap = new_cap;
+    return 0;
+}
+
+/* Acrescenta blocks blocos a partir de start ao fim do conteúdo (a última
+   extensão só cresce quando o trecho vem logo depois dela) */
+static int extents_push(FileExtent **list, uint32_t *count, uint32_t *cap, uint64_t start, uint64_t blocks) {
+    if (*count > 0) {
+        FileExtent *last = &(*list)[*count - 1];
+        if (last->start + last->count == start) {
+            last->count += blocks;
+            return 0;
+        }
+    }
+    if (extents_reserve(list, cap, *count + 1) != 0) {
+        return -1;
+    }
+    FileExtent *extent = &(*list)[*count];
+    extent->start = start;
+    extent->count = blocks;
+    extent->logical = *count > 0 ? (*list)[*count - 1].logical + (*list)[*count - 1].count : 0;
+    (*count)++;
+    return 0;
+}
+
+/* Completa blocks blocos com as maiores extensões livres: poucas
+   extensões, e a última usa o menor trecho que basta. Só começa se o
+   espaço livre for suficiente; o que já foi alocado numa falha fica na
+   lista, para o chamador devolver. */
+static int extents_alloc(FileSystem *fs, uint64_t blocks, FileExtent **list, uint32_t *count, uint32_t *cap) {
+    if (fs->free_extents->free_blocks < blocks &&
+        (!pending_free_reclaim(fs) || fs->free_extents->free_blocks < blocks)) {
+        return -1;
+    }
+    while (blocks > 0) {
+        uint64_t largest = extent_index_largest(fs->free_extents);
+        uint64_t take = largest < blocks ? largest : blocks;
+        int64_t start = extent_index_best_fit(fs->free_extents, take);
+        op_timing.alloc_scans++;
+        op_timing.alloc_scan_nodes += fs->free_extents->last_scan;
+        if (start == -1 || extents_reserve(list, cap, *count + 1) != 0 ||
+            fs_alloc_range(fs, (uint64_t)start, take) != 0) {
+            return -1;
+        }
+        extents_push(list, count, cap, (uint64_t)start, take);
+        blocks -= take;
+    }
+    return 0;
+}
+
+/* Devolve as extensões da lista e a libera */
+static void extents_release(FileSystem *fs, FileExtent *list, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        fs_release_range(fs, list[i].start, list[i].count);
+    }
+    free(list);
+}
+
+/* Encurta a lista para os primeiros blocks blocos; com fs, os blocos
+   cortados são devolvidos */
+static void extents_trim(FileSystem *fs, FileExtent *list, uint32_t *count, uint64_t blocks) {
+    while (*count > 0) {
+        FileExtent *last = &list[*count - 1];
+        if (last->logical >= blocks) {
+            if (fs) {
+                fs_release_range(fs, last->start, last->count);
+            }
+            (*count)--;
+            continue;
+        }
+        uint64_t keep = blocks - last->logical;
+        if (keep < last->count) {
+            if (fs) {
+                fs_release_range(fs, last->start + keep, last->count - keep);
+            }
+            last->count = keep;
+        }
+        break;
+    }
+}
+
+/* Aloca blocks blocos para um conteúdo novo: uma extensão só quando há
+   espaço contíguo (em preferred, se estiver livre, ou onde a política de
+   alocação escolher), senão várias. Sem espaço, nada fica alocado. */
+static int layout_alloc(FileSystem *fs, uint64_t blocks, int64_t preferred,
+                        FileExtent **list, uint32_t *count) {
+    uint32_t cap = 0;
+    *list = NULL;
+    *count = 0;
+    if (blocks == 0) {
+        return 0;
+    }
+    
+    int64_t start = -1;
+    if (preferred != -1 && extent_index_is_free(fs->free_extents, (uint64_t)preferred, blocks)) {
+        start = preferred;
+    } else {
+        start = fs_find_free(fs, blocks);
+    }
+    if (start != -1) {
+        if (extents_reserve(list, &cap, 1) != 0) {
+            return -1;
+        }
+        fs_alloc_range(fs, (uint64_t)start, blocks);
+        extents_push(list, count, &cap, (uint64_t)start, blocks);
+        return 0;
+    }
+    
+    if (extents_alloc(fs, blocks, list, count, &cap) != 0) {
+        extents_release(fs, *list, *count);
+        *list = NULL;
+        *count = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/* Grava a lista no mapa que começa em map */
+static int extent_map_write(FileSystem *fs, uint64_t map, const FileExtent *list, uint32_t count) {
+    uint64_t blocks = extent_map_blocks(fs, count);
+    uint8_t *buffer = calloc(blocks, fs->layout.block_size);
+    if (!buffer) {
+        return -1;
+    }
+    for (uint64_t b = 0; b < blocks; b++) {
+        uint8_t *block = buffer + b * fs->layout.block_size;
+        uint32_t first = (uint32_t)(b * fs->layout.extent_map_entries);
+        uint32_t in_block = count - first < fs->layout.extent_map_entries ? count - first : (uint32_t)fs->layout.extent_map_entries;
+        ExtentMapHeader header = { EXTENT_MAP_MAGIC, in_block, count, (uint32_t)b };
+        memcpy(block, &header, sizeof(header));
+        ExtentMapEntry *entries = (ExtentMapEntry *)(block + sizeof(header));
+        for (uint32_t i = 0; i < in_block; i++) {
+            entries[i].start_block = (uint32_t)list[first + i].start;
+            entries[i].block_count = (uint32_t)list[first + i].count;
+        }
+    }
+    int result = disk_write_at(fs, map * fs->layout.block_size, buffer, blocks * fs->layout.block_size, 0);
+    free(buffer);
+    return result;
+}
+
+/* Lê e confere o mapa do arquivo; as extensões precisam estar na área de
+   dados e somar size_blocks */
+static int extent_map_read(FileSystem *fs, FileEntry *entry) {
+    ExtentMapHeader header;
+    uint64_t map = entry->map_block;
+    if (map < fs->layout.data_start || map >= fs->layout.total_blocks ||
+        disk_read_at(fs, map * fs->layout.block_size, &header, sizeof(header), 0) != 0 ||
+        header.magic != EXTENT_MAP_MAGIC || header.total < 2 ||
+        map + extent_map_blocks(fs, header.total) > fs->layout.total_blocks) {
+        return -1;
+    }
+    
+    uint32_t total = header.total;
+    uint64_t blocks = extent_map_blocks(fs, total);
+    uint8_t *buffer = malloc(blocks * fs->layout.block_size);
+    FileExtent *list = malloc(total * sizeof(FileExtent));
+    if (!buffer || !list || disk_read_at(fs, map * fs->layout.block_size, buffer, blocks * fs->layout.block_size, 0) != 0) {
+        goto invalid;
+    }
+    
+    uint64_t logical = 0;
+    for (uint64_t b = 0; b < blocks; b++) {
+        const uint8_t *block = buffer + b * fs->layout.block_size;
+        uint32_t first = (uint32_t)(b * fs->layout.extent_map_entries);
+        uint32_t in_block = total - first < fs->layout.extent_map_entries ? total - first : (uint32_t)fs->layout.extent_map_entries;
+        memcpy(&header, block, sizeof(header));
+        if (header.magic != EXTENT_MAP_MAGIC || header.total != total || header.index != b ||
+            header.count != in_block) {
+            goto invalid;
+        }
+        const ExtentMapEntry *entries = (const ExtentMapEntry *)(block + sizeof(header));
+        for (uint32_t i = 0; i < in_block; i++) {
+            uint64_t start = entries[i].start_block;
+            uint64_t count = entries[i].block_count;
+            if (start < fs->layout.data_start || count == 0 || start + count > fs->layout.total_blocks) {
+                goto invalid;
+            }
+            list[first + i].start = start;
+            list[first + i].count = count;
+            list[first + i].logical = logical;
+            logical += count;
+        }
+    }
+    if (logical != entry->size_blocks) {
+        goto invalid;
+    }
+    
+    free(buffer);
+    entry->extents = list;
+    entry->extent_count = total;
+    entry->start_block = list[0].start;
+    return 0;
+    
+invalid:
+    free(buffer);
+    free(list);
+    return -1;
+}
+
+/* Na montagem, lê o mapa de cada arquivo em várias extensões. Um mapa
+   ilegível deixa o arquivo vazio (os blocos dele continuam marcados). */
+static void extent_maps_load(FileSystem *fs) {
+    for (uint32_t i = 0; i < fs->layout.max_files; i++) {
+        FileEntry *entry = &fs->file_table[i];
+        if (!entry->is_used || !entry->map_block || extent_map_read(fs, entry) == 0) {
+            continue;
+        }
+        log_error("Aviso: Mapa de extensões de '%s' inválido; arquivo esvaziado.\n", entry->name);
+        entry->map_block = 0;
+        entry->start_block = 0;
+        entry->size_blocks = 0;
+        entry->size_bytes = 0;
+        fs->dir_dirty[(uint64_t)i * METADATA_SIZE / fs->layout.block_size] = 1;
+        fs->superblock_dirty = 1; // Grava a correção ainda na montagem
+    }
+}
+
+/* Devolve a extensão (start, count) de um arquivo ou, se compartilhada,
+   só a referência dele a ela */
+static void extent_drop(FileSystem *fs, uint64_t start, uint64_t count) {
+    int64_t slot = share_lookup(fs, start, count);
+    if (slot != -1) {
+        share_unref(fs, (uint32_t)slot);
+    } else {
+        fs_release_range(fs, start, count);
+    }
+}
+
+/* O arquivo deixa tudo o que ocupa: as extensões (devolvidas ou, as
+   compartilhadas, só abandonadas) e o mapa */
+static void file_release_blocks(FileSystem *fs, int index) {
+    FileEntry *entry = &fs->file_table[index];
+    FileExtent single;
+    uint32_t count;
+    const FileExtent *list = file_extents(entry, &single, &count);
+    int shared = entry->shared != 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (shared) {
+            extent_drop(fs, list[i].start, list[i].count);
+        } else {
+            fs_release_range(fs, list[i].start, list[i].count);
+        }
+    }
+    if (entry->map_block) {
+        fs_release_range(fs, entry->map_block, extent_map_blocks(fs, entry->extent_count));
+        free(entry->extents);
+        entry->extents = NULL;
+        entry->extent_count = 0;
+        entry->map_block = 0;
+    }
+    entry->start_block = 0;
+    entry->size_blocks = 0;
+    entry->shared = 0;
+}
+
+/* Grava o mapa de list num lugar novo, que fica alocado em *map (0 se a
+   lista tem uma extensão só e não precisa de mapa). Sem espaço para ele,
+   falha sem alocar nada. */
+static int extent_map_prepare(FileSystem *fs, const FileExtent *list, uint32_t count, uint64_t *map) {
+    uint64_t map_blocks = count > 1 ? extent_map_blocks(fs, count) : 0;
+    *map = 0;
+    if (map_blocks == 0) {
+        return 0;
+    }
+    int64_t found = fs_find_free(fs, map_blocks);
+    if (found == -1) {
+        return -1;
+    }
+    fs_alloc_range(fs, (uint64_t)found, map_blocks);
+    if (extent_map_write(fs, (uint64_t)found, list, count) != 0) {
+        fs_release_range(fs, (uint64_t)found, map_blocks);
+        return -1;
+    }
+    *map = (uint64_t)found;
+    return 0;
+}
+
+/* Segunda metade de file_install, que não falha: o arquivo passa a
+   ocupar list, com o mapa (se preciso) já gravado em map */
+static void file_install_map(FileSystem *fs, int index, FileExtent *list, uint32_t count,
+                             uint64_t map, int release_old) {
+    FileEntry *entry = &fs->file_table[index];
+    uint64_t old_map = entry->map_block;
+    uint64_t old_map_blocks = old_map ? extent_map_blocks(fs, entry->extent_count) : 0;
+    
+    if (release_old) {
+        file_release_blocks(fs, index);
+    } else if (old_map) {
+        fs_release_range(fs, old_map, old_map_blocks);
+        free(entry->extents);
+    }
+    
+    uint64_t blocks = count > 0 ? list[count - 1].logical + list[count - 1].count : 0;
+    entry->size_blocks = blocks;
+    entry->start_block = count > 0 ? list[0].start : 0;
+    if (count > 1) {
+        entry->map_block = map;
+        entry->extent_count = count;
+        entry->extents = list;
+    } else {
+        entry->map_block = 0;
+        entry->extent_count = 0;
+        entry->extents = NULL;
+        free(list);
+    }
+    fs_entry_changed(fs, index);
+}
+
+/* O arquivo passa a ocupar as extensões de list (já alocadas, e com o
+   conteúdo gravado). Com mais de uma, o mapa novo é gravado antes de
+   qualquer outra mudança. Com release_old, tudo o que o arquivo ocupava é
+   devolvido; sem, list contém os blocos atuais dele, e só o mapa antigo
+   sai. Sem espaço para o mapa novo a instalação falha, mesmo que ele
+   coubesse no antigo: o mapa confirmado não pode ser sobrescrito antes
+   do commit. A lista passa a ser do arquivo; na falha nada muda. */
+static int file_install(FileSystem *fs, int index, FileExtent *list, uint32_t count, int release_old) {
+    uint64_t map;
+    if (extent_map_prepare(fs, list, count, &map) != 0) {
+        return -1;
+    }
+    file_install_map(fs, index, list, count, map, release_old);
+    return 0;
+}
+
+/* Cópia da lista de extensões do arquivo, que pode crescer */
+static int file_extents_dup(const FileEntry *entry, FileExtent **list, uint32_t *count, uint32_t *cap) {
+    FileExtent single;
+    uint32_t n;
+    const FileExtent *source = file_extents(entry, &single, &n);
+    *list = NULL;
+    *count = 0;
+    *cap = 0;
+    if (n == 0) {
+        return 0;
+    }
+    if (extents_reserve(list, cap, n) != 0) {
+        return -1;
+    }
+    memcpy(*list, source, n * sizeof(FileExtent));
+    *count = n;
+    return 0;
+}
+
+/* Faz o arquivo (não compartilhado) chegar a new_blocks blocos sem mexer
+   no que já ocupa: a última extensão cresce sobre os blocos livres logo
+   depois dela e o restante vem em novas extensões, de preferência a
+   partir de hint (a reserva do handle). Na falha nada muda. */
+static int file_add_extents(FileSystem *fs, int index, uint64_t new_blocks, int64_t hint) {
+    FileEntry *entry = &fs->file_table[index];
+    FileExtent *list;
+    uint32_t count, cap;
+    if (file_extents_dup(entry, &list, &count, &cap) != 0) {
+        log_error("Erro: Falha ao alocar memória.\n");
+        return -1;
+    }
+    uint32_t old_count = count;
+    uint64_t old_last = count > 0 ? list[count - 1].count : 0;
+    uint64_t remaining = new_blocks - entry->size_blocks;
+    
+    uint64_t free_start, free_length;
+    if (count > 0 &&
+        extent_index_containing(fs->free_extents, file_end_block(entry), &free_start, &free_length) == 0) {
+        uint64_t take = free_length < remaining ? free_length : remaining;
+        fs_alloc_range(fs, free_start, take);
+        list[count - 1].count += take;
+        remaining -= take;
+    }
+    if (remaining > 0 && hint != -1 && extent_index_is_free(fs->free_extents, (uint64_t)hint, remaining) &&
+        extents_reserve(&list, &cap, count + 1) == 0) {
+        fs_alloc_range(fs, (uint64_t)hint, remaining);
+        extents_push(&list, &count, &cap, (uint64_t)hint, remaining);
+        remaining = 0;
+    }
+    if ((remaining == 0 || extents_alloc(fs, remaining, &list, &count, &cap) == 0) &&
+        file_install(fs, index, list, count, 0) == 0) {
+        return 0;
+    }
+    
+    // Devolve só o que foi acrescentado
+    for (uint32_t i = old_count; i < count; i++) {
+        fs_release_range(fs, list[i].start, list[i].count);
+    }
+    if (old_count > 0 && list[old_count - 1].count > old_last) {
+        fs_release_range(fs, list[old_count - 1].start + old_last, list[old_count - 1].count - old_last);
+    }
+    free(list);
+    log_error("Erro: Espaço insuficiente no disco.\n");
+    return -1;
+}
+
+/* Devolve os blocos do arquivo (não compartilhado) além dos primeiros
+   blocks. Num arquivo em várias extensões, a lista menor é instalada
+   antes de os blocos do fim ficarem livres. */
+static int file_trim(FileSystem *fs, int index, uint64_t blocks) {
+    FileEntry *entry = &fs->file_table[index];
+    if (blocks >= entry->size_blocks) {
+        return 0;
+    }
+    if (!entry->map_block) {
+        fs_release_range(fs, entry->start_block + blocks, entry->size_blocks - blocks);
+        entry->size_blocks = blocks;
+        if (blocks == 0) {
+            entry->start_block = 0;
+        }
+        return 0;
+    }
+    
+    FileExtent *list, *old;
+    uint32_t count, old_count, cap;
+    if (file_extents_dup(entry, &list, &count, &cap) != 0 ||
+        file_extents_dup(entry, &old, &old_count, &cap) != 0) {
+        free(list);
+        log_error("Erro: Falha ao alocar memória.\n");
+        return -1;
+    }
+    extents_trim(NULL, list, &count, blocks);
+    if (file_install(fs, index, list, count, 0) != 0) {
+        free(list);
+        free(old);
+        log_error("Erro: Sem espaço ou falha ao gravar o novo mapa de extensões.\n");
+        return -1;
+    }
+    extents_trim(fs, old, &old_count, blocks);
+    free(old);
+    return 0;
+}
+
+/* Junta numa extensão só o conteúdo de um arquivo em várias, se houver
+   espaço contíguo. Retorna 1 se juntou, 0 se não há espaço. */
+static int file_gather(FileSystem *fs, int index) {
+    FileEntry *entry = &fs->file_table[index];
+    int64_t start = fs_find_free(fs, entry->size_blocks);
+    if (start == -1) {
+        return 0;
+    }
+    
+    FileExtent *list;
+    uint32_t count;
+    if (layout_alloc(fs, entry->size_blocks, start, &list, &count) != 0) {
+        return -1;
+    }
+    if (extents_copy(fs, entry->extents, entry->extent_count, list, count,
+                     entry->size_blocks * fs->layout.block_size) != 0 ||
+        file_install(fs, index, list, count, 1) != 0) {
+        extents_release(fs, list, count);
+        return -1;
+    }
+    return 1;
+}
+
+/* ============================================
+   EXTENSÕES COMPARTILHADAS (REFLINK)
+   ============================================ */
+
+/* Uma cópia reflink ou a deduplicação fazem arquivos diferentes apontar
+   para a mesma extensão, e a posição dela em share_table conta quantas
+   extensões de arquivos a usam. Os blocos continuam marcados uma única
+   vez no bitmap e só são devolvidos quando a última referência sai. Uma
+   extensão compartilhada aparece inteira, com o mesmo início e tamanho,
+   na lista de cada arquivo que a usa, e nunca é juntada a uma vizinha.
+   share_order mantém as posições em uso por bloco inicial, para a busca
+   binária. A tabela segue o caminho do diretório: bloco marcado para o
+   fs_sync e imagem nova no journal. */
+static void share_changed(FileSystem *fs, uint32_t slot) {
+    uint8_t record[4 + sizeof(SharedExtent)];
+    
+    fs->share_dirty[(uint64_t)slot * sizeof(SharedExtent) / fs->layout.block_size] = 1;
+    array_to_bytes(slot, record, 4);
+    memcpy(record + 4, &fs->share_table[slot], sizeof(SharedExtent));
+    journal_append(fs, JREC_SHARE, record, sizeof(record));
+}
+
+/* Primeira posição de share_order com bloco inicial >= start */
+static uint32_t share_order_find(const FileSystem *fs, uint64_t start) {
+    uint32_t lo = 0, hi = fs->share_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (fs->share_table[fs->share_order[mid]].start_block < start) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* Posição da tabela da extensão compartilhada (start, count), ou -1 */
+static int64_t share_lookup(const FileSystem *fs, uint64_t start, uint64_t count) {
+    uint32_t k = share_order_find(fs, start);
+    if (k < fs->share_count) {
+        const SharedExtent *shared = &fs->share_table[fs->share_order[k]];
+        if (shared->start_block == start && shared->block_count == count) {
+            return fs->share_order[k];
+        }
+    }
+    return -1;
+}
+
+static void share_order_insert(FileSystem *fs, uint32_t slot) {
+    uint32_t k = share_order_find(fs, fs->share_table[slot].start_block);
+    memmove(&fs->share_order[k + 1], &fs->share_order[k], (fs->share_count - k) * sizeof(uint32_t));
+    fs->share_order[k] = slot;
+    fs->share_count++;
+}
+
+static void share_order_remove(FileSystem *fs, uint32_t slot) {
+    uint32_t k = share_order_find(fs, fs->share_table[slot].start_block);
+    while (fs->share_order[k] != slot) {
+        k++;
+    }
+    memmove(&fs->share_order[k], &fs->share_order[k + 1], (fs->share_count - k - 1) * sizeof(uint32_t));
+    fs->share_count--;
+}
+
+/* Quantas extensões do arquivo são compartilhadas */
+static uint32_t share_count_of(const FileSystem *fs, const FileEntry *entry) {
+    FileExtent single;
+    uint32_t count, shared = 0;
+    const FileExtent *list = file_extents(entry, &single, &count);
+    for (uint32_t i = 0; i < count && fs->share_count > 0; i++) {
+        shared += share_lookup(fs, list[i].start, list[i].count) != -1;
+    }
+    return shared;
+}
+
+/* Uma referência a menos à extensão, sem mexer nos blocos, que ficam com
+   os demais. Se sobra uma só, o arquivo dela passa a ser o dono exclusivo
+   e a posição da tabela é liberada. */
+static void share_unref(FileSystem *fs, uint32_t slot) {
+    SharedExtent *shared = &fs->share_table[slot];
+    if (--shared->refs == 1) {
+        uint64_t start = shared->start_block;
+        share_order_remove(fs, slot);
+        memset(shared, 0, sizeof(SharedExtent));
+        for (uint32_t i = 0; i < fs->layout.max_files; i++) {
+            FileEntry *entry = &fs->file_table[i];
+            if (!entry->is_used || !entry->shared) {
+                continue;
+            }
+            FileExtent single;
+            uint32_t count;
+            const FileExtent *list = file_extents(entry, &single, &count);
+            for (uint32_t e = 0; e < count; e++) {
+                if (list[e].start == start) {
+                    entry->shared = share_count_of(fs, entry);
+                    break;
+                }
+            }
+        }
+    }
+    share_changed(fs, slot);
+}
+
+/* Mais uma referência à extensão (start, count) de owner, que passa a ser
+   compartilhada se ainda não era. O chamador garante uma posição livre
+   (share_room). */
+static void share_ref(FileSystem *fs, FileEntry *owner, uint64_t start, uint64_t count) {
+    int64_t found = share_lookup(fs, start, count);
+    uint32_t slot;
+    if (found != -1) {
+        slot = (uint32_t)found;
+    } else {
+        for (slot = 0; fs->share_table[slot].refs != 0; slot++) {
+        }
+        fs->share_table[slot].start_block = (uint32_t)start;
+        fs->share_table[slot].block_count = (uint32_t)count;
+        fs->share_table[slot].refs = 1;
+        share_order_insert(fs, slot);
+        owner->shared++;
+    }
+    fs->share_table[slot].refs++;
+    share_changed(fs, slot);
+}
+
+/* Posições livres na tabela */
+static uint32_t share_room(const FileSystem *fs) {
+    return fs->layout.share_entries - fs->share_count;
+}
+
+/* Copy-on-write: antes de ser alterado, o arquivo ganha blocos próprios
+   (new_blocks, de preferência numa extensão em preferred), com a parte
+   do conteúdo que couber neles */
+static int file_unshare(FileSystem *fs, int index, uint64_t new_blocks, int64_t preferred) {
+    FileEntry *entry = &fs->file_table[index];
+    uint64_t keep = entry->size_bytes;
+    if (keep > new_blocks * fs->layout.block_size) {
+        keep = new_blocks * fs->layout.block_size;
+    }
+    
+    FileExtent *list;
+    uint32_t count;
+    if (layout_alloc(fs, new_blocks, preferred, &list, &count) != 0) {
+        log_error("Erro: Espaço insuficiente no disco.\n");
+        return -1;
+    }
+    FileExtent single;
+    uint32_t src_count;
+    const FileExtent *src = file_extents(entry, &single, &src_count);
+    if (extents_copy(fs, src, src_count, list, count, keep) != 0) {
+        log_error("Erro: Falha ao copiar a extensão compartilhada.\n");
+        extents_release(fs, list, count);
+        return -1;
+    }
+    if (file_install(fs, index, list, count, 1) != 0) {
+        log_error("Erro: Espaço insuficiente no disco.\n");
+        extents_release(fs, list, count);
+        return -1;
+    }
+    
+    entry->size_bytes = keep;
+    fs_entry_changed(fs, index);
+    return 0;
+}
+
+/* A entrada index deixa o que ocupa e passa a apontar para todas as
+   extensões de src_index. O chamador garante as posições da tabela e o
+   espaço para o mapa; sem memória para a lista, nada muda. */
+static int share_attach(FileSystem *fs, int index, int src_index) {
+    FileEntry *src = &fs->file_table[src_index];
+    FileEntry *entry = &fs->file_table[index];
+    FileExtent *list;
+    uint32_t count, cap;
+    
+    if (file_extents_dup(src, &list, &count, &cap) != 0 ||
+        file_install(fs, index, list, count, 1) != 0) {
+        free(list);
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        share_ref(fs, src, entry->map_block ? entry->extents[i].start : entry->start_block,
+                  entry->map_block ? entry->extents[i].count : entry->size_blocks);
+    }
+    entry->shared = count;
+    entry->size_bytes = src->size_bytes;
+    fs_entry_changed(fs, index);
+    return 0;
+}
+
+/* Lista do arquivo com os primeiros blocks blocos da extensão (start,
+   count) em dest; se sobra parte dela, a extensão vira duas */
+static int share_list_move(const FileEntry *entry, uint64_t start, uint64_t count, uint64_t blocks,
+                           uint64_t dest, FileExtent **out, uint32_t *out_count) {
+    FileExtent single;
+    uint32_t extent_count, cap = 0;
+    const FileExtent *list = file_extents(entry, &single, &extent_count);
+    *out = NULL;
+    *out_count = 0;
+    for (uint32_t e = 0; e < extent_count; e++) {
+        FileExtent runs[2] = { list[e], list[e] };
+        int pieces = 1;
+        if (list[e].start == start) {
+            runs[0].start = dest;
+            runs[0].count = blocks;
+            runs[1].start = start + blocks;
+            runs[1].count = count - blocks;
+            runs[1].logical = list[e].logical + blocks;
+            pieces = blocks < count ? 2 : 1;
+        }
+        if (extents_reserve(out, &cap, *out_count + pieces) != 0) {
+            free(*out);
+            *out = NULL;
+            return -1;
+        }
+        for (int p = 0; p < pieces; p++) {
+            (*out)[(*out_count)++] = runs[p];
+        }
+    }
+    return 0;
+}
+
+/* Desloca os primeiros blocks blocos da extensão compartilhada da posição
+   slot, já copiados para dest, em todos os arquivos que a usam. Se sobra
+   parte da extensão, ela fica na posição slot e o trecho deslocado ganha
+   outra (cada arquivo passa a ter uma extensão a mais). Os mapas novos
+   são todos gravados antes da primeira mudança: sem espaço para algum ou
+   sem posição livre na tabela, nada muda. Os blocos antigos só são
+   devolvidos no fim. */
+static int share_move(FileSystem *fs, uint32_t slot, uint64_t blocks, uint64_t dest) {
+    SharedExtent *shared = &fs->share_table[slot];
+    uint64_t start = shared->start_block;
+    uint64_t count = shared->block_count;
+    uint32_t refs = shared->refs;
+    if (blocks < count && share_room(fs) == 0) {
+        return -1;
+    }
+    int *users = malloc(refs * sizeof(int));
+    FileExtent **lists = calloc(refs, sizeof(FileExtent *));
+    uint32_t *counts = malloc(refs * sizeof(uint32_t));
+    uint64_t *maps = calloc(refs, sizeof(uint64_t));
+    uint32_t found = 0;
+    int result = users && lists && counts && maps ? 0 : -1;
+    
+    for (uint32_t i = 0; i < fs->layout.max_files && result == 0 && found < refs; i++) {
+        FileEntry *entry = &fs->file_table[i];
+        if (!entry->is_used || !entry->shared) {
+            continue;
+        }
+        FileExtent single;
+        uint32_t extent_count;
+        const FileExtent *list = file_extents(entry, &single, &extent_count);
+        int uses = 0;
+        for (uint32_t e = 0; e < extent_count; e++) {
+            uses |= list[e].start == start;
+        }
+        if (!uses) {
+            continue;
+        }
+        users[found] = (int)i;
+        if (share_list_move(entry, start, count, blocks, dest, &lists[found], &counts[found]) != 0) {
+            result = -1;
+            break;
+        }
+        result = extent_map_prepare(fs, lists[found], counts[found], &maps[found]);
+        found++;
+    }
+    
+    if (result != 0) {
+        for (uint32_t k = 0; k < found; k++) {
+            if (maps[k]) {
+                fs_release_range(fs, maps[k], extent_map_blocks(fs, counts[k]));
+            }
+            free(lists[k]);
+        }
+    } else {
+        for (uint32_t k = 0; k < found; k++) {
+            file_install_map(fs, users[k], lists[k], counts[k], maps[k], 0);
+        }
+        share_order_remove(fs, slot);
+        if (blocks < count) {
+            uint32_t piece = 0;
+            while (fs->share_table[piece].refs != 0) {
+                piece++;
+            }
+            fs->share_table[piece] = (SharedExtent){ (uint32_t)dest, (uint32_t)blocks, refs, 0 };
+            share_order_insert(fs, piece);
+            share_changed(fs, piece);
+            shared->start_block = (uint32_t)(start + blocks);
+            shared->block_count = (uint32_t)(count - blocks);
+        } else {
+            shared->start_block = (uint32_t)dest;
+        }
+        share_order_insert(fs, slot);
+        share_changed(fs, slot);
+        for (uint32_t k = 0; k < found; k++) {
+            fs->file_table[users[k]].shared = share_count_of(fs, &fs->file_table[users[k]]);
+        }
+        fs_release_range(fs, start, blocks);
+    }
+    free(users);
+    free(lists);
+    free(counts);
+    free(maps);
+    return result;
+}
+
+/* Junta de novo as extensões compartilhadas que cobrem [start, start +
+   blocks), divididas por share_move e já encostadas umas nas outras, numa
+   só, em todos os arquivos que as usam (na ordem, uma depois da outra). A
+   posição da primeira fica com a extensão inteira. Como em share_move, os
+   mapas novos vêm antes de qualquer mudança; na falha tudo fica dividido
+   como estava. */
+static int share_join(FileSystem *fs, uint64_t start, uint64_t blocks) {
+    uint32_t first = share_order_find(fs, start), last = first;
+    uint64_t covered = 0;
+    while (last < fs->share_count && covered < blocks &&
+           fs->share_table[fs->share_order[last]].start_block == start + covered &&
+           fs->share_table[fs->share_order[last]].refs == fs->share_table[fs->share_order[first]].refs) {
+        covered += fs->share_table[fs->share_order[last]].block_count;
+        last++;
+    }
+    if (covered != blocks || last - first < 2) {
+        return -1;
+    }
+    uint32_t slot = fs->share_order[first];
+    uint32_t refs = fs->share_table[slot].refs;
+    int *users = malloc(refs * sizeof(int));
+    FileExtent **lists = calloc(refs, sizeof(FileExtent *));
+    uint32_t *counts = calloc(refs, sizeof(uint32_t));
+    uint64_t *maps = calloc(refs, sizeof(uint64_t));
+    uint32_t found = 0;
+    int result = users && lists && counts && maps ? 0 : -1;
+    
+    for (uint32_t i = 0; i < fs->layout.max_files && result == 0 && found < refs; i++) {
+        FileEntry *entry = &fs->file_table[i];
+        if (!entry->is_used || !entry->shared) {
+            continue;
+        }
+        FileExtent single;
+        uint32_t extent_count, cap = 0;
+        const FileExtent *list = file_extents(entry, &single, &extent_count);
+        int uses = 0;
+        for (uint32_t e = 0; e < extent_count && result == 0; e++) {
+            if (extents_reserve(&lists[found], &cap, counts[found] + 1) != 0) {
+                result = -1;
+                break;
+            }
+            FileExtent *joined = &lists[found][counts[found]++];
+            *joined = list[e];
+            if (list[e].start != start) {
+                continue;
+            }
+            // Os pedaços seguintes precisam vir logo depois, em ordem
+            uses = 1;
+            while (joined->count < blocks && e + 1 < extent_count &&
+                   list[e + 1].start == joined->start + joined->count) {
+                joined->count += list[++e].count;
+            }
+            if (joined->count != blocks) {
+                result = -1;
+            }
+        }
+        if (!uses) {
+            free(lists[found]);
+            lists[found] = NULL;
+            counts[found] = 0;
+            continue;
+        }
+        users[found] = (int)i;
+        if (result == 0) {
+            result = extent_map_prepare(fs, lists[found], counts[found], &maps[found]);
+        }
+        found++;
+    }
+    
+    if (result != 0) {
+        for (uint32_t k = 0; k < found; k++) {
+            if (maps[k]) {
+                fs_release_range(fs, maps[k], extent_map_blocks(fs, counts[k]));
+            }
+            free(lists[k]);
+        }
+    } else {
+        for (uint32_t k = 0; k < found; k++) {
+            file_install_map(fs, users[k], lists[k], counts[k], maps[k], 0);
+        }
+        for (uint32_t k = first + 1; k < last; k++) {
+            uint32_t piece = fs->share_order[first + 1];
+            share_order_remove(fs, piece);
+            memset(&fs->share_table[piece], 0, sizeof(SharedExtent));
+            share_changed(fs, piece);
+        }
+        fs->share_table[slot].block_count = (uint32_t)blocks;
+        share_changed(fs, slot);
+        for (uint32_t k = 0; k < found; k++) {
+            fs->file_table[users[k]].shared = share_count_of(fs, &fs->file_table[users[k]]);
+        }
+    }
+    free(users);
+    free(lists);
+    free(counts);
+    free(maps);
+    return result;
+}
+
+/* Blocos de mapa que os arquivos que usam a extensão compartilhada da
+   posição slot vão precisar com extra extensões a mais cada um */
+static uint64_t share_map_blocks(const FileSystem *fs, uint32_t slot, uint32_t extra) {
+    uint64_t start = fs->share_table[slot].start_block;
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < fs->layout.max_files; i++) {
+        const FileEntry *entry = &fs->file_table[i];
+        if (!entry->is_used || !entry->shared) {
+            continue;
+        }
+        FileExtent single;
+        uint32_t count;
+        const FileExtent *list = file_extents(entry, &single, &count);
+        for (uint32_t e = 0; e < count; e++) {
+            if (list[e].start == start) {
+                total += extent_map_blocks(fs, count + extra);
+                break;
+            }
+        }
+    }
+    return total;
+}
+
+static int compare_share_start(const void *a, const void *b, void *ctx) {
+    const SharedExtent *table = ctx;
+    uint32_t x = table[*(const uint32_t *)a].start_block;
+    uint32_t y = table[*(const uint32_t *)b].start_block;
+    return x < y ? -1 : x > y;
+}
+
+/* Na montagem, conta as extensões de arquivos que apontam para cada
+   posição da tabela. O diretório prevalece: contagens divergentes são
+   corrigidas e posições com menos de duas referências, liberadas. */
+static int share_rebuild(FileSystem *fs) {
+    fs->share_order = malloc((fs->layout.share_entries + 1) * sizeof(uint32_t));
+    uint32_t *refs = calloc(fs->layout.share_entries + 1, sizeof(uint32_t));
+    if (!fs->share_order || !refs) {
+        free(refs);
+        return -1;
+    }
+    
+    fs->share_count = 0;
+    for (uint32_t slot = 0; slot < fs->layout.share_entries; slot++) {
+        if (fs->share_table[slot].refs > 0) {
+            fs->share_order[fs->share_count++] = slot;
+        }
+    }
+    qsort_r(fs->share_order, fs->share_count, sizeof(uint32_t), compare_share_start, fs->share_table);
+    
+    for (uint32_t i = 0; i < fs->layout.max_files && fs->share_count > 0; i++) {
+        const FileEntry *entry = &fs->file_table[i];
+        if (!entry->is_used) {
+            continue;
+        }
+        FileExtent single;
+        uint32_t count;
+        const FileExtent *list = file_extents(entry, &single, &count);
+        for (uint32_t e = 0; e < count; e++) {
+            int64_t slot = share_lookup(fs, list[e].start, list[e].count);
+            if (slot != -1) {
+                refs[slot]++;
+            }
+        }
+    }
+    
+    for (uint32_t k = 0; k < fs->share_count; k++) {
+        uint32_t slot = fs->share_order[k];
+        if (refs[slot] == fs->share_table[slot].refs) {
+            continue;
+        }
+        log_error("Aviso: Contagem de referências da extensão %u corrigida (%u -> %u).\n",
+                  fs->share_table[slot].start_block, fs->share_table[slot].refs, refs[slot]);
+        if (refs[slot] < 2) {
+            share_order_remove(fs, slot);
+            memset(&fs->share_table[slot], 0, sizeof(SharedExtent));
+            k--;
+        } else {
+            fs->share_table[slot].refs = refs[slot];
+        }
+        fs->share_dirty[(uint64_t)slot * sizeof(SharedExtent) / fs->layout.block_size] = 1;
+        fs->superblock_dirty = 1; // Grava a correção ainda na montagem
+    }
+    
+    for (uint32_t i = 0; i < fs->layout.max_files; i++) {
+        FileEntry *entry = &fs->file_table[i];
+        entry->shared = entry->is_used ? share_count_of(fs, entry) : 0;
+    }
+    free(refs);
+    return 0;
+}
+
+/* ============================================
+   DEDUPLICAÇÃO
+   ============================================ */
+
+/* A unidade de deduplicação é a extensão: uma extensão de um arquivo cujo
+   conteúdo é igual ao de uma extensão de outro (mesmo tamanho em blocos e
+   em bytes válidos) passa a ser uma referência a ela, como numa cópia
+   reflink. Cada arquivo guarda a impressão digital (FNV-1a de 64 bits)
+   de cada extensão, e dedup_index leva da impressão às extensões que a
+   têm, com endereçamento aberto como o índice de nomes. A impressão só
+   escolhe o candidato; a igualdade é sempre confirmada byte a byte. O
+   índice vive só em memória: é montado quando o modo é ligado (ou pela
+   varredura) e não é gravado no disco. */
+#define DEDUP_CHUNK (256 * 1024)    // Memória usada ao ler os arquivos
+#define DEDUP_INDEX_MIN 64
+
+static uint64_t fingerprint_update(uint64_t hash, const uint8_t *data, uint64_t size) {
+    for (uint64_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+static uint64_t fingerprint_finish(uint64_t hash) {
+    return hash ? hash : 1; // 0 marca impressão desconhecida
+}
+
+#define FINGERPRINT_INIT 0xCBF29CE484222325ull
+
+/* Bytes de conteúdo na extensão extent do arquivo (a última pode ter
+   blocos além do fim) */
+static uint64_t extent_length(const FileSystem *fs, const FileEntry *entry, const FileExtent *list,
+                              uint32_t extent) {
+    uint64_t from = list[extent].logical * fs->layout.block_size;
+    if (entry->size_bytes <= from) {
+        return 0;
+    }
+    uint64_t length = list[extent].count * fs->layout.block_size;
+    return entry->size_bytes - from < length ? entry->size_bytes - from : length;
+}
+
+/* Trecho contíguo a comparar: os blocos a partir de start no disco ou,
+   com data, o conteúdo ainda em memória */
+typedef struct {
+    uint64_t start;             // 0 = ainda não gravado
+    uint64_t count;
+    uint64_t length;            // Bytes válidos
+    const uint8_t *data;
+} DedupRun;
+
+/* Impressão digital do trecho; 0 se estiver vazio ou a leitura falhar */
+static uint64_t run_fingerprint(FileSystem *fs, const DedupRun *run, uint8_t *buffer) {
+    if (run->length == 0) {
+        return 0;
+    }
+    if (run->data) {
+        return fingerprint_finish(fingerprint_update(FINGERPRINT_INIT, run->data, run->length));
+    }
+    uint64_t hash = FINGERPRINT_INIT;
+    for (uint64_t done = 0; done < run->length; done += DEDUP_CHUNK) {
+        uint64_t chunk = run->length - done < DEDUP_CHUNK ? run->length - done : DEDUP_CHUNK;
+        if (disk_read_at(fs, run->start * fs->layout.block_size + done, buffer, chunk, 0) != 0) {
+            return 0;
+        }
+        hash = fingerprint_update(hash, buffer, chunk);
+    }
+    return fingerprint_finish(hash);
+}
+
+/* O trecho tem os mesmos bytes que os gravados a partir do bloco other */
+static int run_equals(FileSystem *fs, const DedupRun *run, uint64_t other, uint8_t *buffer) {
+    uint64_t half = DEDUP_CHUNK / 2;
+    uint64_t block_size = fs->layout.block_size;
+    for (uint64_t done = 0; done < run->length; done += half) {
+        uint64_t chunk = run->length - done < half ? run->length - done : half;
+        if (disk_read_at(fs, other * block_size + done, buffer, chunk, 0) != 0) {
+            return 0;
+        }
+        const uint8_t *expected = run->data ? run->data + done : buffer + half;
+        if (!run->data &&
+            disk_read_at(fs, run->start * block_size + done, buffer + half, chunk, 0) != 0) {
+            return 0;
+        }
+        if (memcmp(buffer, expected, chunk) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Impressões das extensões do arquivo, calculadas a partir de data (o
+   conteúdo inteiro, em memória) ou do disco; NULL sem memória */
+static uint64_t* dedup_prints(FileSystem *fs, int index, const uint8_t *data, uint8_t *buffer,
+                              uint32_t *count) {
+    const FileEntry *entry = &fs->file_table[index];
+    FileExtent single;
+    const FileExtent *list = file_extents(entry, &single, count);
+    uint64_t *prints = malloc((*count + 1) * sizeof(uint64_t));
+    if (!prints) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < *count; i++) {
+        DedupRun run = { list[i].start, list[i].count, extent_length(fs, entry, list, i),
+                         data ? data + list[i].logical * fs->layout.block_size : NULL };
+        prints[i] = run_fingerprint(fs, &run, buffer);
+    }
+    return prints;
+}
+
+static uint32_t dedup_home(const FileSystem *fs, uint64_t print) {
+    return (uint32_t)((print * 0x9E3779B97F4A7C15ull) >> 32) & (fs->dedup_index_size - 1);
+}
+
+static void dedup_index_put(FileSystem *fs, uint64_t print, int index, uint32_t extent) {
+    uint32_t pos = dedup_home(fs, print);
+    while (fs->dedup_index[pos].print != 0) {
+        pos = (pos + 1) & (fs->dedup_index_size - 1);
+    }
+    fs->dedup_index[pos] = (DedupSlot){ print, index, extent };
+    fs->dedup_index_used++;
+}
+
+/* Monta o índice de novo a partir das impressões guardadas nos arquivos,
+   com folga para extra impressões; as posições que já não valem somem.
+   Sem memória, o índice antigo continua. */
+static int dedup_index_rebuild(FileSystem *fs, uint32_t extra) {
+    uint64_t live = extra;
+    for (uint32_t i = 0; i < fs->layout.max_files; i++) {
+        live += fs->fingerprints[i].count;
+    }
+    uint32_t size = DEDUP_INDEX_MIN;
+    while (size < live * 4) {
+        size *= 2;
+    }
+    DedupSlot *slots = calloc(size, sizeof(DedupSlot));
+    if (!slots) {
+        return -1;
+    }
+    free(fs->dedup_index);
+    fs->dedup_index = slots;
+    fs->dedup_index_size = size;
+    fs->dedup_index_used = 0;
+    for (uint32_t i = 0; i < fs->layout.max_files; i++) {
+        const DedupPrints *mine = &fs->fingerprints[i];
+        for (uint32_t e = 0; mine->prints && e < mine->count; e++) {
+            if (mine->prints[e] != 0) {
+                dedup_index_put(fs, mine->prints[e], (int)i, e);
+            }
+        }
+    }
+    return 0;
+}
+
+/* Guarda as impressões das extensões do arquivo (o array passa a ser
+   dele) e as acrescenta ao índice */
+static void dedup_remember(FileSystem *fs, int index, uint64_t *prints, uint32_t count) {
+    DedupPrints *mine = &fs->fingerprints[index];
+    free(mine->prints);
+    mine->prints = prints;
+    mine->count = count;
+    if (!fs->dedup_index || ((uint64_t)fs->dedup_index_used + count) * 2 > fs->dedup_index_size) {
+        dedup_index_rebuild(fs, 0); // Já inclui as novas
+        return;
+    }
+    for (uint32_t e = 0; e < count; e++) {
+        if (prints[e] != 0) {
+            dedup_index_put(fs, prints[e], index, e);
+        }
+    }
+}
+
+/* Extensão de outro arquivo com o mesmo conteúdo do trecho, que ocupa
+   outros blocos; retorna o arquivo, com o bloco inicial dela em *start,
+   ou -1 */
+static int dedup_find(FileSystem *fs, int index, uint64_t print, const DedupRun *run,
+                      uint8_t *buffer, uint64_t *start) {
+    if (!fs->dedup_index || print == 0) {
+        return -1;
+    }
+    for (uint32_t pos = dedup_home(fs, print); fs->dedup_index[pos].print != 0;
+         pos = (pos + 1) & (fs->dedup_index_size - 1)) {
+        const DedupSlot *slot = &fs->dedup_index[pos];
+        if (slot->print != print || slot->entry == index) {
+            continue;
+        }
+        const FileEntry *other = &fs->file_table[slot->entry];
+        const DedupPrints *theirs = &fs->fingerprints[slot->entry];
+        FileExtent single;
+        uint32_t count;
+        const FileExtent *list = file_extents(other, &single, &count);
+        if (!other->is_used || !theirs->prints || slot->extent >= theirs->count ||
+            theirs->prints[slot->extent] != print || slot->extent >= count) {
+            continue; // O arquivo mudou depois de entrar no índice
+        }
+        const FileExtent *extent = &list[slot->extent];
+        if (extent->count != run->count || extent->start == run->start ||
+            extent_length(fs, other, list, slot->extent) != run->length ||
+            !run_equals(fs, run, extent->start, buffer)) {
+            continue;
+        }
+        *start = extent->start;
+        return slot->entry;
+    }
+    return -1;
+}
+
+/* A entrada index deixa o que ocupa e passa a ser uma referência à
+   extensão (start, count) de owner, que já tem o conteúdo. Com a tabela
+   de extensões compartilhadas cheia, nada muda. */
+static int dedup_adopt(FileSystem *fs, int index, int owner, uint64_t start, uint64_t count) {
+    if (share_lookup(fs, start, count) == -1 && share_room(fs) == 0) {
+        return -1;
+    }
+    FileEntry *entry = &fs->file_table[index];
+    file_release_blocks(fs, index);
+    share_ref(fs, &fs->file_table[owner], start, count);
+    entry->start_block = start;
+    entry->size_blocks = count;
+    entry->shared = 1;
+    return 0;
+}
+
+/* Cada extensão própria do arquivo igual a uma de outro arquivo passa a
+   ser uma referência a ela; o conteúdo vem de data (em memória) ou do
+   disco. As que não têm posição na tabela de extensões compartilhadas
+   ficam como estão (*table_full). Retorna os blocos liberados (com
+   *merged se alguma extensão foi unida) ou -1 sem memória ou espaço para
+   o mapa novo, e nesse caso nada muda. Extensões repetidas dentro do
+   próprio arquivo não são unidas. */
+static int64_t dedup_file(FileSystem *fs, int index, const uint8_t *data, int *table_full, int *merged) {
+    FileEntry *entry = &fs->file_table[index];
+    DedupPrints *mine = &fs->fingerprints[index];
+    FileExtent single;
+    uint32_t count;
+    const FileExtent *list = file_extents(entry, &single, &count);
+    *merged = 0;
+    if (count == 0) {
+        return 0;
+    }
+    
+    uint8_t *buffer = malloc(DEDUP_CHUNK);
+    int fresh = !mine->prints || mine->count != count;
+    uint64_t *prints = fresh ? NULL : mine->prints;
+    if (buffer && fresh) {
+        prints = dedup_prints(fs, index, data, buffer, &count);
+    }
+    FileExtent *before = malloc(count * sizeof(FileExtent));
+    FileExtent *after = malloc(count * sizeof(FileExtent));
+    int *owners = malloc(count * sizeof(int));
+    if (!buffer || !prints || !before || !after || !owners) {
+        if (fresh) free(prints);
+        free(buffer);
+        free(before);
+        free(after);
+        free(owners);
+        return -1;
+    }
+    memcpy(before, list, count * sizeof(FileExtent));
+    memcpy(after, list, count * sizeof(FileExtent));
+    
+    // Alvos de cada extensão, enquanto houver posição na tabela
+    uint32_t room = share_room(fs), found = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        owners[i] = -1;
+        if (prints[i] == 0 || share_lookup(fs, before[i].start, before[i].count) != -1) {
+            continue; // Vazia ou já compartilhada
+        }
+        DedupRun run = { before[i].start, before[i].count, extent_length(fs, entry, before, i),
+                         data ? data + before[i].logical * fs->layout.block_size : NULL };
+        uint64_t start;
+        int owner = dedup_find(fs, index, prints[i], &run, buffer, &start);
+        if (owner == -1) {
+            continue;
+        }
+        int needed = share_lookup(fs, start, before[i].count) == -1;
+        for (uint32_t j = 0; j < i && needed; j++) {
+            needed = !(owners[j] != -1 && after[j].start == start);
+        }
+        if ((uint32_t)needed > room) {
+            *table_full = 1;
+            continue;
+        }
+        room -= (uint32_t)needed;
+        owners[i] = owner;
+        after[i].start = start;
+        found++;
+    }
+    free(buffer);
+    
+    int64_t released = 0;
+    uint64_t map = 0;
+    if (found > 0 && extent_map_prepare(fs, after, count, &map) != 0) {
+        released = -1;
+    } else if (found > 0) {
+        // A lista nova aponta para os alvos; as impressões continuam as
+        // mesmas e voltam para o arquivo depois da troca
+        if (!fresh) {
+            mine->prints = NULL;
+        }
+        file_install_map(fs, index, after, count, map, 0);
+        after = NULL;
+        list = file_extents(entry, &single, &count);
+        for (uint32_t i = 0; i < count; i++) {
+            if (owners[i] != -1) {
+                share_ref(fs, &fs->file_table[owners[i]], list[i].start, list[i].count);
+                fs_release_range(fs, before[i].start, before[i].count);
+                released += (int64_t)before[i].count;
+            }
+        }
+        entry->shared = share_count_of(fs, entry);
+        *merged = 1;
+        if (!fresh) {
+            mine->prints = prints;
+            mine->count = count;
+        }
+    }
+    if (fresh && released >= 0) {
+        dedup_remember(fs, index, prints, count);
+    } else if (fresh) {
+        free(prints);
+    }
+    free(before);
+    free(after);
+    free(owners);
+    return released;
+}
+
+/* Libera as impressões e o índice (modo desligado) */
+static void dedup_release(FileSystem *fs) {
+    if (fs->fingerprints) {
+        for (uint32_t i = 0; i < fs->layout.max_files; i++) {
+            free(fs->fingerprints[i].prints);
+        }
+    }
+    free(fs->fingerprints);
+    free(fs->dedup_index);
+    fs->fingerprints = NULL;
+    fs->dedup_index = NULL;
+    fs->dedup_index_size = 0;
+    fs->dedup_index_used = 0;
+}
+
+/* ============================================
+   COMPRESSÃO
+   ============================================ */
+
+/* Arquivos com compressão ligada são gravados em quadros independentes
+   (ver CompressedHeader): ler um trecho só descomprime os quadros que o
+   contêm, e converter um arquivo inteiro passa por um quadro de cada
+   vez, sem carregar o arquivo na memória. */
+
+static uint32_t compressed_frame_count(uint64_t raw_size) {
+    return (uint32_t)((raw_size + COMPRESS_FRAME_SIZE - 1) / COMPRESS_FRAME_SIZE);
+}
+
+/* Cabeçalho mais a tabela de quadros: onde começa o primeiro quadro */
+static uint64_t compressed_header_size(uint32_t frame_count) {
+    return sizeof(CompressedHeader) + (uint64_t)frame_count * sizeof(uint32_t);
+}
+
+static uint32_t frame_stored_size(uint32_t table_value) {
+    return table_value & ~COMPRESS_FRAME_RAW;
+}
+
+/* Bytes descomprimidos do quadro frame */
+static uint32_t frame_raw_size(uint64_t raw_size, uint32_t frame) {
+    uint64_t offset = (uint64_t)frame * COMPRESS_FRAME_SIZE;
+    return raw_size - offset < COMPRESS_FRAME_SIZE ? (uint32_t)(raw_size - offset) : COMPRESS_FRAME_SIZE;
+}
+
+/* Grava em out (com espaço para size bytes) o quadro comprimido ou, se
+   não diminuir, como está. Retorna o valor da tabela de quadros. */
+static uint32_t frame_encode(const uint8_t *raw, uint32_t size, uint8_t *out) {
+    size_t packed = size > 1 ? lz_compress(raw, size, out, size - 1) : 0;
+    if (packed > 0) {
+        return (uint32_t)packed;
+    }
+    memcpy(out, raw, size);
+    return size | COMPRESS_FRAME_RAW;
+}
+
+/* Descomprime em dst o quadro que começa em offset no conteúdo gravado;
+   scratch comporta um quadro gravado */
+static int frame_decode(FileSystem *fs, const FileEntry *entry, uint64_t offset, uint32_t table_value,
+                        uint32_t raw_size, uint8_t *dst, uint8_t *scratch) {
+    uint32_t stored = frame_stored_size(table_value);
+    if (table_value & COMPRESS_FRAME_RAW) {
+        return stored == raw_size ? file_read_at(fs, entry, offset, dst, raw_size) : -1;
+    }
+    if (file_read_at(fs, entry, offset, scratch, stored) != 0) {
+        return -1;
+    }
+    return lz_decompress(scratch, stored, dst, raw_size);
+}
+
+/* Lê e confere o cabeçalho e a tabela de quadros; *table fica com a
+   tabela, a ser liberada pelo chamador. Um arquivo comprimido vazio não
+   tem cabeçalho. */
+static int compressed_load(FileSystem *fs, const FileEntry *entry, CompressedHeader *header,
+                           uint32_t **table) {
+    memset(header, 0, sizeof(CompressedHeader));
+    *table = NULL;
+    if (entry->size_bytes > 0) {
+        if (entry->size_bytes < sizeof(CompressedHeader) ||
+            file_read_at(fs, entry, 0, header, sizeof(CompressedHeader)) != 0) {
+            goto corrupt;
+        }
+        uint64_t frames_raw = (uint64_t)header->frame_count * COMPRESS_FRAME_SIZE;
+        if (header->magic != COMPRESS_MAGIC || frames_raw < header->raw_size ||
+            frames_raw - header->raw_size >= COMPRESS_FRAME_SIZE ||
+            compressed_header_size(header->frame_count) > entry->size_bytes) {
+            goto corrupt;
+        }
+    }
+    
+    *table = malloc(((uint64_t)header->frame_count + 1) * sizeof(uint32_t));
+    if (!*table) {
+        log_error("Erro: Falha ao alocar memória.\n");
+        return -1;
+    }
+    if (header->frame_count > 0 &&
+        file_read_at(fs, entry, sizeof(CompressedHeader), *table,
+                     (uint64_t)header->frame_count * sizeof(uint32_t)) != 0) {
+        goto corrupt;
+    }
+    
+    uint64_t total = compressed_header_size(header->frame_count);
+    for (uint32_t f = 0; f < header->frame_count; f++) {
+        uint32_t stored = frame_stored_size((*table)[f]);
+        if (stored == 0 || stored > COMPRESS_FRAME_SIZE) {
+            goto corrupt;
+        }
+        total += stored;
+    }
+    if (entry->size_bytes > 0 && total > entry->size_bytes) {
+        goto corrupt;
+    }
+    return 0;
+    
+corrupt:
+    free(*table);
+    *table = NULL;
+    log_error("Erro: Conteúdo comprimido de '%s' corrompido.\n", entry->name);
+    return -1;
+}
+
+/* Descomprime o arquivo inteiro em buffer; *raw_size recebe o tamanho */
+static int compressed_read_all(FileSystem *fs, const FileEntry *entry, uint8_t *buffer,
+                               uint64_t *raw_size) {
+    CompressedHeader header;
+    uint32_t *table;
+    if (compressed_load(fs, entry, &header, &table) != 0) {
+        return -1;
+    }
+    
+    uint8_t *scratch = malloc(COMPRESS_FRAME_SIZE);
+    int result = scratch ? 0 : -1;
+    uint64_t offset = compressed_header_size(header.frame_count);
+    for (uint32_t f = 0; f < header.frame_count && result == 0; f++) {
+        result = frame_decode(fs, entry, offset, table[f], frame_raw_size(header.raw_size, f),
+                              buffer + (uint64_t)f * COMPRESS_FRAME_SIZE, scratch);
+        offset += frame_stored_size(table[f]);
+    }
+    free(scratch);
+    free(table);
+    *raw_size = header.raw_size;
+    return result;
+}
+
+/* Monta em memória o conteúdo comprimido de size bytes. Retorna o
+   buffer (liberado pelo chamador), com *stored_size bytes. */
+static uint8_t* compress_image(const uint8_t *data, uint64_t size, uint64_t *stored_size) {
+    uint32_t count = compressed_frame_count(size);
+    uint64_t header_size = compressed_header_size(count);
+    uint8_t *image = malloc(header_size + size);
+    if (!image) {
+        return NULL;
+    }
+    
+    CompressedHeader header = { COMPRESS_MAGIC, count, size };
+    memcpy(image, &header, sizeof(header));
+    uint64_t pos = header_size;
+    for (uint32_t f = 0; f < count; f++) {
+        uint64_t offset = (uint64_t)f * COMPRESS_FRAME_SIZE;
+        uint32_t value = frame_encode(data + offset, frame_raw_size(size, f), image + pos);
+        memcpy(image + sizeof(header) + (uint64_t)f * sizeof(uint32_t), &value, sizeof(value));
+        pos += frame_stored_size(value);
+    }
+    *stored_size = pos;
+    return image;
+}
+
+/* Converte para o formato comprimido o conteúdo do arquivo. O destino é
+   reservado para o pior caso (nenhum quadro diminui) e a sobra do fim é
+   devolvida; na falha o arquivo fica como estava. */
+static int file_compress(FileSystem *fs, int index) {
+    FileEntry *entry = &fs->file_table[index];
+    uint64_t raw_size = entry->size_bytes;
+    uint32_t count = compressed_frame_count(raw_size);
+    uint64_t header_size = compressed_header_size(count);
+    
+    if (raw_size == 0) {
+        entry->compressed = 1;
+        fs_entry_changed(fs, index);
+        return 0;
+    }
+    
+    uint32_t *table = malloc(count * sizeof(uint32_t));
+    uint8_t *raw = malloc(2 * COMPRESS_FRAME_SIZE);
+    if (!table || !raw) {
+        free(table);
+        free(raw);
+        log_error("Erro: Falha ao alocar memória.\n");
+        return -1;
+    }
+    uint8_t *out = raw + COMPRESS_FRAME_SIZE;
+    
+    uint64_t worst_blocks = (header_size + raw_size + fs->layout.block_size - 1) / fs->layout.block_size;
+    FileExtent *list;
+    uint32_t extents;
+    if (layout_alloc(fs, worst_blocks, -1, &list, &extents) != 0) {
+        free(table);
+        free(raw);
+        log_error("Erro: Espaço insuficiente no disco para comprimir '%s'.\n", entry->name);
+        return -1;
+    }
+    
+    uint64_t pos = header_size;
+    int result = 0;
+    for (uint32_t f = 0; f < count && result == 0; f++) {
+        uint32_t len = frame_raw_size(raw_size, f);
+        if (file_read_at(fs, entry, (uint64_t)f * COMPRESS_FRAME_SIZE, raw, len) != 0) {
+            result = -1;
+            break;
+        }
+        table[f] = frame_encode(raw, len, out);
+        result = extents_transfer(fs, list, extents, pos, out, frame_stored_size(table[f]), XFER_WRITE);
+        pos += frame_stored_size(table[f]);
+    }
+    
+    CompressedHeader header = { COMPRESS_MAGIC, count, raw_size };
+    if (result == 0 &&
+        (extents_transfer(fs, list, extents, 0, &header, sizeof(header), XFER_WRITE) != 0 ||
+         extents_transfer(fs, list, extents, sizeof(header), table,
+                          (uint64_t)count * sizeof(uint32_t), XFER_WRITE) != 0)) {
+        result = -1;
+    }
+    free(table);
+    free(raw);
+    
+    if (result == 0) {
+        extents_trim(fs, list, &extents, (pos + fs->layout.block_size - 1) / fs->layout.block_size);
+        result = file_install(fs, index, list, extents, 1);
+    }
+    if (result != 0) {
+        log_error("Erro: Falha ao comprimir o arquivo '%s'.\n", entry->name);
+        extents_release(fs, list, extents);
+        return -1;
+    }
+    
+    entry->size_bytes = pos;
+    entry->compressed = 1;
+    fs_entry_changed(fs, index);
+    return 0;
+}
+
+/* Volta o arquivo ao conteúdo sem compressão, em blocos novos,
+   descomprimindo um quadro de cada vez */
+static int file_decompress(FileSystem *fs, int index) {
+    FileEntry *entry = &fs->file_table[index];
+    CompressedHeader header;
+    uint32_t *table;
+    if (compressed_load(fs, entry, &header, &table) != 0) {
+        return -1;
+    }
+    
+    uint8_t *frame = malloc(2 * COMPRESS_FRAME_SIZE);
+    if (!frame) {
+        free(table);
+        log_error("Erro: Falha ao alocar memória.\n");
+        return -1;
+    }
+    
+    uint64_t blocks = (header.raw_size + fs->layout.block_size - 1) / fs->layout.block_size;
+    FileExtent *list;
+    uint32_t extents;
+    if (layout_alloc(fs, blocks, -1, &list, &extents) != 0) {
+        free(frame);
+        free(table);
+        log_error("Erro: Espaço insuficiente no disco para descomprimir '%s'.\n", entry->name);
+        return -1;
+    }
+    
+    int result = 0;
+    uint64_t offset = compressed_header_size(header.frame_count);
+    for (uint32_t f = 0; f < header.frame_count && result == 0; f++) {
+        uint32_t len = frame_raw_size(header.raw_size, f);
+        if (frame_decode(fs, entry, offset, table[f], len, frame, frame + COMPRESS_FRAME_SIZE) != 0 ||
+            extents_transfer(fs, list, extents, (uint64_t)f * COMPRESS_FRAME_SIZE, frame, len,
+                             XFER_WRITE) != 0) {
+            result = -1;
+        }
+        offset += frame_stored_size(table[f]);
+    }
+    free(frame);
+    free(table);
+    if (result == 0) {
+        result = file_install(fs, index, list, extents, 1);
+    }
+    if (result != 0) {
+        log_error("Erro: Falha ao descomprimir o arquivo '%s'.\n", entry->name);
+        extents_release(fs, list, extents);
+        return -1;
+    }
+    
+    entry->size_bytes = header.raw_size;
+    entry->compressed = 0;
+    fs_entry_changed(fs, index);
+    return 0;
+}
+
+/* ============================================
+   ÍNDICE DE NOMES
+   ============================================ */
+
+/* Como os nomes têm no máximo 8 bytes, o nome completo (completado com
+   zeros) cabe numa chave de 64 bits: comparar chaves substitui strcmp. */
+static uint64_t name_key(const char *name) {
+    char padded[MAX_FILENAME_LENGTH] = {0};
+    for (int i = 0; i < MAX_FILENAME_LENGTH && name[i] != '\0'; i++) {
+        padded[i] = name[i];
+    }
+    uint64_t key;
+    memcpy(&key, padded, sizeof(key));
+    return key;
+}
+
+static uint32_t name_slot(const FileSystem *fs, uint64_t key) {
+    // Hash multiplicativo (Fibonacci) sobre os 64 bits do nome
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (fs->layout.name_index_size - 1);
+}
+
+/* Retorna o índice da entrada em file_table ou -1 */
+static int name_index_find(FileSystem *fs, const char *name) {
+    if (strlen(name) > MAX_FILENAME_LENGTH) {
+        return -1;
+    }
+    uint64_t key = name_key(name);
+    for (uint32_t slot = name_slot(fs, key); ; slot = (slot + 1) & (fs->layout.name_index_size - 1)) {
+        NameSlot *ns = &fs->name_index[slot];
+        if (ns->entry < 0) {
+            return -1;
+        }
+        if (ns->key == key) {
+            return ns->entry;
+        }
+    }
+}
+
+/* name_index_find com o tempo somado a op_timing.lookup_ns */
+static int name_index_lookup(FileSystem *fs, const char *name) {
+    uint64_t start = clock_ns();
+    int entry = name_index_find(fs, name);
+    time_since(&op_timing.lookup_ns, start);
+    return entry;
+}
+
+static void name_index_insert(FileSystem *fs, int entry) {
+    uint64_t key = name_key(fs->file_table[entry].name);
+    uint32_t slot = name_slot(fs, key);
+    while (fs->name_index[slot].entry >= 0) {
+        slot = (slot + 1) & (fs->layout.name_index_size - 1);
+    }
+    fs->name_index[slot].key = key;
+    fs->name_index[slot].entry = entry;
+}
+
+/* Remoção com deslocamento para trás: mantém as sequências de sondagem
+   sem precisar de marcadores de posição apagada. */
+static void name_index_remove(FileSystem *fs, int entry) {
+    uint32_t slot = name_slot(fs, name_key(fs->file_table[entry].name));
+    while (fs->name_index[slot].entry != entry) {
+        if (fs->name_index[slot].entry < 0) {
+            return;
+        }
+        slot = (slot + 1) & (fs->layout.name_index_size - 1);
+    }
+    
+    uint32_t hole = slot;
+    for (uint32_t next = (hole + 1) & (fs->layout.name_index_size - 1);
+         fs->name_index[next].entry >= 0;
+         next = (next + 1) & (fs->layout.name_index_size - 1)) {
+        uint32_t home = name_slot(fs, fs->name_index[next].key);
+        // Move se a posição ideal do elemento não está entre hole e next
+        if (((next - home) & (fs->layout.name_index_size - 1)) >= ((next - hole) & (fs->layout.name_index_size - 1))) {
+            fs->name_index[hole] = fs->name_index[next];
+            hole = next;
+        }
+    }
+    fs->name_index[hole].entry = -1;
+}
+
+/* Monta o índice de nomes e a pilha de entradas livres a partir da
+   tabela de arquivos. As entradas livres são empilhadas em ordem
+   decrescente para que a menor seja reutilizada primeiro. */
+static int name_index_build(FileSystem *fs) {
+    fs->name_index = malloc(fs->layout.name_index_size * sizeof(NameSlot));
+    fs->free_slots = malloc(fs->layout.max_files * sizeof(int32_t));
+    if (!fs->name_index || !fs->free_slots) {
+        free(fs->name_index);
+        free(fs->free_slots);
+        return -1;
+    }
+    
+    for (uint32_t i = 0; i < fs->layout.name_index_size; i++) {
+        fs->name_index[i].entry = -1;
+    }
+    fs->free_slot_count = 0;
+    for (int i = fs->layout.max_files - 1; i >= 0; i--) {
+        if (fs->file_table[i].is_used) {
+            name_index_insert(fs, i);
+        } else {
+            fs->free_slots[fs->free_slot_count++] = i;
+        }
+    }
+    return 0;
+}
+
+/* ============================================
+   FORMATAÇÃO DO SISTEMA DE ARQUIVOS
+   ============================================ */
+
+int fs_layout_compute(const FsGeometry *geometry, FsLayout *layout) {
+    uint32_t bs = geometry->block_size;
+    if (bs < FS_MIN_BLOCK_SIZE || bs > FS_MAX_BLOCK_SIZE || (bs & (bs - 1)) != 0 ||
+        geometry->max_files < FS_MIN_FILES || geometry->max_files > FS_MAX_FILES ||
+        geometry->total_blocks > FS_MAX_TOTAL_BLOCKS) {
+        return -1;
+    }
+    
+    memset(layout, 0, sizeof(FsLayout));
+    layout->block_size = bs;
+    layout->total_blocks = geometry->total_blocks;
+    layout->max_files = geometry->max_files;
+    layout->bitmap_start = SUPERBLOCK_BLOCKS;
+    layout->bitmap_blocks = (geometry->total_blocks + (uint64_t)bs * 8 - 1) / ((uint64_t)bs * 8);
+    layout->root_dir_start = layout->bitmap_start + layout->bitmap_blocks;
+    layout->root_dir_blocks = ((uint64_t)geometry->max_files * METADATA_SIZE + bs - 1) / bs;
+    layout->data_start = layout->root_dir_start + layout->root_dir_blocks;
+    
+    // Journal com JOURNAL_BYTES (blocos grandes: ao menos JOURNAL_MIN_BLOCKS
+    // commits antes do checkpoint) e uma extensão compartilhada para cada
+    // dois arquivos, arredondada para blocos inteiros
+    layout->journal_blocks = JOURNAL_BYTES / bs > JOURNAL_MIN_BLOCKS ? JOURNAL_BYTES / bs : JOURNAL_MIN_BLOCKS;
+    layout->share_table_blocks = ((uint64_t)geometry->max_files / 2 * sizeof(SharedExtent) + bs - 1) / bs;
+    uint64_t reserved = layout->data_start + layout->share_table_blocks + layout->journal_blocks;
+    if (geometry->total_blocks < reserved + FS_MIN_DATA_BLOCKS) {
+        return -1;
+    }
+    layout->journal_start = geometry->total_blocks - layout->journal_blocks;
+    layout->share_table_start = layout->journal_start - layout->share_table_blocks;
+    layout->share_entries = (uint32_t)(layout->share_table_blocks * bs / sizeof(SharedExtent));
+    
+    layout->name_index_size = 1;
+    while (layout->name_index_size < 2 * geometry->max_files) {
+        layout->name_index_size *= 2;
+    }
+    layout->extent_map_entries = (uint32_t)((bs - sizeof(ExtentMapHeader)) / sizeof(ExtentMapEntry));
+    return 0;
+}
+
+/* Seções de um disco formatado: a geometria vem do superbloco, e as
+   posições gravadas nele prevalecem sobre as calculadas. Journal e tabela
+   de extensões compartilhadas ausentes (discos antigos) ficam nas
+   posições calculadas, usadas pela migração. */
+static int layout_load(const Superblock *sb, FsLayout *layout) {
+    FsGeometry geometry = { sb->block_size, sb->total_blocks, sb->max_files };
+    if (fs_layout_compute(&geometry, layout) != 0 ||
+        sb->bitmap_start < SUPERBLOCK_BLOCKS || sb->root_dir_start < sb->bitmap_start ||
+        sb->data_start < sb->root_dir_start || sb->data_start >= sb->total_blocks) {
+        return -1;
+    }
+    
+    uint64_t bs = sb->block_size;
+    layout->bitmap_start = sb->bitmap_start;
+    layout->bitmap_blocks = sb->root_dir_start - sb->bitmap_start;
+    layout->root_dir_start = sb->root_dir_start;
+    layout->root_dir_blocks = sb->data_start - sb->root_dir_start;
+    layout->data_start = sb->data_start;
+    if (layout->bitmap_blocks * bs * 8 < layout->total_blocks ||
+        layout->root_dir_blocks * bs < (uint64_t)layout->max_files * METADATA_SIZE) {
+        return -1;
+    }
+    
+    if (sb->journal_blocks > 0) {
+        if (sb->journal_start < sb->data_start ||
+            (uint64_t)sb->journal_start + sb->journal_blocks > sb->total_blocks) {
+            return -1;
+        }
+        layout->journal_start = sb->journal_start;
+        layout->journal_blocks = sb->journal_blocks;
+    }
+    if (sb->share_table_blocks > 0) {
+        if (sb->share_table_start < sb->data_start ||
+            (uint64_t)sb->share_table_start + sb->share_table_blocks > sb->total_blocks) {
+            return -1;
+        }
+        layout->share_table_start = sb->share_table_start;
+        layout->share_table_blocks = sb->share_table_blocks;
+        layout->share_entries = (uint32_t)(layout->share_table_blocks * bs / sizeof(SharedExtent));
+    }
+    return 0;
+}
+
+/* Zera a região [start, start + blocks) da imagem */
+static int zero_region(int fd, const FsLayout *layout, uint64_t start, uint64_t blocks) {
+    static const uint8_t zeros[256 * 1024];
+    uint64_t offset = start * layout->block_size;
+    uint64_t size = blocks * layout->block_size;
+    while (size > 0) {
+        uint64_t n = size < sizeof(zeros) ? size : sizeof(zeros);
+        if (pwrite_full(fd, zeros, n, offset) != 0) {
+            return -1;
+        }
+        offset += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/* A imagem nova é esparsa: ftruncate define o tamanho e a área de dados
+   fica sem blocos no hospedeiro até ser escrita. Só os metadados, a
+   tabela de extensões compartilhadas e o journal são reservados com
+   posix_fallocate (o commit do journal não pode falhar por falta de
+   espaço). Na formatação rápida, a imagem existente é mantida e só essas
+   regiões são zeradas: os dados antigos continuam nos blocos, mas nada
+   aponta para eles. */
+int fs_format_geometry(const char *disk_path, const FsGeometry *geometry, int quick) {
+    int fd = open(disk_path, O_RDWR | O_CREAT | (quick ? 0 : O_TRUNC), 0644);
+    if (fd < 0) {
+        log_error("Erro: Não foi possível criar o disco virtual.\n");
+        return -1;
+    }
+    
+    // Sem geometria: a padrão, ou a da imagem na formatação rápida
+    FsLayout layout;
+    Superblock sb;
+    FsGeometry chosen = { FS_DEFAULT_BLOCK_SIZE, FS_DEFAULT_TOTAL_BLOCKS, FS_DEFAULT_MAX_FILES };
+    if (geometry) {
+        chosen = *geometry;
+    } else if (quick && pread_full(fd, &sb, sizeof(sb), 0) == 0 &&
+               strncmp(sb.signature, "UNIOESTE", 8) == 0 && layout_load(&sb, &layout) == 0) {
+        chosen = (FsGeometry){ sb.block_size, sb.total_blocks, sb.max_files };
+    }
+    if (fs_layout_compute(&chosen, &layout) != 0) {
+        log_error("Erro: Geometria inválida (bloco de %u bytes, %llu blocos, %u arquivos).\n",
+                  chosen.block_size, (unsigned long long)chosen.total_blocks, chosen.max_files);
+        close(fd);
+        return -1;
+    }
+    
+    uint64_t bs = layout.block_size;
+    int result = ftruncate(fd, (off_t)(layout.total_blocks * bs));
+    if (result == 0) {
+        result = posix_fallocate(fd, 0, (off_t)(layout.data_start * bs));
+    }
+    if (result == 0) {
+        result = posix_fallocate(fd, (off_t)(layout.share_table_start * bs),
+                                 (off_t)((layout.share_table_blocks + layout.journal_blocks) * bs));
+    }
+    if (result != 0) {
+        log_error("Erro: Espaço insuficiente para o disco virtual.\n");
+        close(fd);
+        return -1;
+    }
+    
+    // Na imagem truncada, diretório, tabela e journal já leem como zeros.
+    // O superbloco antigo é apagado primeiro e o novo gravado por último:
+    // uma formatação interrompida não monta.
+    if (quick && (zero_region(fd, &layout, 0, SUPERBLOCK_BLOCKS) != 0 ||
+                  zero_region(fd, &layout, layout.root_dir_start, layout.root_dir_blocks) != 0 ||
+                  zero_region(fd, &layout, layout.share_table_start,
+                              layout.share_table_blocks + layout.journal_blocks) != 0)) {
+        log_error("Erro: Falha ao escrever no disco virtual.\n");
+        close(fd);
+        return -1;
+    }
+    
+    uint64_t free_blocks = layout.total_blocks - layout.data_start -
+                           layout.share_table_blocks - layout.journal_blocks;
+    
+    // Cria o superbloco
+    memset(&sb, 0, sizeof(Superblock));
+    strcpy(sb.signature, "UNIOESTE");
+    sb.block_size = layout.block_size;
+    sb.total_blocks = (uint32_t)layout.total_blocks;
+    sb.free_blocks = (uint32_t)free_blocks;
+    sb.bitmap_start = (uint32_t)layout.bitmap_start;
+    sb.root_dir_start = (uint32_t)layout.root_dir_start;
+    sb.data_start = (uint32_t)layout.data_start;
+    sb.max_files = layout.max_files;
+    sb.current_files = 0;
+    sb.version = FS_VERSION_CURRENT;
+    sb.journal_start = (uint32_t)layout.journal_start;
+    sb.journal_blocks = (uint32_t)layout.journal_blocks;
+    sb.journal_sequence = 1;
+    sb.share_table_start = (uint32_t)layout.share_table_start;
+    sb.share_table_blocks = (uint32_t)layout.share_table_blocks;
+    
+    // Inicializa o bitmap (marca blocos do sistema como ocupados)
+    uint8_t *bitmap = calloc(layout.bitmap_blocks, bs);
+    if (!bitmap) {
+        close(fd);
+        return -1;
+    }
+    bitmap_set_range(bitmap, 0, layout.data_start);
+    bitmap_set_range(bitmap, layout.journal_start, layout.journal_blocks);
+    bitmap_set_range(bitmap, layout.share_table_start, layout.share_table_blocks);
+    
+    result = pwrite_full(fd, bitmap, layout.bitmap_blocks * bs, layout.bitmap_start * bs);
+    free(bitmap);
+    if (result == 0) {
+        result = pwrite_full(fd, &sb, sizeof(Superblock), 0);
+    }
+    if (close(fd) != 0 || result != 0) {
+        log_error("Erro: Falha ao escrever no disco virtual.\n");
+        return -1;
+    }
+    
+    log_info("Sistema de arquivos formatado com sucesso%s!\n", quick ? " (formatação rápida)" : "");
+    log_info("Tamanho total: %llu blocos de %u bytes (%llu MB)\n",
+             (unsigned long long)layout.total_blocks, layout.block_size,
+             (unsigned long long)(layout.total_blocks * bs / (1024 * 1024)));
+    log_info("Área de dados: %llu blocos\n", (unsigned long long)free_blocks);
+    log_info("Máximo de arquivos: %u\n", layout.max_files);
+    log_info("Journal: %llu blocos\n", (unsigned long long)layout.journal_blocks);
+    return 0;
+}
+
+int fs_format(const char *disk_path) {
+    return fs_format_geometry(disk_path, NULL, 0);
+}
+
+int fs_format_quick(const char *disk_path) {
+    return fs_format_geometry(disk_path, NULL, 1);
+}
+
+/* ============================================
+   JOURNAL DE METADADOS
+   ============================================ */
+
+/* Cada operação que altera metadados (criação, escrita, remoção...)
+   acrescenta registros lógicos a journal_buf: a imagem nova da entrada
+   alterada e as faixas de blocos alocadas e liberadas. A cada
+   JOURNAL_GROUP_OPS operações os registros viram uma transação, gravada
+   numa única escrita seguida de fdatasync. Na montagem, as transações com
+   sequência e CRC válidos são reaplicadas; fs_sync grava os metadados no
+   lugar definitivo e recomeça o journal. */
+
+/* Dados do modo normal estão no cache; no modo mapeado, nas páginas do
+   mapeamento */
+static int flush_data(FileSystem *fs) {
+    if (fs->disk_map) {
+        return msync(fs->disk_map, fs->disk_map_size, MS_SYNC);
+    }
+    return cache_flush(fs->cache);
+}
+
+static int journal_enabled(const FileSystem *fs) {
+    return fs->superblock.journal_blocks > 0;
+}
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, uint64_t size) {
+    static uint32_t table[256];
+    if (table[1] == 0) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+    }
+    crc = ~crc;
+    for (uint64_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/* journal_buf guarda o espaço do cabeçalho no início, para a transação
+   ser gravada direto dele */
+static void journal_append(FileSystem *fs, JournalRecordType type, const void *payload, uint32_t size) {
+    fs->op_dirty = 1;
+    if (!journal_enabled(fs)) return;
+    
+    uint64_t needed = sizeof(JournalHeader) + fs->journal_len + 1 + size;
+    if (needed > fs->journal_cap) {
+        uint64_t cap = fs->journal_cap ? fs->journal_cap : 4 * fs->layout.block_size;
+        while (cap < needed) {
+            cap *= 2;
+        }
+        uint8_t *buf = realloc(fs->journal_buf, cap);
+        if (!buf) {
+            // Sem memória para o registro: marca o journal como cheio, e o
+            // próximo commit vira um fs_sync completo
+            fs->journal_head = (uint64_t)fs->superblock.journal_blocks * fs->layout.block_size;
+            return;
+        }
+        fs->journal_buf = buf;
+        fs->journal_cap = cap;
+    }
+    
+    uint8_t *dest = fs->journal_buf + sizeof(JournalHeader) + fs->journal_len;
+    dest[0] = (uint8_t)type;
+    memcpy(dest + 1, payload, size);
+    fs->journal_len += 1 + size;
+}
+
+/* Tamanho do conteúdo de cada tipo de registro */
+static uint32_t journal_record_size(uint8_t type) {
+    switch (type) {
+    case JREC_ENTRY:
+        return 4 + METADATA_SIZE;
+    case JREC_SHARE:
+        return 4 + sizeof(SharedExtent);
+    default:
+        return 16;
+    }
+}
+
+/* Grava os registros pendentes como uma transação. Sem espaço na região,
+   faz um checkpoint completo (fs_sync), que também os torna duráveis. */
+static int journal_commit(FileSystem *fs) {
+    if (!journal_enabled(fs) || fs->journal_len == 0) return 0;
+    
+    uint64_t region = (uint64_t)fs->superblock.journal_blocks * fs->layout.block_size;
+    uint64_t total = sizeof(JournalHeader) + fs->journal_len;
+    total = (total + fs->layout.block_size - 1) / fs->layout.block_size * fs->layout.block_size;
+    if (fs->journal_head + total > region) {
+        return fs_sync(fs);
+    }
+    if (total > fs->journal_cap) {
+        // Espaço para o preenchimento do último bloco
+        uint8_t *buf = realloc(fs->journal_buf, total);
+        if (!buf) {
+            return fs_sync(fs);
+        }
+        fs->journal_buf = buf;
+        fs->journal_cap = total;
+    }
+    
+    // Registros apontam para dados que precisam estar no disco antes
+    if (flush_data(fs) != 0) {
+        return -1;
+    }
+    
+    uint32_t count = 0;
+    for (uint64_t pos = 0; pos < fs->journal_len; count++) {
+        uint8_t type = fs->journal_buf[sizeof(JournalHeader) + pos];
+        pos += 1 + journal_record_size(type);
+    }
+    
+    JournalHeader header = {0};
+    header.magic = JOURNAL_MAGIC;
+    header.sequence = fs->journal_next_seq;
+    header.length = (uint32_t)fs->journal_len;
+    header.record_count = count;
+    header.free_blocks = fs->superblock.free_blocks + (uint32_t)fs->reserved_blocks;
+    header.current_files = fs->superblock.current_files;
+    memcpy(fs->journal_buf, &header, sizeof(header));
+    memset(fs->journal_buf + sizeof(header) + fs->journal_len, 0,
+           total - sizeof(header) - fs->journal_len);
+    header.checksum = crc32_update(0, fs->journal_buf, sizeof(header) + fs->journal_len);
+    memcpy(fs->journal_buf, &header, sizeof(header));
+    
+    uint64_t offset = (uint64_t)fs->superblock.journal_start * fs->layout.block_size + fs->journal_head;
+    if (pwrite_full(fs->disk_fd, fs->journal_buf, total, offset) != 0 ||
+        fdatasync(fs->disk_fd) != 0) {
+        return -1;
+    }
+    
+    fs->journal_head += total;
+    fs->journal_next_seq++;
+    fs->journal_len = 0;
+    fs->journal_ops = 0;
+    fs->op_dirty = 0;
+    pending_free_apply(fs);
+    return 0;
+}
+
+/* Fim de uma operação: os registros só formam uma transação em fronteiras
+   de operação, para que nenhuma seja reaplicada pela metade */
+static void journal_op_end(FileSystem *fs) {
+    fs->op_dirty = 0;
+    if (!journal_enabled(fs)) return;
+    
+    uint64_t region = (uint64_t)fs->superblock.journal_blocks * fs->layout.block_size;
+    if (++fs->journal_ops >= JOURNAL_GROUP_OPS || fs->journal_len >= region / 4) {
+        uint64_t start = clock_ns();
+        if (journal_commit(fs) != 0) {
+            log_error("Erro: Falha ao gravar o journal de metadados.\n");
+        }
+        time_since(&op_timing.io_ns, start);
+    }
+}
+
+/* Aplica os registros de uma transação ao bitmap, à tabela de arquivos e
+   à de extensões compartilhadas */
+static int journal_apply(FileSystem *fs, const uint8_t *records, uint32_t length) {
+    uint32_t pos = 0;
+    while (pos < length) {
+        uint8_t type = records[pos++];
+        if (type == JREC_ENTRY && pos + 4 + METADATA_SIZE <= length) {
+            uint64_t index = bytes_to_array(records + pos, 4);
+            if (index >= fs->layout.max_files) return -1;
+            metadata_to_entry((const FileMetadata *)(records + pos + 4), &fs->file_table[index],
+                              fs->layout.block_size);
+            fs->dir_dirty[index * METADATA_SIZE / fs->layout.block_size] = 1;
+            pos += 4 + METADATA_SIZE;
+        } else if ((type == JREC_ALLOC || type == JREC_FREE) && pos + 16 <= length) {
+            uint64_t start = bytes_to_array(records + pos, 8);
+            uint64_t count = bytes_to_array(records + pos + 8, 8);
+            if (start < fs->layout.data_start || count > fs->layout.total_blocks || start + count > fs->layout.total_blocks) return -1;
+            if (type == JREC_ALLOC) {
+                bitmap_set_range(fs->bitmap, start, count);
+            } else {
+                bitmap_clear_range(fs->bitmap, start, count);
+            }
+            bitmap_mark_dirty(fs, start, count);
+            pos += 16;
+        } else if (type == JREC_SHARE && pos + 4 + sizeof(SharedExtent) <= length) {
+            uint64_t slot = bytes_to_array(records + pos, 4);
+            if (slot >= (uint64_t)fs->superblock.share_table_blocks * fs->layout.block_size / sizeof(SharedExtent)) {
+                return -1;
+            }
+            memcpy(&fs->share_table[slot], records + pos + 4, sizeof(SharedExtent));
+            fs->share_dirty[slot * sizeof(SharedExtent) / fs->layout.block_size] = 1;
+            pos += 4 + sizeof(SharedExtent);
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Percorre a região a partir do início, aceitando transações com a
+   sequência esperada e CRC correto; a primeira inválida encerra o
+   journal (commit interrompido ou resto de um ciclo anterior) */
+static int journal_replay(FileSystem *fs) {
+    fs->journal_next_seq = fs->superblock.journal_sequence;
+    fs->journal_head = 0;
+    if (!journal_enabled(fs)) return 0;
+    
+    uint64_t region = (uint64_t)fs->superblock.journal_blocks * fs->layout.block_size;
+    uint64_t base = (uint64_t)fs->superblock.journal_start * fs->layout.block_size;
+    uint8_t *buffer = malloc(region);
+    if (!buffer || pread_full(fs->disk_fd, buffer, region, base) != 0) {
+        free(buffer);
+        return -1;
+    }
+    
+    int replayed = 0;
+    while (fs->journal_head + sizeof(JournalHeader) <= region) {
+        uint8_t *tx = buffer + fs->journal_head;
+        JournalHeader header;
+        memcpy(&header, tx, sizeof(header));
+        if (header.magic != JOURNAL_MAGIC || header.sequence != fs->journal_next_seq ||
+            header.length > region - fs->journal_head - sizeof(header)) {
+            break;
+        }
+        
+        uint32_t checksum = header.checksum;
+        header.checksum = 0;
+        memcpy(tx, &header, sizeof(header));
+        if (crc32_update(0, tx, sizeof(header) + header.length) != checksum) {
+            break;
+        }
+        if (journal_apply(fs, tx + sizeof(header), header.length) != 0) {
+            free(buffer);
+            return -1;
+        }
+        fs->superblock.free_blocks = header.free_blocks;
+        fs->superblock.current_files = header.current_files;
+        fs->superblock_dirty = 1;
+        
+        uint64_t total = sizeof(header) + header.length;
+        fs->journal_head += (total + fs->layout.block_size - 1) / fs->layout.block_size * fs->layout.block_size;
+        fs->journal_next_seq++;
+        replayed++;
+    }
+    free(buffer);
+    
+    if (replayed > 0) {
+        log_info("Journal: %d transação(ões) reaplicada(s).\n", replayed);
+    }
+    return 0;
+}
+
+/* ============================================
+   MONTAGEM E DESMONTAGEM
+   ============================================ */
+
+/* Libera tudo o que fs_mount alocou (campos ainda nulos são ignorados) */
+static void fs_release_resources(FileSystem *fs) {
+    if (fs->disk_map) {
+        munmap(fs->disk_map, fs->disk_map_size);
+    }
+    free(fs->bitmap);
+    cache_destroy(fs->cache);
+    if (fs->disk_fd >= 0) {
+        close(fs->disk_fd);
+    }
+    extent_index_destroy(fs->free_extents);
+    free(fs->bitmap_dirty);
+    free(fs->dir_dirty);
+    free(fs->share_table);
+    free(fs->share_dirty);
+    free(fs->share_order);
+    dedup_release(fs);
+    free(fs->journal_buf);
+    free(fs->pending_free);
+    pthread_rwlock_destroy(&fs->lock);
+    pthread_mutex_destroy(&fs->stats_lock);
+    if (fs->file_table) {
+        for (uint32_t i = 0; i < fs->layout.max_files; i++) {
+            free(fs->file_table[i].extents);
+        }
+    }
+    free(fs->file_table);
+    free(fs->name_index);
+    free(fs->free_slots);
+    free(fs);
+}
+
+/* Versão 0 -> 1: discos antigos só guardavam o tamanho em blocos.
+   Arquivos de texto não contêm bytes nulos, então o preenchimento com
+   zeros do último bloco pode ser descartado com segurança; para os demais
+   tipos não há como distinguir dados de preenchimento, e o tamanho
+   continua arredondado para blocos. */
+static int migrate_exact_size(FileSystem *fs) {
+    uint8_t *block = malloc(fs->layout.block_size);
+    if (!block) return -1;
+    int trimmed = 0;
+    for (uint32_t i = 0; i < fs->layout.max_files; i++) {
+        FileEntry *entry = &fs->file_table[i];
+        if (!entry->is_used || entry->type != TYPE_TEXTO || entry->size_blocks == 0) {
+            continue;
+        }
+        uint64_t last = entry->start_block + entry->size_blocks - 1;
+        if (disk_read(fs, last, block, fs->layout.block_size) != 0) {
+            free(block);
+            return -1;
+        }
+        uint64_t used = fs->layout.block_size;
+        while (used > 0 && block[used - 1] == 0) {
+            used--;
+        }
+        if (used > 0 && used < fs->layout.block_size) {
+            entry->size_bytes = (entry->size_blocks - 1) * fs->layout.block_size + used;
+            fs_entry_changed(fs, i);
+            trimmed++;
+        }
+    }
+    free(block);
+    
+    log_info("Disco migrado para a versão %d do formato (%d arquivo(s) de texto ajustados).\n",
+           FS_VERSION_EXACT_SIZE, trimmed);
+    return 0;
+}
+
+/* Versão 1 -> 2: o journal ocupa os últimos blocos do disco. Se algum
+   arquivo já estiver lá, o disco segue sem journal e os metadados só são
+   persistidos em fs_sync. */
+static int migrate_journal(FileSystem *fs) {
+    if (!extent_index_is_free(fs->free_extents, fs->layout.journal_start, fs->layout.journal_blocks)) {
+        log_error("Aviso: Fim do disco ocupado; disco migrado sem journal de metadados.\n");
+        return 0;
+    }
+    
+    // Região zerada: nada do conteúdo anterior passa por transação
+    uint8_t *zeros = calloc(fs->layout.journal_blocks, fs->layout.block_size);
+    if (!zeros ||
+        pwrite_full(fs->disk_fd, zeros, (uint64_t)fs->layout.journal_blocks * fs->layout.block_size,
+                    (uint64_t)fs->layout.journal_start * fs->layout.block_size) != 0) {
+        free(zeros);
+        return -1;
+    }
+    free(zeros);
+    
+    fs_alloc_range(fs, fs->layout.journal_start, fs->layout.journal_blocks);
+    fs->superblock.journal_start = fs->layout.journal_start;
+    fs->superblock.journal_blocks = fs->layout.journal_blocks;
+    fs->superblock.journal_sequence = 1;
+    fs->journal_next_seq = 1;
+    log_info("Disco migrado para a versão %d do formato (journal de %llu blocos).\n",
+           FS_VERSION_JOURNAL, (unsigned long long)fs->layout.journal_blocks);
+    return 0;
+}
+
+/* Versão 2 -> 3: a tabela de extensões compartilhadas fica logo antes do
+   journal. Se algum arquivo já estiver lá, o disco segue sem cópias
+   reflink (fs_reflink recusa). */
+static int migrate_share_table(FileSystem *fs) {
+    if (!extent_index_is_free(fs->free_extents, fs->layout.share_table_start, fs->layout.share_table_blocks)) {
+        log_error("Aviso: Área da tabela de compartilhamento ocupada; disco migrado sem cópias reflink.\n");
+        return 0;
+    }
+    
+    // Tabela vazia no disco e na memória
+    if (pwrite_full(fs->disk_fd, fs->share_table, (uint64_t)fs->layout.share_table_blocks * fs->layout.block_size,
+                    (uint64_t)fs->layout.share_table_start * fs->layout.block_size) != 0) {
+        return -1;
+    }
+    
+    fs_alloc_range(fs, fs->layout.share_table_start, fs->layout.share_table_blocks);
+    fs->superblock.share_table_start = fs->layout.share_table_start;
+    fs->superblock.share_table_blocks = fs->layout.share_table_blocks;
+    log_info("Disco migrado para a versão %d do formato (tabela de compartilhamento de %llu blocos).\n",
+           FS_VERSION_REFLINK, (unsigned long long)fs->layout.share_table_blocks);
+    return 0;
+}
+
+/* Aplica as migrações pendentes, da versão do disco até a atual */
+static int fs_migrate(FileSystem *fs) {
+    if (fs->superblock.version < FS_VERSION_EXACT_SIZE) {
+        if (migrate_exact_size(fs) != 0) return -1;
+        fs->superblock.version = FS_VERSION_EXACT_SIZE;
+        fs->superblock_dirty = 1;
+    }
+    if (fs->superblock.version < FS_VERSION_JOURNAL) {
+        if (migrate_journal(fs) != 0) return -1;
+        fs->superblock.version = FS_VERSION_JOURNAL;
+        fs->superblock_dirty = 1;
+    }
+    if (fs->superblock.version < FS_VERSION_REFLINK) {
+        if (migrate_share_table(fs) != 0) return -1;
+        fs->superblock.version = FS_VERSION_REFLINK;
+        fs->superblock_dirty = 1;
+    }
+    if (fs->superblock.version < FS_VERSION_COMPRESSION) {
+        // Versão 3 -> 4: nenhum arquivo antigo tem o bit de compressão no
+        // tipo; a versão nova só impede que binários antigos leiam como
+        // dados o conteúdo comprimido
+        fs->superblock.version = FS_VERSION_COMPRESSION;
+        fs->superblock_dirty = 1;
+        log_info("Disco migrado para a versão %d do formato (compressão por arquivo).\n",
+               FS_VERSION_COMPRESSION);
+    }
+    if (fs->superblock.version < FS_VERSION_EXTENTS) {
+        // Versão 4 -> 5: todo arquivo antigo ocupa uma extensão só; a
+        // versão nova impede que binários antigos tomem o mapa de
+        // extensões pelo conteúdo
+        fs->superblock.version = FS_VERSION_EXTENTS;
+        fs->superblock_dirty = 1;
+        log_info("Disco migrado para a versão %d do formato (arquivos em várias extensões).\n",
+               FS_VERSION_EXTENTS);
+    }
+    if (fs->superblock.version < FS_VERSION_GEOMETRY) {
+        // Versão 5 -> 6: os discos antigos já gravavam a geometria fixa
+        // no superbloco, e é ela que a montagem usa; a versão nova impede
+        // que binários antigos montem discos com outra geometria
+        fs->superblock.version = FS_VERSION_GEOMETRY;
+        fs->superblock_dirty = 1;
+        log_info("Disco migrado para a versão %d do formato (geometria no superbloco).\n",
+               FS_VERSION_GEOMETRY);
+    }
+    if (fs->superblock.version < FS_VERSION_SHARED_EXTENTS) {
+        // Versão 6 -> 7: só arquivos numa extensão compartilhavam; a
+        // versão nova impede que binários antigos, que não ligam os
+        // arquivos em várias à tabela, liberem extensões ainda em uso
+        fs->superblock.version = FS_VERSION_SHARED_EXTENTS;
+        fs->superblock_dirty = 1;
+        log_info("Disco migrado para a versão %d do formato (extensões compartilhadas por extensão).\n",
+               FS_VERSION_SHARED_EXTENTS);
+    }
+    return 0;
+}
+
+/* Cache padrão: CACHE_BYTES_DEFAULT, com ao menos CACHE_MIN_BLOCKS_DEFAULT
+   blocos quando eles são grandes */
+static size_t default_cache_blocks(const FsLayout *layout) {
+    size_t blocks = CACHE_BYTES_DEFAULT / layout->block_size;
+    return blocks > CACHE_MIN_BLOCKS_DEFAULT ? blocks : CACHE_MIN_BLOCKS_DEFAULT;
+}
+
+static FileSystem* fs_mount_common(const char *disk_path, int use_mmap) {
+    FileSystem *fs = calloc(1, sizeof(FileSystem));
+    if (!fs) {
+        log_error("Erro: Falha ao alocar memória para o sistema de arquivos.\n");
+        return NULL;
+    }
+    pthread_rwlock_init(&fs->lock, NULL);
+    pthread_mutex_init(&fs->stats_lock, NULL);
+    
+    // Abre o disco
+    fs->disk_fd = open(disk_path, O_RDWR);
+    if (fs->disk_fd < 0) {
+        log_error("Erro: Não foi possível abrir o disco virtual.\n");
+        free(fs);
+        return NULL;
+    }
+    
+    // Lê o superbloco
+    if (pread_full(fs->disk_fd, &fs->superblock, sizeof(Superblock), 0) != 0) {
+        log_error("Erro: Falha ao ler o superbloco.\n");
+        fs_release_resources(fs);
+        return NULL;
+    }
+    
+    // Verifica a assinatura
+    if (strncmp(fs->superblock.signature, "UNIOESTE", 8) != 0) {
+        log_error("Erro: Assinatura inválida. Disco não formatado?\n");
+        fs_release_resources(fs);
+        return NULL;
+    }
+    
+    if (fs->superblock.version > FS_VERSION_CURRENT) {
+        log_error("Erro: Versão %u do formato não suportada.\n", fs->superblock.version);
+        fs_release_resources(fs);
+        return NULL;
+    }
+    
+    // Geometria e posição de cada seção
+    if (layout_load(&fs->superblock, &fs->layout) != 0) {
+        log_error("Erro: Geometria inválida no superbloco.\n");
+        fs_release_resources(fs);
+        return NULL;
+    }
+    const FsLayout *layout = &fs->layout;
+    uint64_t bs = layout->block_size;
+    
+    struct stat st;
+    uint64_t disk_size = layout->total_blocks * bs;
+    if (fstat(fs->disk_fd, &st) != 0 || (uint64_t)st.st_size < disk_size) {
+        log_error("Erro: Disco virtual menor que o esperado.\n");
+        fs_release_resources(fs);
+        return NULL;
+    }
+    
+    // No modo mapeado o disco inteiro é mapeado uma única vez
+    if (use_mmap) {
+        void *map = mmap(NULL, disk_size, PROT_READ | PROT_WRITE, MAP_SHARED, fs->disk_fd, 0);
+        if (map == MAP_FAILED) {
+            log_error("Erro: Falha ao mapear o disco virtual.\n");
+            fs_release_resources(fs);
+            return NULL;
+        }
+        fs->disk_map = map;
+        fs->disk_map_size = disk_size;
+    }
+    
+    // Carrega o bitmap. Mesmo no modo mapeado ele é uma cópia privada:
+    // metadados só chegam ao disco pelo journal ou por fs_sync.
+    fs->bitmap = malloc(layout->bitmap_blocks * bs);
+    if (!fs->bitmap ||
+        block_read_range(fs->disk_fd, layout->block_size, layout->bitmap_start, fs->bitmap,
+                         layout->bitmap_blocks * bs) != 0) {
+        log_error("Erro: Falha ao ler o bitmap.\n");
+        fs_release_resources(fs);
+        return NULL;
+    }
+    
+    // Marcas de blocos de metadados alterados (gravados por fs_sync)
+    fs->bitmap_dirty = calloc(layout->bitmap_blocks, 1);
+    fs->dir_dirty = calloc(layout->root_dir_blocks, 1);
+    if (!fs->bitmap_dirty || !fs->dir_dirty) {
+        log_error("Erro: Falha ao alocar as marcas de metadados alterados.\n");
+        fs_release_resources(fs);
+        return NULL;
+    }
+    
+    // Carrega a tabela de extensões compartilhadas (vazia nos discos sem ela)
+    fs->share_table = calloc(layout->share_table_blocks * bs, 1);
+    fs->share_dirty = calloc(layout->share_table_blocks, 1);
+    if (!fs->share_table || !fs->share_dirty ||
+        (fs->superblock.share_table_blocks > 0 &&
+         block_read_range(fs->disk_fd, layout->block_size, layout->share_table_start, fs->share_table,
+                          layout->share_table_blocks * bs) != 0)) {
+        log_error("Erro: Falha ao ler a tabela de extensões compartilhadas.\n");
+        fs_release_resources(fs);
+        return NULL;
+    }
+    
+    // Carrega a tabela de arquivos
+    fs->file_table = calloc(layout->max_files, sizeof(FileEntry));
+    if (!fs->file_table) {
+        log_error("Erro: Falha ao alocar a tabela de arquivos.\n");
+        fs_release_resources(fs);
+        return NULL;
+    }
+    
+    uint8_t *root_dir_data;
+    if (fs->disk_map) {
+        root_dir_data = fs->disk_map + layout->root_dir_start * bs;
+    } else {
+        root_dir_data = malloc(layout->root_dir_blocks * bs);
+        if (!root_dir_data ||
+            block_read_range(fs->disk_fd, layout->block_size, layout->root_dir_start, root_dir_data,
+                             layout->root_dir_blocks * bs) != 0) {
+            log_error("Erro: Falha ao ler o diretório raiz.\n");
+            free(root_dir_data);
+            fs_release_resources(fs);
+            return NULL;
+        }
+    }
+    
+    for (uint32_t i = 0; i < layout->max_files; i++) {
+        FileMetadata *meta = (FileMetadata *)(root_dir_data + (uint64_t)i * METADATA_SIZE);
+        metadata_to_entry(meta, &fs->file_table[i], layout->block_size);
+    }
+    if (!fs->disk_map) {
+        free(root_dir_data);
+    }
+    
+    // Reaplica as transações confirmadas depois do último fs_sync
+    if (journal_replay(fs) != 0) {
+        log_error("Erro: Falha ao ler o journal de metadados.\n");
+        fs_release_resources(fs);
+        return NULL;
+    }
+    
+    // Monta o índice de extensões livres a partir do bitmap
+    fs->free_extents = extent_index_build(fs->bitmap, layout->data_start, layout->total_blocks);
+    if (!fs->free_extents) {
+        log_error("Erro: Falha ao construir o índice de blocos livres.\n");
+        fs_release_resources(fs);
+        return NULL;
+    }
+    fs->alloc_policy = ALLOC_FIRST_FIT;
+    
+    if (name_index_build(fs) != 0) {
+        log_error("Erro: Falha ao construir o índice de nomes.\n");
+        fs_release_resources(fs);
+        return NULL;
+    }
+    
+    if (fs_migrate(fs) != 0) {
+        log_error("Erro: Falha ao migrar o formato do disco.\n");
+        fs_release_resources(fs);
+        return NULL;
+    }
+    
+    // Listas dos arquivos em várias extensões
+    extent_maps_load(fs);
+    
+    if (share_rebuild(fs) != 0) {
+        log_error("Erro: Falha ao ligar os arquivos às extensões compartilhadas.\n");
+        fs_release_resources(fs);
+        return NULL;
+    }
+    
+    fs->current_user = 0; // Root por padrão
+    
+    // Cache de blocos de dados; no modo mapeado o próprio mapeamento já
+    // faz esse papel. Sem memória para ele, o disco é acessado direto.
+    if (!fs->disk_map) {
+        fs->cache = cache_create(fs->disk_fd, layout->block_size, default_cache_blocks(layout));
+    }
+    
+    // Journal reaplicado ou formato migrado: o novo estado vai para o
+    // lugar definitivo e o journal recomeça vazio
+    if (fs->superblock_dirty && fs_sync(fs) != 0) {
+        log_error("Erro: Falha ao gravar os metadados recuperados.\n");
+        fs_release_resources(fs);
+        return NULL;
+    }
+    
+    log_info("Sistema de arquivos montado com sucesso%s!\n",
+           fs->disk_map ? " (mapeado em memória)" : "");
+    log_info("Arquivos presentes: %u/%u\n", fs->superblock.current_files, layout->max_files);
+    log_info("Blocos livres: %u/%llu\n", fs->superblock.free_blocks,
+           (unsigned long long)(layout->total_blocks - layout->data_start));
+    
+    return fs;
+}
+
+FileSystem* fs_mount(const char *disk_path) {
+    return fs_mount_common(disk_path, 0);
+}
+
+FileSystem* fs_mount_mmap(const char *disk_path) {
+    return fs_mount_common(disk_path, 1);
+}
+
+/* Grava as sequências de blocos marcados de uma região de metadados que
+   está inteira em memória (bitmap, tabela de extensões compartilhadas) */
+static int sync_dirty_runs(FileSystem *fs, uint8_t *dirty, uint32_t count,
+                           uint64_t first_block, const uint8_t *data) {
+    uint32_t i = 0;
+    while (i < count) {
+        if (!dirty[i]) {
+            i++;
+            continue;
+        }
+        uint32_t run = 1;
+        while (i + run < count && dirty[i + run]) {
+            run++;
+        }
+        if (pwrite_full(fs->disk_fd, data + (uint64_t)i * fs->layout.block_size, (uint64_t)run * fs->layout.block_size,
+                        (first_block + i) * fs->layout.block_size) != 0) {
+            return -1;
+        }
+        memset(dirty + i, 0, run);
+        i += run;
+    }
+    return 0;
+}
+
+/* Codifica e grava os blocos marcados do diretório raiz */
+static int sync_dirty_dir(FileSystem *fs) {
+    const int per_block = fs->layout.block_size / METADATA_SIZE;
+    uint8_t *block = malloc(fs->layout.block_size);
+    if (!block) return -1;
+    
+    for (uint32_t b = 0; b < fs->layout.root_dir_blocks; b++) {
+        if (!fs->dir_dirty[b]) {
+            continue;
+        }
+        memset(block, 0, fs->layout.block_size);
+        // O último bloco pode ter só parte das entradas (max_files não é
+        // múltiplo de per_block); o resto dele fica zerado
+        uint64_t first = (uint64_t)b * per_block;
+        uint64_t count = fs->layout.max_files - first;
+        if (count > (uint64_t)per_block) {
+            count = per_block;
+        }
+        for (uint64_t k = 0; k < count; k++) {
+            const FileEntry *entry = &fs->file_table[first + k];
+            if (entry->is_used) {
+                entry_to_metadata(entry, (FileMetadata *)(block + k * METADATA_SIZE), fs->layout.block_size);
+            }
+        }
+        if (pwrite_full(fs->disk_fd, block, fs->layout.block_size, (fs->layout.root_dir_start + b) * fs->layout.block_size) != 0) {
+            free(block);
+            return -1;
+        }
+        fs->dir_dirty[b] = 0;
+    }
+    free(block);
+    return 0;
+}
+
+/* Ponto de sincronização (checkpoint): dados primeiro, depois só os blocos
+   de metadados alterados desde o último fs_sync, gravados no lugar
+   definitivo, e por fim o superbloco, que recomeça o journal. O custo é
+   proporcional ao que mudou, não ao tamanho dos metadados. */
+static int sync_filesystem(FileSystem *fs) {
+    if (!fs) return -1;
+    
+    // Dados vão para o arquivo antes dos metadados que apontam para eles
+    if (flush_data(fs) != 0) {
+        return -1;
+    }
+    if (sync_dirty_runs(fs, fs->bitmap_dirty, fs->layout.bitmap_blocks, fs->layout.bitmap_start, fs->bitmap) != 0 ||
+        sync_dirty_dir(fs) != 0 ||
+        sync_dirty_runs(fs, fs->share_dirty, fs->superblock.share_table_blocks,
+                        fs->superblock.share_table_start, (const uint8_t *)fs->share_table) != 0) {
+        return -1;
+    }
+    
+    if (journal_enabled(fs)) {
+        // Metadados no lugar antes de o superbloco descartar o journal;
+        // os registros ainda não confirmados já estão incluídos neles
+        if (fdatasync(fs->disk_fd) != 0) {
+            return -1;
+        }
+        fs->superblock.journal_sequence = fs->journal_next_seq;
+        fs->journal_head = 0;
+        fs->journal_len = 0;
+        fs->journal_ops = 0;
+        fs->superblock_dirty = 1;
+    }
+    if (fs->superblock_dirty) {
+        // Reservas de handles abertos continuam livres no disco
+        Superblock superblock = fs->superblock;
+        superblock.free_blocks += (uint32_t)fs->reserved_blocks;
+        if (pwrite_full(fs->disk_fd, &superblock, sizeof(Superblock), 0) != 0) {
+            return -1;
+        }
+        fs->superblock_dirty = 0;
+    }
+    if (fdatasync(fs->disk_fd) != 0) {
+        return -1;
+    }
+    fs->op_dirty = 0;
+    pending_free_apply(fs);
+    return 0;
+}
+
+int fs_sync(FileSystem *fs) {
+    if (!fs) return -1;
+    fs_lock(fs, 1);
+    int result = sync_filesystem(fs);
+    fs_unlock(fs);
+    return result;
+}
+
+static void handles_detach(FileSystem *fs);
+
+int fs_unmount(FileSystem *fs) {
+    if (!fs) return -1;
+    
+    handles_detach(fs);
+    
+    // Ponto de sincronização: grava o que mudou desde o último fs_sync
+    if (fs_sync(fs) != 0) {
+        log_error("Erro: Falha ao gravar o sistema de arquivos no disco.\n");
+    }
+    
+    // Libera recursos
+    fs_release_resources(fs);
+    
+    log_info("Sistema de arquivos desmontado com sucesso!\n");
+    return 0;
+}
+
+/* ============================================
+   OPERAÇÕES COM ARQUIVOS
+   ============================================ */
+
+/* Cada operação pública mede a própria latência (incluindo a espera pelo
+   lock no modo concorrente) e as etapas acumuladas em op_timing. Só a
+   operação mais externa é contabilizada: uma operação pública chamada por
+   outra entra no total da que a chamou. */
+static uint64_t op_begin(void) {
+    if (op_depth++ == 0) {
+        memset(&op_timing, 0, sizeof(OpTiming));
+    }
+    return clock_ns();
+}
+
+static void op_end(FileSystem *fs, FsOperation op, uint64_t start, int failed) {
+    if (--op_depth > 0) {
+        return;
+    }
+    
+    uint64_t elapsed = clock_ns() - start;
+    op_stats_lock(fs);
+    OpStats *stats = &fs->op_stats[op];
+    stats->count++;
+    if (failed) {
+        stats->errors++;
+    }
+    stats->total_ns += elapsed;
+    if (elapsed > stats->max_ns) {
+        stats->max_ns = elapsed;
+    }
+    stats->timing.lookup_ns += op_timing.lookup_ns;
+    stats->timing.alloc_ns += op_timing.alloc_ns;
+    stats->timing.io_ns += op_timing.io_ns;
+    stats->timing.alloc_scans += op_timing.alloc_scans;
+    stats->timing.alloc_scan_nodes += op_timing.alloc_scan_nodes;
+    
+    // Histograma em potências de 2 de microssegundos
+    uint64_t us = elapsed / 1000;
+    int bucket = 0;
+    while (bucket < STATS_LATENCY_BUCKETS - 1 && us >= (1ULL << bucket)) {
+        bucket++;
+    }
+    stats->latency[bucket]++;
+    op_stats_unlock(fs);
+}
+
+static int create_file(FileSystem *fs, const char *name, FileType type, FilePermission perm) {
+    
+    // Verifica tamanho do nome
+    if (strlen(name) > MAX_FILENAME_LENGTH) {
+        log_error("Erro: Nome muito longo (máximo %d caracteres).\n", MAX_FILENAME_LENGTH);
+        return -1;
+    }
+    
+    // Verifica se já existe
+    if (name_index_lookup(fs, name) != -1) {
+        log_error("Erro: Arquivo '%s' já existe.\n", name);
+        return -1;
+    }
+    
+    // Retira uma entrada livre da pilha
+    if (fs->free_slot_count == 0) {
+        log_error("Erro: Número máximo de arquivos atingido.\n");
+        return -1;
+    }
+    int free_entry = fs->free_slots[--fs->free_slot_count];
+    
+    // Cria o arquivo
+    FileEntry *entry = &fs->file_table[free_entry];
+    strcpy(entry->name, name);
+    entry->type = type;
+    entry->size_bytes = 0;
+    entry->size_blocks = 0;
+    entry->start_block = 0;
+    entry->owner = fs->current_user;
+    entry->permission = perm;
+    entry->last_modified = 0;
+    entry->is_used = 1;
+    entry->compressed = 0;
+    entry->map_block = 0;
+    entry->extent_count = 0;
+    entry->extents = NULL;
+    name_index_insert(fs, free_entry);
+    fs_entry_changed(fs, free_entry);
+    
+    fs->superblock.current_files++;
+    fs->superblock_dirty = 1;
+    journal_op_end(fs);
+    
+    log_info("Arquivo '%s' criado com sucesso.\n", name);
+    return 0;
+}
+
+int fs_create(FileSystem *fs, const char *name, FileType type, FilePermission perm) {
+    if (!fs || !name) return -1;
+    uint64_t start = op_begin();
+    fs_lock(fs, 1);
+    int result = create_file(fs, name, type, perm);
+    fs_unlock(fs);
+    op_end(fs, FS_OP_CREATE, start, result != 0);
+    return result;
+}
+
+/* Reserva blocks_needed blocos para um conteúdo que vai substituir todo o
+   atual, na ordem de preferência:
+     1. a própria extensão, quando o arquivo encolhe ou mantém o tamanho
+        (a sobra do fim é devolvida);
+     2. a extensão atual estendida sobre os blocos livres vizinhos (depois
+        dela e, se preciso, antes dela);
+     3. uma nova extensão em outro lugar.
+   Retorna o bloco inicial ou -1, deixando o arquivo intacto na falha. */
+static int64_t file_place_for_overwrite(FileSystem *fs, FileEntry *entry, uint64_t blocks_needed) {
+    uint64_t old_start = entry->start_block;
+    uint64_t old_blocks = entry->size_blocks;
+    
+    if (entry->shared) {
+        // O conteúdo todo será substituído: não há o que copiar, o arquivo
+        // só deixa a extensão compartilhada
+        int64_t start_block = fs_find_free(fs, blocks_needed);
+        if (start_block == -1) {
+            return -1;
+        }
+        file_release_blocks(fs, (int)(entry - fs->file_table));
+        fs_alloc_range(fs, start_block, blocks_needed);
+        return start_block;
+    }
+    
+    if (old_blocks >= blocks_needed) {
+        if (old_blocks > blocks_needed) {
+            fs_release_range(fs, old_start + blocks_needed, old_blocks - blocks_needed);
+        }
+        return (int64_t)old_start;
+    }
+    
+    int64_t start_block = -1;
+    if (old_blocks > 0) {
+        // Trecho que a extensão formaria ao ser devolvida, coalescida com
+        // os trechos livres vizinhos
+        uint64_t old_end = old_start + old_blocks;
+        uint64_t region_start = old_start, region_end = old_end;
+        uint64_t free_start, free_length;
+        if (old_start > fs->layout.data_start &&
+            extent_index_containing(fs->free_extents, old_start - 1, &free_start, &free_length) == 0) {
+            region_start = free_start;
+        }
+        if (extent_index_containing(fs->free_extents, old_end, &free_start, &free_length) == 0) {
+            region_end = free_start + free_length;
+        }
+        if (region_end - old_start >= blocks_needed) {
+            start_block = (int64_t)old_start;
+        } else if (region_end - region_start >= blocks_needed) {
+            start_block = (int64_t)(region_end - blocks_needed);
+        }
+    }
+    
+    if (start_block == -1) {
+        start_block = fs_find_free(fs, blocks_needed);
+    }
+    if (start_block == -1) {
+        return -1; // A extensão antiga continua intacta
+    }
+    
+    // Só agora a extensão antiga é devolvida (e seus blocos saem do cache)
+    if (old_blocks > 0) {
+        fs_release_range(fs, old_start, old_blocks);
+    }
+    fs_alloc_range(fs, start_block, blocks_needed);
+    return start_block;
+}
+
+/* Lugar em várias extensões para um conteúdo novo de blocks blocos,
+   quando file_place_for_overwrite não acha uma só (ou o arquivo já está
+   em várias). Como o conteúdo todo será substituído, um arquivo próprio
+   aproveita os blocos que já tem e só completa o que falta; volta a uma
+   extensão só se houver espaço contíguo. Na falha nada muda. */
+static int file_place_extents(FileSystem *fs, int index, uint64_t blocks) {
+    FileEntry *entry = &fs->file_table[index];
+    if (entry->shared || (entry->map_block && fs_find_free(fs, blocks) != -1)) {
+        FileExtent *list;
+        uint32_t count;
+        if (layout_alloc(fs, blocks, -1, &list, &count) != 0) {
+            return -1;
+        }
+        if (file_install(fs, index, list, count, 1) != 0) {
+            extents_release(fs, list, count);
+            return -1;
+        }
+        return 0;
+    }
+    if (blocks <= entry->size_blocks) {
+        return file_trim(fs, index, blocks);
+    }
+    return file_add_extents(fs, index, blocks, -1);
+}
+
+/* Conteúdo novo sempre em blocos novos: o arquivo só passa a apontar para
+   eles depois de gravados, e os antigos saem por último. Usado para a
+   imagem de um arquivo comprimido, que sobrescrita no lugar ficaria
+   ilegível se houvesse uma queda antes do commit. Na falha nada muda. */
+static int file_replace(FileSystem *fs, int index, const void *data, uint64_t size,
+                        uint64_t blocks) {
+    FileExtent *list;
+    uint32_t count;
+    if (layout_alloc(fs, blocks, -1, &list, &count) != 0) {
+        log_error("Erro: Espaço insuficiente no disco.\n");
+        return -1;
+    }
+    if (extents_transfer(fs, list, count, 0, (void *)data, size, XFER_WRITE) != 0 ||
+        extents_transfer(fs, list, count, size, NULL,
+                         blocks * fs->layout.block_size - size, XFER_ZERO) != 0) {
+        log_error("Erro: Falha ao escrever no disco.\n");
+        extents_release(fs, list, count);
+        return -1;
+    }
+    if (file_install(fs, index, list, count, 1) != 0) {
+        log_error("Erro: Espaço insuficiente no disco.\n");
+        extents_release(fs, list, count);
+        return -1;
+    }
+    return 0;
+}
+
+/* Grava data (size bytes, já no formato em disco do arquivo) como o novo
+   conteúdo da entrada; raw_size é o tamanho antes da compressão */
+static int write_content(FileSystem *fs, int file_index, const void *data, uint64_t size,
+                         uint64_t raw_size) {
+    FileEntry *entry = &fs->file_table[file_index];
+    const char *name = entry->name;
+    
+    // Calcula blocos necessários
+    uint64_t blocks_needed = (size + fs->layout.block_size - 1) / fs->layout.block_size;
+    
+    // Com a deduplicação ligada, um conteúdo que já existe numa extensão
+    // de outro arquivo vira referência a ela, sem gravar dados
+    uint64_t fingerprint = 0;
+    if (fs->fingerprints) {
+        DedupRun run = { 0, blocks_needed, size, data };
+        uint8_t *buffer = malloc(DEDUP_CHUNK);
+        uint64_t start = 0;
+        fingerprint = run_fingerprint(fs, &run, buffer);
+        int twin = buffer ? dedup_find(fs, file_index, fingerprint, &run, buffer, &start) : -1;
+        free(buffer);
+        if (twin != -1 && !entry->map_block && entry->start_block == start &&
+            entry->size_blocks == blocks_needed && entry->size_bytes == size) {
+            log_info("Arquivo '%s' já tem esse conteúdo.\n", name);
+            return 0;
+        }
+        uint64_t *prints = twin != -1 ? malloc(sizeof(uint64_t)) : NULL;
+        if (prints && dedup_adopt(fs, file_index, twin, start, blocks_needed) == 0) {
+            entry->size_bytes = size;
+            entry->last_modified = 1;
+            fs_entry_changed(fs, file_index);
+            prints[0] = fingerprint;
+            dedup_remember(fs, file_index, prints, 1);
+            journal_op_end(fs);
+            log_info("Dados escritos no arquivo '%s' (%lu bytes, iguais a '%s': nenhum bloco gravado).\n",
+                   name, raw_size, fs->file_table[twin].name);
+            return 0;
+        }
+        free(prints);
+    }
+    
+    // Escolhe a extensão: a atual, estendida ou outra; sem espaço contíguo
+    // (ou com o arquivo já em várias extensões), várias. Arquivo
+    // comprimido: blocos novos, trocados só depois de gravados.
+    int64_t start_block = entry->map_block || entry->compressed ? -1 :
+                          file_place_for_overwrite(fs, entry, blocks_needed);
+    int result;
+    if (entry->compressed) {
+        // Na falha o conteúdo antigo continua intacto
+        if (file_replace(fs, file_index, data, size, blocks_needed) != 0) {
+            return -1;
+        }
+        result = 0;
+    } else if (start_block != -1) {
+        // A extensão inteira de uma vez
+        entry->start_block = (uint64_t)start_block;
+        entry->size_blocks = blocks_needed;
+        result = disk_write(fs, start_block, data, size);
+    } else if (file_place_extents(fs, file_index, blocks_needed) == 0) {
+        // Uma transferência por extensão; o fim do último bloco é zerado
+        result = file_write_at(fs, entry, 0, data, size);
+        if (result == 0) {
+            result = file_zero_at(fs, entry, size, blocks_needed * fs->layout.block_size - size);
+        }
+    } else {
+        log_error("Erro: Espaço insuficiente no disco.\n");
+        return -1;
+    }
+    
+    if (result != 0) {
+        log_error("Erro: Falha ao escrever no disco.\n");
+        file_release_blocks(fs, file_index);
+        entry->size_bytes = 0;
+        fs_entry_changed(fs, file_index);
+        return -1;
+    }
+    
+    // Atualiza metadados
+    entry->size_bytes = size;
+    entry->last_modified = 1;
+    fs_entry_changed(fs, file_index);
+    if (fs->fingerprints && entry->map_block) {
+        // Em várias extensões: cada uma é comparada com as dos outros
+        int table_full = 0, merged;
+        dedup_file(fs, file_index, data, &table_full, &merged);
+    } else if (fs->fingerprints) {
+        uint64_t *prints = malloc(sizeof(uint64_t));
+        if (prints) {
+            prints[0] = fingerprint;
+            dedup_remember(fs, file_index, prints, 1);
+        }
+    }
+    journal_op_end(fs);
+    
+    if (entry->compressed) {
+        log_info("Dados escritos no arquivo '%s' (%lu bytes, comprimidos em %lu: %lu blocos).\n",
+               name, raw_size, size, blocks_needed);
+    } else {
+        log_info("Dados escritos no arquivo '%s' (%lu bytes, %lu blocos).\n",
+               name, size, blocks_needed);
+    }
+    if (entry->map_block) {
+        log_info("Sem espaço contíguo: conteúdo em %u extensões.\n", entry->extent_count);
+    }
+    return 0;
+}
+
+static int write_file(FileSystem *fs, const char *name, const void *data, uint64_t size) {
+    // Procura o arquivo
+    int file_index = name_index_lookup(fs, name);
+    
+    if (file_index == -1) {
+        log_error("Erro: Arquivo '%s' não encontrado.\n", name);
+        return -1;
+    }
+    
+    FileEntry *entry = &fs->file_table[file_index];
+    
+    // Verifica permissão
+    if (entry->owner != fs->current_user && fs->current_user != 0) {
+        if (!(entry->permission & PERM_WRITE)) {
+            log_error("Erro: Sem permissão de escrita.\n");
+            return -1;
+        }
+    }
+    
+    if (!entry->compressed) {
+        return write_content(fs, file_index, data, size, size);
+    }
+    
+    // Arquivo comprimido: vai para o disco o conteúdo já comprimido (e a
+    // deduplicação compara os conteúdos comprimidos)
+    uint64_t stored_size;
+    uint8_t *image = compress_image(data, size, &stored_size);
+    if (!image) {
+        log_error("Erro: Falha ao alocar memória para a compressão.\n");
+        return -1;
+    }
+    int result = write_content(fs, file_index, image, stored_size, size);
+    free(image);
+    return result;
+}
+
+int fs_write(FileSystem *fs, const char *name, const void *data, uint64_t size) {
+    if (!fs || !name || !data || size == 0) return -1;
+    uint64_t start = op_begin();
+    fs_lock(fs, 1);
+    int result = write_file(fs, name, data, size);
+    fs_unlock(fs);
+    op_end(fs, FS_OP_WRITE, start, result != 0);
+    return result;
+}
+
+static int read_file(FileSystem *fs, const char *name, void *buffer, uint64_t *size) {
+    // Procura o arquivo
+    int file_index = name_index_lookup(fs, name);
+    
+    if (file_index == -1) {
+        log_error("Erro: Arquivo '%s' não encontrado.\n", name);
+        return -1;
+    }
+    
+    FileEntry *entry = &fs->file_table[file_index];
+    
+    // Verifica permissão
+    if (entry->owner != fs->current_user && fs->current_user != 0) {
+        if (!(entry->permission & PERM_READ)) {
+            log_error("Erro: Sem permissão de leitura.\n");
+            return -1;
+        }
+    }
+    
+    if (entry->size_blocks == 0) {
+        log_info("Arquivo '%s' está vazio.\n", name);
+        *size = 0;
+        return 0;
+    }
+    
+    if (entry->compressed) {
+        // Descomprime quadro a quadro direto no buffer do chamador
+        if (compressed_read_all(fs, entry, buffer, size) != 0) {
+            log_error("Erro: Falha ao ler o arquivo comprimido '%s'.\n", name);
+            return -1;
+        }
+        log_info("Arquivo '%s' lido (%lu bytes, %lu gravados).\n", name, *size, entry->size_bytes);
+        return 0;
+    }
+    
+    // Lê cada extensão inteira de uma vez
+    if (file_read_at(fs, entry, 0, buffer, entry->size_bytes) != 0) {
+        log_error("Erro: Falha ao ler do disco.\n");
+        return -1;
+    }
+    
+    *size = entry->size_bytes;
+    log_info("Arquivo '%s' lido (%lu bytes).\n", name, entry->size_bytes);
+    return 0;
+}
+
+int fs_read(FileSystem *fs, const char *name, void *buffer, uint64_t *size) {
     if (!fs || !name || !buffer || !size) return -1;
+    uint64_t start = op_begin();
+    fs_lock(fs, 0);
+    int result = read_file(fs, name, buffer, size);
+    fs_unlock(fs);
+    op_end(fs, FS_OP_READ, start, result != 0);
+    return result;
+}
+
+/* Visão somente leitura, sem cópia, do conteúdo de um arquivo. Só existe
+   no modo mapeado em memória e para arquivos sem compressão numa
+   extensão única; o ponteiro vale até a próxima escrita ou remoção do
+   arquivo, ou até a desmontagem. */
+static const void* read_view(FileSystem *fs, const char *name, uint64_t *size) {
+    if (!fs || !name || !size) return NULL;
+    
+    if (!fs->disk_map) {
+        log_error("Erro: Visão sem cópia exige montagem mapeada em memória.\n");
+        return NULL;
+    }
+    
+    // Procura o arquivo
+    int file_index = name_index_lookup(fs, name);
+    if (file_index == -1) {
+        log_error("Erro: Arquivo '%s' não encontrado.\n", name);
+        return NULL;
+    }
+    
+    FileEntry *entry = &fs->file_table[file_index];
+    
+    // Verifica permissão
+    if (entry->owner != fs->current_user && fs->current_user != 0) {
+        if (!(entry->permission & PERM_READ)) {
+            log_error("Erro: Sem permissão de leitura.\n");
+            return NULL;
+        }
+    }
+    
+    if (entry->compressed) {
+        log_error("Erro: Arquivo '%s' é comprimido (sem visão sem cópia).\n", name);
+        return NULL;
+    }
+    if (entry->map_block) {
+        log_error("Erro: Arquivo '%s' está em várias extensões (sem visão sem cópia).\n", name);
+        return NULL;
+    }
+    
+    *size = entry->size_bytes;
+    return fs->disk_map + entry->start_block * fs->layout.block_size;
+}
+
+const void* fs_read_view(FileSystem *fs, const char *name, uint64_t *size) {
+    if (!fs || !name || !size) return NULL;
+    fs_lock(fs, 0);
+    const void *view = read_view(fs, name, size);
+    fs_unlock(fs);
+    return view;
+}
+
+/* A cópia não passa pela memória: os blocos de destino são reservados de
+   uma vez, com o tamanho final (numa extensão só, se houver espaço
+   contíguo), e os dados vão de extensão para extensão pelo disco
+   (disk_copy). O destino só é criado depois de garantido o espaço. */
+static int copy_file(FileSystem *fs, const char *src_name, const char *dest_name) {
+    // Procura o arquivo de origem
+    int src_index = name_index_lookup(fs, src_name);
+    
+    if (src_index == -1) {
+        log_error("Erro: Arquivo origem '%s' não encontrado.\n", src_name);
+        return -1;
+    }
+    
+    FileEntry *src = &fs->file_table[src_index];
+    
+    // Verifica permissão
+    if (src->owner != fs->current_user && fs->current_user != 0) {
+        if (!(src->permission & PERM_READ)) {
+            log_error("Erro: Sem permissão de leitura.\n");
+            return -1;
+        }
+    }
+    
+    // Reserva os blocos de destino antes de criar o arquivo
+    uint64_t blocks = (src->size_bytes + fs->layout.block_size - 1) / fs->layout.block_size;
+    FileExtent *list;
+    uint32_t count;
+    if (layout_alloc(fs, blocks, -1, &list, &count) != 0) {
+        log_error("Erro: Espaço insuficiente no disco.\n");
+        return -1;
+    }
+    
+    // Cria o arquivo de destino
+    if (create_file(fs, dest_name, src->type, src->permission) != 0) {
+        extents_release(fs, list, count);
+        return -1;
+    }
+    int dest_index = name_index_lookup(fs, dest_name);
+    FileEntry *dest = &fs->file_table[dest_index];
+    dest->compressed = src->compressed; // Os bytes gravados vão como estão
+    if (blocks == 0) {
+        if (dest->compressed) {
+            fs_entry_changed(fs, dest_index);
+            journal_op_end(fs);
+        }
+        log_info("Arquivo '%s' copiado para '%s'.\n", src_name, dest_name);
+        return 0;
+    }
+    
+    FileExtent single;
+    uint32_t src_count;
+    const FileExtent *src_extents = file_extents(src, &single, &src_count);
+    if (extents_copy(fs, src_extents, src_count, list, count, src->size_bytes) != 0 ||
+        file_install(fs, dest_index, list, count, 1) != 0) {
+        log_error("Erro: Falha ao copiar os dados no disco.\n");
+        extents_release(fs, list, count);
+        journal_op_end(fs);
+        return -1;
+    }
+    
+    // Atualiza metadados
+    dest->size_bytes = src->size_bytes;
+    dest->last_modified = 1;
+    fs_entry_changed(fs, dest_index);
+    journal_op_end(fs);
+    
+    log_info("Arquivo '%s' copiado para '%s' (%lu bytes, %lu blocos).\n",
+           src_name, dest_name, dest->size_bytes, blocks);
+    return 0;
+}
+
+int fs_copy(FileSystem *fs, const char *src_name, const char *dest_name) {
+    if (!fs || !src_name || !dest_name) return -1;
+    uint64_t start = op_begin();
+    fs_lock(fs, 1);
+    int result = copy_file(fs, src_name, dest_name);
+    fs_unlock(fs);
+    op_end(fs, FS_OP_COPY, start, result != 0);
+    return result;
+}
+
+/* Cópia reflink: o destino aponta para as extensões da origem, e nenhum
+   dado é copiado; tempo e espaço não dependem do tamanho do arquivo. A
+   primeira alteração de qualquer um dos dois faz a cópia de verdade. */
+static int reflink_file(FileSystem *fs, const char *src_name, const char *dest_name) {
+    if (fs->superblock.share_table_blocks == 0) {
+        log_error("Erro: Disco sem tabela de extensões compartilhadas (cópia reflink indisponível).\n");
+        return -1;
+    }
+    
+    // Procura o arquivo de origem
+    int src_index = name_index_lookup(fs, src_name);
+    
+    if (src_index == -1) {
+        log_error("Erro: Arquivo origem '%s' não encontrado.\n", src_name);
+        return -1;
+    }
+    
+    FileEntry *src = &fs->file_table[src_index];
+    
+    // Verifica permissão
+    if (src->owner != fs->current_user && fs->current_user != 0) {
+        if (!(src->permission & PERM_READ)) {
+            log_error("Erro: Sem permissão de leitura.\n");
+            return -1;
+        }
+    }
+    
+    // Uma posição da tabela para cada extensão ainda não compartilhada e,
+    // com várias, espaço para o mapa do destino
+    FileExtent single;
+    uint32_t extent_count;
+    file_extents(src, &single, &extent_count);
+    if (extent_count - src->shared > share_room(fs)) {
+        log_error("Erro: Tabela de extensões compartilhadas cheia.\n");
+        return -1;
+    }
+    if (src->map_block && fs_find_free(fs, extent_map_blocks(fs, extent_count)) == -1) {
+        log_error("Erro: Espaço insuficiente no disco.\n");
+        return -1;
+    }
+    
+    // Cria o arquivo de destino
+    if (create_file(fs, dest_name, src->type, src->permission) != 0) {
+        return -1;
+    }
+    int dest_index = name_index_lookup(fs, dest_name);
+    fs->file_table[dest_index].compressed = src->compressed;
+    if (src->size_blocks == 0) {
+        if (src->compressed) {
+            fs_entry_changed(fs, dest_index);
+            journal_op_end(fs);
+        }
+        log_info("Arquivo '%s' copiado para '%s'.\n", src_name, dest_name);
+        return 0;
+    }
+    
+    fs->file_table[dest_index].last_modified = 1;
+    if (share_attach(fs, dest_index, src_index) != 0) {
+        log_error("Erro: Memória insuficiente para a cópia reflink.\n");
+        journal_op_end(fs);
+        return -1;
+    }
+    const DedupPrints *prints = fs->fingerprints ? &fs->fingerprints[src_index] : NULL;
+    uint64_t *copy = prints && prints->prints ? malloc(prints->count * sizeof(uint64_t)) : NULL;
+    if (copy) {
+        memcpy(copy, prints->prints, prints->count * sizeof(uint64_t));
+        dedup_remember(fs, dest_index, copy, prints->count);
+    }
+    journal_op_end(fs);
+    
+    if (extent_count == 1) {
+        log_info("Arquivo '%s' copiado para '%s' (reflink, extensão usada por %u arquivos).\n",
+               src_name, dest_name, fs->share_table[share_lookup(fs, src->start_block, src->size_blocks)].refs);
+    } else {
+        log_info("Arquivo '%s' copiado para '%s' (reflink, %u extensões compartilhadas).\n",
+               src_name, dest_name, extent_count);
+    }
+    return 0;
+}
+
+int fs_reflink(FileSystem *fs, const char *src_name, const char *dest_name) {
+    if (!fs || !src_name || !dest_name) return -1;
+    uint64_t start = op_begin();
+    fs_lock(fs, 1);
+    int result = reflink_file(fs, src_name, dest_name);
+    fs_unlock(fs);
+    op_end(fs, FS_OP_COPY, start, result != 0);
+    return result;
+}
+
+static int remove_file(FileSystem *fs, const char *name) {
+    // Procura o arquivo
+    int file_index = name_index_lookup(fs, name);
+    
+    if (file_index == -1) {
+        log_error("Erro: Arquivo '%s' não encontrado.\n", name);
+        return -1;
+    }
     
-    // Procura o arquivo
-    int file_index = -1;
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (fs->file_table[i].is_used && 
-            strcmp(fs->file_table[i].name, name) == 0) {
-            file_index = i;
-            break;
+    FileEntry *entry = &fs->file_table[file_index];
+    
+    // Verifica permissão (apenas o dono ou root pode remover)
+    if (entry->owner != fs->current_user && fs->current_user != 0) {
+        log_error("Erro: Apenas o dono pode remover o arquivo.\n");
+        return -1;
+    }
+    
+    // Libera os blocos (os de uma extensão compartilhada ficam com os
+    // outros arquivos)
+    file_release_blocks(fs, file_index);
+    
+    // Remove da tabela
+    name_index_remove(fs, file_index);
+    memset(entry, 0, sizeof(FileEntry));
+    fs_entry_changed(fs, file_index);
+    fs->free_slots[fs->free_slot_count++] = file_index;
+    fs->superblock.current_files--;
+    fs->superblock_dirty = 1;
+    journal_op_end(fs);
+    
+    log_info("Arquivo '%s' removido.\n", name);
+    return 0;
+}
+
+int fs_remove(FileSystem *fs, const char *name) {
+    if (!fs || !name) return -1;
+    uint64_t start = op_begin();
+    fs_lock(fs, 1);
+    int result = remove_file(fs, name);
+    fs_unlock(fs);
+    op_end(fs, FS_OP_REMOVE, start, result != 0);
+    return result;
+}
+
+/* ============================================
+   ACESSO POR HANDLE (LEITURA/ESCRITA COM DESLOCAMENTO)
+   ============================================ */
+
+/* Reserva de um handle: o trecho sai do índice de extensões livres e de
+   free_blocks, para que nenhuma outra alocação o use, mas não vai ao
+   bitmap nem ao journal (uma queda não deixa blocos perdidos). Por isso o
+   free_blocks gravado no disco soma fs->reserved_blocks de volta. */
+static void handle_unreserve(FileHandle *handle) {
+    if (handle->reserved_blocks > 0) {
+        FileSystem *fs = handle->fs;
+        if (extent_index_release(fs->free_extents, handle->reserved_start,
+                                 handle->reserved_blocks) != 0) {
+            log_error("Erro: Reserva de blocos já livres (%llu+%llu).\n",
+                      (unsigned long long)handle->reserved_start,
+                      (unsigned long long)handle->reserved_blocks);
+        }
+        fs->superblock.free_blocks += handle->reserved_blocks;
+        fs->reserved_blocks -= handle->reserved_blocks;
+        handle->reserved_blocks = 0;
+    }
+}
+
+static int handle_reserve(FileHandle *handle, uint64_t start, uint64_t num_blocks) {
+    FileSystem *fs = handle->fs;
+    if (num_blocks == 0 ||
+        extent_index_allocate(fs->free_extents, start, num_blocks) != 0) {
+        return -1;
+    }
+    handle->reserved_start = start;
+    handle->reserved_blocks = num_blocks;
+    fs->superblock.free_blocks -= num_blocks;
+    fs->reserved_blocks += num_blocks;
+    return 0;
+}
+
+/* Só handles de escrita podem reservar: são eles que ficam na lista que
+   fs_unmount percorre */
+static void handle_link(FileHandle *handle) {
+    FileSystem *fs = handle->fs;
+    handle->prev = NULL;
+    handle->next = fs->handles;
+    if (fs->handles) {
+        fs->handles->prev = handle;
+    }
+    fs->handles = handle;
+}
+
+static void handle_unlink(FileHandle *handle) {
+    if (handle->prev) {
+        handle->prev->next = handle->next;
+    } else {
+        handle->fs->handles = handle->next;
+    }
+    if (handle->next) {
+        handle->next->prev = handle->prev;
+    }
+    handle->prev = handle->next = NULL;
+}
+
+/* Garante que o arquivo tenha ao menos new_blocks blocos, preservando o
+   conteúdo. Primeiro tenta estender a extensão sobre os blocos livres
+   logo depois dela; se não houver, realoca e copia os dados atuais, de
+   preferência para a reserva do handle (preferred). Sem espaço contíguo
+   para o arquivo inteiro, ele fica onde está e o que falta vem em outras
+   extensões, como num arquivo que já está em várias. Um arquivo com
+   extensão compartilhada sempre vai para blocos novos (copy-on-write). */
+static int file_grow_extent(FileSystem *fs, int index, uint64_t new_blocks, int64_t preferred) {
+    FileEntry *entry = &fs->file_table[index];
+    if (entry->shared) {
+        return file_unshare(fs, index, new_blocks, preferred);
+    }
+    if (entry->map_block) {
+        return file_add_extents(fs, index, new_blocks, preferred);
+    }
+    uint64_t extra = new_blocks - entry->size_blocks;
+    if (entry->size_blocks > 0 &&
+        extent_index_is_free(fs->free_extents, entry->start_block + entry->size_blocks, extra)) {
+        fs_alloc_range(fs, entry->start_block + entry->size_blocks, extra);
+        entry->size_blocks = new_blocks;
+        fs_entry_changed(fs, index);
+        return 0;
+    }
+    
+    int64_t start_block = -1;
+    if (preferred != -1 && extent_index_is_free(fs->free_extents, (uint64_t)preferred, new_blocks)) {
+        start_block = preferred;
+    } else {
+        start_block = fs_find_free(fs, new_blocks);
+    }
+    if (start_block == -1) {
+        return file_add_extents(fs, index, new_blocks, preferred);
+    }
+    fs_alloc_range(fs, start_block, new_blocks);
+    
+    if (entry->size_bytes > 0 &&
+        disk_copy(fs, entry->start_block, start_block, entry->size_bytes) != 0) {
+        log_error("Erro: Falha ao mover o arquivo.\n");
+        fs_release_range(fs, start_block, new_blocks);
+        return -1;
+    }
+    
+    if (entry->size_blocks > 0) {
+        fs_release_range(fs, entry->start_block, entry->size_blocks);
+    }
+    entry->start_block = start_block;
+    entry->size_blocks = new_blocks;
+    fs_entry_changed(fs, index);
+    return 0;
+}
+
+static int file_grow(FileHandle *handle, uint64_t new_blocks) {
+    FileSystem *fs = handle->fs;
+    FileEntry *entry = &fs->file_table[handle->entry_index];
+    if (new_blocks <= entry->size_blocks) {
+        if (!entry->shared) {
+            return 0;
+        }
+        new_blocks = entry->size_blocks; // Só a cópia da extensão compartilhada
+    }
+    if (handle->reserved_blocks == 0) {
+        return file_grow_extent(fs, handle->entry_index, new_blocks, -1);
+    }
+    
+    // A reserva volta ao índice e vira o destino: ou ela segue a extensão
+    // (crescimento no lugar), ou é para lá que o arquivo se muda, ou é lá
+    // que começa a próxima extensão dele
+    uint64_t reserve_start = handle->reserved_start;
+    uint64_t reserve_end = reserve_start + handle->reserved_blocks;
+    handle_unreserve(handle);
+    
+    int result = file_grow_extent(fs, handle->entry_index, new_blocks, (int64_t)reserve_start);
+    
+    // O que sobrou da reserva depois do novo fim continua reservado
+    uint64_t end = file_end_block(entry);
+    if (result != 0) {
+        handle_reserve(handle, reserve_start, reserve_end - reserve_start);
+    } else if (end > reserve_start && end < reserve_end) {
+        handle_reserve(handle, end, reserve_end - end);
+    }
+    return result;
+}
+
+/* Confere se a entrada guardada no handle ainda é o mesmo arquivo */
+static FileEntry* handle_entry(FileHandle *handle) {
+    FileEntry *entry = &handle->fs->file_table[handle->entry_index];
+    if (!entry->is_used || name_key(entry->name) != handle->name_key) {
+        log_error("Erro: O arquivo do handle foi removido.\n");
+        return NULL;
+    }
+    return entry;
+}
+
+/* Tabela de quadros do arquivo comprimido do handle, relida quando
+   alguma entrada mudou desde a última carga (o arquivo pode ter sido
+   regravado ou deslocado) */
+static int view_load(FileHandle *handle, const FileEntry *entry) {
+    CompressedView *view = &handle->view;
+    if (view->frame_table && view->generation == handle->fs->entry_generation) {
+        return 0;
+    }
+    free(view->frame_table);
+    free(view->frame_offsets);
+    view->frame_table = NULL;
+    view->frame_offsets = NULL;
+    view->frame = -1;
+    
+    CompressedHeader header;
+    uint32_t *table;
+    if (compressed_load(handle->fs, entry, &header, &table) != 0) {
+        return -1;
+    }
+    uint64_t *offsets = malloc(((uint64_t)header.frame_count + 1) * sizeof(uint64_t));
+    if (!view->frame_data) {
+        view->frame_data = malloc(2 * COMPRESS_FRAME_SIZE);
+    }
+    if (!offsets || !view->frame_data) {
+        free(table);
+        free(offsets);
+        log_error("Erro: Falha ao alocar memória.\n");
+        return -1;
+    }
+    
+    offsets[0] = compressed_header_size(header.frame_count);
+    for (uint32_t f = 0; f < header.frame_count; f++) {
+        offsets[f + 1] = offsets[f] + frame_stored_size(table[f]);
+    }
+    view->frame_table = table;
+    view->frame_offsets = offsets;
+    view->frame_count = header.frame_count;
+    view->raw_size = header.raw_size;
+    view->generation = handle->fs->entry_generation;
+    return 0;
+}
+
+/* Leitura com deslocamento sobre o conteúdo descomprimido: cada quadro
+   tocado é descomprimido para frame_data, onde fica para as próximas */
+static int64_t view_read(FileHandle *handle, const FileEntry *entry, uint8_t *buffer,
+                         uint64_t count, uint64_t offset) {
+    CompressedView *view = &handle->view;
+    if (view_load(handle, entry) != 0) {
+        return -1;
+    }
+    if (offset >= view->raw_size) {
+        return 0; // Fim do arquivo
+    }
+    if (count > view->raw_size - offset) {
+        count = view->raw_size - offset;
+    }
+    
+    uint64_t done = 0;
+    while (done < count) {
+        uint64_t pos = offset + done;
+        uint32_t frame = (uint32_t)(pos / COMPRESS_FRAME_SIZE);
+        uint32_t frame_size = frame_raw_size(view->raw_size, frame);
+        uint64_t in_frame = pos % COMPRESS_FRAME_SIZE;
+        uint64_t chunk = frame_size - in_frame;
+        if (chunk > count - done) {
+            chunk = count - done;
+        }
+        
+        // Quadro gravado sem compressão: lê só o trecho pedido
+        if ((view->frame_table[frame] & COMPRESS_FRAME_RAW) &&
+            frame_stored_size(view->frame_table[frame]) == frame_size) {
+            if (file_read_at(handle->fs, entry, view->frame_offsets[frame] + in_frame,
+                             buffer + done, chunk) != 0) {
+                log_error("Erro: Falha ao ler do disco.\n");
+                return -1;
+            }
+            done += chunk;
+            continue;
+        }
+        
+        if (view->frame != frame) {
+            if (frame_decode(handle->fs, entry, view->frame_offsets[frame], view->frame_table[frame],
+                             frame_size, view->frame_data, view->frame_data + COMPRESS_FRAME_SIZE) != 0) {
+                view->frame = -1;
+                log_error("Erro: Falha ao ler o arquivo comprimido '%s'.\n", entry->name);
+                return -1;
+            }
+            view->frame = frame;
+        }
+        memcpy(buffer + done, view->frame_data + in_frame, chunk);
+        done += chunk;
+    }
+    return (int64_t)count;
+}
+
+static void view_release(CompressedView *view) {
+    free(view->frame_table);
+    free(view->frame_offsets);
+    free(view->frame_data);
+    memset(view, 0, sizeof(CompressedView));
+    view->frame = -1;
+}
+
+/* Escritas por handle trabalham sobre o conteúdo sem compressão: a
+   primeira descomprime o arquivo, que volta a ser comprimido no
+   fs_close */
+static int handle_prepare_write(FileHandle *handle, FileEntry *entry) {
+    if (!entry->compressed) {
+        return 0;
+    }
+    if (file_decompress(handle->fs, handle->entry_index) != 0) {
+        return -1;
+    }
+    handle->recompress = 1;
+    return 0;
+}
+
+static FileHandle* open_handle(FileSystem *fs, const char *name, int mode) {
+    if (!fs || !name || !(mode & (FS_OPEN_READ | FS_OPEN_WRITE))) return NULL;
+    
+    int file_index = name_index_lookup(fs, name);
+    if (file_index == -1) {
+        log_error("Erro: Arquivo '%s' não encontrado.\n", name);
+        return NULL;
+    }
+    
+    FileEntry *entry = &fs->file_table[file_index];
+    
+    // Verifica permissão para o modo pedido
+    if (entry->owner != fs->current_user && fs->current_user != 0) {
+        if ((mode & FS_OPEN_READ) && !(entry->permission & PERM_READ)) {
+            log_error("Erro: Sem permissão de leitura.\n");
+            return NULL;
+        }
+        if ((mode & FS_OPEN_WRITE) && !(entry->permission & PERM_WRITE)) {
+            log_error("Erro: Sem permissão de escrita.\n");
+            return NULL;
+        }
+    }
+    
+    FileHandle *handle = malloc(sizeof(FileHandle));
+    if (!handle) return NULL;
+    handle->fs = fs;
+    handle->entry_index = file_index;
+    handle->name_key = name_key(entry->name);
+    handle->mode = mode;
+    handle->reserved_start = 0;
+    handle->reserved_blocks = 0;
+    handle->modified = 0;
+    handle->recompress = 0;
+    memset(&handle->view, 0, sizeof(CompressedView));
+    handle->view.frame = -1;
+    handle->prev = handle->next = NULL;
+    if (mode & FS_OPEN_WRITE) {
+        handle_link(handle);
+    }
+    return handle;
+}
+
+FileHandle* fs_open(FileSystem *fs, const char *name, int mode) {
+    if (!fs || !name) return NULL;
+    fs_lock(fs, (mode & FS_OPEN_WRITE) != 0);
+    FileHandle *handle = open_handle(fs, name, mode);
+    fs_unlock(fs);
+    return handle;
+}
+
+static int64_t pread_handle(FileHandle *handle, void *buffer, uint64_t count, uint64_t offset) {
+    if (!(handle->mode & FS_OPEN_READ)) {
+        log_error("Erro: Handle não foi aberto para leitura.\n");
+        return -1;
+    }
+    
+    FileEntry *entry = handle_entry(handle);
+    if (!entry) return -1;
+    
+    if (entry->compressed) {
+        return view_read(handle, entry, buffer, count, offset);
+    }
+    
+    if (offset >= entry->size_bytes) {
+        return 0; // Fim do arquivo
+    }
+    if (count > entry->size_bytes - offset) {
+        count = entry->size_bytes - offset;
+    }
+    if (file_read_at(handle->fs, entry, offset, buffer, count) != 0) {
+        log_error("Erro: Falha ao ler do disco.\n");
+        return -1;
+    }
+    return (int64_t)count;
+}
+
+int64_t fs_pread(FileHandle *handle, void *buffer, uint64_t count, uint64_t offset) {
+    if (!handle || !handle->fs || !buffer) return -1;
+    uint64_t start = op_begin();
+    fs_lock(handle->fs, 0);
+    int64_t result = pread_handle(handle, buffer, count, offset);
+    fs_unlock(handle->fs);
+    op_end(handle->fs, FS_OP_PREAD, start, result < 0);
+    return result;
+}
+
+static int64_t pwrite_handle(FileHandle *handle, const void *data, uint64_t count, uint64_t offset) {
+    if (!(handle->mode & FS_OPEN_WRITE)) {
+        log_error("Erro: Handle não foi aberto para escrita.\n");
+        return -1;
+    }
+    
+    FileEntry *entry = handle_entry(handle);
+    if (!entry) return -1;
+    if (count == 0) return 0;
+    if (handle_prepare_write(handle, entry) != 0) return -1;
+    
+    FileSystem *fs = handle->fs;
+    uint64_t end = offset + count;
+    uint64_t old_size = entry->size_bytes;
+    
+    // Só cresce (e talvez realoca) quando a escrita passa do último bloco
+    uint64_t blocks_needed = (end + fs->layout.block_size - 1) / fs->layout.block_size;
+    if (file_grow(handle, blocks_needed) != 0) {
+        return -1;
+    }
+    
+    // Um buraco entre o fim atual e o deslocamento é lido como zeros
+    if (offset > old_size && file_zero_at(fs, entry, old_size, offset - old_size) != 0) {
+        log_error("Erro: Falha ao escrever no disco.\n");
+        return -1;
+    }
+    
+    if (file_write_at(fs, entry, offset, data, count) != 0) {
+        log_error("Erro: Falha ao escrever no disco.\n");
+        return -1;
+    }
+    
+    if (end > old_size) {
+        entry->size_bytes = end;
+    }
+    entry->last_modified = 1;
+    fs_entry_changed(fs, handle->entry_index);
+    journal_op_end(fs);
+    handle->modified = 1;
+    return (int64_t)count;
+}
+
+int64_t fs_pwrite(FileHandle *handle, const void *data, uint64_t count, uint64_t offset) {
+    if (!handle || !handle->fs || !data) return -1;
+    uint64_t start = op_begin();
+    fs_lock(handle->fs, 1);
+    int64_t result = pwrite_handle(handle, data, count, offset);
+    fs_unlock(handle->fs);
+    op_end(handle->fs, FS_OP_PWRITE, start, result < 0);
+    return result;
+}
+
+int64_t fs_append(FileHandle *handle, const void *data, uint64_t count) {
+    if (!handle || !handle->fs) return -1;
+    fs_lock(handle->fs, 1);
+    int64_t result = -1;
+    if (handle_entry(handle)) {
+        result = fs_pwrite(handle, data, count, fs_handle_size(handle));
+    }
+    fs_unlock(handle->fs);
+    return result;
+}
+
+static int truncate_handle(FileHandle *handle, uint64_t size) {
+    if (!handle) return -1;
+    if (!(handle->mode & FS_OPEN_WRITE)) {
+        log_error("Erro: Handle não foi aberto para escrita.\n");
+        return -1;
+    }
+    
+    FileEntry *entry = handle_entry(handle);
+    if (!entry || handle_prepare_write(handle, entry) != 0) return -1;
+    
+    FileSystem *fs = handle->fs;
+    uint64_t blocks_needed = (size + fs->layout.block_size - 1) / fs->layout.block_size;
+    
+    if (size > entry->size_bytes) {
+        // Crescer: aloca e preenche com zeros
+        uint64_t old_size = entry->size_bytes;
+        if (file_grow(handle, blocks_needed) != 0 ||
+            file_zero_at(fs, entry, old_size, size - old_size) != 0) {
+            return -1;
+        }
+    } else if (entry->shared && size < entry->size_bytes) {
+        // Encolher uma extensão compartilhada: a cópia leva só o que fica
+        if (file_unshare(fs, handle->entry_index, blocks_needed, -1) != 0) {
+            return -1;
+        }
+    } else if (blocks_needed < entry->size_blocks) {
+        // Encolher: devolve os blocos que sobraram no fim
+        if (file_trim(fs, handle->entry_index, blocks_needed) != 0) {
+            return -1;
+        }
+    }
+    
+    entry->size_bytes = size;
+    entry->last_modified = 1;
+    fs_entry_changed(fs, handle->entry_index);
+    journal_op_end(fs);
+    handle->modified = 1;
+    return 0;
+}
+
+int fs_truncate(FileHandle *handle, uint64_t size) {
+    if (!handle || !handle->fs) return -1;
+    fs_lock(handle->fs, 1);
+    int result = truncate_handle(handle, size);
+    fs_unlock(handle->fs);
+    return result;
+}
+
+static uint64_t handle_size(FileHandle *handle) {
+    if (!handle) return 0;
+    FileEntry *entry = handle_entry(handle);
+    if (entry && entry->compressed) {
+        return view_load(handle, entry) == 0 ? handle->view.raw_size : 0;
+    }
+    return entry ? entry->size_bytes : 0;
+}
+
+uint64_t fs_handle_size(FileHandle *handle) {
+    if (!handle || !handle->fs) return 0;
+    fs_lock(handle->fs, 0);
+    uint64_t size = handle_size(handle);
+    fs_unlock(handle->fs);
+    return size;
+}
+
+/* Reserva espaço contíguo para o arquivo chegar a size bytes sem
+   realocações no meio das escritas: logo depois da última extensão, se
+   estiver livre, ou numa extensão nova que receberá o arquivo no próximo
+   crescimento. Sem espaço para o arquivo inteiro, só o que falta é
+   reservado, e vira mais uma extensão dele; nem para isso, nada é
+   reservado e basta haver blocos livres. O tamanho do arquivo não
+   muda; o que não for usado volta a ficar livre em fs_close. */
+static int reserve_handle(FileHandle *handle, uint64_t size) {
+    if (!handle) return -1;
+    if (!(handle->mode & FS_OPEN_WRITE)) {
+        log_error("Erro: Handle não foi aberto para escrita.\n");
+        return -1;
+    }
+    
+    FileEntry *entry = handle_entry(handle);
+    if (!entry || handle_prepare_write(handle, entry) != 0) return -1;
+    
+    FileSystem *fs = handle->fs;
+    uint64_t blocks_needed = (size + fs->layout.block_size - 1) / fs->layout.block_size;
+    handle_unreserve(handle);
+    if (blocks_needed <= entry->size_blocks) {
+        return 0;
+    }
+    
+    // Extensão compartilhada não cresce no lugar: a reserva recebe a cópia
+    uint64_t end = file_end_block(entry);
+    uint64_t extra = blocks_needed - entry->size_blocks;
+    if (entry->size_blocks > 0 && !entry->shared && extent_index_is_free(fs->free_extents, end, extra)) {
+        return handle_reserve(handle, end, extra);
+    }
+    
+    int64_t start_block = entry->map_block ? -1 : fs_find_free(fs, blocks_needed);
+    if (start_block != -1) {
+        return handle_reserve(handle, (uint64_t)start_block, blocks_needed);
+    }
+    start_block = fs_find_free(fs, extra);
+    if (start_block != -1) {
+        return handle_reserve(handle, (uint64_t)start_block, extra);
+    }
+    
+    // Sem espaço contíguo nem para o que falta: não há o que reservar, e
+    // o arquivo cresce em várias extensões
+    if (fs->superblock.free_blocks < extra) {
+        log_error("Erro: Espaço insuficiente no disco.\n");
+        return -1;
+    }
+    return 0;
+}
+
+int fs_reserve(FileHandle *handle, uint64_t size) {
+    if (!handle || !handle->fs) return -1;
+    fs_lock(handle->fs, 1);
+    int result = reserve_handle(handle, size);
+    fs_unlock(handle->fs);
+    return result;
+}
+
+/* Com a deduplicação ligada, o conteúdo deixado pelas escritas do handle
+   é comparado com o dos outros arquivos no fechamento */
+static void dedup_on_close(FileHandle *handle) {
+    FileSystem *fs = handle->fs;
+    int index = handle->entry_index;
+    FileEntry *entry = &fs->file_table[index];
+    if (!entry->is_used || name_key(entry->name) != handle->name_key || entry->size_bytes == 0) {
+        return;
+    }
+    
+    int table_full = 0, merged;
+    dedup_file(fs, index, NULL, &table_full, &merged);
+    if (merged) {
+        journal_op_end(fs);
+    }
+}
+
+/* O arquivo descomprimido para as escritas do handle volta ao formato
+   comprimido (se faltar espaço, fica sem compressão) */
+static void handle_recompress(FileHandle *handle) {
+    FileSystem *fs = handle->fs;
+    FileEntry *entry = &fs->file_table[handle->entry_index];
+    if (!entry->is_used || name_key(entry->name) != handle->name_key || entry->compressed) {
+        return;
+    }
+    if (file_compress(fs, handle->entry_index) == 0) {
+        journal_op_end(fs);
+    }
+}
+
+static int close_handle(FileHandle *handle) {
+    if (!handle) return -1;
+    handle_unreserve(handle);
+    if (handle->mode & FS_OPEN_WRITE) {
+        handle_unlink(handle);
+    }
+    if (handle->recompress) {
+        handle_recompress(handle);
+    }
+    if (handle->modified && handle->fs->fingerprints) {
+        dedup_on_close(handle);
+    }
+    view_release(&handle->view);
+    free(handle);
+    return 0;
+}
+
+/* Só o fechamento de um handle de escrita mexe no disco (reserva,
+   recompressão, deduplicação) */
+int fs_close(FileHandle *handle) {
+    if (!handle) return -1;
+    FileSystem *fs = handle->fs;
+    if (!fs) {
+        // Desmontado com o handle aberto: já não há o que gravar
+        free(handle);
+        return 0;
+    }
+    fs_lock(fs, (handle->mode & FS_OPEN_WRITE) != 0);
+    int result = close_handle(handle);
+    fs_unlock(fs);
+    return result;
+}
+
+/* Desmontagem com handles de escrita abertos: as reservas voltam a ficar
+   livres antes da gravação final e os handles deixam de apontar para o
+   sistema de arquivos */
+static void handles_detach(FileSystem *fs) {
+    while (fs->handles) {
+        FileHandle *handle = fs->handles;
+        handle_unreserve(handle);
+        handle_unlink(handle);
+        view_release(&handle->view);
+        handle->fs = NULL;
+    }
+}
+
+/* ============================================
+   DESFRAGMENTAÇÃO
+   ============================================ */
+
+static int fragmentation_info(FileSystem *fs, FragmentationInfo *info) {
+    if (!fs || !info) return -1;
+    
+    info->free_blocks = fs->free_extents->free_blocks;
+    info->free_extents = fs->free_extents->extent_count;
+    info->largest_free = extent_index_largest(fs->free_extents);
+    info->fragmentation = info->free_blocks > 0 ?
+        1.0 - (double)info->largest_free / (double)info->free_blocks : 0.0;
+    return 0;
+}
+
+int fs_fragmentation(FileSystem *fs, FragmentationInfo *info) {
+    if (!fs || !info) return -1;
+    fs_lock(fs, 0);
+    int result = fragmentation_info(fs, info);
+    fs_unlock(fs);
+    return result;
+}
+
+/* Torna durável o deslocamento antes que os blocos liberados possam ser
+   reaproveitados por outro: commit do journal (que descarrega os dados
+   antes) ou, sem journal, um checkpoint */
+static int defrag_commit(FileSystem *fs) {
+    if (journal_enabled(fs)) {
+        return journal_commit(fs);
+    }
+    return fs_sync(fs);
+}
+
+/* Copia o arquivo inteiro para dest, que não pode sobrepor a extensão
+   atual, e só então devolve a antiga */
+static int defrag_move(FileSystem *fs, int index, uint64_t dest, DefragReport *report) {
+    FileEntry *entry = &fs->file_table[index];
+    uint64_t blocks = entry->size_blocks;
+    
+    if (fs_alloc_range(fs, dest, blocks) != 0) {
+        return -1;
+    }
+    if (disk_copy(fs, entry->start_block, dest, blocks * fs->layout.block_size) != 0) {
+        fs_release_range(fs, dest, blocks);
+        return -1;
+    }
+    fs_release_range(fs, entry->start_block, blocks);
+    entry->start_block = dest;
+    fs_entry_changed(fs, index);
+    report->bytes_moved += blocks * fs->layout.block_size;
+    return defrag_commit(fs);
+}
+
+/* Desloca os primeiros blocks blocos da extensão do arquivo que começa
+   em start, com o mesmo cuidado de defrag_move: cópia, mapa novo e só
+   então a devolução do trecho antigo. Se sobra parte da extensão, o
+   arquivo passa a ter uma extensão a mais. Com merge, o trecho se junta
+   às vizinhas que ficarem encostadas nele; sem, continua separado
+   (passagem intermediária). Extensões compartilhadas nunca se juntam. */
+static int defrag_move_run(FileSystem *fs, int index, uint64_t start, uint64_t blocks,
+                           uint64_t dest, int merge, DefragReport *report) {
+    FileEntry *entry = &fs->file_table[index];
+    FileExtent single;
+    uint32_t extent_count;
+    const FileExtent *extents = file_extents(entry, &single, &extent_count);
+    FileExtent *list = NULL;
+    uint32_t count = 0, cap = 0;
+    
+    for (uint32_t i = 0; i < extent_count; i++) {
+        FileExtent runs[2] = { extents[i], extents[i] };
+        int pieces = 1;
+        if (extents[i].start == start) {
+            runs[0].start = dest;
+            runs[0].count = blocks;
+            runs[1].start = start + blocks;
+            runs[1].count = extents[i].count - blocks;
+            pieces = runs[1].count > 0 ? 2 : 1;
+        }
+        for (int p = 0; p < pieces; p++) {
+            int pushed;
+            if (merge && share_lookup(fs, runs[p].start, runs[p].count) == -1 &&
+                (count == 0 || share_lookup(fs, list[count - 1].start, list[count - 1].count) == -1)) {
+                pushed = extents_push(&list, &count, &cap, runs[p].start, runs[p].count);
+            } else {
+                pushed = extents_reserve(&list, &cap, count + 1);
+                if (pushed == 0) {
+                    runs[p].logical = count > 0 ? list[count - 1].logical + list[count - 1].count : 0;
+                    list[count++] = runs[p];
+                }
+            }
+            if (pushed != 0) {
+                free(list);
+                return -1;
+            }
         }
     }
-    
-    if (file_index == -1) {
-        printf("Erro: Arquivo '%s' não encontrado.\n", name);
+    
+    if (fs_alloc_range(fs, dest, blocks) != 0) {
+        free(list);
+        return -1;
+    }
+    if (disk_copy(fs, start, dest, blocks * fs->layout.block_size) != 0 ||
+        file_install(fs, index, list, count, 0) != 0) {
+        free(list);
+        fs_release_range(fs, dest, blocks);
         return -1;
     }
+    fs_release_range(fs, start, blocks);
+    report->bytes_moved += blocks * fs->layout.block_size;
+    return defrag_commit(fs);
+}
+
+/* Desloca os primeiros blocks blocos da extensão compartilhada da
+   posição slot para dest, para todos os arquivos que a usam (com
+   share_move: o que sobra continua na posição slot) */
+static int defrag_move_shared(FileSystem *fs, uint32_t slot, uint64_t blocks, uint64_t dest,
+                              DefragReport *report) {
+    uint64_t start = fs->share_table[slot].start_block;
     
-    FileEntry *entry = &fs->file_table[file_index];
-    
-    // Verifica permissão
-    if (entry->owner != fs->current_user && fs->current_user != 0) {
-        if (!(entry->permission & PERM_READ)) {
-            printf("Erro: Sem permissão de leitura.\n");
-            return -1;
+    if (fs_alloc_range(fs, dest, blocks) != 0) {
+        return -1;
+    }
+    if (disk_copy(fs, start, dest, blocks * fs->layout.block_size) != 0 ||
+        share_move(fs, slot, blocks, dest) != 0) {
+        fs_release_range(fs, dest, blocks);
+        return -1;
+    }
+    report->bytes_moved += blocks * fs->layout.block_size;
+    return defrag_commit(fs);
+}
+
+/* Desloca a unidade inteira para dest, pelo caminho do seu tipo */
+static int defrag_move_unit(FileSystem *fs, int index, uint64_t start, uint64_t blocks,
+                            uint64_t dest, int merge, DefragReport *report) {
+    int64_t slot = share_lookup(fs, start, blocks);
+    if (slot != -1) {
+        return defrag_move_shared(fs, (uint32_t)slot, blocks, dest, report);
+    }
+    if (fs->file_table[index].map_block) {
+        return defrag_move_run(fs, index, start, blocks, dest, merge, report);
+    }
+    return defrag_move(fs, index, dest, report);
+}
+
+/* Unidade da compactação: um arquivo contíguo, uma das extensões de um
+   arquivo em várias ou uma extensão compartilhada (com um dos arquivos
+   que a usam) */
+typedef struct {
+    int index;
+    uint64_t start;
+    uint64_t blocks;
+} DefragUnit;
+
+static int compare_by_start(const void *a, const void *b) {
+    uint64_t x = ((const DefragUnit *)a)->start;
+    uint64_t y = ((const DefragUnit *)b)->start;
+    return x < y ? -1 : x > y;
+}
+
+/* A unidade ainda está onde estava quando a ordem foi montada (outro
+   deslocamento pode tê-la juntado a uma vizinha) */
+static int defrag_unit_valid(const FileSystem *fs, const DefragUnit *unit) {
+    const FileEntry *entry = &fs->file_table[unit->index];
+    FileExtent single;
+    uint32_t count;
+    const FileExtent *list = file_extents(entry, &single, &count);
+    for (uint32_t i = 0; i < count; i++) {
+        if (list[i].start == unit->start) {
+            return list[i].count == unit->blocks;
         }
     }
-    
-    if (entry->size_blocks == 0) {
-        printf("Arquivo '%s' está vazio.\n", name);
-        *size = 0;
-        return 0;
+    return 0;
+}
+
+static double monotonic_seconds(void) {
+    return clock_ns() / 1e9;
+}
+
+/* As extensões de todos os arquivos (uma compartilhada entra uma vez só),
+   em ordem de bloco inicial */
+static DefragUnit* defrag_order(const FileSystem *fs, int *count) {
+    size_t capacity = fs->layout.max_files;
+    for (uint32_t i = 0; i < fs->layout.max_files; i++) {
+        if (fs->file_table[i].is_used && fs->file_table[i].map_block) {
+            capacity += fs->file_table[i].extent_count;
+        }
+    }
+    DefragUnit *order = malloc(capacity * sizeof(DefragUnit));
+    uint8_t *seen = calloc(fs->layout.share_entries + 1, 1);
+    if (!order || !seen) {
+        free(order);
+        free(seen);
+        return NULL;
+    }
+    *count = 0;
+    for (uint32_t i = 0; i < fs->layout.max_files; i++) {
+        const FileEntry *entry = &fs->file_table[i];
+        if (!entry->is_used) {
+            continue;
+        }
+        FileExtent single;
+        uint32_t extent_count;
+        const FileExtent *list = file_extents(entry, &single, &extent_count);
+        for (uint32_t e = 0; e < extent_count; e++) {
+            int64_t slot = entry->shared ? share_lookup(fs, list[e].start, list[e].count) : -1;
+            if (slot != -1 && seen[slot]) {
+                continue;
+            }
+            if (slot != -1) {
+                seen[slot] = 1;
+            }
+            order[(*count)++] = (DefragUnit){ i, list[e].start, list[e].count };
+        }
     }
+    free(seen);
+    qsort(order, *count, sizeof(DefragUnit), compare_by_start);
+    return order;
+}
+
+static int defrag_over_budget(const DefragReport *report, double deadline, uint64_t max_bytes) {
+    return (deadline > 0 && monotonic_seconds() >= deadline) ||
+           (max_bytes > 0 && report->bytes_moved >= max_bytes);
+}
+
+/* Percorre as unidades em ordem de bloco inicial, a partir do cursor, e
+   desliza cada uma para o começo do trecho livre logo antes dela. Quando
+   o trecho é menor que a unidade as extensões se sobreporiam, e uma queda
+   no meio da cópia destruiria o original; nesse caso ela passa antes por
+   uma extensão livre em outro lugar. Cada deslocamento é confirmado antes
+   do próximo. *finished indica se a passagem chegou ao fim do disco. */
+static int defrag_compact(FileSystem *fs, double deadline, uint64_t max_bytes,
+                          DefragReport *report, int *finished) {
+    int count;
+    DefragUnit *order = defrag_order(fs, &count);
+    if (!order) return -1;
     
-    // Lê os blocos
-    uint8_t *block_buffer = malloc(BLOCK_SIZE);
-    uint8_t *data_ptr = (uint8_t *)buffer;
+    if (fs->defrag_cursor < fs->layout.data_start) {
+        fs->defrag_cursor = fs->layout.data_start;
+    }
+    int result = 0;
+    int k = 0;
+    while (k < count && order[k].start < fs->defrag_cursor) {
+        k++;
+    }
     
-    for (uint64_t i = 0; i < entry->size_blocks; i++) {
-        block_read(fs->disk_file, entry->start_block + i, block_buffer);
+    for (; k < count; k++) {
+        if (defrag_over_budget(report, deadline, max_bytes)) {
+            break;
+        }
+        if (!defrag_unit_valid(fs, &order[k])) {
+            continue;
+        }
+        
+        int index = order[k].index;
+        FileEntry *entry = &fs->file_table[index];
+        uint64_t start = order[k].start;
+        uint64_t blocks = order[k].blocks;
+        int64_t slot = share_lookup(fs, start, blocks);
+        fs->defrag_cursor = start;
+        
+        // Trecho livre imediatamente antes da unidade
+        uint64_t hole_start, hole_length;
+        if (start <= fs->layout.data_start ||
+            extent_index_containing(fs->free_extents, start - 1, &hole_start, &hole_length) != 0) {
+            continue; // Já encostado no anterior
+        }
         
-        uint64_t bytes_to_copy = BLOCK_SIZE;
-        if (i == entry->size_blocks - 1) {
-            bytes_to_copy = entry->size_bytes - (i * BLOCK_SIZE);
+        uint64_t dest = hole_start;
+        int64_t bounce = hole_length < blocks ? fs_find_free(fs, blocks) : -1;
+        if (hole_length < blocks && bounce == -1) {
+            // Sem outro lugar para a unidade inteira: ela anda em pedaços do
+            // tamanho do buraco, cada um copiado para fora do próprio trecho
+            // (no meio do caminho o arquivo fica em várias extensões, e o
+            // mapa precisa caber fora do buraco). Uma extensão compartilhada
+            // fica dividida nos pedaços, cada um com sua posição na tabela,
+            // e todos os arquivos que a usam ganham mapas maiores. O mapa
+            // antigo só é devolvido no commit de cada passo, então o mapa
+            // novo precisa caber com ele ainda ocupado.
+            uint64_t pieces = (blocks + hole_length - 1) / hole_length;
+            uint64_t map_blocks = slot != -1 ? share_map_blocks(fs, (uint32_t)slot, (uint32_t)pieces - 1) :
+                extent_map_blocks(fs, (entry->map_block ? entry->extent_count : 1) + 1);
+            if ((slot != -1 && share_room(fs) < pieces - 1) ||
+                fs->free_extents->free_blocks < hole_length + 2 * map_blocks) {
+                report->files_skipped++;
+                continue;
+            }
+            uint64_t from = start, to = hole_start, left = blocks;
+            while (result == 0 && left > 0) {
+                uint64_t step = left < hole_length ? left : hole_length;
+                result = slot != -1 ? defrag_move_shared(fs, (uint32_t)slot, step, to, report)
+                                    : defrag_move_run(fs, index, from, step, to, 1, report);
+                from += step;
+                to += step;
+                left -= step;
+            }
+            // Os pedaços de uma extensão compartilhada, agora encostados,
+            // voltam a ser uma só (sem espaço para os mapas, ficam assim)
+            if (result == 0 && slot != -1 && pieces > 1 && share_join(fs, hole_start, blocks) == 0) {
+                result = defrag_commit(fs);
+            }
+            start = hole_start;
+            dest = 0;
+        } else if (hole_length < blocks) {
+            result = defrag_move_unit(fs, index, start, blocks, (uint64_t)bounce, 0, report);
+            // Com o original devolvido, trecho e extensão antiga formam um
+            // espaço contínuo a partir de hole_start (se a extensão livre
+            // ficava antes, a unidade já avançou; o mapa novo de um arquivo
+            // em várias também pode ter ocupado o trecho)
+            start = (uint64_t)bounce;
+            if ((uint64_t)bounce < order[k].start ||
+                !extent_index_is_free(fs->free_extents, hole_start, blocks)) {
+                dest = 0;
+            }
+        }
+        if (result == 0 && dest != 0) {
+            result = defrag_move_unit(fs, index, start, blocks, dest, 1, report);
+        }
+        if (result != 0) {
+            log_error("Erro: Falha ao deslocar o arquivo '%s'.\n", entry->name);
+            break;
         }
-        memcpy(data_ptr + (i * BLOCK_SIZE), block_buffer, bytes_to_copy);
+        if (!entry->map_block && slot == -1) {
+            report->files_moved++;
+        }
+        fs->defrag_cursor = (dest != 0 ? dest : start) + blocks;
     }
-    free(block_buffer);
-    
-    *size = entry->size_bytes;
-    printf("Arquivo '%s' lido (%lu bytes).\n", name, entry->size_bytes);
+    *finished = k >= count && result == 0;
+    free(order);
+    return result;
+}
+
+/* Com o disco compactado, os arquivos em várias extensões voltam a uma só
+   onde houver espaço contíguo para eles. *gathered conta os que voltaram. */
+static int defrag_gather(FileSystem *fs, double deadline, uint64_t max_bytes,
+                         DefragReport *report, int *gathered, int *finished) {
+    *gathered = 0;
+    for (uint32_t i = 0; i < fs->layout.max_files; i++) {
+        if (defrag_over_budget(report, deadline, max_bytes)) {
+            *finished = 0;
+            return 0;
+        }
+        FileEntry *entry = &fs->file_table[i];
+        if (!entry->is_used || !entry->map_block || entry->shared) {
+            continue; // Juntar um arquivo compartilhado desfaria o compartilhamento
+        }
+        int result = file_gather(fs, i);
+        if (result == 0) {
+            report->files_skipped++;
+            continue;
+        }
+        if (result < 0 || defrag_commit(fs) != 0) {
+            log_error("Erro: Falha ao juntar as extensões do arquivo '%s'.\n", entry->name);
+            return -1;
+        }
+        (*gathered)++;
+        report->files_moved++;
+        report->bytes_moved += entry->size_blocks * fs->layout.block_size;
+    }
+    *finished = 1;
     return 0;
 }
 
-int fs_copy(FileSystem *fs, const char *src_name, const char *dest_name) {
-    if (!fs || !src_name || !dest_name) return -1;
+/* Compacta o disco e junta os arquivos em várias extensões. Juntar um
+   arquivo deixa buracos onde estavam as extensões dele, e a compactação
+   seguinte fecha esses buracos e pode abrir espaço para outro: as rodadas
+   se repetem até uma que não junte nenhum arquivo. */
+static int defrag_run(FileSystem *fs, const DefragBudget *budget, DefragReport *report) {
+    if (!fs || !report) return -1;
     
-    // Procura o arquivo de origem
-    int src_index = -1;
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (fs->file_table[i].is_used && 
-            strcmp(fs->file_table[i].name, src_name) == 0) {
-            src_index = i;
+    memset(report, 0, sizeof(DefragReport));
+    fs_fragmentation(fs, &report->before);
+    
+    double deadline = budget && budget->max_seconds > 0 ?
+        monotonic_seconds() + budget->max_seconds : 0;
+    uint64_t max_bytes = budget ? budget->max_bytes : 0;
+    int result;
+    for (;;) {
+        int finished, gathered;
+        report->files_skipped = 0; // Só os da última rodada ficaram de fora
+        result = defrag_compact(fs, deadline, max_bytes, report, &finished);
+        if (result != 0 || !finished) break;
+        result = defrag_gather(fs, deadline, max_bytes, report, &gathered, &finished);
+        if (result != 0 || !finished) break;
+        
+        fs->defrag_cursor = fs->layout.data_start; // A rodada seguinte (ou a próxima chamada) recomeça do início
+        if (gathered == 0) {
+            report->complete = 1;
             break;
         }
     }
     
-    if (src_index == -1) {
-        printf("Erro: Arquivo origem '%s' não encontrado.\n", src_name);
-        return -1;
+    fs_fragmentation(fs, &report->after);
+    return result;
+}
+
+int fs_defrag(FileSystem *fs, const DefragBudget *budget, DefragReport *report) {
+    if (!fs || !report) return -1;
+    fs_lock(fs, 1);
+    int result = defrag_run(fs, budget, report);
+    fs_unlock(fs);
+    return result;
+}
+
+/* ============================================
+   DEDUPLICAÇÃO (MODO E VARREDURA)
+   ============================================ */
+
+/* Calcula as impressões que faltam (arquivos alterados desde o último
+   cálculo) e monta o índice de novo com elas */
+static int dedup_fill_fingerprints(FileSystem *fs, uint8_t *buffer) {
+    int added = 0;
+    for (uint32_t i = 0; i < fs->layout.max_files; i++) {
+        const FileEntry *entry = &fs->file_table[i];
+        DedupPrints *mine = &fs->fingerprints[i];
+        if (!entry->is_used || entry->size_bytes == 0 || mine->prints) {
+            continue;
+        }
+        mine->prints = dedup_prints(fs, (int)i, NULL, buffer, &mine->count);
+        if (!mine->prints) {
+            return -1;
+        }
+        added = 1;
     }
+    return added || !fs->dedup_index ? dedup_index_rebuild(fs, 0) : 0;
+}
+
+/* Ligar calcula a impressão de todas as extensões (lê o disco inteiro uma
+   vez) e monta o índice; os dois ficam em memória e são mantidos pelas
+   escritas seguintes */
+static int set_dedup(FileSystem *fs, int enabled) {
+    if (!fs) return -1;
     
-    FileEntry *src = &fs->file_table[src_index];
-    
-    // Cria o arquivo de destino
-    if (fs_create(fs, dest_name, src->type, src->permission) != 0) {
+    if (!enabled) {
+        dedup_release(fs);
+        return 0;
+    }
+    if (fs->fingerprints) {
+        return 0;
+    }
+    if (fs->superblock.share_table_blocks == 0) {
+        log_error("Erro: Disco sem tabela de extensões compartilhadas (deduplicação indisponível).\n");
         return -1;
     }
     
-    // Copia os dados se houver
-    if (src->size_bytes > 0) {
-        void *buffer = malloc(src->size_bytes);
-        uint64_t size;
-        
-        if (fs_read(fs, src_name, buffer, &size) == 0) {
-            fs_write(fs, dest_name, buffer, size);
-        }
+    fs->fingerprints = calloc(fs->layout.max_files, sizeof(DedupPrints));
+    uint8_t *buffer = malloc(DEDUP_CHUNK);
+    if (!fs->fingerprints || !buffer || dedup_fill_fingerprints(fs, buffer) != 0) {
+        log_error("Erro: Falha ao calcular as impressões digitais dos arquivos.\n");
         free(buffer);
+        dedup_release(fs);
+        return -1;
     }
-    
-    printf("Arquivo '%s' copiado para '%s'.\n", src_name, dest_name);
+    free(buffer);
     return 0;
 }
 
-int fs_remove(FileSystem *fs, const char *name) {
-    if (!fs || !name) return -1;
+int fs_set_dedup(FileSystem *fs, int enabled) {
+    if (!fs) return -1;
+    fs_lock(fs, 1);
+    int result = set_dedup(fs, enabled);
+    fs_unlock(fs);
+    return result;
+}
+
+/* Varredura offline: cada extensão de cada arquivo é procurada no índice,
+   e as iguais a uma de outro arquivo passam a ser referências a ela. Cada
+   arquivo unido é uma operação no journal. */
+static int dedup_scan(FileSystem *fs, DedupReport *report) {
+    if (!fs || !report) return -1;
+    memset(report, 0, sizeof(DedupReport));
     
-    // Procura o arquivo
-    int file_index = -1;
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (fs->file_table[i].is_used && 
-            strcmp(fs->file_table[i].name, name) == 0) {
-            file_index = i;
-            break;
+    int temporary = fs->fingerprints == NULL;
+    if (temporary && set_dedup(fs, 1) != 0) {
+        return -1;
+    }
+    
+    uint8_t *buffer = malloc(DEDUP_CHUNK);
+    int result = 0;
+    if (!buffer || dedup_fill_fingerprints(fs, buffer) != 0) {
+        result = -1;
+    }
+    free(buffer);
+    
+    int table_full = 0;
+    for (uint32_t i = 0; i < fs->layout.max_files && result == 0 && !table_full; i++) {
+        if (!fs->file_table[i].is_used || fs->file_table[i].size_bytes == 0) {
+            continue;
+        }
+        report->files_scanned++;
+        int merged;
+        int64_t released = dedup_file(fs, (int)i, NULL, &table_full, &merged);
+        if (released > 0 && merged) { // Na falha o arquivo só fica como está
+            report->files_merged++;
+            report->blocks_reclaimed += (uint64_t)released;
+            journal_op_end(fs);
         }
     }
+    if (table_full) {
+        log_error("Aviso: Tabela de extensões compartilhadas cheia; deduplicação interrompida.\n");
+    }
+    
+    if (temporary) {
+        set_dedup(fs, 0);
+    }
+    if (result == 0) {
+        log_info("Deduplicação: %lu arquivo(s) examinados, %lu unidos, %lu blocos liberados.\n",
+               report->files_scanned, report->files_merged, report->blocks_reclaimed);
+    }
+    return result;
+}
+
+int fs_dedup(FileSystem *fs, DedupReport *report) {
+    if (!fs || !report) return -1;
+    fs_lock(fs, 1);
+    int result = dedup_scan(fs, report);
+    fs_unlock(fs);
+    return result;
+}
+
+/* ============================================
+   COMPRESSÃO POR ARQUIVO
+   ============================================ */
+
+/* Liga ou desliga a compressão de um arquivo, convertendo na hora o
+   conteúdo já gravado. Só texto e binário: imagens e áudio costumam vir
+   comprimidos do formato de origem. */
+static int set_compression(FileSystem *fs, const char *name, int enabled) {
+    if (!fs || !name) return -1;
     
+    int file_index = name_index_lookup(fs, name);
     if (file_index == -1) {
-        printf("Erro: Arquivo '%s' não encontrado.\n", name);
+        log_error("Erro: Arquivo '%s' não encontrado.\n", name);
         return -1;
     }
     
     FileEntry *entry = &fs->file_table[file_index];
     
-    // Verifica permissão (apenas o dono ou root pode remover)
+    // Verifica permissão
     if (entry->owner != fs->current_user && fs->current_user != 0) {
-        printf("Erro: Apenas o dono pode remover o arquivo.\n");
-        return -1;
+        if (!(entry->permission & PERM_WRITE)) {
+            log_error("Erro: Sem permissão de escrita.\n");
+            return -1;
+        }
     }
     
-    // Libera os blocos
-    if (entry->size_blocks > 0) {
-        for (uint64_t i = 0; i < entry->size_blocks; i++) {
-            bitmap_clear_bit(fs->bitmap, entry->start_block + i);
-        }
-        fs->superblock.free_blocks += entry->size_blocks;
+    if (enabled && entry->type != TYPE_TEXTO && entry->type != TYPE_BINARIO) {
+        log_error("Erro: Compressão só para arquivos de texto e binários.\n");
+        return -1;
+    }
+    if (!entry->compressed == !enabled) {
+        log_info("Arquivo '%s' já está %s.\n", name, enabled ? "comprimido" : "sem compressão");
+        return 0;
     }
     
-    // Remove da tabela
-    memset(entry, 0, sizeof(FileEntry));
-    fs->superblock.current_files--;
+    uint64_t before = entry->size_blocks;
+    if ((enabled ? file_compress(fs, file_index) : file_decompress(fs, file_index)) != 0) {
+        return -1;
+    }
+    journal_op_end(fs);
     
-    printf("Arquivo '%s' removido.\n", name);
+    log_info("Arquivo '%s' %s (%lu -> %lu blocos).\n", name,
+           enabled ? "comprimido" : "descomprimido", before, entry->size_blocks);
     return 0;
 }
 
+int fs_set_compression(FileSystem *fs, const char *name, int enabled) {
+    if (!fs || !name) return -1;
+    fs_lock(fs, 1);
+    int result = set_compression(fs, name, enabled);
+    fs_unlock(fs);
+    return result;
+}
+
+/* 1 se o arquivo é comprimido, 0 se não, -1 se não existe */
+int fs_get_compression(FileSystem *fs, const char *name) {
+    if (!fs || !name) return -1;
+    fs_lock(fs, 0);
+    int file_index = name_index_lookup(fs, name);
+    int result = file_index == -1 ? -1 : fs->file_table[file_index].compressed;
+    fs_unlock(fs);
+    return result;
+}
+
+static int count_extents(FileSystem *fs, const char *name) {
+    if (!fs || !name) return -1;
+    int file_index = name_index_lookup(fs, name);
+    if (file_index == -1) {
+        return -1;
+    }
+    const FileEntry *entry = &fs->file_table[file_index];
+    if (entry->map_block) {
+        return (int)entry->extent_count;
+    }
+    return entry->size_blocks > 0 ? 1 : 0;
+}
+
+int fs_get_extents(FileSystem *fs, const char *name) {
+    if (!fs || !name) return -1;
+    fs_lock(fs, 0);
+    int result = count_extents(fs, name);
+    fs_unlock(fs);
+    return result;
+}
+
+int fs_lookup(FileSystem *fs, const char *name) {
+    if (!fs || !name) return -1;
+    fs_lock(fs, 0);
+    int result = name_index_lookup(fs, name);
+    fs_unlock(fs);
+    return result;
+}
+
 /* ============================================
    FUNÇÕES DE LISTAGEM E INFORMAÇÕES
    ============================================ */
 
-int fs_list(FileSystem *fs) {
+static int list_files(FileSystem *fs) {
     if (!fs) return -1;
     
     printf("\n========================================\n");
@@ -586,16 +5668,17 @@ int fs_list(FileSystem *fs) {
     printf("----------------------------------------\n");
     
     int count = 0;
-    for (int i = 0; i < MAX_FILES; i++) {
+    for (uint32_t i = 0; i < fs->layout.max_files; i++) {
         if (fs->file_table[i].is_used) {
             FileEntry *e = &fs->file_table[i];
-            printf("%-10s %-5s %7luB %9lu  %4d  %s\n",
+            printf("%-10s %-5s %7luB %9lu  %4d  %s%s\n",
                    e->name,
                    filetype_to_string(e->type),
                    e->size_bytes,
                    e->size_blocks,
                    e->owner,
-                   permission_to_string(e->permission));
+                   permission_to_string(e->permission),
+                   e->compressed ? "  (comprimido)" : "");
             count++;
         }
     }
@@ -607,80 +5690,301 @@ int fs_list(FileSystem *fs) {
     return 0;
 }
 
-int fs_info(FileSystem *fs, const char *name) {
+int fs_list(FileSystem *fs) {
+    if (!fs) return -1;
+    fs_lock(fs, 0);
+    int result = list_files(fs);
+    fs_unlock(fs);
+    return result;
+}
+
+static int print_file_info(FileSystem *fs, const char *name) {
     if (!fs || !name) return -1;
     
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (fs->file_table[i].is_used && 
-            strcmp(fs->file_table[i].name, name) == 0) {
-            FileEntry *e = &fs->file_table[i];
-            
-            printf("\n========================================\n");
-            printf("INFORMAÇÕES DO ARQUIVO\n");
-            printf("========================================\n");
-            printf("Nome:           %s\n", e->name);
-            printf("Tipo:           %s\n", filetype_to_string(e->type));
-            printf("Tamanho:        %lu bytes\n", e->size_bytes);
-            printf("Blocos:         %lu\n", e->size_blocks);
-            printf("Bloco inicial:  %lu\n", e->start_block);
-            printf("Proprietário:   user%d\n", e->owner);
-            printf("Permissões:     %s\n", permission_to_string(e->permission));
-            printf("Modificado:     %s\n", e->last_modified ? "Sim" : "Não");
-            printf("========================================\n\n");
-            
-            return 0;
+    int file_index = name_index_lookup(fs, name);
+    if (file_index == -1) {
+        printf("Erro: Arquivo '%s' não encontrado.\n", name);
+        return -1;
+    }
+    
+    FileEntry *e = &fs->file_table[file_index];
+    
+    printf("\n========================================\n");
+    printf("INFORMAÇÕES DO ARQUIVO\n");
+    printf("========================================\n");
+    printf("Nome:           %s\n", e->name);
+    printf("Tipo:           %s\n", filetype_to_string(e->type));
+    printf("Tamanho:        %lu bytes\n", e->size_bytes);
+    printf("Blocos:         %lu\n", e->size_blocks);
+    printf("Bloco inicial:  %lu\n", e->start_block);
+    printf("Proprietário:   user%d\n", e->owner);
+    printf("Permissões:     %s\n", permission_to_string(e->permission));
+    printf("Modificado:     %s\n", e->last_modified ? "Sim" : "Não");
+    if (e->shared && !e->map_block) {
+        printf("Compartilhado:  extensão comum a mais %u arquivo(s)\n",
+               fs->share_table[share_lookup(fs, e->start_block, e->size_blocks)].refs - 1);
+    } else if (e->shared) {
+        printf("Compartilhado:  %u de %u extensões\n", e->shared, e->extent_count);
+    }
+    if (e->map_block) {
+        printf("Extensões:      %u (mapa no bloco %lu)\n", e->extent_count, e->map_block);
+    }
+    if (e->compressed) {
+        CompressedHeader header;
+        uint32_t *table;
+        if (compressed_load(fs, e, &header, &table) == 0) {
+            printf("Compressão:     LZ, %lu bytes descomprimidos (%.1f%% gravados)\n", header.raw_size,
+                   header.raw_size > 0 ? 100.0 * (double)e->size_bytes / (double)header.raw_size : 100.0);
+            free(table);
         }
     }
+    printf("========================================\n\n");
     
-    printf("Erro: Arquivo '%s' não encontrado.\n", name);
-    return -1;
+    return 0;
 }
 
-int fs_disk_info(FileSystem *fs) {
+int fs_info(FileSystem *fs, const char *name) {
+    if (!fs || !name) return -1;
+    fs_lock(fs, 0);
+    int result = print_file_info(fs, name);
+    fs_unlock(fs);
+    return result;
+}
+
+static int print_disk_info(FileSystem *fs) {
     if (!fs) return -1;
     
     printf("\n========================================\n");
     printf("INFORMAÇÕES DO DISCO\n");
     printf("========================================\n");
     printf("Assinatura:     %s\n", fs->superblock.signature);
-    printf("Tamanho bloco:  %d bytes\n", fs->superblock.block_size);
-    printf("Total blocos:   %d\n", fs->superblock.total_blocks);
-    printf("Blocos livres:  %d\n", fs->superblock.free_blocks);
-    printf("Blocos usados:  %d\n", 
+    printf("Versão:         %u\n", fs->superblock.version);
+    printf("Tamanho bloco:  %u bytes\n", fs->superblock.block_size);
+    printf("Total blocos:   %u (%llu MB)\n", fs->superblock.total_blocks,
+           (unsigned long long)(fs->layout.total_blocks * fs->layout.block_size >> 20));
+    printf("Blocos livres:  %u\n", fs->superblock.free_blocks);
+    printf("Blocos usados:  %u\n", 
            fs->superblock.total_blocks - fs->superblock.free_blocks);
-    printf("Arquivos:       %d/%d\n", 
+    printf("Arquivos:       %u/%u\n", 
            fs->superblock.current_files, fs->superblock.max_files);
     printf("----------------------------------------\n");
-    printf("Bitmap início:  bloco %d\n", fs->superblock.bitmap_start);
-    printf("Diret. raiz:    bloco %d\n", fs->superblock.root_dir_start);
-    printf("Dados início:   bloco %d\n", fs->superblock.data_start);
+    printf("Bitmap início:  bloco %u\n", fs->superblock.bitmap_start);
+    printf("Diret. raiz:    bloco %u\n", fs->superblock.root_dir_start);
+    printf("Dados início:   bloco %u\n", fs->superblock.data_start);
+    if (journal_enabled(fs)) {
+        printf("Journal:        blocos %u-%u (%lu bytes pendentes)\n", fs->superblock.journal_start,
+               fs->superblock.journal_start + fs->superblock.journal_blocks - 1, fs->journal_head);
+    } else {
+        printf("Journal:        desativado\n");
+    }
+    if (fs->superblock.share_table_blocks > 0) {
+        uint32_t extents = 0;
+        uint64_t saved = 0;
+        for (uint32_t i = 0; i < fs->layout.share_entries; i++) {
+            if (fs->share_table[i].refs > 0) {
+                extents++;
+                saved += (uint64_t)fs->share_table[i].block_count * (fs->share_table[i].refs - 1);
+            }
+        }
+        printf("Compartilhadas: blocos %u-%u (%u extensões, %lu blocos economizados)\n",
+               fs->superblock.share_table_start,
+               fs->superblock.share_table_start + fs->superblock.share_table_blocks - 1,
+               extents, saved);
+    } else {
+        printf("Compartilhadas: desativado\n");
+    }
     printf("========================================\n\n");
     
     return 0;
 }
 
+int fs_disk_info(FileSystem *fs) {
+    if (!fs) return -1;
+    fs_lock(fs, 0);
+    int result = print_disk_info(fs);
+    fs_unlock(fs);
+    return result;
+}
+
 int fs_set_user(FileSystem *fs, uint8_t user_id) {
     if (!fs || user_id > 7) return -1;
+    fs_lock(fs, 1);
     fs->current_user = user_id;
-    printf("Usuário alterado para: user%d\n", user_id);
+    fs_unlock(fs);
+    log_info("Usuário alterado para: user%d\n", user_id);
+    return 0;
+}
+
+int fs_set_alloc_policy(FileSystem *fs, AllocPolicy policy) {
+    if (!fs || (policy != ALLOC_FIRST_FIT && policy != ALLOC_BEST_FIT)) return -1;
+    fs_lock(fs, 1);
+    fs->alloc_policy = policy;
+    fs_unlock(fs);
+    return 0;
+}
+
+/* Troca a capacidade do cache; os blocos sujos do cache atual são
+   gravados antes de descartá-lo */
+static int set_cache_size(FileSystem *fs, size_t capacity_blocks) {
+    if (!fs) return -1;
+    if (fs->disk_map) {
+        log_error("Erro: Cache de blocos não se aplica ao modo mapeado.\n");
+        return -1;
+    }
+    
+    BlockCache *cache = NULL;
+    if (capacity_blocks > 0) {
+        cache = cache_create(fs->disk_fd, fs->layout.block_size, capacity_blocks);
+        if (!cache) {
+            log_error("Erro: Falha ao alocar o cache de blocos.\n");
+            return -1;
+        }
+        cache_set_concurrent(cache, fs->concurrent);
+    }
+    if (cache_flush(fs->cache) != 0) {
+        log_error("Erro: Falha ao gravar os blocos do cache.\n");
+        cache_destroy(cache);
+        return -1;
+    }
+    cache_destroy(fs->cache);
+    fs->cache = cache;
+    return 0;
+}
+
+int fs_set_cache_size(FileSystem *fs, size_t capacity_blocks) {
+    if (!fs) return -1;
+    fs_lock(fs, 1);
+    int result = set_cache_size(fs, capacity_blocks);
+    fs_unlock(fs);
+    return result;
+}
+
+int fs_cache_stats(FileSystem *fs, CacheStats *stats, size_t *capacity_blocks) {
+    if (!fs || !stats) return -1;
+    fs_lock(fs, 0);
+    if (fs->cache) {
+        cache_get_stats(fs->cache, stats);
+    } else {
+        memset(stats, 0, sizeof(CacheStats));
+    }
+    if (capacity_blocks) {
+        *capacity_blocks = fs->cache ? fs->cache->capacity : 0;
+    }
+    fs_unlock(fs);
     return 0;
 }
 
+static int check_permission(FileSystem *fs, const char *name, FilePermission required) {
+    if (!fs || !name) return -1;
+    
+    int file_index = name_index_lookup(fs, name);
+    if (file_index == -1) {
+        return -1;
+    }
+    
+    FileEntry *e = &fs->file_table[file_index];
+    if (e->owner == fs->current_user || fs->current_user == 0) {
+        return 1; // Dono ou root tem acesso total
+    }
+    
+    return (e->permission & required) == required;
+}
+
 int fs_check_permission(FileSystem *fs, const char *name, FilePermission required) {
     if (!fs || !name) return -1;
+    fs_lock(fs, 0);
+    int result = check_permission(fs, name, required);
+    fs_unlock(fs);
+    return result;
+}
+
+/* ============================================
+   ESTATÍSTICAS
+   ============================================ */
+
+static void extent_histogram_visit(uint64_t start, uint64_t length, void *ctx) {
+    (void)start;
+    uint64_t *histogram = ctx;
+    unsigned bucket = 63 - bit_clz64(length);
+    histogram[bucket < STATS_EXTENT_BUCKETS ? bucket : STATS_EXTENT_BUCKETS - 1]++;
+}
+
+int fs_stats(FileSystem *fs, FsStats *stats) {
+    if (!fs || !stats) return -1;
     
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (fs->file_table[i].is_used && 
-            strcmp(fs->file_table[i].name, name) == 0) {
-            FileEntry *e = &fs->file_table[i];
-            
-            if (e->owner == fs->current_user || fs->current_user == 0) {
-                return 1; // Dono ou root tem acesso total
+    memset(stats, 0, sizeof(FsStats));
+    fs_lock(fs, 0);
+    fs_fragmentation(fs, &stats->space);
+    extent_index_foreach(fs->free_extents, extent_histogram_visit, stats->extent_histogram);
+    op_stats_lock(fs);
+    memcpy(stats->ops, fs->op_stats, sizeof(stats->ops));
+    op_stats_unlock(fs);
+    fs_unlock(fs);
+    return 0;
+}
+
+void fs_stats_reset(FileSystem *fs) {
+    if (!fs) return;
+    op_stats_lock(fs);
+    memset(fs->op_stats, 0, sizeof(fs->op_stats));
+    op_stats_unlock(fs);
+}
+
+static const char *op_names[FS_OP_COUNT] = {
+    "create", "write", "read", "copy", "remove", "pread", "pwrite"
+};
+
+/* Escreve as estatísticas como um objeto JSON. Tempos em nanossegundos;
+   os histogramas listam só os buckets não vazios. */
+int fs_stats_json(FileSystem *fs, FILE *out) {
+    FsStats stats;
+    CacheStats cache;
+    size_t capacity;
+    if (!out || fs_stats(fs, &stats) != 0 || fs_cache_stats(fs, &cache, &capacity) != 0) {
+        return -1;
+    }
+    
+    fprintf(out, "{\n  \"space\": {\n");
+    fprintf(out, "    \"free_blocks\": %lu,\n", stats.space.free_blocks);
+    fprintf(out, "    \"free_extents\": %lu,\n", stats.space.free_extents);
+    fprintf(out, "    \"largest_free\": %lu,\n", stats.space.largest_free);
+    fprintf(out, "    \"fragmentation\": %.6f,\n", stats.space.fragmentation);
+    fprintf(out, "    \"extent_histogram\": [");
+    const char *sep = "";
+    for (int i = 0; i < STATS_EXTENT_BUCKETS; i++) {
+        if (stats.extent_histogram[i] == 0) continue;
+        fprintf(out, "%s{\"min_blocks\": %llu, \"count\": %lu}",
+                sep, 1ULL << i, stats.extent_histogram[i]);
+        sep = ", ";
+    }
+    fprintf(out, "]\n  },\n");
+    
+    fprintf(out, "  \"cache\": {\"capacity\": %zu, \"hits\": %lu, \"misses\": %lu, "
+            "\"writebacks\": %lu, \"evictions\": %lu},\n",
+            capacity, cache.hits, cache.misses, cache.writebacks, cache.evictions);
+    
+    fprintf(out, "  \"operations\": {\n");
+    for (int op = 0; op < FS_OP_COUNT; op++) {
+        const OpStats *s = &stats.ops[op];
+        fprintf(out, "    \"%s\": {\"count\": %lu, \"errors\": %lu, \"total_ns\": %lu, "
+                "\"mean_ns\": %lu, \"max_ns\": %lu, \"lookup_ns\": %lu, \"alloc_ns\": %lu, "
+                "\"io_ns\": %lu, \"alloc_scans\": %lu, \"alloc_scan_nodes\": %lu, \"latency_us\": [",
+                op_names[op], s->count, s->errors, s->total_ns,
+                s->count > 0 ? s->total_ns / s->count : 0, s->max_ns,
+                s->timing.lookup_ns, s->timing.alloc_ns, s->timing.io_ns,
+                s->timing.alloc_scans, s->timing.alloc_scan_nodes);
+        sep = "";
+        for (int i = 0; i < STATS_LATENCY_BUCKETS; i++) {
+            if (s->latency[i] == 0) continue;
+            if (i == STATS_LATENCY_BUCKETS - 1) {
+                fprintf(out, "%s{\"below\": null, \"count\": %lu}", sep, s->latency[i]);
+            } else {
+                fprintf(out, "%s{\"below\": %llu, \"count\": %lu}", sep, 1ULL << i, s->latency[i]);
             }
-            
-            return (e->permission & required) == required;
+            sep = ", ";
         }
+        fprintf(out, "]}%s\n", op < FS_OP_COUNT - 1 ? "," : "");
     }
-    
-    return -1;
+    fprintf(out, "  }\n}\n");
+    return 0;
 }
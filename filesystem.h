@@ -4,25 +4,76 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <time.h>
+#include <pthread.h>
+#include "extent_tree.h"
+#include "block_cache.h"
 
 /* ============================================
    CONFIGURAÇÕES GLOBAIS DO SISTEMA DE ARQUIVOS
    ============================================ */
 
-#define BLOCK_SIZE 512              // Tamanho de cada bloco em bytes
-#define TOTAL_BLOCKS 65536          // Total de blocos no disco (32MB)
-#define MAX_FILES 2048              // Máximo de arquivos simultaneamente
+/* Geometria padrão (fs_format); fs_format_geometry escolhe outra e a
+   montagem lê a do superbloco */
+#define FS_DEFAULT_BLOCK_SIZE 512       // Tamanho de cada bloco em bytes
+#define FS_DEFAULT_TOTAL_BLOCKS 65536   // Total de blocos no disco (32MB)
+#define FS_DEFAULT_MAX_FILES 2048       // Máximo de arquivos simultaneamente
+
+/* Limites da geometria */
+#define FS_MIN_BLOCK_SIZE 512
+#define FS_MAX_BLOCK_SIZE 65536         // Bytes do último bloco cabem em tail_bytes
+#define FS_MAX_TOTAL_BLOCKS 0xFFFFFFFFULL // Números de bloco de 32 bits (superbloco, mapas)
+#define FS_MIN_FILES 16
+#define FS_MAX_FILES (1u << 20)
+#define FS_MIN_DATA_BLOCKS 16           // Área de dados mínima
+
 #define METADATA_SIZE 32            // Tamanho dos metadados de cada arquivo
 #define MAX_FILENAME_LENGTH 8       // Tamanho máximo do nome do arquivo
 #define SUPERBLOCK_BLOCKS 1         // Blocos para o superbloco
-#define BITMAP_BLOCKS 16            // Blocos para o bitmap (65536 bits = 8192 bytes)
-#define ROOT_DIR_BLOCKS 128         // Blocos para o diretório raiz (2048 * 32 bytes)
+#define CACHE_BYTES_DEFAULT (512 * 1024) // Capacidade padrão do cache de blocos
+#define CACHE_MIN_BLOCKS_DEFAULT 64 // Mínimo do cache padrão com blocos grandes
+#define JOURNAL_BYTES (128 * 1024)  // Tamanho do journal de metadados (fim do disco)
+#define JOURNAL_MIN_BLOCKS 16       // Mínimo de blocos do journal com blocos grandes
+#define JOURNAL_GROUP_OPS 32        // Operações agrupadas em cada commit do journal
 
-/* Início de cada seção no disco */
-#define SUPERBLOCK_START 0
-#define BITMAP_START (SUPERBLOCK_START + SUPERBLOCK_BLOCKS)
-#define ROOT_DIR_START (BITMAP_START + BITMAP_BLOCKS)
-#define DATA_START (ROOT_DIR_START + ROOT_DIR_BLOCKS)
+/* Versões do formato em disco (superbloco.version) */
+#define FS_VERSION_LEGACY 0         // Tamanho só em blocos
+#define FS_VERSION_EXACT_SIZE 1     // Bytes usados no último bloco nos metadados
+#define FS_VERSION_JOURNAL 2        // Journal de metadados no fim do disco
+#define FS_VERSION_REFLINK 3        // Tabela de extensões compartilhadas (cópias reflink)
+#define FS_VERSION_COMPRESSION 4    // Bit de compressão no tipo do arquivo
+#define FS_VERSION_EXTENTS 5        // Arquivos em várias extensões (mapa de extensões)
+#define FS_VERSION_GEOMETRY 6       // Geometria lida do superbloco (bloco, tamanho, arquivos)
+#define FS_VERSION_SHARED_EXTENTS 7 // Extensões compartilhadas também em arquivos em várias
+#define FS_VERSION_CURRENT FS_VERSION_SHARED_EXTENTS
+
+/* Geometria escolhida na formatação */
+typedef struct {
+    uint32_t block_size;        // Potência de 2 entre FS_MIN_BLOCK_SIZE e FS_MAX_BLOCK_SIZE
+    uint64_t total_blocks;      // Blocos da imagem, metadados incluídos
+    uint32_t max_files;         // Entradas do diretório raiz
+} FsGeometry;
+
+/* Seções do disco, em blocos: superbloco, bitmap, diretório raiz, área
+   de dados e, nos últimos blocos da área de dados, a tabela de extensões
+   compartilhadas e o journal. Derivadas da geometria na formatação e
+   lidas do superbloco na montagem. */
+typedef struct {
+    uint32_t block_size;
+    uint64_t total_blocks;
+    uint32_t max_files;
+    uint64_t bitmap_start;
+    uint64_t bitmap_blocks;         // total_blocks bits
+    uint64_t root_dir_start;
+    uint64_t root_dir_blocks;       // max_files entradas de METADATA_SIZE bytes
+    uint64_t data_start;
+    uint64_t share_table_start;
+    uint64_t share_table_blocks;    // max_files / 2 extensões compartilhadas
+    uint64_t journal_start;
+    uint64_t journal_blocks;
+    uint32_t share_entries;         // Posições da tabela de extensões compartilhadas
+    uint32_t name_index_size;       // Posições do índice de nomes (potência de 2, >= 2x max_files)
+    uint32_t extent_map_entries;    // Extensões em cada bloco de um mapa
+} FsLayout;
 
 /* ============================================
    TIPOS DE ARQUIVO
@@ -69,13 +120,20 @@ typedef struct {
     uint32_t data_start;        // Início da área de dados
     uint32_t max_files;         // Máximo de arquivos
     uint32_t current_files;     // Arquivos atuais
-    uint8_t reserved[472];      // Reservado para expansão futura
+    uint32_t version;           // Versão do formato (FS_VERSION_*)
+    uint32_t journal_start;     // Início do journal (0 = sem journal)
+    uint32_t journal_blocks;    // Tamanho do journal
+    uint64_t journal_sequence;  // Sequência da primeira transação válida
+    uint32_t share_table_start; // Início da tabela de extensões compartilhadas
+    uint32_t share_table_blocks; // Tamanho da tabela (0 = sem cópias reflink)
+    uint8_t reserved[444];      // Reservado para expansão futura
 } __attribute__((packed)) Superblock;
 
 /* Metadados do arquivo - 32 bytes */
 typedef struct {
     char name[8];               // Nome do arquivo (8 bytes)
-    uint8_t type[3];            // Tipo/extensão (3 bytes)
+    uint8_t type;               // Tipo/extensão (1 byte)
+    uint8_t tail_bytes[2];      // Bytes usados no último bloco, 0 = cheio (2 bytes)
     uint8_t size[6];            // Tamanho em blocos (6 bytes)
     uint8_t location[8];        // Bloco inicial (8 bytes)
     uint8_t owner[3];           // Dono do arquivo (3 bytes)
@@ -83,6 +141,16 @@ typedef struct {
     uint8_t last_modified;      // Última modificação (1 byte)
 } __attribute__((packed)) FileMetadata;
 
+#define META_TYPE_COMPRESSED 0x80   // Bit do campo type: conteúdo comprimido
+#define META_TYPE_EXTENTS 0x40      // Bit do campo type: location aponta para o mapa de extensões
+
+/* Extensão de um arquivo em várias extensões (memória) */
+typedef struct {
+    uint64_t start;             // Bloco inicial no disco
+    uint64_t count;             // Blocos
+    uint64_t logical;           // Primeiro bloco do arquivo guardado nela
+} FileExtent;
+
 /* Estrutura de arquivo em uso (memória) */
 typedef struct {
     char name[MAX_FILENAME_LENGTH + 1];
@@ -94,41 +162,376 @@ typedef struct {
     FilePermission permission;  // Permissões
     uint8_t last_modified;      // Status de modificação
     int is_used;                // Se está em uso
+    uint32_t shared;            // Extensões compartilhadas com outros arquivos (0 = nenhuma)
+    uint8_t compressed;         // Conteúdo gravado no formato comprimido
+    uint64_t map_block;         // Mapa de extensões (0 = extensão única em start_block)
+    uint32_t extent_count;      // Extensões em extents (só com map_block)
+    FileExtent *extents;        // Extensões na ordem do conteúdo (só com map_block)
 } FileEntry;
 
+/* Mapa de extensões de um arquivo que não coube numa extensão só: blocos
+   consecutivos a partir de location, cada um com o cabeçalho e até
+   layout.extent_map_entries pares (início, tamanho). O primeiro bloco
+   guarda as primeiras extensões e os seguintes, o restante da lista. Em
+   memória, start_block é o início da primeira extensão e size_blocks a
+   soma dos tamanhos (sem os blocos do mapa). */
+#define EXTENT_MAP_MAGIC 0x4D545845u // "EXTM"
+
+typedef struct {
+    uint32_t magic;             // EXTENT_MAP_MAGIC
+    uint32_t count;             // Extensões neste bloco
+    uint32_t total;             // Extensões do arquivo
+    uint32_t index;             // Posição deste bloco no mapa
+} __attribute__((packed)) ExtentMapHeader;
+
+typedef struct {
+    uint32_t start_block;       // Bloco inicial
+    uint32_t block_count;       // Tamanho em blocos
+} __attribute__((packed)) ExtentMapEntry;
+
+/* Extensão usada por mais de um arquivo (cópia reflink, deduplicação) -
+   16 bytes. Cada arquivo que a compartilha tem uma extensão com o mesmo
+   bloco inicial e o mesmo tamanho (um arquivo em várias pode compartilhar
+   só algumas); a primeira alteração de qualquer um deles o muda para
+   extensões próprias (copy-on-write). */
+typedef struct {
+    uint32_t start_block;       // Bloco inicial (0 = posição livre)
+    uint32_t block_count;       // Tamanho em blocos
+    uint32_t refs;              // Extensões de arquivos que apontam para ela (>= 2)
+    uint32_t reserved;
+} __attribute__((packed)) SharedExtent;
+
+/* Conteúdo de um arquivo comprimido: cabeçalho, tabela com o tamanho
+   gravado de cada quadro (uint32, frame_count posições) e os quadros em
+   sequência. Cada quadro guarda COMPRESS_FRAME_SIZE bytes descomprimidos
+   (o último, o resto); um quadro que não diminui fica sem compressão,
+   marcado com COMPRESS_FRAME_RAW. O tamanho do arquivo nos metadados é o
+   gravado. */
+#define COMPRESS_MAGIC 0x315A4C46u  // "FLZ1"
+#define COMPRESS_FRAME_SIZE 65536   // Bytes descomprimidos por quadro
+#define COMPRESS_FRAME_RAW 0x80000000u
+
+typedef struct {
+    uint32_t magic;             // COMPRESS_MAGIC
+    uint32_t frame_count;       // Quadros
+    uint64_t raw_size;          // Tamanho descomprimido
+} __attribute__((packed)) CompressedHeader;
+
+/* Posição do índice de nomes: chave de 64 bits (nome completado com zeros)
+   e entrada correspondente em file_table (-1 = posição vazia) */
+typedef struct {
+    uint64_t key;
+    int32_t entry;
+} NameSlot;
+
+/* Impressões digitais das extensões de um arquivo, na ordem do conteúdo
+   (0 = extensão sem conteúdo) */
+typedef struct {
+    uint64_t *prints;           // NULL = ainda não calculadas
+    uint32_t count;
+} DedupPrints;
+
+/* Posição do índice da deduplicação: impressão digital de uma extensão
+   (0 = posição vazia), arquivo e posição da extensão nele. Uma posição
+   vale enquanto a impressão guardada no arquivo for a mesma. */
+typedef struct {
+    uint64_t print;
+    int32_t entry;
+    uint32_t extent;
+} DedupSlot;
+
+/* Cabeçalho de uma transação do journal. Seguem-se length bytes de
+   registros (tipo de 1 byte + conteúdo) e preenchimento até o fim do
+   bloco; checksum é o CRC-32 do cabeçalho (com checksum zerado) e dos
+   registros. */
+#define JOURNAL_MAGIC 0x4C4E524Au   // "JRNL"
+
+typedef enum {
+    JREC_ENTRY = 1,             // Índice (4 bytes) + metadados pós-alteração (32 bytes)
+    JREC_ALLOC = 2,             // Bloco inicial (8 bytes) + quantidade (8 bytes)
+    JREC_FREE = 3,              // Bloco inicial (8 bytes) + quantidade (8 bytes)
+    JREC_SHARE = 4              // Posição (4 bytes) + SharedExtent pós-alteração (16 bytes)
+} JournalRecordType;
+
+typedef struct {
+    uint32_t magic;             // JOURNAL_MAGIC
+    uint32_t checksum;          // CRC-32 da transação
+    uint64_t sequence;          // Número de sequência
+    uint32_t length;            // Bytes de registros
+    uint32_t record_count;      // Quantidade de registros
+    uint32_t free_blocks;       // Contadores do superbloco após a transação
+    uint32_t current_files;
+} __attribute__((packed)) JournalHeader;
+
+/* Mensagens impressas pelas funções fs_* (fs_list, fs_info e
+   fs_disk_info imprimem sempre: é a função delas) */
+typedef enum {
+    FS_VERBOSITY_SILENT = 0,    // Nada
+    FS_VERBOSITY_ERRORS = 1,    // Só erros e avisos
+    FS_VERBOSITY_NORMAL = 2     // Também o andamento de cada operação (padrão)
+} FsVerbosity;
+
+/* Política de escolha de espaço livre */
+typedef enum {
+    ALLOC_FIRST_FIT = 0,        // Primeira extensão que comporta (padrão)
+    ALLOC_BEST_FIT = 1          // Menor extensão que comporta
+} AllocPolicy;
+
+/* Estado do espaço livre: fragmentation = 1 - maior extensão / livres
+   (0 = todo o espaço livre é contíguo) */
+typedef struct {
+    uint64_t free_blocks;       // Blocos livres
+    uint64_t free_extents;      // Extensões livres
+    uint64_t largest_free;      // Maior extensão livre
+    double fragmentation;       // Fração do espaço livre fora da maior extensão
+} FragmentationInfo;
+
+/* Limites de uma chamada de fs_defrag (0 = sem limite) */
+typedef struct {
+    double max_seconds;         // Tempo máximo
+    uint64_t max_bytes;         // Bytes copiados no máximo
+} DefragBudget;
+
+typedef struct {
+    FragmentationInfo before;   // Antes da chamada
+    FragmentationInfo after;    // Depois da chamada
+    uint64_t files_moved;       // Arquivos deslocados
+    uint64_t bytes_moved;       // Bytes copiados (inclui cópias intermediárias)
+    uint64_t files_skipped;     // Sem espaço para deslocar com segurança
+    int complete;               // 1 se percorreu todo o disco
+} DefragReport;
+
+/* Trecho de blocos liberado, à espera do commit para voltar ao índice */
+typedef struct {
+    uint64_t start;
+    uint64_t count;
+} FreeRange;
+
+/* Resultado de fs_dedup */
+typedef struct {
+    uint64_t files_scanned;     // Arquivos com conteúdo examinados
+    uint64_t files_merged;      // Arquivos que passaram a compartilhar extensões de outros
+    uint64_t blocks_reclaimed;  // Blocos devolvidos ao espaço livre
+} DedupReport;
+
+/* ============================================
+   ESTATÍSTICAS DE OPERAÇÃO
+   ============================================ */
+
+typedef enum {
+    FS_OP_CREATE = 0,
+    FS_OP_WRITE,
+    FS_OP_READ,
+    FS_OP_COPY,                 // fs_copy e fs_reflink
+    FS_OP_REMOVE,
+    FS_OP_PREAD,                // Acesso por handle (fs_append conta como pwrite)
+    FS_OP_PWRITE,
+    FS_OP_COUNT
+} FsOperation;
+
+#define STATS_LATENCY_BUCKETS 24    // Bucket i: latência < 2^i us (o último acumula o resto)
+#define STATS_EXTENT_BUCKETS 17     // Bucket i: extensões livres com 2^i a 2^(i+1)-1 blocos
+
+/* Tempo gasto em cada etapa da operação em andamento */
+typedef struct {
+    uint64_t lookup_ns;         // Busca do nome
+    uint64_t alloc_ns;          // Escolha, reserva e liberação de blocos
+    uint64_t io_ns;             // Transferência de dados e commits do journal
+    uint64_t alloc_scans;       // Consultas ao índice de extensões livres
+    uint64_t alloc_scan_nodes;  // Nós visitados nessas consultas
+} OpTiming;
+
+typedef struct {
+    uint64_t count;             // Chamadas
+    uint64_t errors;            // Chamadas que retornaram erro
+    uint64_t total_ns;          // Soma das latências
+    uint64_t max_ns;            // Maior latência
+    OpTiming timing;            // Soma por etapa
+    uint64_t latency[STATS_LATENCY_BUCKETS];
+} OpStats;
+
+/* Fotografia devolvida por fs_stats */
+typedef struct {
+    FragmentationInfo space;    // Espaço livre
+    uint64_t extent_histogram[STATS_EXTENT_BUCKETS];
+    OpStats ops[FS_OP_COUNT];   // Contadores por operação
+} FsStats;
+
 /* Estrutura do sistema de arquivos */
 typedef struct {
-    FILE *disk_file;            // Arquivo que representa o disco
+    int disk_fd;                // Descritor do arquivo que representa o disco
+    uint8_t *disk_map;          // Disco mapeado em memória (NULL no modo normal)
+    uint64_t disk_map_size;     // Tamanho do mapeamento
+    int no_kernel_copy;         // copy_file_range indisponível para a imagem
+    BlockCache *cache;          // Cache de blocos de dados (NULL se desligado)
     Superblock superblock;      // Superbloco
+    FsLayout layout;            // Geometria e seções, lidas do superbloco
     uint8_t *bitmap;            // Bitmap de blocos livres
+    uint8_t *bitmap_dirty;      // Blocos do bitmap alterados desde o último fs_sync
+    uint8_t *dir_dirty;         // Blocos do diretório raiz alterados
+    SharedExtent *share_table;  // Extensões compartilhadas (layout.share_entries)
+    uint8_t *share_dirty;       // Blocos da tabela alterados
+    uint32_t *share_order;      // Posições em uso da tabela, por bloco inicial
+    uint32_t share_count;       // Posições em uso
+    DedupPrints *fingerprints;  // Impressões por entrada; não nulo só com a
+                                // deduplicação ligada
+    DedupSlot *dedup_index;     // Impressão -> extensão (endereçamento aberto)
+    uint32_t dedup_index_size;  // Posições (potência de 2)
+    uint32_t dedup_index_used;  // Ocupadas, incluindo impressões que já mudaram
+    uint64_t entry_generation;  // Alterações de entradas (invalida visões dos handles)
+    int superblock_dirty;       // Superbloco alterado
+    uint8_t *journal_buf;       // Registros ainda não confirmados
+    uint64_t journal_len;       // Bytes em journal_buf
+    uint64_t journal_cap;       // Capacidade de journal_buf
+    uint64_t journal_head;      // Bytes já usados na região do journal
+    uint64_t journal_next_seq;  // Sequência da próxima transação
+    uint32_t journal_ops;       // Operações desde o último commit
+    int op_dirty;               // Operação em andamento com alterações não confirmadas
+    FreeRange *pending_free;    // Liberados desde o último commit (fora do índice)
+    uint32_t pending_count;
+    uint32_t pending_cap;
+    uint64_t reserved_blocks;   // Reservados por handles (fora de free_blocks, livres no disco)
+    struct FileHandle *handles; // Handles de escrita abertos (reservas a liberar na desmontagem)
+    uint64_t defrag_cursor;     // Onde a próxima chamada de fs_defrag continua
+    ExtentIndex *free_extents;  // Índice das extensões livres (espelha o bitmap)
+    AllocPolicy alloc_policy;   // Política de alocação
     FileEntry *file_table;      // Tabela de arquivos
+    NameSlot *name_index;       // Hash nome -> entrada (endereçamento aberto)
+    int32_t *free_slots;        // Pilha de entradas livres da tabela
+    uint32_t free_slot_count;   // Topo da pilha
     uint8_t current_user;       // Usuário atual
+    OpStats op_stats[FS_OP_COUNT]; // Estatísticas acumuladas desde a montagem
+    int concurrent;             // Modo concorrente: operações tomam os locks abaixo
+    pthread_rwlock_t lock;      // Leitores juntos, escritores sozinhos
+    pthread_mutex_t stats_lock; // Protege op_stats
 } FileSystem;
 
+/* Handle de arquivo aberto: guarda a entrada já resolvida em file_table,
+   evitando a busca pelo nome a cada operação */
+#define FS_OPEN_READ  0x1
+#define FS_OPEN_WRITE 0x2
+
+/* Quadros de um arquivo comprimido, como vistos pelo handle: a tabela de
+   quadros e o último quadro descomprimido ficam guardados, e leituras
+   seguidas dentro do mesmo quadro não o descomprimem de novo */
+typedef struct {
+    uint64_t generation;        // entry_generation do carregamento
+    uint64_t raw_size;          // Tamanho descomprimido
+    uint32_t frame_count;       // Quadros
+    uint32_t *frame_table;      // Tamanho gravado de cada quadro (NULL = não carregada)
+    uint64_t *frame_offsets;    // Onde cada quadro começa no arquivo gravado
+    int64_t frame;              // Quadro em frame_data (-1 = nenhum)
+    uint8_t *frame_data;        // Quadro descomprimido + área de leitura
+} CompressedView;
+
+typedef struct FileHandle {
+    FileSystem *fs;             // Sistema de arquivos de origem (NULL após fs_unmount)
+    int entry_index;            // Entrada em file_table
+    uint64_t name_key;          // Nome (64 bits) para detectar remoção
+    int mode;                   // FS_OPEN_READ | FS_OPEN_WRITE
+    uint64_t reserved_start;    // Blocos reservados por fs_reserve
+    uint64_t reserved_blocks;   // (0 = sem reserva)
+    int modified;               // Escreveu pelo handle (deduplicação no fs_close)
+    int recompress;             // Descomprimiu o arquivo para escrever (comprime no fs_close)
+    CompressedView view;        // Leitura de arquivo comprimido
+    struct FileHandle *prev;    // Lista de handles de escrita em fs->handles
+    struct FileHandle *next;
+} FileHandle;
+
 /* ============================================
    FUNÇÕES PRINCIPAIS DO SISTEMA DE ARQUIVOS
    ============================================ */
 
-/* Inicialização e formatação */
+/* Inicialização e formatação. fs_format cria a imagem esparsa (a área de
+   dados só ocupa espaço no hospedeiro depois de escrita) com a geometria
+   padrão; fs_format_quick mantém a imagem existente, com a geometria
+   dela, e zera só as regiões de metadados. fs_format_geometry escolhe a
+   geometria (NULL = padrão, ou a da imagem na formatação rápida). */
 int fs_format(const char *disk_path);
+int fs_format_quick(const char *disk_path);
+int fs_format_geometry(const char *disk_path, const FsGeometry *geometry, int quick);
+int fs_layout_compute(const FsGeometry *geometry, FsLayout *layout); // -1 se inválida
 FileSystem* fs_mount(const char *disk_path);
+FileSystem* fs_mount_mmap(const char *disk_path);
 int fs_unmount(FileSystem *fs);
+int fs_sync(FileSystem *fs);
 
 /* Operações com arquivos */
 int fs_create(FileSystem *fs, const char *name, FileType type, FilePermission perm);
 int fs_write(FileSystem *fs, const char *name, const void *data, uint64_t size);
 int fs_read(FileSystem *fs, const char *name, void *buffer, uint64_t *size);
+const void* fs_read_view(FileSystem *fs, const char *name, uint64_t *size);
 int fs_copy(FileSystem *fs, const char *src_name, const char *dest_name);
+int fs_reflink(FileSystem *fs, const char *src_name, const char *dest_name);
 int fs_remove(FileSystem *fs, const char *name);
 
+/* Acesso por handle, com deslocamento (memória limitada para arquivos
+   grandes). fs_unmount libera as reservas dos handles de escrita ainda
+   abertos; depois dela esses handles só aceitam fs_close. */
+FileHandle* fs_open(FileSystem *fs, const char *name, int mode);
+int64_t fs_pread(FileHandle *handle, void *buffer, uint64_t count, uint64_t offset);
+int64_t fs_pwrite(FileHandle *handle, const void *data, uint64_t count, uint64_t offset);
+int64_t fs_append(FileHandle *handle, const void *data, uint64_t count);
+int fs_truncate(FileHandle *handle, uint64_t size);
+int fs_reserve(FileHandle *handle, uint64_t size);
+uint64_t fs_handle_size(FileHandle *handle);
+int fs_close(FileHandle *handle);
+
 /* Listagem e informações */
 int fs_list(FileSystem *fs);
 int fs_info(FileSystem *fs, const char *name);
 int fs_disk_info(FileSystem *fs);
+int fs_fragmentation(FileSystem *fs, FragmentationInfo *info);
+
+/* Desfragmentação: desloca os arquivos para o início da área de dados. Com
+   budget, para ao atingir o limite e continua na próxima chamada. */
+int fs_defrag(FileSystem *fs, const DefragBudget *budget, DefragReport *report);
+
+/* Deduplicação por extensão: com o modo ligado, fs_write de um conteúdo
+   igual a uma extensão de outro arquivo só passa a compartilhá-la, e as
+   extensões de um arquivo em várias iguais às de outros são trocadas por
+   elas; fs_dedup faz o mesmo com os arquivos já gravados */
+int fs_set_dedup(FileSystem *fs, int enabled);
+int fs_dedup(FileSystem *fs, DedupReport *report);
+
+/* Compressão por arquivo (texto e binário): com ela ligada, o conteúdo é
+   gravado comprimido e descomprimido na leitura; o conteúdo atual é
+   convertido na hora */
+int fs_set_compression(FileSystem *fs, const char *name, int enabled);
+int fs_get_compression(FileSystem *fs, const char *name);
+
+/* Extensões ocupadas pelo arquivo (0 se vazio), ou -1 se não existe. Sem
+   espaço contíguo, uma escrita distribui o conteúdo por várias; fs_defrag
+   as junta de novo quando houver espaço. */
+int fs_get_extents(FileSystem *fs, const char *name);
+
+/* Entrada do arquivo em file_table pelo índice de nomes, ou -1 se não
+   existe */
+int fs_lookup(FileSystem *fs, const char *name);
 
 /* Funções auxiliares */
 int fs_set_user(FileSystem *fs, uint8_t user_id);
 int fs_check_permission(FileSystem *fs, const char *name, FilePermission required);
+int fs_set_alloc_policy(FileSystem *fs, AllocPolicy policy);
+void fs_set_verbosity(FsVerbosity level);
+
+/* Cache de blocos: capacidade 0 desliga; sem efeito no modo mapeado */
+int fs_set_cache_size(FileSystem *fs, size_t capacity_blocks);
+int fs_cache_stats(FileSystem *fs, CacheStats *stats, size_t *capacity_blocks);
+
+/* Modo concorrente: o mesmo FileSystem pode ser usado por várias threads.
+   Leituras (fs_read, fs_pread, listagens, estatísticas) rodam em paralelo;
+   operações que alteram o disco rodam uma de cada vez. Cada handle deve
+   ser usado por uma thread de cada vez, e a visão de fs_read_view só vale
+   enquanto nenhuma outra thread escrever. Ligar e desligar sem operações
+   em andamento; fs_unmount também. */
+int fs_set_concurrent(FileSystem *fs, int enabled);
+
+/* Estatísticas: espaço livre e contadores por operação desde a montagem
+   (ou o último fs_stats_reset); fs_stats_json escreve o mesmo em JSON */
+int fs_stats(FileSystem *fs, FsStats *stats);
+void fs_stats_reset(FileSystem *fs);
+int fs_stats_json(FileSystem *fs, FILE *out);
 
 /* ============================================
    FUNÇÕES INTERNAS (BITMAP E BLOCOS)
@@ -138,15 +541,29 @@ int fs_check_permission(FileSystem *fs, const char *name, FilePermission require
 int bitmap_get_bit(uint8_t *bitmap, uint64_t bit_index);
 void bitmap_set_bit(uint8_t *bitmap, uint64_t bit_index);
 void bitmap_clear_bit(uint8_t *bitmap, uint64_t bit_index);
+void bitmap_set_range(uint8_t *bitmap, uint64_t start, uint64_t count);
+void bitmap_clear_range(uint8_t *bitmap, uint64_t start, uint64_t count);
 int64_t bitmap_find_contiguous(uint8_t *bitmap, uint64_t total_bits, uint64_t num_blocks);
+int64_t bitmap_find_contiguous_from(const uint8_t *bitmap, uint64_t total_bits,
+                                    uint64_t num_blocks, uint64_t first_bit);
+int64_t bitmap_find_contiguous_bitwise(uint8_t *bitmap, uint64_t total_bits, uint64_t num_blocks);
+uint64_t bitmap_count_free(const uint8_t *bitmap, uint64_t total_bits, uint64_t first_bit);
+
+/* Alocação de blocos (mantém bitmap, índice de extensões e superbloco
+   sincronizados; são os únicos pontos que alteram o bitmap montado) */
+int64_t fs_find_free(FileSystem *fs, uint64_t num_blocks);
+int fs_alloc_range(FileSystem *fs, uint64_t start, uint64_t num_blocks);
+int fs_release_range(FileSystem *fs, uint64_t start, uint64_t num_blocks); // -1 se já livres
 
 /* Operações de bloco */
-int block_read(FILE *disk, uint64_t block_num, void *buffer);
-int block_write(FILE *disk, uint64_t block_num, const void *buffer);
+int block_read(FILE *disk, uint32_t block_size, uint64_t block_num, void *buffer);
+int block_write(FILE *disk, uint32_t block_size, uint64_t block_num, const void *buffer);
+int block_read_range(int fd, uint32_t block_size, uint64_t start_block, void *buffer, uint64_t size);
+int block_write_range(int fd, uint32_t block_size, uint64_t start_block, const void *data, uint64_t size);
 
 /* Conversão de metadados */
-void metadata_to_entry(const FileMetadata *meta, FileEntry *entry);
-void entry_to_metadata(const FileEntry *entry, FileMetadata *meta);
+void metadata_to_entry(const FileMetadata *meta, FileEntry *entry, uint32_t block_size);
+void entry_to_metadata(const FileEntry *entry, FileMetadata *meta, uint32_t block_size);
 
 /* Utilitários */
 uint64_t bytes_to_array(const uint8_t *array, int size);
@@ -0,0 +1,293 @@
+#define _GNU_SOURCE
+
+#include "fs_client.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define FSC_READ_CHUNK (256 * 1024)
+
+/* ============================================
+   FUNÇÕES AUXILIARES
+   ============================================ */
+
+static int buffer_reserve(uint8_t **buffer, size_t *capacity, size_t need) {
+    if (need <= *capacity) return 0;
+    size_t grown = *capacity ? *capacity : FSC_READ_CHUNK;
+    while (grown < need) {
+        grown *= 2;
+    }
+    uint8_t *resized = realloc(*buffer, grown);
+    if (!resized) return -1;
+    *buffer = resized;
+    *capacity = grown;
+    return 0;
+}
+
+/* Lê do socket o que houver (bloqueando ou não); 0 se o daemon fechou */
+static ssize_t receive_some(FsClient *client, size_t need, int flags) {
+    if (client->in_pos > 0) {
+        // Descarta as respostas já entregues
+        memmove(client->in, client->in + client->in_pos, client->in_len - client->in_pos);
+        client->in_len -= client->in_pos;
+        client->in_pos = 0;
+    }
+    if (need < FSC_READ_CHUNK) need = FSC_READ_CHUNK;
+    if (buffer_reserve(&client->in, &client->in_cap, client->in_len + need) != 0) {
+        return -1;
+    }
+    ssize_t n;
+    do {
+        n = recv(client->fd, client->in + client->in_len, client->in_cap - client->in_len, flags);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) {
+        client->in_len += (size_t)n;
+    }
+    return n;
+}
+
+/* ============================================
+   CONEXÃO
+   ============================================ */
+
+FsClient* fsc_connect(const char *socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (!socket_path || strlen(socket_path) >= sizeof(addr.sun_path)) {
+        return NULL;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    FsClient *client = calloc(1, sizeof(FsClient));
+    if (!client) return NULL;
+    client->next_tag = 1;
+    client->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (client->fd < 0 || connect(client->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        if (client->fd >= 0) close(client->fd);
+        free(client);
+        return NULL;
+    }
+    return client;
+}
+
+void fsc_disconnect(FsClient *client) {
+    if (!client) return;
+    close(client->fd);
+    free(client->out);
+    free(client->in);
+    free(client);
+}
+
+/* ============================================
+   PEDIDOS EM SEQUÊNCIA
+   ============================================ */
+
+uint32_t fsc_send(FsClient *client, FspOperation op, const char *name, const char *name2,
+                  uint32_t arg32, uint64_t arg, const void *data, uint32_t length) {
+    size_t name_len = name ? strlen(name) : 0;
+    size_t name2_len = name2 ? strlen(name2) : 0;
+    if (!client || name_len > FSP_MAX_NAME || name2_len > FSP_MAX_NAME || length > FSP_MAX_PAYLOAD) {
+        return 0;
+    }
+
+    size_t total = sizeof(FspRequest) + name_len + name2_len + length;
+    if (buffer_reserve(&client->out, &client->out_cap, client->out_len + total) != 0) {
+        return 0;
+    }
+    FspRequest req = { length, client->next_tag, (uint8_t)op, (uint8_t)name_len,
+                       (uint8_t)name2_len, 0, arg32, arg };
+    uint8_t *ptr = client->out + client->out_len;
+    memcpy(ptr, &req, sizeof(req));
+    ptr += sizeof(req);
+    memcpy(ptr, name, name_len);
+    ptr += name_len;
+    memcpy(ptr, name2, name2_len);
+    ptr += name2_len;
+    if (length > 0) {
+        memcpy(ptr, data, length);
+    }
+    client->out_len += total;
+    client->pending++;
+
+    if (client->out_len >= FSC_FLUSH_THRESHOLD && fsc_flush(client) != 0) {
+        return 0;
+    }
+    uint32_t tag = client->next_tag++;
+    if (client->next_tag == 0) client->next_tag = 1;
+    return tag;
+}
+
+/* Envia os pedidos acumulados. Enquanto o socket não aceita mais dados,
+   as respostas que chegam são guardadas: o daemon para de atender quem
+   não lê as respostas, e os dois ficariam esperando um pelo outro. */
+int fsc_flush(FsClient *client) {
+    size_t sent = 0;
+    while (sent < client->out_len) {
+        ssize_t n = send(client->fd, client->out + sent, client->out_len - sent,
+                         MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) {
+            sent += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+
+        struct pollfd pfd = { client->fd, POLLIN | POLLOUT, 0 };
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) return -1;
+        if (pfd.revents & POLLIN) {
+            if (receive_some(client, 0, MSG_DONTWAIT) == 0) return -1;
+        } else if (pfd.revents & (POLLERR | POLLHUP)) {
+            return -1;
+        }
+    }
+    client->out_len = 0;
+    return 0;
+}
+
+int fsc_receive(FsClient *client, FsClientReply *reply) {
+    if (client->pending == 0) return -1;
+    if (client->out_len > 0 && fsc_flush(client) != 0) return -1;
+
+    for (;;) {
+        size_t available = client->in_len - client->in_pos;
+        if (available >= sizeof(FspReply)) {
+            FspReply header;
+            memcpy(&header, client->in + client->in_pos, sizeof(header));
+            size_t total = sizeof(header) + header.length;
+            if (available >= total) {
+                reply->tag = header.tag;
+                reply->status = header.status;
+                reply->value = header.value;
+                reply->length = header.length;
+                reply->data = client->in + client->in_pos + sizeof(header);
+                client->in_pos += total;
+                client->pending--;
+                return 0;
+            }
+            if (receive_some(client, total - available, 0) <= 0) return -1;
+        } else if (receive_some(client, 0, 0) <= 0) {
+            return -1;
+        }
+    }
+}
+
+/* ============================================
+   OPERAÇÕES SÍNCRONAS
+   ============================================ */
+
+/* Manda um pedido e espera a resposta dele */
+static int call(FsClient *client, FsClientReply *reply, FspOperation op, const char *name,
+                const char *name2, uint32_t arg32, uint64_t arg, const void *data, uint32_t length) {
+    if (!client || fsc_send(client, op, name, name2, arg32, arg, data, length) == 0 ||
+        fsc_receive(client, reply) != 0) {
+        return -1;
+    }
+    return reply->status;
+}
+
+int fsc_ping(FsClient *client) {
+    FsClientReply reply;
+    return call(client, &reply, FSP_OP_PING, NULL, NULL, 0, 0, NULL, 0);
+}
+
+int fsc_create(FsClient *client, const char *name, uint8_t type, uint8_t perm) {
+    FsClientReply reply;
+    return call(client, &reply, FSP_OP_CREATE, name, NULL, (uint32_t)type | (uint32_t)perm << 8, 0, NULL, 0);
+}
+
+int fsc_write(FsClient *client, const char *name, const void *data, uint64_t size) {
+    FsClientReply reply;
+    if (size > FSP_MAX_PAYLOAD) return -1;
+    return call(client, &reply, FSP_OP_WRITE, name, NULL, 0, 0, data, (uint32_t)size);
+}
+
+/* Conteúdo inteiro; falha se não couber em capacity bytes */
+int64_t fsc_read(FsClient *client, const char *name, void *buffer, uint64_t capacity) {
+    FsClientReply reply;
+    if (call(client, &reply, FSP_OP_READ, name, NULL, 0, 0, NULL, 0) != 0 || reply.length > capacity) {
+        return -1;
+    }
+    memcpy(buffer, reply.data, reply.length);
+    return reply.length;
+}
+
+int64_t fsc_pread(FsClient *client, const char *name, void *buffer, uint64_t count, uint64_t offset) {
+    FsClientReply reply;
+    if (count > FSP_MAX_PAYLOAD ||
+        call(client, &reply, FSP_OP_PREAD, name, NULL, (uint32_t)count, offset, NULL, 0) != 0) {
+        return -1;
+    }
+    memcpy(buffer, reply.data, reply.length);
+    return reply.length;
+}
+
+int64_t fsc_pwrite(FsClient *client, const char *name, const void *data, uint64_t count, uint64_t offset) {
+    FsClientReply reply;
+    if (count > FSP_MAX_PAYLOAD ||
+        call(client, &reply, FSP_OP_PWRITE, name, NULL, 0, offset, data, (uint32_t)count) != 0) {
+        return -1;
+    }
+    return (int64_t)reply.value;
+}
+
+int fsc_truncate(FsClient *client, const char *name, uint64_t size) {
+    FsClientReply reply;
+    return call(client, &reply, FSP_OP_TRUNCATE, name, NULL, 0, size, NULL, 0);
+}
+
+int fsc_remove(FsClient *client, const char *name) {
+    FsClientReply reply;
+    return call(client, &reply, FSP_OP_REMOVE, name, NULL, 0, 0, NULL, 0);
+}
+
+int fsc_copy(FsClient *client, const char *src_name, const char *dest_name) {
+    FsClientReply reply;
+    return call(client, &reply, FSP_OP_COPY, src_name, dest_name, 0, 0, NULL, 0);
+}
+
+int fsc_reflink(FsClient *client, const char *src_name, const char *dest_name) {
+    FsClientReply reply;
+    return call(client, &reply, FSP_OP_REFLINK, src_name, dest_name, 0, 0, NULL, 0);
+}
+
+int fsc_stat(FsClient *client, const char *name, FspStat *stat) {
+    FsClientReply reply;
+    if (call(client, &reply, FSP_OP_STAT, name, NULL, 0, 0, NULL, 0) != 0 ||
+        reply.length != sizeof(FspStat)) {
+        return -1;
+    }
+    memcpy(stat, reply.data, sizeof(FspStat));
+    return 0;
+}
+
+int fsc_list(FsClient *client, FspStat **entries) {
+    FsClientReply reply;
+    if (call(client, &reply, FSP_OP_LIST, NULL, NULL, 0, 0, NULL, 0) != 0) {
+        return -1;
+    }
+    int count = (int)(reply.length / sizeof(FspStat));
+    *entries = malloc(count > 0 ? reply.length : 1);
+    if (!*entries) return -1;
+    memcpy(*entries, reply.data, reply.length);
+    return count;
+}
+
+int fsc_sync(FsClient *client) {
+    FsClientReply reply;
+    return call(client, &reply, FSP_OP_SYNC, NULL, NULL, 0, 0, NULL, 0);
+}
+
+int fsc_set_user(FsClient *client, uint8_t user_id) {
+    FsClientReply reply;
+    return call(client, &reply, FSP_OP_SET_USER, NULL, NULL, user_id, 0, NULL, 0);
+}
+
+int fsc_shutdown(FsClient *client) {
+    FsClientReply reply;
+    return call(client, &reply, FSP_OP_SHUTDOWN, NULL, NULL, 0, 0, NULL, 0);
+}
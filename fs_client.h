@@ -0,0 +1,64 @@
+#ifndef FS_CLIENT_H
+#define FS_CLIENT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "fs_protocol.h"
+
+/* ============================================
+   CLIENTE DO DAEMON
+   ============================================ */
+
+/* Biblioteca fina sobre o protocolo de fs_protocol.h. Os pedidos de
+   fsc_send se acumulam num buffer e saem juntos em fsc_flush (ou quando
+   o buffer enche); as respostas chegam na mesma ordem por fsc_receive.
+   As funções síncronas (fsc_create, fsc_read...) mandam um pedido e
+   esperam a resposta, e só devem ser usadas sem pedidos pendentes. */
+
+#define FSC_FLUSH_THRESHOLD (64 * 1024)     // Pedidos acumulados que forçam o envio
+
+typedef struct {
+    int fd;                     // Socket conectado ao daemon
+    uint32_t next_tag;          // Tag do próximo pedido
+    uint32_t pending;           // Pedidos enviados ou acumulados sem resposta
+    uint8_t *out;               // Pedidos ainda não enviados
+    size_t out_len, out_cap;
+    uint8_t *in;                // Respostas recebidas: [in_pos, in_len) ainda não lidas
+    size_t in_len, in_pos, in_cap;
+} FsClient;
+
+typedef struct {
+    uint32_t tag;
+    int32_t status;             // 0 ou -1
+    uint64_t value;             // Bytes transferidos, tamanho...
+    uint32_t length;            // Bytes em data
+    const uint8_t *data;        // Válido até a próxima chamada com o mesmo cliente
+} FsClientReply;
+
+FsClient* fsc_connect(const char *socket_path);
+void fsc_disconnect(FsClient *client);
+
+/* Pedidos em sequência: fsc_send retorna o tag (0 em erro) */
+uint32_t fsc_send(FsClient *client, FspOperation op, const char *name, const char *name2,
+                  uint32_t arg32, uint64_t arg, const void *data, uint32_t length);
+int fsc_flush(FsClient *client);
+int fsc_receive(FsClient *client, FsClientReply *reply);
+
+/* Operações síncronas (retornam -1 em erro) */
+int fsc_ping(FsClient *client);
+int fsc_create(FsClient *client, const char *name, uint8_t type, uint8_t perm); // FSP_TYPE_*, FSP_PERM_*
+int fsc_write(FsClient *client, const char *name, const void *data, uint64_t size);
+int64_t fsc_read(FsClient *client, const char *name, void *buffer, uint64_t capacity);
+int64_t fsc_pread(FsClient *client, const char *name, void *buffer, uint64_t count, uint64_t offset);
+int64_t fsc_pwrite(FsClient *client, const char *name, const void *data, uint64_t count, uint64_t offset);
+int fsc_truncate(FsClient *client, const char *name, uint64_t size);
+int fsc_remove(FsClient *client, const char *name);
+int fsc_copy(FsClient *client, const char *src_name, const char *dest_name);
+int fsc_reflink(FsClient *client, const char *src_name, const char *dest_name);
+int fsc_stat(FsClient *client, const char *name, FspStat *stat);
+int fsc_list(FsClient *client, FspStat **entries); // Quantidade; *entries é liberado com free
+int fsc_sync(FsClient *client);
+int fsc_set_user(FsClient *client, uint8_t user_id);
+int fsc_shutdown(FsClient *client);
+
+#endif // FS_CLIENT_H
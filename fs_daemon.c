@@ -0,0 +1,521 @@
+#define _GNU_SOURCE
+
+#include "fs_daemon.h"
+#include "fs_protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define DAEMON_MAX_EVENTS 64
+#define DAEMON_READ_CHUNK (256 * 1024)          // Leitura mínima do socket
+#define DAEMON_OUT_HIGH (8 * 1024 * 1024)       // Respostas pendentes que param a conexão
+#define DAEMON_IDLE_SYNC_MS 1000                // Ociosidade antes do checkpoint
+
+/* Conexão de um cliente: pedidos recebidos e ainda não atendidos em in,
+   respostas ainda não enviadas em out[out_sent, out_len) */
+typedef struct Connection {
+    int fd;
+    uint8_t user;               // Usuário da conexão (FSP_OP_SET_USER)
+    uint32_t events;            // Eventos pedidos ao epoll
+    uint8_t *in;
+    size_t in_len, in_cap;
+    uint8_t *out;
+    size_t out_len, out_sent, out_cap;
+    struct Connection *prev, *next;
+} Connection;
+
+typedef struct {
+    FileSystem *fs;
+    int epoll_fd;
+    int listen_fd;
+    int signal_fd;
+    int running;
+    int dirty;                  // Alterações desde o último fs_sync
+    uint8_t current_user;       // Usuário ativo no FileSystem
+    Connection *connections;
+} Daemon;
+
+/* ============================================
+   BUFFERS
+   ============================================ */
+
+/* Garante capacidade para need bytes (cresce dobrando) */
+static int buffer_reserve(uint8_t **buffer, size_t *capacity, size_t need) {
+    if (need <= *capacity) return 0;
+    size_t grown = *capacity ? *capacity : DAEMON_READ_CHUNK;
+    while (grown < need) {
+        grown *= 2;
+    }
+    uint8_t *resized = realloc(*buffer, grown);
+    if (!resized) return -1;
+    *buffer = resized;
+    *capacity = grown;
+    return 0;
+}
+
+/* Espaço para uma resposta com até length bytes de dados; os dados vão
+   no ponteiro devolvido e reply_commit fecha a resposta */
+static uint8_t* reply_reserve(Connection *conn, size_t length) {
+    if (buffer_reserve(&conn->out, &conn->out_cap, conn->out_len + sizeof(FspReply) + length) != 0) {
+        return NULL;
+    }
+    return conn->out + conn->out_len + sizeof(FspReply);
+}
+
+static void reply_commit(Connection *conn, uint32_t tag, int32_t status, uint64_t value, uint32_t length) {
+    FspReply reply = { length, tag, status, 0, value };
+    memcpy(conn->out + conn->out_len, &reply, sizeof(reply));
+    conn->out_len += sizeof(reply) + length;
+}
+
+/* Resposta sem dados; sem memória para ela, a conexão é encerrada */
+static int reply_status(Connection *conn, uint32_t tag, int status, uint64_t value) {
+    if (!reply_reserve(conn, 0)) return -1;
+    reply_commit(conn, tag, status == 0 ? 0 : -1, value, 0);
+    return 0;
+}
+
+/* ============================================
+   EXECUÇÃO DOS PEDIDOS
+   ============================================ */
+
+static void fill_stat(FileSystem *fs, const FileEntry *entry, FspStat *stat) {
+    memset(stat, 0, sizeof(FspStat));
+    snprintf(stat->name, sizeof(stat->name), "%s", entry->name);
+    stat->size_bytes = entry->size_bytes;
+    stat->size_blocks = entry->size_blocks;
+    stat->extents = (uint32_t)fs_get_extents(fs, entry->name);
+    stat->type = (uint8_t)entry->type;
+    stat->permission = (uint8_t)entry->permission;
+    stat->owner = entry->owner;
+    stat->compressed = entry->compressed;
+}
+
+/* Leitura de count bytes a partir de offset direto no buffer de saída
+   (count = UINT64_MAX lê até o fim) */
+static int execute_read(Daemon *daemon, Connection *conn, uint32_t tag, const char *name,
+                        uint64_t offset, uint64_t count) {
+    FileHandle *handle = fs_open(daemon->fs, name, FS_OPEN_READ);
+    if (!handle) {
+        return reply_status(conn, tag, -1, 0);
+    }
+    uint64_t size = fs_handle_size(handle);
+    uint64_t available = offset < size ? size - offset : 0;
+    if (count > available) count = available;
+    if (count > FSP_MAX_PAYLOAD) {
+        fs_close(handle);
+        return reply_status(conn, tag, -1, size);
+    }
+
+    uint8_t *data = reply_reserve(conn, count);
+    if (!data) {
+        fs_close(handle);
+        return -1;
+    }
+    int64_t n = count > 0 ? fs_pread(handle, data, count, offset) : 0;
+    fs_close(handle);
+    if (n < 0) {
+        reply_commit(conn, tag, -1, 0, 0);
+    } else {
+        reply_commit(conn, tag, 0, (uint64_t)n, (uint32_t)n);
+    }
+    return 0;
+}
+
+/* Escrita com deslocamento ou mudança de tamanho por um handle de
+   escrita aberto só para o pedido */
+static int execute_handle_write(Daemon *daemon, Connection *conn, const FspRequest *req,
+                                const char *name, const uint8_t *data) {
+    FileHandle *handle = fs_open(daemon->fs, name, FS_OPEN_WRITE);
+    if (!handle) {
+        return reply_status(conn, req->tag, -1, 0);
+    }
+    int64_t result;
+    if (req->op == FSP_OP_PWRITE) {
+        result = fs_pwrite(handle, data, req->length, req->arg);
+    } else {
+        result = fs_truncate(handle, req->arg) == 0 ? (int64_t)req->arg : -1;
+    }
+    fs_close(handle);
+    return reply_status(conn, req->tag, result < 0 ? -1 : 0, result < 0 ? 0 : (uint64_t)result);
+}
+
+static int execute_list(Daemon *daemon, Connection *conn, uint32_t tag) {
+    FileSystem *fs = daemon->fs;
+    uint32_t count = fs->superblock.current_files;
+    FspStat *stats = (FspStat *)reply_reserve(conn, (size_t)count * sizeof(FspStat));
+    if (!stats) return -1;
+
+    uint32_t found = 0;
+    for (uint32_t i = 0; i < fs->layout.max_files && found < count; i++) {
+        if (fs->file_table[i].is_used) {
+            FspStat stat;
+            fill_stat(fs, &fs->file_table[i], &stat);
+            memcpy(&stats[found++], &stat, sizeof(stat));
+        }
+    }
+    reply_commit(conn, tag, 0, found, found * (uint32_t)sizeof(FspStat));
+    return 0;
+}
+
+/* Atende um pedido e acrescenta a resposta em out. Retorna -1 só quando
+   a conexão deve ser encerrada (falta de memória). */
+static int execute(Daemon *daemon, Connection *conn, const FspRequest *req,
+                   const char *name, const char *name2, const uint8_t *data) {
+    FileSystem *fs = daemon->fs;
+
+    // Permissões conferidas com o usuário desta conexão
+    if (daemon->current_user != conn->user) {
+        fs_set_user(fs, conn->user);
+        daemon->current_user = conn->user;
+    }
+
+    switch (req->op) {
+        case FSP_OP_PING:
+            return reply_status(conn, req->tag, 0, 0);
+        case FSP_OP_CREATE:
+            daemon->dirty = 1;
+            return reply_status(conn, req->tag,
+                                fs_create(fs, name, (FileType)(req->arg32 & 0xFF),
+                                          (FilePermission)((req->arg32 >> 8) & 0xFF)), 0);
+        case FSP_OP_WRITE:
+            daemon->dirty = 1;
+            return reply_status(conn, req->tag, fs_write(fs, name, data, req->length), req->length);
+        case FSP_OP_READ:
+            return execute_read(daemon, conn, req->tag, name, 0, UINT64_MAX);
+        case FSP_OP_PREAD:
+            return execute_read(daemon, conn, req->tag, name, req->arg, req->arg32);
+        case FSP_OP_PWRITE:
+        case FSP_OP_TRUNCATE:
+            daemon->dirty = 1;
+            return execute_handle_write(daemon, conn, req, name, data);
+        case FSP_OP_REMOVE:
+            daemon->dirty = 1;
+            return reply_status(conn, req->tag, fs_remove(fs, name), 0);
+        case FSP_OP_COPY:
+            daemon->dirty = 1;
+            return reply_status(conn, req->tag, fs_copy(fs, name, name2), 0);
+        case FSP_OP_REFLINK:
+            daemon->dirty = 1;
+            return reply_status(conn, req->tag, fs_reflink(fs, name, name2), 0);
+        case FSP_OP_STAT: {
+            int index = fs_lookup(fs, name);
+            if (index == -1) {
+                return reply_status(conn, req->tag, -1, 0);
+            }
+            const FileEntry *entry = &fs->file_table[index];
+            uint8_t *out = reply_reserve(conn, sizeof(FspStat));
+            if (!out) return -1;
+            FspStat stat;
+            fill_stat(fs, entry, &stat);
+            memcpy(out, &stat, sizeof(stat));
+            reply_commit(conn, req->tag, 0, entry->size_bytes, sizeof(FspStat));
+            return 0;
+        }
+        case FSP_OP_LIST:
+            return execute_list(daemon, conn, req->tag);
+        case FSP_OP_SYNC: {
+            int result = fs_sync(fs);
+            if (result == 0) daemon->dirty = 0;
+            return reply_status(conn, req->tag, result, 0);
+        }
+        case FSP_OP_SET_USER:
+            if (req->arg32 > 7) {
+                return reply_status(conn, req->tag, -1, 0);
+            }
+            conn->user = (uint8_t)req->arg32;
+            return reply_status(conn, req->tag, 0, 0);
+        case FSP_OP_SHUTDOWN:
+            daemon->running = 0;
+            return reply_status(conn, req->tag, 0, 0);
+        default:
+            return reply_status(conn, req->tag, -1, 0);
+    }
+}
+
+/* Atende os pedidos completos em in, parando se as respostas pendentes
+   passarem de DAEMON_OUT_HIGH (o cliente precisa lê-las antes). Retorna
+   -1 se o pedido for inválido ou faltar memória. */
+static int process_requests(Daemon *daemon, Connection *conn) {
+    size_t pos = 0;
+    int result = 0;
+    char name[FSP_MAX_NAME + 1], name2[FSP_MAX_NAME + 1];
+
+    while (daemon->running && conn->in_len - pos >= sizeof(FspRequest) &&
+           conn->out_len - conn->out_sent < DAEMON_OUT_HIGH) {
+        FspRequest req;
+        memcpy(&req, conn->in + pos, sizeof(req));
+        if (req.length > FSP_MAX_PAYLOAD) {
+            result = -1;
+            break;
+        }
+        size_t total = sizeof(req) + req.name_len + req.name2_len + req.length;
+        if (conn->in_len - pos < total) {
+            break; // Pedido ainda incompleto
+        }
+
+        const uint8_t *payload = conn->in + pos + sizeof(req);
+        memcpy(name, payload, req.name_len);
+        name[req.name_len] = '\0';
+        memcpy(name2, payload + req.name_len, req.name2_len);
+        name2[req.name2_len] = '\0';
+        if (execute(daemon, conn, &req, name, name2, payload + req.name_len + req.name2_len) != 0) {
+            result = -1;
+            break;
+        }
+        pos += total;
+    }
+
+    memmove(conn->in, conn->in + pos, conn->in_len - pos);
+    conn->in_len -= pos;
+    return result;
+}
+
+/* ============================================
+   CONEXÕES
+   ============================================ */
+
+static void connection_close(Daemon *daemon, Connection *conn) {
+    epoll_ctl(daemon->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    if (conn->prev) conn->prev->next = conn->next;
+    else daemon->connections = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+    free(conn->in);
+    free(conn->out);
+    free(conn);
+}
+
+/* Envia o que couber das respostas pendentes. Retorna -1 se o cliente
+   desconectou. */
+static int connection_flush(Connection *conn) {
+    while (conn->out_sent < conn->out_len) {
+        ssize_t n = send(conn->fd, conn->out + conn->out_sent, conn->out_len - conn->out_sent,
+                         MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) return -1;
+        conn->out_sent += (size_t)n;
+    }
+    if (conn->out_sent == conn->out_len) {
+        conn->out_sent = conn->out_len = 0;
+    } else if (conn->out_sent > conn->out_cap / 2) {
+        memmove(conn->out, conn->out + conn->out_sent, conn->out_len - conn->out_sent);
+        conn->out_len -= conn->out_sent;
+        conn->out_sent = 0;
+    }
+    return 0;
+}
+
+/* Pede ao epoll escrita enquanto houver respostas pendentes e leitura
+   enquanto elas não passarem do limite */
+static void connection_update_events(Daemon *daemon, Connection *conn) {
+    size_t pending = conn->out_len - conn->out_sent;
+    uint32_t events = (pending < DAEMON_OUT_HIGH ? EPOLLIN : 0) | (pending > 0 ? EPOLLOUT : 0);
+    if (events != conn->events) {
+        struct epoll_event ev = { .events = events, .data.ptr = conn };
+        epoll_ctl(daemon->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+        conn->events = events;
+    }
+}
+
+static void accept_connections(Daemon *daemon) {
+    for (;;) {
+        int fd = accept4(daemon->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return; // EAGAIN: sem mais conexões; outros erros: tenta no próximo evento
+        }
+        Connection *conn = calloc(1, sizeof(Connection));
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = conn };
+        if (!conn || epoll_ctl(daemon->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->events = EPOLLIN;
+        conn->next = daemon->connections;
+        if (conn->next) conn->next->prev = conn;
+        daemon->connections = conn;
+    }
+}
+
+/* Eventos de uma conexão: lê o que chegou, atende os pedidos completos e
+   envia as respostas juntas */
+static void connection_event(Daemon *daemon, Connection *conn, uint32_t events) {
+    if (events & (EPOLLERR | EPOLLHUP) && !(events & EPOLLIN)) {
+        connection_close(daemon, conn);
+        return;
+    }
+
+    if (events & EPOLLIN) {
+        // Um pedido grande pede de uma vez o espaço que falta para ele
+        size_t need = DAEMON_READ_CHUNK;
+        if (conn->in_len >= sizeof(FspRequest)) {
+            FspRequest req;
+            memcpy(&req, conn->in, sizeof(req));
+            size_t total = sizeof(req) + req.name_len + req.name2_len + req.length;
+            if (total > conn->in_len && total - conn->in_len > need) {
+                need = total - conn->in_len;
+            }
+        }
+        if (buffer_reserve(&conn->in, &conn->in_cap, conn->in_len + need) != 0) {
+            connection_close(daemon, conn);
+            return;
+        }
+        ssize_t n = recv(conn->fd, conn->in + conn->in_len, conn->in_cap - conn->in_len, 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            connection_close(daemon, conn);
+            return;
+        }
+        if (n > 0) {
+            conn->in_len += (size_t)n;
+        }
+    }
+
+    // Atende, envia e, se o envio liberou espaço, continua com os pedidos
+    // que ficaram esperando
+    for (;;) {
+        size_t before = conn->in_len;
+        if (process_requests(daemon, conn) != 0 || connection_flush(conn) != 0) {
+            connection_close(daemon, conn);
+            return;
+        }
+        if (conn->in_len == before || conn->in_len < sizeof(FspRequest) ||
+            conn->out_len - conn->out_sent >= DAEMON_OUT_HIGH || !daemon->running) {
+            break;
+        }
+    }
+    connection_update_events(daemon, conn);
+}
+
+/* ============================================
+   LAÇO PRINCIPAL
+   ============================================ */
+
+static int listen_socket(const char *socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        printf("Erro: Caminho do socket muito longo.\n");
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        printf("Erro: Falha ao criar o socket.\n");
+        return -1;
+    }
+
+    // Socket antigo: só é removido se nenhum daemon estiver atendendo nele
+    struct stat st;
+    if (stat(socket_path, &st) == 0) {
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int alive = probe >= 0 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+        if (probe >= 0) close(probe);
+        if (alive || !S_ISSOCK(st.st_mode)) {
+            printf("Erro: '%s' já existe%s.\n", socket_path, alive ? " e outro daemon atende nele" : "");
+            close(fd);
+            return -1;
+        }
+        unlink(socket_path);
+    }
+
+    mode_t old_mask = umask(0077);
+    int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (bound != 0 || listen(fd, SOMAXCONN) != 0) {
+        printf("Erro: Falha ao escutar em '%s'.\n", socket_path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int fs_daemon_run(FileSystem *fs, const char *socket_path) {
+    if (!fs || !socket_path) return -1;
+
+    Daemon daemon;
+    memset(&daemon, 0, sizeof(daemon));
+    daemon.fs = fs;
+    daemon.running = 1;
+    daemon.current_user = fs->current_user;
+
+    daemon.listen_fd = listen_socket(socket_path);
+    if (daemon.listen_fd < 0) {
+        return -1;
+    }
+
+    // SIGINT/SIGTERM chegam pelo epoll, como qualquer outro evento
+    sigset_t signals, old_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, &old_signals);
+    daemon.signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    daemon.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &daemon.listen_fd };
+    int ready = daemon.signal_fd >= 0 && daemon.epoll_fd >= 0 &&
+                epoll_ctl(daemon.epoll_fd, EPOLL_CTL_ADD, daemon.listen_fd, &ev) == 0;
+    ev.data.ptr = &daemon.signal_fd;
+    ready = ready && epoll_ctl(daemon.epoll_fd, EPOLL_CTL_ADD, daemon.signal_fd, &ev) == 0;
+    if (!ready) {
+        printf("Erro: Falha ao preparar o laço de eventos.\n");
+        daemon.running = 0;
+    }
+
+    struct epoll_event events[DAEMON_MAX_EVENTS];
+    while (daemon.running) {
+        int n = epoll_wait(daemon.epoll_fd, events, DAEMON_MAX_EVENTS, daemon.dirty ? DAEMON_IDLE_SYNC_MS : -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (n == 0) {
+            // Ocioso com alterações: checkpoint, para não depender só do journal
+            if (fs_sync(fs) == 0) {
+                daemon.dirty = 0;
+            }
+            continue;
+        }
+        for (int i = 0; i < n && daemon.running; i++) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == &daemon.listen_fd) {
+                accept_connections(&daemon);
+            } else if (ptr == &daemon.signal_fd) {
+                // Consome o sinal: pendente, ele mataria o processo ao ser
+                // desbloqueado, antes da desmontagem
+                struct signalfd_siginfo info;
+                while (read(daemon.signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                }
+                daemon.running = 0;
+            } else {
+                connection_event(&daemon, ptr, events[i].events);
+            }
+        }
+    }
+
+    // Respostas pendentes (inclusive a do FSP_OP_SHUTDOWN) saem antes do fim
+    while (daemon.connections) {
+        connection_flush(daemon.connections);
+        connection_close(&daemon, daemon.connections);
+    }
+    if (daemon.epoll_fd >= 0) close(daemon.epoll_fd);
+    if (daemon.signal_fd >= 0) close(daemon.signal_fd);
+    sigprocmask(SIG_SETMASK, &old_signals, NULL);
+    close(daemon.listen_fd);
+    unlink(socket_path);
+    return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef FS_DAEMON_H
+#define FS_DAEMON_H
+
+#include "filesystem.h"
+
+/* ============================================
+   DAEMON: SISTEMA DE ARQUIVOS NUM SOCKET UNIX
+   ============================================ */
+
+/* Serve fs (já montado) pelo protocolo de fs_protocol.h no socket
+   socket_path, num único laço de eventos (epoll). Os pedidos de cada
+   conexão são atendidos na ordem de chegada, e as respostas dos pedidos
+   que chegaram juntos saem numa única escrita. O socket é criado só para
+   o dono (0600). Retorna ao receber FSP_OP_SHUTDOWN, SIGINT ou SIGTERM,
+   sem desmontar: fs_unmount fica com quem chamou. Retorna -1 se o socket
+   não puder ser criado. */
+int fs_daemon_run(FileSystem *fs, const char *socket_path);
+
+#endif // FS_DAEMON_H
@@ -0,0 +1,84 @@
+#ifndef FS_PROTOCOL_H
+#define FS_PROTOCOL_H
+
+#include <stdint.h>
+
+/* ============================================
+   PROTOCOLO DO DAEMON (SOCKET UNIX)
+   ============================================ */
+
+/* Cada pedido é um cabeçalho fixo seguido do nome, do segundo nome (só
+   em cópias) e dos dados; cada resposta, um cabeçalho fixo seguido dos
+   dados. Inteiros na ordem da máquina (o socket é local). O cliente pode
+   mandar vários pedidos sem esperar as respostas, que voltam na mesma
+   ordem e com o mesmo tag. */
+
+#define FSP_MAX_NAME 255                    // Limite de cada nome no pedido
+#define FSP_MAX_PAYLOAD (64u * 1024 * 1024) // Limite dos dados de um pedido ou resposta
+
+/* Tipo e permissões de CREATE, com os mesmos valores de FileType e
+   FilePermission (filesystem.h), para clientes que só incluem o
+   protocolo */
+#define FSP_TYPE_TEXTO 0x1
+#define FSP_TYPE_BINARIO 0x2
+#define FSP_TYPE_DIRETORIO 0x3
+#define FSP_TYPE_IMAGEM 0x4
+#define FSP_TYPE_AUDIO 0x5
+#define FSP_TYPE_EXECUTAVEL 0x6
+
+#define FSP_PERM_NONE 0x0
+#define FSP_PERM_READ 0x1
+#define FSP_PERM_WRITE 0x2
+#define FSP_PERM_EXEC 0x4
+#define FSP_PERM_ALL 0x7
+
+typedef enum {
+    FSP_OP_PING = 1,        // Nada (mede o custo do protocolo)
+    FSP_OP_CREATE,          // arg32 = tipo | permissões << 8
+    FSP_OP_WRITE,           // Conteúdo inteiro = dados
+    FSP_OP_READ,            // Resposta = conteúdo inteiro
+    FSP_OP_PREAD,           // arg = deslocamento, arg32 = bytes
+    FSP_OP_PWRITE,          // arg = deslocamento, dados
+    FSP_OP_TRUNCATE,        // arg = novo tamanho
+    FSP_OP_REMOVE,
+    FSP_OP_COPY,            // nome -> segundo nome
+    FSP_OP_REFLINK,         // nome -> segundo nome, compartilhando a extensão
+    FSP_OP_STAT,            // Resposta = um FspStat
+    FSP_OP_LIST,            // Resposta = um FspStat por arquivo
+    FSP_OP_SYNC,
+    FSP_OP_SET_USER,        // arg32 = usuário (vale para a conexão)
+    FSP_OP_SHUTDOWN         // Desmonta e encerra o daemon
+} FspOperation;
+
+typedef struct {
+    uint32_t length;        // Bytes de dados depois dos nomes
+    uint32_t tag;           // Devolvido na resposta
+    uint8_t op;             // FspOperation
+    uint8_t name_len;       // Bytes do nome (sem terminador)
+    uint8_t name2_len;      // Bytes do segundo nome
+    uint8_t reserved;
+    uint32_t arg32;         // Argumento pequeno (tipo, bytes, usuário)
+    uint64_t arg;           // Deslocamento ou tamanho
+} __attribute__((packed)) FspRequest;
+
+typedef struct {
+    uint32_t length;        // Bytes de dados depois do cabeçalho
+    uint32_t tag;           // Tag do pedido
+    int32_t status;         // 0 ou -1
+    uint32_t reserved;
+    uint64_t value;         // Bytes transferidos, tamanho...
+} __attribute__((packed)) FspReply;
+
+/* Metadados de um arquivo em STAT e LIST */
+typedef struct {
+    char name[16];          // Terminado em zero
+    uint64_t size_bytes;
+    uint64_t size_blocks;
+    uint32_t extents;       // Extensões ocupadas
+    uint8_t type;           // FSP_TYPE_*
+    uint8_t permission;     // FSP_PERM_*
+    uint8_t owner;
+    uint8_t compressed;
+} __attribute__((packed)) FspStat;
+
+#endif // FS_PROTOCOL_H
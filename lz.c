@@ -0,0 +1,199 @@
+#include "lz.h"
+#include <string.h>
+
+#define LZ_MIN_MATCH 4              // Menor repetição codificada
+#define LZ_LAST_LITERALS 5          // Bytes finais sempre literais
+#define LZ_MATCH_LIMIT 12           // Repetições só começam antes disso do fim
+#define LZ_MAX_DISTANCE 65535       // Distância cabe em 16 bits
+#define LZ_HASH_BITS 12             // Tabela de 4096 posições
+#define LZ_SKIP_TRIGGER 6           // Após 2^6 falhas seguidas, o passo da busca cresce
+
+/* ============================================
+   FUNÇÕES AUXILIARES
+   ============================================ */
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint64_t read64(const uint8_t *p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t hash4(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Comprimentos >= 15 continuam em bytes de 255 até um byte menor */
+static uint8_t* write_length(uint8_t *op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+/* Emite uma sequência: literais [literal, literal + literal_length) e,
+   se match_length > 0, a repetição. Retorna NULL se não couber. */
+static uint8_t* emit_sequence(uint8_t *op, const uint8_t *op_end,
+                              const uint8_t *literal, size_t literal_length,
+                              size_t distance, size_t match_length) {
+    size_t worst = 1 + literal_length / 255 + 1 + literal_length + 2 + match_length / 255 + 1;
+    if ((size_t)(op_end - op) < worst) {
+        return NULL;
+    }
+
+    uint8_t *token = op++;
+    *token = (uint8_t)((literal_length >= 15 ? 15 : literal_length) << 4);
+    if (literal_length >= 15) {
+        op = write_length(op, literal_length - 15);
+    }
+    memcpy(op, literal, literal_length);
+    op += literal_length;
+
+    if (match_length > 0) {
+        *op++ = (uint8_t)(distance & 0xFF);
+        *op++ = (uint8_t)(distance >> 8);
+        size_t code = match_length - LZ_MIN_MATCH;
+        *token |= (uint8_t)(code >= 15 ? 15 : code);
+        if (code >= 15) {
+            op = write_length(op, code - 15);
+        }
+    }
+    return op;
+}
+
+/* ============================================
+   COMPRESSÃO E DESCOMPRESSÃO
+   ============================================ */
+
+size_t lz_compress_bound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+size_t lz_compress(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity) {
+    uint32_t table[1 << LZ_HASH_BITS] = {0};   // Posição + 1 (0 = vazia)
+    const uint8_t *op_end = dst + capacity;
+    uint8_t *op = dst;
+    size_t anchor = 0;
+    size_t ip = 0;
+    size_t misses = 0;
+
+    if (size > LZ_MATCH_LIMIT) {
+        size_t match_end = size - LZ_LAST_LITERALS;
+        while (ip < size - LZ_MATCH_LIMIT) {
+            uint32_t sequence = read32(src + ip);
+            uint32_t h = hash4(sequence);
+            size_t candidate = table[h];
+            table[h] = (uint32_t)(ip + 1);
+
+            if (candidate == 0 || ip - (candidate - 1) > LZ_MAX_DISTANCE ||
+                read32(src + candidate - 1) != sequence) {
+                // Trecho sem repetições (dados já comprimidos, aleatórios):
+                // o passo cresce para não gastar tempo byte a byte
+                ip += 1 + (misses++ >> LZ_SKIP_TRIGGER);
+                continue;
+            }
+            misses = 0;
+
+            // Estende a repetição de 8 em 8 bytes e termina byte a byte
+            size_t ref = candidate - 1;
+            size_t length = LZ_MIN_MATCH;
+            while (ip + length + 8 <= match_end && read64(src + ref + length) == read64(src + ip + length)) {
+                length += 8;
+            }
+            while (ip + length < match_end && src[ref + length] == src[ip + length]) {
+                length++;
+            }
+
+            op = emit_sequence(op, op_end, src + anchor, ip - anchor, ip - ref, length);
+            if (!op) return 0;
+            ip += length;
+            anchor = ip;
+        }
+    }
+
+    // Última sequência: só literais
+    op = emit_sequence(op, op_end, src + anchor, size - anchor, 0, 0);
+    if (!op) return 0;
+    return (size_t)(op - dst);
+}
+
+int lz_decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t raw_size) {
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < size) {
+        uint8_t token = src[ip++];
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15) {
+            uint8_t extra;
+            do {
+                if (ip >= size) return -1;
+                extra = src[ip++];
+                literal_length += extra;
+            } while (extra == 255);
+        }
+        if (literal_length > size - ip || literal_length > raw_size - op) {
+            return -1;
+        }
+        // Literais curtos (o caso comum) copiados em 16 bytes fixos quando
+        // há folga na entrada e na saída; o excesso é sobrescrito depois
+        if (literal_length <= 16 && size - ip >= 16 && raw_size - op >= 16) {
+            memcpy(dst + op, src + ip, 16);
+        } else {
+            memcpy(dst + op, src + ip, literal_length);
+        }
+        ip += literal_length;
+        op += literal_length;
+
+        if (ip == size) {
+            break; // Última sequência não tem repetição
+        }
+
+        if (size - ip < 2) return -1;
+        size_t distance = src[ip] | ((size_t)src[ip + 1] << 8);
+        ip += 2;
+        if (distance == 0 || distance > op) {
+            return -1;
+        }
+
+        size_t match_length = token & 0x0F;
+        if (match_length == 15) {
+            uint8_t extra;
+            do {
+                if (ip >= size) return -1;
+                extra = src[ip++];
+                match_length += extra;
+            } while (extra == 255);
+        }
+        match_length += LZ_MIN_MATCH;
+        if (match_length > raw_size - op) {
+            return -1;
+        }
+
+        // Repetições podem se sobrepor ao destino (distância < comprimento):
+        // com distância >= 8, cópias de 8 bytes só leem o que já foi escrito
+        const uint8_t *match = dst + op - distance;
+        if (distance >= 8 && raw_size - op >= match_length + 8) {
+            for (size_t i = 0; i < match_length; i += 8) {
+                memcpy(dst + op + i, match + i, 8);
+            }
+        } else if (distance >= match_length) {
+            memcpy(dst + op, match, match_length);
+        } else {
+            for (size_t i = 0; i < match_length; i++) {
+                dst[op + i] = match[i];
+            }
+        }
+        op += match_length;
+    }
+
+    return op == raw_size ? 0 : -1;
+}
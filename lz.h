@@ -0,0 +1,28 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* ============================================
+   COMPRESSÃO LZ (FORMATO DE BLOCO DO LZ4)
+   ============================================ */
+
+/* Codec LZ77 rápido, sem dependências, no formato de bloco do LZ4: uma
+   sequência de (token, literais, distância de 16 bits, resto do
+   comprimento da repetição). O compressor procura repetições de 4 bytes
+   por uma tabela hash de posições; o descompressor confere todos os
+   limites e rejeita entradas corrompidas. */
+
+/* Maior saída possível de lz_compress para size bytes */
+size_t lz_compress_bound(size_t size);
+
+/* Comprime size bytes de src em dst. Retorna o tamanho comprimido, ou 0
+   se não couber em capacity bytes. */
+size_t lz_compress(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity);
+
+/* Descomprime exatamente raw_size bytes em dst. Retorna 0, ou -1 se a
+   entrada estiver corrompida ou não produzir raw_size bytes. */
+int lz_decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t raw_size);
+
+#endif // LZ_H
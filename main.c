@@ -1,9 +1,52 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "filesystem.h"
+#include "fs_daemon.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
 
 #define DISK_PATH "virtual_disk.img"
+#define IO_CHUNK (64 * 1024)        // Pedaço usado para ler/escrever por handle
+#define TRANSFER_CHUNK (1024 * 1024) // Pedaço das transferências com o sistema hospedeiro
+#define HOST_PATH_MAX 4096
+
+/* Modo de execução (opções da linha de comando) */
+static FILE *input;                 // Comandos e conteúdo de 'write' (stdin ou script)
+static int batch_mode = 0;          // -b: sem banner, menu, prompt nem mensagens de sucesso
+static int assume_yes = 0;          // -y: confirma sem perguntar
+
+/* Mensagem de sucesso de um comando; omitida no modo batch */
+static void print_ok(const char *format, ...) __attribute__((format(printf, 1, 2)));
+static void print_ok(const char *format, ...) {
+    if (batch_mode) return;
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+/* Pergunta s/n; com -y a resposta é sempre sim. A resposta é lida da
+   mesma entrada dos comandos (num script, a linha seguinte). */
+static int confirm(const char *question) {
+    if (assume_yes) return 1;
+    
+    printf("%s (s/n): ", question);
+    char line[64];
+    char answer;
+    while (fgets(line, sizeof(line), input)) {
+        if (sscanf(line, " %c", &answer) == 1) {
+            return answer == 's' || answer == 'S';
+        }
+    }
+    return 0;
+}
 
 void print_menu() {
     printf("\n");
@@ -13,18 +56,38 @@ void print_menu() {
     printf("╚═════════════════════════════════════════════════╝\n");
     printf("\n");
     printf("Comandos disponíveis:\n");
-    printf("  format              - Formata o disco virtual\n");
-    printf("  mount               - Monta o sistema de arquivos\n");
+    printf("  format [--quick] [-b bloco] [-s tamanho] [-n arquivos]\n");
+    printf("                      - Formata o disco virtual\n");
+    printf("                         --quick: zera só os metadados da imagem atual\n");
+    printf("                         -b: bytes por bloco, de 512 a 64K (padrão 512)\n");
+    printf("                         -s: tamanho da imagem, ex.: 4G (padrão 32M)\n");
+    printf("                         -n: máximo de arquivos (padrão 2048)\n");
+    printf("  mount [mmap]        - Monta o sistema de arquivos\n");
+    printf("                         mmap: mapeia o disco em memória\n");
     printf("  create <nome> <tipo> - Cria um novo arquivo\n");
     printf("                         Tipos: txt, bin, dir, img, aud, exe\n");
     printf("  write <nome>        - Escreve dados em um arquivo\n");
     printf("  read <nome>         - Lê o conteúdo de um arquivo\n");
-    printf("  copy <orig> <dest>  - Copia um arquivo\n");
+    printf("  copy [--reflink] <orig> <dest> - Copia um arquivo\n");
+    printf("                         --reflink: compartilha os blocos até a\n");
+    printf("                         primeira alteração (cp é alias)\n");
     printf("  remove <nome>       - Remove um arquivo\n");
     printf("  list                - Lista todos os arquivos\n");
     printf("  info <nome>         - Mostra informações de um arquivo\n");
     printf("  diskinfo            - Mostra informações do disco\n");
     printf("  user <id>           - Altera o usuário (0-7)\n");
+    printf("  cache [blocos]      - Mostra o cache ou altera a capacidade\n");
+    printf("  sync                - Grava no disco os dados pendentes\n");
+    printf("  defrag [tempo|bytes <n>] - Desfragmenta o disco\n");
+    printf("                         tempo: limite em ms; bytes: limite em KB\n");
+    printf("  dedup [on|off]      - Une arquivos de conteúdo igual\n");
+    printf("                         on/off: deduplicação nas escritas\n");
+    printf("  compress <nome> [off] - Liga (ou desliga) a compressão do arquivo\n");
+    printf("  stats [reset]       - Estatísticas em JSON (reset zera os contadores)\n");
+    printf("  import <arq> [nome] - Copia um arquivo do hospedeiro para o disco\n");
+    printf("  export <nome> <arq> - Copia um arquivo do disco para o hospedeiro\n");
+    printf("  import-dir <dir>    - Importa todos os arquivos de um diretório\n");
+    printf("  export-dir <dir>    - Exporta todos os arquivos para um diretório\n");
     printf("  help                - Mostra este menu\n");
     printf("  exit                - Sai do programa\n");
     printf("\n");
@@ -40,17 +103,73 @@ FileType parse_file_type(const char *type_str) {
     return TYPE_TEXTO;
 }
 
-void cmd_format() {
-    printf("\n⚠️  ATENÇÃO: Esta operação irá apagar todos os dados do disco!\n");
-    printf("Deseja continuar? (s/n): ");
+/* Tamanho em bytes com sufixo opcional K, M, G ou T (potências de 1024) */
+static int parse_size(const char *text, uint64_t *size) {
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (errno != 0 || end == text || text[0] == '-') {
+        return -1;
+    }
+    int shift = 0;
+    switch (*end) {
+        case 'k': case 'K': shift = 10; end++; break;
+        case 'm': case 'M': shift = 20; end++; break;
+        case 'g': case 'G': shift = 30; end++; break;
+        case 't': case 'T': shift = 40; end++; break;
+        default: break;
+    }
+    if (*end != '\0' || value > (UINT64_MAX >> shift)) {
+        return -1;
+    }
+    *size = (uint64_t)value << shift;
+    return 0;
+}
+
+/* Opções de 'format': [--quick] [-b bloco] [-s tamanho] [-n arquivos].
+   Sem -b, -s nem -n, geometry fica NULL (padrão, ou a da imagem atual
+   no --quick); a opção omitida usa o valor padrão. */
+static int parse_format_args(char *args, FsGeometry *geometry, int *custom, int *quick) {
+    uint64_t block_size = FS_DEFAULT_BLOCK_SIZE;
+    uint64_t image_size = (uint64_t)FS_DEFAULT_TOTAL_BLOCKS * FS_DEFAULT_BLOCK_SIZE;
+    uint64_t max_files = FS_DEFAULT_MAX_FILES;
+    *custom = 0;
+    *quick = 0;
+    
+    char *save;
+    for (char *opt = strtok_r(args, " \t", &save); opt; opt = strtok_r(NULL, " \t", &save)) {
+        if (strcmp(opt, "--quick") == 0) {
+            *quick = 1;
+            continue;
+        }
+        uint64_t *target = strcmp(opt, "-b") == 0 ? &block_size :
+                           strcmp(opt, "-s") == 0 ? &image_size :
+                           strcmp(opt, "-n") == 0 ? &max_files : NULL;
+        char *value = target ? strtok_r(NULL, " \t", &save) : NULL;
+        if (!value || parse_size(value, target) != 0) {
+            return -1;
+        }
+        *custom = 1;
+    }
     
-    char confirm;
-    scanf(" %c", &confirm);
-    getchar(); // Consome o newline
+    if (block_size == 0 || block_size > UINT32_MAX || max_files > UINT32_MAX) {
+        return -1;
+    }
+    geometry->block_size = (uint32_t)block_size;
+    geometry->total_blocks = image_size / block_size;
+    geometry->max_files = (uint32_t)max_files;
+    return 0;
+}
+
+void cmd_format(const FsGeometry *geometry, int quick) {
+    if (!assume_yes) {
+        printf("\n⚠️  ATENÇÃO: Esta operação irá apagar todos os dados do disco!\n");
+    }
     
-    if (confirm == 's' || confirm == 'S') {
-        if (fs_format(DISK_PATH) == 0) {
-            printf("✓ Disco formatado com sucesso!\n");
+    if (confirm("Deseja continuar?")) {
+        int result = fs_format_geometry(DISK_PATH, geometry, quick);
+        if (result == 0) {
+            print_ok("✓ Disco formatado com sucesso!\n");
         } else {
             printf("✗ Erro ao formatar o disco.\n");
         }
@@ -59,10 +178,15 @@ void cmd_format() {
     }
 }
 
-FileSystem* cmd_mount() {
-    FileSystem *fs = fs_mount(DISK_PATH);
+FileSystem* cmd_mount(const char *mode) {
+    FileSystem *fs;
+    if (strcmp(mode, "mmap") == 0) {
+        fs = fs_mount_mmap(DISK_PATH);
+    } else {
+        fs = fs_mount(DISK_PATH);
+    }
     if (fs) {
-        printf("✓ Sistema de arquivos montado!\n");
+        print_ok("✓ Sistema de arquivos montado!\n");
     } else {
         printf("✗ Erro ao montar. Execute 'format' primeiro.\n");
     }
@@ -78,7 +202,7 @@ void cmd_create(FileSystem *fs, const char *name, const char *type_str) {
     FileType type = parse_file_type(type_str);
     
     if (fs_create(fs, name, type, PERM_ALL) == 0) {
-        printf("✓ Arquivo criado com sucesso!\n");
+        print_ok("✓ Arquivo criado com sucesso!\n");
     }
 }
 
@@ -88,35 +212,85 @@ void cmd_write(FileSystem *fs, const char *name) {
         return;
     }
     
-    printf("Digite o conteúdo (finalize com uma linha contendo apenas '###'):\n");
+    // Os dados vão para o arquivo em pedaços de IO_CHUNK, sem limite de tamanho
+    FileHandle *handle = fs_open(fs, name, FS_OPEN_WRITE);
+    if (!handle) {
+        return;
+    }
+    
+    if (!batch_mode) {
+        printf("Digite o conteúdo (finalize com uma linha contendo apenas '###'):\n");
+    }
     
-    char *buffer = malloc(65536); // 64KB buffer
+    char *buffer = malloc(IO_CHUNK);
     char line[256];
-    int total_size = 0;
+    uint64_t pending = 0;
+    uint64_t total_size = 0;
+    int failed = 0;
     
-    while (fgets(line, sizeof(line), stdin)) {
+    while (fgets(line, sizeof(line), input)) {
         if (strcmp(line, "###\n") == 0) {
             break;
         }
-        int len = strlen(line);
-        if (total_size + len < 65536) {
-            memcpy(buffer + total_size, line, len);
-            total_size += len;
-        } else {
-            printf("⚠️  Limite de tamanho atingido (64KB).\n");
-            break;
+        size_t len = strlen(line);
+        if (pending + len > IO_CHUNK) {
+            if (total_size == 0) {
+                fs_truncate(handle, 0); // Substitui o conteúdo anterior
+            }
+            if (fs_append(handle, buffer, pending) < 0) {
+                failed = 1;
+                break;
+            }
+            total_size += pending;
+            pending = 0;
         }
+        memcpy(buffer + pending, line, len);
+        pending += len;
     }
     
-    if (total_size > 0) {
-        if (fs_write(fs, name, buffer, total_size) == 0) {
-            printf("✓ Dados escritos com sucesso!\n");
+    if (!failed && pending > 0) {
+        if (total_size == 0) {
+            fs_truncate(handle, 0);
+        }
+        if (fs_append(handle, buffer, pending) < 0) {
+            failed = 1;
+        } else {
+            total_size += pending;
         }
+    }
+    
+    if (failed) {
+        printf("✗ Erro ao escrever os dados.\n");
+    } else if (total_size > 0) {
+        print_ok("Dados escritos no arquivo '%s' (%lu bytes).\n", name, total_size);
+        print_ok("✓ Dados escritos com sucesso!\n");
     } else {
         printf("Nenhum dado para escrever.\n");
     }
     
     free(buffer);
+    fs_close(handle);
+}
+
+/* Heurística de exibição: texto se os primeiros bytes não têm controles */
+static int looks_like_text(const uint8_t *data, uint64_t size) {
+    for (uint64_t i = 0; i < size && i < 1000; i++) {
+        if (data[i] < 32 && 
+            data[i] != '\n' && 
+            data[i] != '\r' && 
+            data[i] != '\t') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void print_hex_preview(const uint8_t *data, uint64_t size) {
+    printf("(Arquivo binário - exibindo hexadecimal dos primeiros 256 bytes)\n");
+    for (uint64_t i = 0; i < size && i < 256; i++) {
+        printf("%02X ", data[i]);
+        if ((i + 1) % 16 == 0) printf("\n");
+    }
 }
 
 void cmd_read(FileSystem *fs, const char *name) {
@@ -125,48 +299,60 @@ void cmd_read(FileSystem *fs, const char *name) {
         return;
     }
     
-    void *buffer = malloc(1024 * 1024); // 1MB buffer
-    uint64_t size;
+    if (fs->disk_map && fs_get_compression(fs, name) == 0 && fs_get_extents(fs, name) <= 1) {
+        // Montagem mapeada: exibe direto do mapeamento, sem cópia
+        uint64_t size;
+        const uint8_t *data = fs_read_view(fs, name, &size);
+        if (data) {
+            printf("\n--- CONTEÚDO DO ARQUIVO '%s' ---\n", name);
+            if (looks_like_text(data, size)) {
+                fwrite(data, 1, size, stdout);
+            } else {
+                print_hex_preview(data, size);
+            }
+            printf("\n--- FIM DO ARQUIVO ---\n");
+        }
+        return;
+    }
+    
+    // Lê o arquivo em pedaços de IO_CHUNK: memória limitada para qualquer tamanho
+    FileHandle *handle = fs_open(fs, name, FS_OPEN_READ);
+    if (!handle) {
+        return;
+    }
     
-    if (fs_read(fs, name, buffer, &size) == 0) {
+    uint8_t *buffer = malloc(IO_CHUNK);
+    int64_t n = fs_pread(handle, buffer, IO_CHUNK, 0);
+    if (n >= 0) {
         printf("\n--- CONTEÚDO DO ARQUIVO '%s' ---\n", name);
         
-        // Tenta exibir como texto se for tipo texto
-        int is_text = 1;
-        for (uint64_t i = 0; i < size && i < 1000; i++) {
-            if (((uint8_t*)buffer)[i] < 32 && 
-                ((uint8_t*)buffer)[i] != '\n' && 
-                ((uint8_t*)buffer)[i] != '\r' && 
-                ((uint8_t*)buffer)[i] != '\t') {
-                is_text = 0;
-                break;
+        if (looks_like_text(buffer, n)) {
+            uint64_t offset = 0;
+            while (n > 0) {
+                fwrite(buffer, 1, n, stdout);
+                offset += n;
+                n = fs_pread(handle, buffer, IO_CHUNK, offset);
             }
-        }
-        
-        if (is_text) {
-            fwrite(buffer, 1, size, stdout);
         } else {
-            printf("(Arquivo binário - exibindo hexadecimal dos primeiros 256 bytes)\n");
-            for (uint64_t i = 0; i < size && i < 256; i++) {
-                printf("%02X ", ((uint8_t*)buffer)[i]);
-                if ((i + 1) % 16 == 0) printf("\n");
-            }
+            print_hex_preview(buffer, n);
         }
         
         printf("\n--- FIM DO ARQUIVO ---\n");
     }
     
     free(buffer);
+    fs_close(handle);
 }
 
-void cmd_copy(FileSystem *fs, const char *src, const char *dest) {
+void cmd_copy(FileSystem *fs, const char *src, const char *dest, int reflink) {
     if (!fs) {
         printf("✗ Sistema não montado. Execute 'mount' primeiro.\n");
         return;
     }
     
-    if (fs_copy(fs, src, dest) == 0) {
-        printf("✓ Arquivo copiado com sucesso!\n");
+    int result = reflink ? fs_reflink(fs, src, dest) : fs_copy(fs, src, dest);
+    if (result == 0) {
+        print_ok("✓ Arquivo copiado com sucesso!\n");
     }
 }
 
@@ -176,14 +362,12 @@ void cmd_remove(FileSystem *fs, const char *name) {
         return;
     }
     
-    printf("Deseja realmente remover '%s'? (s/n): ", name);
-    char confirm;
-    scanf(" %c", &confirm);
-    getchar();
+    char question[96];
+    snprintf(question, sizeof(question), "Deseja realmente remover '%s'?", name);
     
-    if (confirm == 's' || confirm == 'S') {
+    if (confirm(question)) {
         if (fs_remove(fs, name) == 0) {
-            printf("✓ Arquivo removido com sucesso!\n");
+            print_ok("✓ Arquivo removido com sucesso!\n");
         }
     } else {
         printf("Operação cancelada.\n");
@@ -231,11 +415,424 @@ void cmd_user(FileSystem *fs, int user_id) {
     fs_set_user(fs, user_id);
 }
 
-int main(int argc, char *argv[]) {
-    FileSystem *fs = NULL;
-    char command[256];
-    char arg1[64], arg2[64], arg3[64];
+void cmd_cache(FileSystem *fs, const char *capacity) {
+    if (!fs) {
+        printf("✗ Sistema não montado. Execute 'mount' primeiro.\n");
+        return;
+    }
+    
+    if (strlen(capacity) > 0) {
+        long blocks = atol(capacity);
+        if (blocks < 0) {
+            printf("✗ Capacidade inválida.\n");
+            return;
+        }
+        if (fs_set_cache_size(fs, (size_t)blocks) == 0) {
+            print_ok("✓ Cache de blocos %s.\n", blocks > 0 ? "redimensionado" : "desligado");
+        }
+        return;
+    }
+    
+    CacheStats stats;
+    size_t blocks;
+    fs_cache_stats(fs, &stats, &blocks);
+    if (blocks == 0) {
+        printf("Cache de blocos desligado%s.\n", fs->disk_map ? " (modo mapeado)" : "");
+        return;
+    }
+    uint64_t lookups = stats.hits + stats.misses;
+    printf("\n=== CACHE DE BLOCOS ===\n");
+    printf("Capacidade: %zu blocos (%zu KB)\n", blocks, blocks * fs->layout.block_size / 1024);
+    printf("Acertos: %lu\n", stats.hits);
+    printf("Faltas: %lu\n", stats.misses);
+    printf("Taxa de acerto: %.1f%%\n", lookups ? 100.0 * stats.hits / lookups : 0.0);
+    printf("Gravações de blocos sujos: %lu\n", stats.writebacks);
+    printf("Expulsões: %lu\n", stats.evictions);
+}
+
+void cmd_sync(FileSystem *fs) {
+    if (!fs) {
+        printf("✗ Sistema não montado. Execute 'mount' primeiro.\n");
+        return;
+    }
+    
+    if (fs_sync(fs) == 0) {
+        print_ok("✓ Dados gravados no disco.\n");
+    } else {
+        printf("✗ Falha ao sincronizar o disco.\n");
+    }
+}
+
+/* ============================================
+   TRANSFERÊNCIA COM O SISTEMA HOSPEDEIRO
+   ============================================ */
+
+static double elapsed_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static double mb_per_s(uint64_t bytes, double seconds) {
+    return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0;
+}
+
+/* Tipo pela extensão do nome no hospedeiro; binário se desconhecida */
+static FileType guess_file_type(const char *path) {
+    const char *dot = strrchr(path, '.');
+    if (dot && (strcmp(dot + 1, "txt") == 0 || strcmp(dot + 1, "dir") == 0 ||
+                strcmp(dot + 1, "img") == 0 || strcmp(dot + 1, "aud") == 0 ||
+                strcmp(dot + 1, "exe") == 0)) {
+        return parse_file_type(dot + 1);
+    }
+    return TYPE_BINARIO;
+}
+
+static const char* path_basename(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static int write_full(int fd, const uint8_t *data, uint64_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        data += n;
+        size -= (uint64_t)n;
+    }
+    return 0;
+}
+
+/* Copia um arquivo do hospedeiro em pedaços de TRANSFER_CHUNK. O espaço
+   é reservado de uma vez pelo tamanho do arquivo, então o disco virtual
+   não realoca no meio da cópia (e falta de espaço aparece antes dela).
+   Um arquivo existente com o mesmo nome é substituído. */
+static int import_file(FileSystem *fs, const char *host_path, const char *name, uint64_t *bytes) {
+    int fd = open(host_path, O_RDONLY);
+    if (fd < 0) {
+        printf("✗ Não foi possível abrir '%s': %s\n", host_path, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        printf("✗ '%s' não é um arquivo regular.\n", host_path);
+        close(fd);
+        return -1;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    
+    if (fs_check_permission(fs, name, PERM_WRITE) == -1 &&
+        fs_create(fs, name, guess_file_type(host_path), PERM_ALL) != 0) {
+        close(fd);
+        return -1;
+    }
+    FileHandle *handle = fs_open(fs, name, FS_OPEN_WRITE);
+    if (!handle || fs_truncate(handle, 0) != 0 || fs_reserve(handle, (uint64_t)st.st_size) != 0) {
+        fs_close(handle);
+        close(fd);
+        return -1;
+    }
+    
+    uint8_t *buffer = malloc(TRANSFER_CHUNK);
+    uint64_t offset = 0;
+    int result = buffer ? 0 : -1;
+    while (result == 0) {
+        ssize_t n = read(fd, buffer, TRANSFER_CHUNK);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            printf("✗ Falha ao ler '%s': %s\n", host_path, strerror(errno));
+            result = -1;
+        } else if (n == 0) {
+            break;
+        } else if (fs_pwrite(handle, buffer, (uint64_t)n, offset) != n) {
+            result = -1;
+        } else {
+            offset += (uint64_t)n;
+        }
+    }
+    
+    free(buffer);
+    fs_close(handle);
+    close(fd);
+    *bytes = offset;
+    return result;
+}
+
+static int export_file(FileSystem *fs, const char *name, const char *host_path, uint64_t *bytes) {
+    FileHandle *handle = fs_open(fs, name, FS_OPEN_READ);
+    if (!handle) {
+        return -1;
+    }
+    int fd = open(host_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("✗ Não foi possível criar '%s': %s\n", host_path, strerror(errno));
+        fs_close(handle);
+        return -1;
+    }
+    
+    uint8_t *buffer = malloc(TRANSFER_CHUNK);
+    uint64_t offset = 0;
+    int result = buffer ? 0 : -1;
+    while (result == 0) {
+        int64_t n = fs_pread(handle, buffer, TRANSFER_CHUNK, offset);
+        if (n < 0) {
+            result = -1;
+        } else if (n == 0) {
+            break;
+        } else if (write_full(fd, buffer, (uint64_t)n) != 0) {
+            printf("✗ Falha ao escrever '%s': %s\n", host_path, strerror(errno));
+            result = -1;
+        } else {
+            offset += (uint64_t)n;
+        }
+    }
+    
+    free(buffer);
+    if (close(fd) != 0 && result == 0) {
+        printf("✗ Falha ao escrever '%s': %s\n", host_path, strerror(errno));
+        result = -1;
+    }
+    fs_close(handle);
+    *bytes = offset;
+    return result;
+}
+
+void cmd_import(FileSystem *fs, const char *host_path, const char *name) {
+    if (!fs) {
+        printf("✗ Sistema não montado. Execute 'mount' primeiro.\n");
+        return;
+    }
+    
+    if (strlen(name) == 0) {
+        name = path_basename(host_path);
+    }
+    if (strlen(name) > MAX_FILENAME_LENGTH) {
+        printf("✗ Nome '%s' muito longo (máximo %d); use: import <arquivo> <nome>\n",
+               name, MAX_FILENAME_LENGTH);
+        return;
+    }
+    
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t bytes = 0;
+    if (import_file(fs, host_path, name, &bytes) == 0) {
+        double seconds = elapsed_since(&start);
+        print_ok("✓ '%s' importado como '%s' (%lu bytes, %.1f MB/s)\n",
+                 host_path, name, bytes, mb_per_s(bytes, seconds));
+    }
+}
+
+void cmd_export(FileSystem *fs, const char *name, const char *host_path) {
+    if (!fs) {
+        printf("✗ Sistema não montado. Execute 'mount' primeiro.\n");
+        return;
+    }
+    
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t bytes = 0;
+    if (export_file(fs, name, host_path, &bytes) == 0) {
+        double seconds = elapsed_since(&start);
+        print_ok("✓ '%s' exportado para '%s' (%lu bytes, %.1f MB/s)\n",
+                 name, host_path, bytes, mb_per_s(bytes, seconds));
+    }
+}
+
+/* Importa os arquivos regulares do diretório (sem descer em
+   subdiretórios), em ordem alfabética para que a disposição no disco
+   seja reprodutível */
+void cmd_import_dir(FileSystem *fs, const char *dir) {
+    if (!fs) {
+        printf("✗ Sistema não montado. Execute 'mount' primeiro.\n");
+        return;
+    }
+    
+    struct dirent **entries;
+    int count = scandir(dir, &entries, NULL, alphasort);
+    if (count < 0) {
+        printf("✗ Não foi possível ler o diretório '%s': %s\n", dir, strerror(errno));
+        return;
+    }
+    
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t total_bytes = 0;
+    int imported = 0, skipped = 0, failed = 0;
+    char path[HOST_PATH_MAX];
+    for (int i = 0; i < count; i++) {
+        const char *name = entries[i]->d_name;
+        struct stat st;
+        if (snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path) ||
+            stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            free(entries[i]);
+            continue;
+        }
+        if (strlen(name) > MAX_FILENAME_LENGTH) {
+            printf("⚠️  '%s' ignorado: nome com mais de %d caracteres.\n", name, MAX_FILENAME_LENGTH);
+            skipped++;
+        } else {
+            uint64_t bytes = 0;
+            if (import_file(fs, path, name, &bytes) == 0) {
+                imported++;
+                total_bytes += bytes;
+            } else {
+                failed++;
+            }
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    
+    double seconds = elapsed_since(&start);
+    print_ok("✓ %d arquivo(s) importado(s) de '%s' (%lu bytes em %.2f s, %.1f MB/s)\n",
+             imported, dir, total_bytes, seconds, mb_per_s(total_bytes, seconds));
+    if (skipped > 0 || failed > 0) {
+        printf("%d ignorado(s), %d com erro.\n", skipped, failed);
+    }
+}
+
+void cmd_export_dir(FileSystem *fs, const char *dir) {
+    if (!fs) {
+        printf("✗ Sistema não montado. Execute 'mount' primeiro.\n");
+        return;
+    }
+    
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        printf("✗ Não foi possível criar o diretório '%s': %s\n", dir, strerror(errno));
+        return;
+    }
+    
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t total_bytes = 0;
+    int exported = 0, failed = 0;
+    char path[HOST_PATH_MAX];
+    for (uint32_t i = 0; i < fs->layout.max_files; i++) {
+        const FileEntry *entry = &fs->file_table[i];
+        if (!entry->is_used) continue;
+        
+        uint64_t bytes = 0;
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->name);
+        if (export_file(fs, entry->name, path, &bytes) == 0) {
+            exported++;
+            total_bytes += bytes;
+        } else {
+            failed++;
+        }
+    }
+    
+    double seconds = elapsed_since(&start);
+    print_ok("✓ %d arquivo(s) exportado(s) para '%s' (%lu bytes em %.2f s, %.1f MB/s)\n",
+             exported, dir, total_bytes, seconds, mb_per_s(total_bytes, seconds));
+    if (failed > 0) {
+        printf("%d arquivo(s) com erro.\n", failed);
+    }
+}
+
+void cmd_stats(FileSystem *fs, const char *action) {
+    if (!fs) {
+        printf("✗ Sistema não montado. Execute 'mount' primeiro.\n");
+        return;
+    }
+    
+    if (strcmp(action, "reset") == 0) {
+        fs_stats_reset(fs);
+        print_ok("✓ Contadores zerados.\n");
+        return;
+    }
+    fs_stats_json(fs, stdout);
+}
+
+static void print_fragmentation(const char *label, const FragmentationInfo *info) {
+    printf("%-8s %8lu blocos livres em %5lu extensões, maior %8lu (fragmentação %.1f%%)\n",
+           label, info->free_blocks, info->free_extents, info->largest_free,
+           info->fragmentation * 100.0);
+}
+
+void cmd_defrag(FileSystem *fs, const char *limit, const char *value) {
+    if (!fs) {
+        printf("✗ Sistema não montado. Execute 'mount' primeiro.\n");
+        return;
+    }
+    
+    DefragBudget budget = {0, 0};
+    if (strcmp(limit, "tempo") == 0 && atol(value) > 0) {
+        budget.max_seconds = atol(value) / 1000.0;
+    } else if (strcmp(limit, "bytes") == 0 && atol(value) > 0) {
+        budget.max_bytes = (uint64_t)atol(value) * 1024;
+    } else if (strlen(limit) > 0) {
+        printf("Uso: defrag [tempo <ms> | bytes <KB>]\n");
+        return;
+    }
+    
+    DefragReport report;
+    int result = fs_defrag(fs, &budget, &report);
+    
+    printf("\n=== DESFRAGMENTAÇÃO ===\n");
+    print_fragmentation("Antes:", &report.before);
+    print_fragmentation("Depois:", &report.after);
+    printf("Arquivos deslocados: %lu (%lu KB copiados)\n",
+           report.files_moved, report.bytes_moved / 1024);
+    if (report.files_skipped > 0) {
+        printf("Arquivos sem espaço para deslocar: %lu\n", report.files_skipped);
+    }
+    if (result != 0) {
+        printf("✗ Desfragmentação interrompida por erro.\n");
+    } else if (report.complete) {
+        print_ok("✓ Disco percorrido por completo.\n");
+    } else {
+        printf("Limite atingido; execute 'defrag' novamente para continuar.\n");
+    }
+}
+
+void cmd_dedup(FileSystem *fs, const char *mode) {
+    if (!fs) {
+        printf("✗ Sistema não montado. Execute 'mount' primeiro.\n");
+        return;
+    }
     
+    if (strcmp(mode, "on") == 0 || strcmp(mode, "off") == 0) {
+        int enabled = strcmp(mode, "on") == 0;
+        if (fs_set_dedup(fs, enabled) == 0) {
+            print_ok(enabled ? "✓ Deduplicação ligada nas escritas.\n" : "✓ Deduplicação desligada.\n");
+        }
+        return;
+    }
+    if (strlen(mode) > 0) {
+        printf("Uso: dedup [on|off]\n");
+        return;
+    }
+    
+    DedupReport report;
+    if (fs_dedup(fs, &report) != 0) {
+        printf("✗ Deduplicação interrompida por erro.\n");
+        return;
+    }
+    printf("\n=== DEDUPLICAÇÃO ===\n");
+    printf("Arquivos examinados: %lu\n", report.files_scanned);
+    printf("Arquivos unidos:     %lu\n", report.files_merged);
+    printf("Espaço liberado:     %lu blocos (%lu KB)\n",
+           report.blocks_reclaimed, report.blocks_reclaimed * fs->layout.block_size / 1024);
+}
+
+void cmd_compress(FileSystem *fs, const char *name, const char *mode) {
+    if (!fs) {
+        printf("✗ Sistema não montado. Execute 'mount' primeiro.\n");
+        return;
+    }
+    
+    if (strlen(mode) > 0 && strcmp(mode, "off") != 0) {
+        printf("Uso: compress <nome> [off]\n");
+        return;
+    }
+    int enabled = strlen(mode) == 0;
+    if (fs_set_compression(fs, name, enabled) == 0) {
+        print_ok(enabled ? "✓ Arquivo '%s' comprimido.\n" : "✓ Arquivo '%s' sem compressão.\n", name);
+    }
+}
+
+static void print_banner(void) {
     printf("╔═══════════════════════════════════════════════════════╗\n");
     printf("║                                                       ║\n");
     printf("║   SISTEMA DE ARQUIVOS - TRABALHO FINAL DE SO         ║\n");
@@ -250,12 +847,93 @@ int main(int argc, char *argv[]) {
     printf("║   Ano: 2025                                           ║\n");
     printf("║                                                       ║\n");
     printf("╚═══════════════════════════════════════════════════════╝\n");
+}
+
+static void print_usage(const char *program) {
+    printf("Uso: %s [-b [script]] [-y] [-v] [-d socket] [-m]\n", program);
+    printf("  -b [script]  Modo batch: executa os comandos do script (ou da entrada\n");
+    printf("               padrão) sem banner, menu, prompt nem mensagens de sucesso\n");
+    printf("  -y           Confirma 'format' e 'remove' sem perguntar\n");
+    printf("  -v           Mantém as mensagens de andamento no modo batch\n");
+    printf("  -d socket    Modo daemon: monta o disco uma vez e atende clientes\n");
+    printf("               (fs_client.h) no socket Unix até SIGINT/SIGTERM\n");
+    printf("  -m           Monta com mmap no modo daemon\n");
+}
+
+/* Modo daemon: uma montagem só, compartilhada pelos clientes do socket */
+static int run_daemon(const char *socket_path, int use_mmap, int verbose) {
+    if (!verbose) {
+        fs_set_verbosity(FS_VERBOSITY_ERRORS);
+    }
+    FileSystem *fs = use_mmap ? fs_mount_mmap(DISK_PATH) : fs_mount(DISK_PATH);
+    if (!fs) {
+        printf("✗ Erro ao montar. Execute 'format' primeiro.\n");
+        return 1;
+    }
+    printf("✓ Atendendo em '%s' (SIGINT/SIGTERM encerra).\n", socket_path);
+    fflush(stdout);
+    int result = fs_daemon_run(fs, socket_path);
+    fs_unmount(fs);
+    return result == 0 ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    FileSystem *fs = NULL;
+    char command[256];
+    char arg1[256], arg2[256], arg3[256]; // Cabem o comando inteiro (caminhos do hospedeiro)
+    const char *script = NULL;
+    const char *daemon_socket = NULL;
+    int verbose = 0;
+    int use_mmap = 0;
     
-    print_menu();
+    input = stdin;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-b") == 0) {
+            batch_mode = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                script = argv[++i];
+            }
+        } else if (strcmp(argv[i], "-y") == 0) {
+            assume_yes = 1;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = 1;
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            daemon_socket = argv[++i];
+        } else if (strcmp(argv[i], "-m") == 0) {
+            use_mmap = 1;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    if (daemon_socket) {
+        return run_daemon(daemon_socket, use_mmap, verbose);
+    }
+    
+    if (script) {
+        input = fopen(script, "r");
+        if (!input) {
+            printf("✗ Não foi possível abrir o script '%s'.\n", script);
+            return 1;
+        }
+    }
+    
+    if (batch_mode) {
+        // A biblioteca só informa erros: nada de formatar mensagens por operação
+        if (!verbose) {
+            fs_set_verbosity(FS_VERBOSITY_ERRORS);
+        }
+    } else {
+        print_banner();
+        print_menu();
+    }
     
     while (1) {
-        printf("fs> ");
-        if (!fgets(command, sizeof(command), stdin)) {
+        if (!batch_mode) {
+            printf("fs> ");
+        }
+        if (!fgets(command, sizeof(command), input)) {
             break;
         }
         
@@ -266,7 +944,7 @@ int main(int argc, char *argv[]) {
         arg1[0] = arg2[0] = arg3[0] = '\0';
         
         // Parse do comando
-        char cmd[64] = {0};
+        char cmd[256] = {0};
         sscanf(command, "%s %s %s %s", cmd, arg1, arg2, arg3);
         
         if (strlen(cmd) == 0) {
@@ -275,14 +953,21 @@ int main(int argc, char *argv[]) {
         
         // Executa comandos
         if (strcmp(cmd, "format") == 0) {
-            cmd_format();
+            FsGeometry geometry;
+            int custom, quick;
+            if (parse_format_args(command + strlen(cmd) + strspn(command, " \t"), &geometry,
+                                  &custom, &quick) == 0) {
+                cmd_format(custom ? &geometry : NULL, quick);
+            } else {
+                printf("Uso: format [--quick] [-b bloco] [-s tamanho] [-n arquivos]\n");
+            }
         }
         else if (strcmp(cmd, "mount") == 0) {
             if (fs) {
                 printf("⚠️  Sistema já montado. Desmontando...\n");
                 fs_unmount(fs);
             }
-            fs = cmd_mount();
+            fs = cmd_mount(arg1);
         }
         else if (strcmp(cmd, "create") == 0) {
             if (strlen(arg1) > 0 && strlen(arg2) > 0) {
@@ -305,11 +990,13 @@ int main(int argc, char *argv[]) {
                 printf("Uso: read <nome>\n");
             }
         }
-        else if (strcmp(cmd, "copy") == 0) {
-            if (strlen(arg1) > 0 && strlen(arg2) > 0) {
-                cmd_copy(fs, arg1, arg2);
+        else if (strcmp(cmd, "copy") == 0 || strcmp(cmd, "cp") == 0) {
+            if (strcmp(arg1, "--reflink") == 0 && strlen(arg2) > 0 && strlen(arg3) > 0) {
+                cmd_copy(fs, arg2, arg3, 1);
+            } else if (arg1[0] != '-' && strlen(arg1) > 0 && strlen(arg2) > 0) {
+                cmd_copy(fs, arg1, arg2, 0);
             } else {
-                printf("Uso: copy <origem> <destino>\n");
+                printf("Uso: copy [--reflink] <origem> <destino>\n");
             }
         }
         else if (strcmp(cmd, "remove") == 0 || strcmp(cmd, "rm") == 0) {
@@ -339,11 +1026,61 @@ int main(int argc, char *argv[]) {
                 printf("Uso: user <id>\n");
             }
         }
+        else if (strcmp(cmd, "cache") == 0) {
+            cmd_cache(fs, arg1);
+        }
+        else if (strcmp(cmd, "sync") == 0) {
+            cmd_sync(fs);
+        }
+        else if (strcmp(cmd, "stats") == 0) {
+            cmd_stats(fs, arg1);
+        }
+        else if (strcmp(cmd, "import") == 0) {
+            if (strlen(arg1) > 0) {
+                cmd_import(fs, arg1, arg2);
+            } else {
+                printf("Uso: import <arquivo> [nome]\n");
+            }
+        }
+        else if (strcmp(cmd, "export") == 0) {
+            if (strlen(arg1) > 0 && strlen(arg2) > 0) {
+                cmd_export(fs, arg1, arg2);
+            } else {
+                printf("Uso: export <nome> <arquivo>\n");
+            }
+        }
+        else if (strcmp(cmd, "import-dir") == 0) {
+            if (strlen(arg1) > 0) {
+                cmd_import_dir(fs, arg1);
+            } else {
+                printf("Uso: import-dir <diretório>\n");
+            }
+        }
+        else if (strcmp(cmd, "export-dir") == 0) {
+            if (strlen(arg1) > 0) {
+                cmd_export_dir(fs, arg1);
+            } else {
+                printf("Uso: export-dir <diretório>\n");
+            }
+        }
+        else if (strcmp(cmd, "defrag") == 0) {
+            cmd_defrag(fs, arg1, arg2);
+        }
+        else if (strcmp(cmd, "dedup") == 0) {
+            cmd_dedup(fs, arg1);
+        }
+        else if (strcmp(cmd, "compress") == 0) {
+            if (strlen(arg1) > 0) {
+                cmd_compress(fs, arg1, arg2);
+            } else {
+                printf("Uso: compress <nome> [off]\n");
+            }
+        }
         else if (strcmp(cmd, "help") == 0) {
             print_menu();
         }
         else if (strcmp(cmd, "exit") == 0 || strcmp(cmd, "quit") == 0) {
-            printf("Encerrando...\n");
+            print_ok("Encerrando...\n");
             break;
         }
         else {
@@ -354,10 +1091,13 @@ int main(int argc, char *argv[]) {
     
     // Desmonta antes de sair
     if (fs) {
-        printf("\nDesmontando sistema de arquivos...\n");
+        print_ok("\nDesmontando sistema de arquivos...\n");
         fs_unmount(fs);
     }
+    if (input != stdin) {
+        fclose(input);
+    }
     
-    printf("Obrigado por usar nosso sistema de arquivos!\n");
+    print_ok("Obrigado por usar nosso sistema de arquivos!\n");
     return 0;
 }